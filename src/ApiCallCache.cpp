@@ -0,0 +1,363 @@
+#include "ApiCallCache.h"
+#include "Logger.h"
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+LOGGER_TAG("com.amazonaws.kinesis.video");
+
+using std::chrono::duration_cast;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+
+// Placeholder for the empty fields of the cache file
+#define API_CALL_CACHE_EMPTY_FIELD                          "-"
+
+#define API_CALL_CACHE_ARN_STREAM_PREFIX                    ":stream/"
+
+namespace {
+    /**
+     * Callbacks routed through a cache, by their custom data
+     */
+    struct ApiCallCacheBinding {
+        std::shared_ptr<ApiCallCache> cache;
+        std::string region;
+        ClientCallbacks callbacks;
+
+        /**
+         * Streams whose first lookup has been made
+         */
+        std::set<std::string> described_streams;
+        std::set<std::string> endpoint_streams;
+
+        /**
+         * Names of the streams described from the cache, by their stream handle
+         */
+        std::map<UINT64, std::string> cached_descriptions;
+    };
+
+    std::mutex gBindingsMutex;
+    std::map<UINT64, ApiCallCacheBinding> gBindings;
+
+    /**
+     * Takes the cached entry for the first lookup of the stream through the binding along with the callbacks to go
+     * to the network with otherwise.
+     */
+    bool takeCachedEntry(UINT64 custom_data, const std::string& stream_name, UINT64 stream_handle, bool describe,
+                         ApiCallCacheEntry& entry, ClientCallbacks& callbacks) {
+        std::lock_guard<std::mutex> lock(gBindingsMutex);
+        auto it = gBindings.find(custom_data);
+        if (it == gBindings.end()) {
+            MEMSET(&callbacks, 0, SIZEOF(callbacks));
+            return false;
+        }
+
+        ApiCallCacheBinding& binding = it->second;
+        callbacks = binding.callbacks;
+        auto& looked_up_streams = describe ? binding.described_streams : binding.endpoint_streams;
+        if (!looked_up_streams.insert(stream_name).second) {
+            return false;
+        }
+
+        if (!binding.cache->lookup(binding.region, stream_name, entry)) {
+            return false;
+        }
+
+        if (describe) {
+            binding.cached_descriptions[stream_handle] = stream_name;
+        }
+
+        return true;
+    }
+
+    /**
+     * Drops the cached entry of a stream described from the cache without its ARN
+     */
+    void invalidateCachedDescription(UINT64 custom_data, UINT64 stream_handle) {
+        std::lock_guard<std::mutex> lock(gBindingsMutex);
+        auto it = gBindings.find(custom_data);
+        if (it != gBindings.end()) {
+            auto description = it->second.cached_descriptions.find(stream_handle);
+            if (description != it->second.cached_descriptions.end()) {
+                LOG_WARN("Stream " << description->second << " has been described from the API call cache without its ARN");
+                it->second.cache->invalidate(it->second.region, description->second);
+            }
+        }
+    }
+
+    bool getBinding(UINT64 custom_data, std::shared_ptr<ApiCallCache>& cache, std::string& region, ClientCallbacks& callbacks) {
+        std::lock_guard<std::mutex> lock(gBindingsMutex);
+        auto it = gBindings.find(custom_data);
+        if (it == gBindings.end()) {
+            MEMSET(&callbacks, 0, SIZEOF(callbacks));
+            return false;
+        }
+
+        cache = it->second.cache;
+        region = it->second.region;
+        callbacks = it->second.callbacks;
+        return true;
+    }
+
+    std::string encodeField(const std::string& field) {
+        return field.empty() ? API_CALL_CACHE_EMPTY_FIELD : field;
+    }
+
+    std::string decodeField(const std::string& field) {
+        return field == API_CALL_CACHE_EMPTY_FIELD ? "" : field;
+    }
+}
+
+ApiCallCache::ApiCallCache(const std::string& path, seconds ttl) : path_(path), ttl_(ttl) {
+    load(path_, entries_);
+    LOG_INFO("Loaded " << entries_.size() << " cached stream descriptions and endpoints from " << path_);
+}
+
+bool ApiCallCache::lookup(const std::string& region, const std::string& stream_name, ApiCallCacheEntry& entry,
+                          system_clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key_t(region, stream_name));
+    if (it == entries_.end() || it->second.streaming_endpoint.empty() || now - it->second.update_time > ttl_) {
+        return false;
+    }
+
+    entry = it->second;
+    return true;
+}
+
+void ApiCallCache::storeEndpoint(const std::string& region, const std::string& stream_name,
+                                 const std::string& streaming_endpoint, system_clock::time_point now) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ApiCallCacheEntry& entry = entries_[key_t(region, stream_name)];
+
+        // Every reconnect puts to the stream again, the file is only touched for a change or an aging entry
+        if (entry.streaming_endpoint == streaming_endpoint && now - entry.update_time < ttl_ / 2) {
+            return;
+        }
+
+        entry.streaming_endpoint = streaming_endpoint;
+        entry.update_time = now;
+    }
+
+    save();
+}
+
+void ApiCallCache::storeArn(const std::string& region, const std::string& stream_name, const std::string& stream_arn,
+                            system_clock::time_point now) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ApiCallCacheEntry& entry = entries_[key_t(region, stream_name)];
+        if (entry.stream_arn == stream_arn) {
+            return;
+        }
+
+        entry.stream_arn = stream_arn;
+        entry.update_time = now;
+    }
+
+    save();
+}
+
+void ApiCallCache::invalidate(const std::string& region, const std::string& stream_name) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key_t(region, stream_name));
+        if (it == entries_.end()) {
+            return;
+        }
+
+        // Kept as an empty entry so that the merge drops the older one on disk
+        it->second = ApiCallCacheEntry();
+        it->second.update_time = system_clock::now();
+    }
+
+    save();
+}
+
+ClientCallbacks ApiCallCache::attach(const std::shared_ptr<ApiCallCache>& cache, const ClientCallbacks& callbacks,
+                                     const std::string& region) {
+    {
+        std::lock_guard<std::mutex> lock(gBindingsMutex);
+        ApiCallCacheBinding& binding = gBindings[callbacks.customData];
+        binding.cache = cache;
+        binding.region = region;
+        binding.callbacks = callbacks;
+    }
+
+    ClientCallbacks cached_callbacks = callbacks;
+    cached_callbacks.describeStreamFn = describeStreamHandler;
+    cached_callbacks.getStreamingEndpointFn = getStreamingEndpointHandler;
+    cached_callbacks.putStreamFn = putStreamHandler;
+    cached_callbacks.tagResourceFn = tagResourceHandler;
+    return cached_callbacks;
+}
+
+void ApiCallCache::detach(UINT64 custom_data) {
+    std::lock_guard<std::mutex> lock(gBindingsMutex);
+    gBindings.erase(custom_data);
+}
+
+void ApiCallCache::load(const std::string& path, std::map<key_t, ApiCallCacheEntry>& entries) {
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string region, stream_name, streaming_endpoint, stream_arn;
+        int64_t update_time;
+        if (!(fields >> region >> stream_name >> update_time >> streaming_endpoint >> stream_arn)) {
+            LOG_WARN("Skipping the malformed API call cache line: " << line);
+            continue;
+        }
+
+        ApiCallCacheEntry entry;
+        entry.streaming_endpoint = decodeField(streaming_endpoint);
+        entry.stream_arn = decodeField(stream_arn);
+        entry.update_time = system_clock::time_point(seconds(update_time));
+        entries[key_t(region, stream_name)] = entry;
+    }
+}
+
+void ApiCallCache::save() {
+    // The other producers of the host might have saved their streams meanwhile
+    std::map<key_t, ApiCallCacheEntry> entries;
+    load(path_, entries);
+
+    std::ostringstream content;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : entries_) {
+            auto it = entries.find(entry.first);
+            if (it == entries.end() || it->second.update_time <= entry.second.update_time) {
+                entries[entry.first] = entry.second;
+            } else {
+                entry.second = it->second;
+            }
+        }
+
+        for (auto& entry : entries) {
+            if (!entry.second.streaming_endpoint.empty() || !entry.second.stream_arn.empty()) {
+                content << entry.first.first << " " << entry.first.second << " "
+                        << duration_cast<seconds>(entry.second.update_time.time_since_epoch()).count() << " "
+                        << encodeField(entry.second.streaming_endpoint) << " " << encodeField(entry.second.stream_arn) << "\n";
+            }
+        }
+    }
+
+    // Written aside and renamed so that a crash or a concurrent reader never sees a truncated cache
+    std::string temporary_path = path_ + "." + std::to_string(reinterpret_cast<uintptr_t>(this)) + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::trunc);
+        file << content.str();
+        if (!file.flush()) {
+            LOG_WARN("Failed to write the API call cache " << temporary_path);
+            remove(temporary_path.c_str());
+            return;
+        }
+    }
+
+#if defined(_WIN32)
+    remove(path_.c_str());
+#endif
+    if (0 != rename(temporary_path.c_str(), path_.c_str())) {
+        LOG_WARN("Failed to replace the API call cache " << path_);
+        remove(temporary_path.c_str());
+    }
+}
+
+STATUS ApiCallCache::describeStreamHandler(UINT64 custom_data, PCHAR stream_name, PServiceCallContext service_call_ctx) {
+    ApiCallCacheEntry entry;
+    ClientCallbacks callbacks;
+    if (takeCachedEntry(custom_data, stream_name, service_call_ctx->customData, true, entry, callbacks)) {
+        LOG_DEBUG("Describing stream " << stream_name << " from the API call cache");
+
+        // The stream has been put to so it is active, the rest of the description isn't used by the producer
+        StreamDescription stream_description;
+        MEMSET(&stream_description, 0, SIZEOF(stream_description));
+        stream_description.version = STREAM_DESCRIPTION_CURRENT_VERSION;
+        STRNCPY(stream_description.streamName, stream_name, MAX_STREAM_NAME_LEN);
+        STRNCPY(stream_description.streamArn, entry.stream_arn.c_str(), MAX_ARN_LEN);
+        stream_description.streamStatus = STREAM_STATUS_ACTIVE;
+        return describeStreamResultEvent(service_call_ctx->customData, SERVICE_CALL_RESULT_OK, &stream_description);
+    }
+
+    if (nullptr == callbacks.describeStreamFn) {
+        return STATUS_INVALID_OPERATION;
+    }
+
+    return callbacks.describeStreamFn(custom_data, stream_name, service_call_ctx);
+}
+
+STATUS ApiCallCache::getStreamingEndpointHandler(UINT64 custom_data, PCHAR stream_name, PCHAR api_name,
+                                                 PServiceCallContext service_call_ctx) {
+    ApiCallCacheEntry entry;
+    ClientCallbacks callbacks;
+    if (takeCachedEntry(custom_data, stream_name, service_call_ctx->customData, false, entry, callbacks)) {
+        LOG_DEBUG("Getting the endpoint of stream " << stream_name << " from the API call cache");
+        return getStreamingEndpointResultEvent(service_call_ctx->customData, SERVICE_CALL_RESULT_OK,
+                                               const_cast<PCHAR>(entry.streaming_endpoint.c_str()));
+    }
+
+    if (nullptr == callbacks.getStreamingEndpointFn) {
+        return STATUS_INVALID_OPERATION;
+    }
+
+    return callbacks.getStreamingEndpointFn(custom_data, stream_name, api_name, service_call_ctx);
+}
+
+STATUS ApiCallCache::putStreamHandler(UINT64 custom_data, PCHAR stream_name, PCHAR container_type, UINT64 start_timestamp,
+                                      BOOL absolute_fragment_timestamp, BOOL do_ack, PCHAR streaming_endpoint,
+                                      PServiceCallContext service_call_ctx) {
+    std::shared_ptr<ApiCallCache> cache;
+    std::string region;
+    ClientCallbacks callbacks;
+    if (getBinding(custom_data, cache, region, callbacks) && nullptr != streaming_endpoint && '\0' != streaming_endpoint[0]) {
+        cache->storeEndpoint(region, stream_name, streaming_endpoint);
+    }
+
+    if (nullptr == callbacks.putStreamFn) {
+        return STATUS_INVALID_OPERATION;
+    }
+
+    return callbacks.putStreamFn(custom_data, stream_name, container_type, start_timestamp, absolute_fragment_timestamp,
+                                 do_ack, streaming_endpoint, service_call_ctx);
+}
+
+STATUS ApiCallCache::tagResourceHandler(UINT64 custom_data, PCHAR stream_arn, UINT32 num_tags, PTag tags,
+                                        PServiceCallContext service_call_ctx) {
+    std::shared_ptr<ApiCallCache> cache;
+    std::string region;
+    ClientCallbacks callbacks;
+    if (nullptr == stream_arn || '\0' == stream_arn[0]) {
+        // The tagging fails and the retry describes the stream over the network
+        invalidateCachedDescription(custom_data, service_call_ctx->customData);
+    }
+
+    if (getBinding(custom_data, cache, region, callbacks) && nullptr != stream_arn) {
+        // arn:aws:kinesisvideo:<region>:<account>:stream/<stream name>/<creation time>
+        std::string arn(stream_arn);
+        auto name_start = arn.find(API_CALL_CACHE_ARN_STREAM_PREFIX);
+        if (std::string::npos != name_start) {
+            name_start += STRLEN(API_CALL_CACHE_ARN_STREAM_PREFIX);
+            auto name_end = arn.find('/', name_start);
+            if (std::string::npos != name_end) {
+                cache->storeArn(region, arn.substr(name_start, name_end - name_start), arn);
+            }
+        }
+    }
+
+    if (nullptr == callbacks.tagResourceFn) {
+        return STATUS_INVALID_OPERATION;
+    }
+
+    return callbacks.tagResourceFn(custom_data, stream_arn, num_tags, tags, service_call_ctx);
+}
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -0,0 +1,113 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include "com/amazonaws/kinesis/video/client/Include.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Default time to live of the cached entries
+ */
+#define API_CALL_CACHE_DEFAULT_TTL_SECONDS                  (24 * 60 * 60)
+
+struct ApiCallCacheEntry {
+    ApiCallCacheEntry() : update_time(std::chrono::seconds(0)) {}
+
+    /**
+     * ARN of the stream, only known for the streams that have been tagged
+     */
+    std::string stream_arn;
+
+    /**
+     * Data endpoint the stream has last been put to
+     */
+    std::string streaming_endpoint;
+
+    std::chrono::system_clock::time_point update_time;
+};
+
+/**
+ * On-disk cache of the DescribeStream and GetDataEndpoint results keyed by the region and the stream name,
+ * so that a restarted producer doesn't have to issue the control plane calls of all its streams again.
+ *
+ * The PIC hands the results of the service calls straight to the stream state machine, so the cache learns them
+ * from the calls that follow: the data endpoint from PutMedia and the stream ARN from TagResource. A stream
+ * that has been put to is known to exist and to be active.
+ *
+ * The cache file is shared between the producers of a host. Every change is merged into the file as it is on
+ * disk at the time, the newer entry winning, and written aside and renamed into place.
+ *
+ * Thread-safe.
+ */
+class ApiCallCache {
+public:
+    /**
+     * @param path File the cache is loaded from and saved to.
+     * @param ttl Age past which an entry is no longer used.
+     */
+    explicit ApiCallCache(const std::string& path,
+                          std::chrono::seconds ttl = std::chrono::seconds(API_CALL_CACHE_DEFAULT_TTL_SECONDS));
+
+    /**
+     * @return Whether an entry with a data endpoint younger than the time to live exists for the stream.
+     */
+    bool lookup(const std::string& region, const std::string& stream_name, ApiCallCacheEntry& entry,
+                std::chrono::system_clock::time_point now = std::chrono::system_clock::now()) const;
+
+    void storeEndpoint(const std::string& region, const std::string& stream_name, const std::string& streaming_endpoint,
+                       std::chrono::system_clock::time_point now = std::chrono::system_clock::now());
+
+    void storeArn(const std::string& region, const std::string& stream_name, const std::string& stream_arn,
+                  std::chrono::system_clock::time_point now = std::chrono::system_clock::now());
+
+    void invalidate(const std::string& region, const std::string& stream_name);
+
+    /**
+     * Routes the DescribeStream and GetStreamingEndpoint calls of the callbacks through the cache and records
+     * the results from the PutStream and TagResource calls. Only the first lookup of a stream is served from the
+     * cache, the later ones follow errors and reconnects and go to the network.
+     *
+     * @param callbacks Callbacks to route, detached by their custom data.
+     * @return Callbacks to create the client with.
+     */
+    static ClientCallbacks attach(const std::shared_ptr<ApiCallCache>& cache, const ClientCallbacks& callbacks,
+                                  const std::string& region);
+
+    /**
+     * Stops routing the callbacks attached with the custom data. The client must have been freed.
+     */
+    static void detach(UINT64 custom_data);
+
+private:
+    using key_t = std::pair<std::string, std::string>;
+
+    static void load(const std::string& path, std::map<key_t, ApiCallCacheEntry>& entries);
+    void save();
+
+    static STATUS describeStreamHandler(UINT64 custom_data, PCHAR stream_name, PServiceCallContext service_call_ctx);
+    static STATUS getStreamingEndpointHandler(UINT64 custom_data, PCHAR stream_name, PCHAR api_name,
+                                              PServiceCallContext service_call_ctx);
+    static STATUS putStreamHandler(UINT64 custom_data, PCHAR stream_name, PCHAR container_type, UINT64 start_timestamp,
+                                   BOOL absolute_fragment_timestamp, BOOL do_ack, PCHAR streaming_endpoint,
+                                   PServiceCallContext service_call_ctx);
+    static STATUS tagResourceHandler(UINT64 custom_data, PCHAR stream_arn, UINT32 num_tags, PTag tags,
+                                     PServiceCallContext service_call_ctx);
+
+    const std::string path_;
+    const std::chrono::seconds ttl_;
+    mutable std::mutex mutex_;
+    std::map<key_t, ApiCallCacheEntry> entries_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
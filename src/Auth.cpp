@@ -1,15 +1,65 @@
 #include "Auth.h"
 #include "Logger.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
 LOGGER_TAG("com.amazonaws.kinesis.video");
 
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
 using std::mutex;
 
+bool parseIso8601Time(const std::string& time, std::chrono::seconds& seconds_since_epoch) {
+    std::tm time_tm = {};
+    if (6 != sscanf(time.c_str(), "%d-%d-%dT%d:%d:%d",
+                    &time_tm.tm_year, &time_tm.tm_mon, &time_tm.tm_mday, &time_tm.tm_hour, &time_tm.tm_min, &time_tm.tm_sec)) {
+        return false;
+    }
+
+    time_tm.tm_year -= 1900;
+    time_tm.tm_mon -= 1;
+#if defined _WIN32 || defined _WIN64
+    seconds_since_epoch = std::chrono::seconds(_mkgmtime(&time_tm));
+#else
+    seconds_since_epoch = std::chrono::seconds(timegm(&time_tm));
+#endif
+    return true;
+}
+
+CredentialsSnapshot::CredentialsSnapshot(const Credentials& credentials)
+    :   credentials_(credentials),
+        aws_credentials_(NULL) {
+    auto& access_key = credentials_.getAccessKey();
+    auto& secret_key = credentials_.getSecretKey();
+    auto& session_token = credentials_.getSessionToken();
+    // Credentials expiration count is in seconds. Need to set the expiration in Kinesis Video time
+    auto expiration = credentials_.getExpiration().count() * HUNDREDS_OF_NANOS_IN_A_SECOND;
+
+    if(IS_EMPTY_STRING(session_token.c_str())) {
+        status_ = createAwsCredentials((PCHAR) access_key.c_str(), (UINT32) access_key.length(),
+                                       (PCHAR) secret_key.c_str(), (UINT32) secret_key.length(),
+                                       nullptr, 0, expiration, &aws_credentials_);
+    } else {
+        status_ = createAwsCredentials((PCHAR) access_key.c_str(), (UINT32) access_key.length(),
+                                       (PCHAR) secret_key.c_str(), (UINT32) secret_key.length(),
+                                       (PCHAR) session_token.c_str(), (UINT32) session_token.length(),
+                                       expiration, &aws_credentials_);
+    }
+
+    if (STATUS_FAILED(status_)) {
+        LOG_ERROR("Serializing the credentials failed with code " << std::hex << status_);
+    }
+}
+
+CredentialsSnapshot::~CredentialsSnapshot() {
+    freeAwsCredentials(&aws_credentials_);
+}
+
 CredentialProvider::CredentialProvider()
     :   next_rotation_time_(0),
-        security_token_(NULL) {
+        refresher_stop_(false) {
     MEMSET(&callbacks_, 0, SIZEOF(callbacks_));
 }
 
@@ -29,6 +79,19 @@ void CredentialProvider::getUpdatedCredentials(Credentials& credentials) {
     credentials = credentials_;
 }
 
+std::shared_ptr<const CredentialsSnapshot> CredentialProvider::getCredentialsSnapshot() {
+    auto snapshot = std::atomic_load(&snapshot_);
+    auto now_time = systemCurrentTime().time_since_epoch();
+    if (nullptr == snapshot || now_time + CredentialProviderGracePeriod > snapshot->getCredentials().getExpiration()) {
+        // Not refreshed yet or the background refresh is behind
+        std::lock_guard<mutex> guard(credential_mutex_);
+        refreshCredentials();
+        snapshot = std::atomic_load(&snapshot_);
+    }
+
+    return snapshot;
+}
+
 void CredentialProvider::refreshCredentials(bool forceUpdate) {
     auto now_time = systemCurrentTime().time_since_epoch();
     // update if we've exceeded the refresh interval with grace period
@@ -38,6 +101,85 @@ void CredentialProvider::refreshCredentials(bool forceUpdate) {
                          << " Expiration: " << next_rotation_time_.count());
         updateCredentials(credentials_);
         next_rotation_time_ = credentials_.getExpiration();
+        publishCredentials();
+    }
+}
+
+void CredentialProvider::publishCredentials() {
+    auto snapshot = std::make_shared<const CredentialsSnapshot>(credentials_);
+    previous_snapshot_ = std::atomic_load(&snapshot_);
+    std::atomic_store(&snapshot_, snapshot);
+
+    // Credentials published off the refresher, like on a change of their source, move the rotation time
+    {
+        std::lock_guard<mutex> lock(refresher_mutex_);
+    }
+
+    refresher_cv_.notify_all();
+}
+
+void CredentialProvider::startRefresher() {
+    std::lock_guard<mutex> lock(refresher_mutex_);
+    if (refresher_thread_.joinable()) {
+        return;
+    }
+
+    refresher_stop_ = false;
+    refresher_thread_ = std::thread(&CredentialProvider::refresherRoutine, this);
+}
+
+void CredentialProvider::stopRefresher() {
+    {
+        std::lock_guard<mutex> lock(refresher_mutex_);
+        refresher_stop_ = true;
+    }
+
+    refresher_cv_.notify_all();
+    if (refresher_thread_.joinable() && refresher_thread_.get_id() != std::this_thread::get_id()) {
+        refresher_thread_.join();
+    }
+}
+
+void CredentialProvider::refresherRoutine() {
+    std::unique_lock<mutex> lock(refresher_mutex_);
+    auto lead_time = CredentialProviderGracePeriod + CredentialProviderPrefetchPeriod;
+    std::chrono::duration<uint64_t> retry_time(0);
+    while (!refresher_stop_) {
+        auto snapshot = std::atomic_load(&snapshot_);
+        auto now_time = std::chrono::duration_cast<std::chrono::duration<uint64_t>>(systemCurrentTime().time_since_epoch());
+        // Without credentials yet they're fetched right away, but a failed fetch still waits the retry period
+        auto rotation_time = retry_time;
+        if (nullptr != snapshot) {
+            auto expiration = snapshot->getCredentials().getExpiration();
+            if (MAX_UINT64 == expiration.count()) {
+                // Never expire, nothing to rotate until stopped
+                refresher_cv_.wait(lock);
+                continue;
+            }
+
+            rotation_time = std::max(expiration > lead_time ? expiration - lead_time : std::chrono::duration<uint64_t>(0),
+                                     retry_time);
+        }
+
+        if (now_time < rotation_time) {
+            // Waits at most the prefetch period at a time so that a step of the system clock doesn't delay the rotation
+            refresher_cv_.wait_for(lock, std::min(rotation_time - now_time, CredentialProviderPrefetchPeriod));
+            continue;
+        }
+
+        lock.unlock();
+        bool rotated = false;
+        try {
+            std::lock_guard<mutex> guard(credential_mutex_);
+            refreshCredentials(true);
+            rotated = next_rotation_time_ > now_time + lead_time;
+        } catch (const std::exception& e) {
+            LOG_WARN("Background credentials refresh failed, keeping the current credentials: " << e.what());
+        }
+
+        // Don't spin on a failing refresh or on credentials which are due as soon as they are handed out
+        retry_time = rotated ? std::chrono::duration<uint64_t>(0) : now_time + CredentialProviderRetryPeriod;
+        lock.lock();
     }
 }
 
@@ -45,7 +187,7 @@ void CredentialProvider::updateCredentials(Credentials &credentials) {
     // no-op
 }
 CredentialProvider::~CredentialProvider() {
-    freeAwsCredentials(&security_token_);
+    stopRefresher();
 }
 
 CredentialProvider::callback_t CredentialProvider::getCallbacks(PClientCallbacks clientCallbacks) {
@@ -62,6 +204,9 @@ CredentialProvider::callback_t CredentialProvider::getCallbacks(PClientCallbacks
 
     addAuthCallbacks(clientCallbacks, &callbacks_);
 
+    // Keeps the snapshot the token callbacks are served from ahead of the expiration
+    startRefresher();
+
     return callbacks_;
 }
 
@@ -90,44 +235,20 @@ DeviceCertToTokenFunc CredentialProvider::deviceCertToTokenCallback() {
 
 STATUS CredentialProvider::getStreamingTokenHandler(UINT64 custom_data, PCHAR stream_name, STREAM_ACCESS_MODE access_mode, PServiceCallContext p_service_call_context) {
     LOG_DEBUG("getStreamingTokenHandler invoked");
-    STATUS status = STATUS_SUCCESS;
     UNUSED_PARAM(stream_name);
     UNUSED_PARAM(access_mode);
 
     auto this_obj = reinterpret_cast<CredentialProvider*>(custom_data);
-
-    Credentials credentials;
-    this_obj->getUpdatedCredentials(credentials);
-
-    auto access_key = credentials.getAccessKey();
-    auto access_key_len = access_key.length();
-    auto secret_key = credentials.getSecretKey();
-    auto secret_key_len = secret_key.length();
-    auto session_token = credentials.getSessionToken();
-    auto session_token_len = session_token.length();
-    // Credentials expiration count is in seconds. Need to set the expiration in Kinesis Video time
-    auto expiration = credentials.getExpiration().count() * HUNDREDS_OF_NANOS_IN_A_SECOND;
-
-    // free current aws credential first
-    freeAwsCredentials(&this_obj->security_token_);
-
-    // Store the buffer so we can release it at the end
-    if(IS_EMPTY_STRING(session_token.c_str())) {
-        status = createAwsCredentials((PCHAR) access_key.c_str(), access_key_len, (PCHAR) secret_key.c_str(), secret_key_len,
-                             nullptr, 0, expiration, &this_obj->security_token_);
-
-    } else {
-        status = createAwsCredentials((PCHAR) access_key.c_str(), access_key_len, (PCHAR) secret_key.c_str(), secret_key_len,
-                             (PCHAR) session_token.c_str(), session_token_len, expiration, &this_obj->security_token_);
-
-    }
+    auto snapshot = this_obj->getCredentialsSnapshot();
+    STATUS status = snapshot->getStatus();
 
     if(STATUS_SUCCEEDED(status)) {
+        PAwsCredentials p_aws_credentials = snapshot->getAwsCredentials();
         status = getStreamingTokenResultEvent(
                 p_service_call_context->customData, SERVICE_CALL_RESULT_OK,
-                reinterpret_cast<PBYTE>(this_obj->security_token_),
-                this_obj->security_token_->size,
-                expiration);
+                reinterpret_cast<PBYTE>(p_aws_credentials),
+                p_aws_credentials->size,
+                p_aws_credentials->expiration);
     } else {
         LOG_ERROR("getStreamingTokenHandler failed with code " << std::hex << status);
     }
@@ -139,40 +260,15 @@ STATUS CredentialProvider::getSecurityTokenHandler(UINT64 custom_data, PBYTE* pp
     LOG_DEBUG("getSecurityTokenHandler invoked");
 
     auto this_obj = reinterpret_cast<CredentialProvider*>(custom_data);
-    STATUS status = STATUS_SUCCESS;
-    Credentials credentials;
-    this_obj->getCredentials(credentials);
-
-
-    auto access_key = credentials.getAccessKey();
-    auto access_key_len = access_key.length();
-    auto secret_key = credentials.getSecretKey();
-    auto secret_key_len = secret_key.length();
-    auto session_token = credentials.getSessionToken();
-    auto session_token_len = session_token.length();
-
-    // free current aws credential first
-    freeAwsCredentials(&this_obj->security_token_);
-
-    // Credentials expiration count is in seconds. Need to set the expiration in Kinesis Video time
-    *p_expiration = credentials.getExpiration().count() * HUNDREDS_OF_NANOS_IN_A_SECOND;
-
-    // Store the buffer so we can release it at the end
-    if(IS_EMPTY_STRING(session_token.c_str())) {
-        // Store the buffer so we can release it at the end
-        status = createAwsCredentials((PCHAR) access_key.c_str(), access_key_len, (PCHAR) secret_key.c_str(), secret_key_len,
-                             nullptr, 0, *p_expiration, &this_obj->security_token_);
-
-    } else {
-        // Store the buffer so we can release it at the end
-        status = createAwsCredentials((PCHAR) access_key.c_str(), access_key_len, (PCHAR) secret_key.c_str(), secret_key_len,
-                             (PCHAR) session_token.c_str(), session_token_len, *p_expiration, &this_obj->security_token_);
-
-    }
+    auto snapshot = this_obj->getCredentialsSnapshot();
+    STATUS status = snapshot->getStatus();
 
     if(STATUS_SUCCEEDED(status)) {
-        *pp_token = (PBYTE) (this_obj->security_token_);
-        *p_size = this_obj->security_token_->size;
+        // The provider keeps the snapshot alive past the next rotation, which is long enough for the caller to copy it
+        PAwsCredentials p_aws_credentials = snapshot->getAwsCredentials();
+        *pp_token = (PBYTE) p_aws_credentials;
+        *p_size = p_aws_credentials->size;
+        *p_expiration = p_aws_credentials->expiration;
     } else {
         LOG_ERROR("getSecurityTokenHandler failed with code " << std::hex << status);
     }
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <chrono>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <thread>
 
 #include <cstdlib>
 #include <cstring>
@@ -129,6 +132,52 @@ private:
     std::chrono::duration<uint64_t> expiration_;
 };
 
+/**
+ * Parses an ISO 8601 UTC time like 2018-01-18T09:18:06Z, as the credential sources return the expirations
+ *
+ * @return Whether the time could be parsed.
+ */
+bool parseIso8601Time(const std::string& time, std::chrono::seconds& seconds_since_epoch);
+
+/**
+ * Credentials along with their serialized form handed out to the PIC. Never modified once created so that
+ * it can be shared between the threads without locking.
+ */
+class CredentialsSnapshot {
+public:
+    explicit CredentialsSnapshot(const Credentials& credentials);
+    ~CredentialsSnapshot();
+
+    CredentialsSnapshot(const CredentialsSnapshot&) = delete;
+    CredentialsSnapshot& operator=(const CredentialsSnapshot&) = delete;
+
+    inline const Credentials& getCredentials() const
+    {
+        return credentials_;
+    }
+
+    /**
+     * Gets the serialized credentials, NULL if the serialization has failed
+     */
+    inline PAwsCredentials getAwsCredentials() const
+    {
+        return aws_credentials_;
+    }
+
+    /**
+     * Gets the status of the serialization
+     */
+    inline STATUS getStatus() const
+    {
+        return status_;
+    }
+
+private:
+    const Credentials credentials_;
+    PAwsCredentials aws_credentials_;
+    STATUS status_;
+};
+
 class CredentialProvider {
 public:
     using callback_t = AuthCallbacks;
@@ -136,6 +185,21 @@ public:
     virtual void getUpdatedCredentials(Credentials& credentials);
     virtual ~CredentialProvider();
 
+    /**
+     * Gets the current credentials. Refreshes them on the calling thread only if the background refresh
+     * hasn't kept them ahead of the expiration.
+     *
+     * @return Snapshot of the credentials, kept alive by the provider until it has been replaced twice
+     */
+    std::shared_ptr<const CredentialsSnapshot> getCredentialsSnapshot();
+
+    /**
+     * Stops the background refresh started by getCallbacks. The refresh calls updateCredentials, so a
+     * subclass refreshing from its own members has to stop it before it gets destroyed. DefaultCallbackProvider
+     * stops it before freeing the provider.
+     */
+    void stopRefresher();
+
     /**
      * Gets the callbacks
      *
@@ -174,18 +238,43 @@ protected:
 
     const std::chrono::duration<uint64_t> CredentialProviderGracePeriod = std::chrono::seconds(5 + (MIN_STREAMING_TOKEN_EXPIRATION_DURATION + STREAMING_TOKEN_EXPIRATION_GRACE_PERIOD) / HUNDREDS_OF_NANOS_IN_A_SECOND);
 
+    /**
+     * How long ahead of the grace period the background refresh rotates the credentials
+     */
+    const std::chrono::duration<uint64_t> CredentialProviderPrefetchPeriod = std::chrono::seconds(30);
+
+    /**
+     * Wait before retrying a background refresh that hasn't moved the expiration past the rotation time
+     */
+    const std::chrono::duration<uint64_t> CredentialProviderRetryPeriod = std::chrono::seconds(5);
+
 private:
     void refreshCredentials(bool forceUpdate = false);
+    void publishCredentials();
+    void startRefresher();
+    void refresherRoutine();
 
     virtual void updateCredentials(Credentials& credentials) = 0;
 
     std::mutex credential_mutex_;
     std::chrono::duration<uint64_t> next_rotation_time_;
     Credentials credentials_;
+
+    /**
+     * Current snapshot, swapped with std::atomic_load/std::atomic_store
+     */
+    std::shared_ptr<const CredentialsSnapshot> snapshot_;
+
     /**
-     * Storage for the serialized security token
+     * The snapshot replaced by the current one. Keeps the token last handed out by getSecurityTokenHandler
+     * alive while the PIC copies it. Guarded by credential_mutex_.
      */
-    PAwsCredentials security_token_;
+    std::shared_ptr<const CredentialsSnapshot> previous_snapshot_;
+
+    std::mutex refresher_mutex_;
+    std::condition_variable refresher_cv_;
+    bool refresher_stop_;
+    std::thread refresher_thread_;
 
     callback_t callbacks_;
 
@@ -208,6 +297,11 @@ public:
 
     StaticCredentialProvider(const Credentials& credentials) : credentials_(credentials) {}
 
+    ~StaticCredentialProvider() {
+        // The refresher copies credentials_ forward
+        stopRefresher();
+    }
+
 protected:
 
     void updateCredentials(Credentials& credentials) override {
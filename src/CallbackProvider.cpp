@@ -61,6 +61,36 @@ void CallbackProvider::shutdownStream(STREAM_HANDLE stream_handle) {
     // No-op
 }
 
+void CallbackProvider::setFragmentAckObserver(FragmentAckObserver fragment_ack_observer) {
+    fragment_ack_observer_ = fragment_ack_observer;
+}
+
+void CallbackProvider::notifyFragmentAck(STREAM_HANDLE stream_handle, PFragmentAck fragment_ack) const {
+    if (nullptr != fragment_ack_observer_ && nullptr != fragment_ack) {
+        fragment_ack_observer_(stream_handle, *fragment_ack);
+    }
+}
+
+void CallbackProvider::setDroppedFrameObserver(DroppedFrameObserver dropped_frame_observer) {
+    dropped_frame_observer_ = dropped_frame_observer;
+}
+
+void CallbackProvider::notifyDroppedFrame(STREAM_HANDLE stream_handle, UINT64 timecode) const {
+    if (nullptr != dropped_frame_observer_) {
+        dropped_frame_observer_(stream_handle, timecode);
+    }
+}
+
+void CallbackProvider::setDroppedFragmentObserver(DroppedFragmentObserver dropped_fragment_observer) {
+    dropped_fragment_observer_ = dropped_fragment_observer;
+}
+
+void CallbackProvider::notifyDroppedFragment(STREAM_HANDLE stream_handle, UINT64 timecode) const {
+    if (nullptr != dropped_fragment_observer_) {
+        dropped_fragment_observer_(stream_handle, timecode);
+    }
+}
+
 CreateMutexFunc CallbackProvider::getCreateMutexCallback() {
     return nullptr;
 }
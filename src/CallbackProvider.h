@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include "com/amazonaws/kinesis/video/client/Include.h"
 
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
@@ -94,6 +96,39 @@ public:
      */
     virtual void shutdownStream(STREAM_HANDLE stream_handle);
 
+    /**
+     * Observer of the fragment acks received for the streams
+     */
+    using FragmentAckObserver = std::function<void(STREAM_HANDLE, const FragmentAck&)>;
+
+    /**
+     * Sets the observer the fragment acks are reported to in addition to the fragment ack callback.
+     * The producer uses it to track the fragment ack latencies of its streams.
+     */
+    void setFragmentAckObserver(FragmentAckObserver fragment_ack_observer);
+
+    /**
+     * Observer of the frames dropped by the streams
+     */
+    using DroppedFrameObserver = std::function<void(STREAM_HANDLE, UINT64)>;
+
+    /**
+     * Sets the observer the dropped frames are reported to in addition to the dropped frame callback.
+     * The producer uses it to count the dropped frames of its streams.
+     */
+    void setDroppedFrameObserver(DroppedFrameObserver dropped_frame_observer);
+
+    /**
+     * Observer of the fragments dropped by the streams
+     */
+    using DroppedFragmentObserver = std::function<void(STREAM_HANDLE, UINT64)>;
+
+    /**
+     * Sets the observer the dropped fragments are reported to in addition to the dropped fragment callback.
+     * The producer uses it to count the dropped fragments of its streams.
+     */
+    void setDroppedFragmentObserver(DroppedFragmentObserver dropped_fragment_observer);
+
     /**
      * @return Kinesis Video client default implementation
      */
@@ -552,7 +587,28 @@ public:
     virtual ~CallbackProvider() {}
 
 protected:
+    /**
+     * Reports the ack to the fragment ack observer, if any. Expected to be called by the fragment ack callback.
+     */
+    void notifyFragmentAck(STREAM_HANDLE stream_handle, PFragmentAck fragment_ack) const;
+
+    /**
+     * Reports the dropped frame to the dropped frame observer, if any. Expected to be called by the dropped frame callback.
+     */
+    void notifyDroppedFrame(STREAM_HANDLE stream_handle, UINT64 timecode) const;
+
+    /**
+     * Reports the dropped fragment to the dropped fragment observer, if any. Expected to be called by the dropped fragment callback.
+     */
+    void notifyDroppedFragment(STREAM_HANDLE stream_handle, UINT64 timecode) const;
+
     callback_t callbacks_;
+
+    FragmentAckObserver fragment_ack_observer_;
+
+    DroppedFrameObserver dropped_frame_observer_;
+
+    DroppedFragmentObserver dropped_fragment_observer_;
 };
 
 } // namespace video
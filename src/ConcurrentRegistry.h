@@ -0,0 +1,264 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Read-optimized concurrent hash registry.
+ *
+ * Lookups and snapshots never take a lock: a reader announces itself on one of two epoch counters,
+ * walks the immutable bucket chains and leaves. Writers are serialized, link/unlink nodes in O(1) and
+ * reclaim unlinked nodes only after all of the readers that could still observe them have left (RCU).
+ *
+ * The bucket array is fixed and is not resized - it is sized for the expected number of entries.
+ *
+ * @tparam K The key
+ * @tparam V The value. Must be copyable and default constructible - a default constructed value is returned for misses.
+ * @tparam BUCKET_COUNT Number of hash buckets. Must be a power of two.
+ */
+template <typename K, typename V, size_t BUCKET_COUNT = 256> class ConcurrentRegistry {
+    static_assert(BUCKET_COUNT != 0 && (BUCKET_COUNT & (BUCKET_COUNT - 1)) == 0, "Bucket count must be a power of two");
+
+public:
+    ConcurrentRegistry() : epoch_(0), size_(0) {
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            buckets_[i].store(nullptr);
+        }
+
+        readers_[0].count.store(0);
+        readers_[1].count.store(0);
+    }
+
+    ~ConcurrentRegistry() {
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            Node* node = buckets_[i].load();
+            while (nullptr != node) {
+                Node* next = node->next.load();
+                delete node;
+                node = next;
+            }
+        }
+    }
+
+    ConcurrentRegistry(const ConcurrentRegistry&) = delete;
+    ConcurrentRegistry& operator=(const ConcurrentRegistry&) = delete;
+
+    /**
+     * Put an item into the registry replacing the existing one if any.
+     * @param k key
+     * @param v value
+     */
+    void put(const K& k, const V& v) {
+        Node* replaced = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            std::atomic<Node*>* link = &buckets_[bucketIndex(k)];
+            Node* node = link->load();
+
+            // Find the existing node for the key, if any
+            while (nullptr != node && !(node->key == k)) {
+                link = &node->next;
+                node = link->load();
+            }
+
+            if (nullptr != node) {
+                // Swap in a new immutable node in place of the existing one
+                link->store(new Node(k, v, node->next.load()));
+                replaced = node;
+                synchronize();
+            } else {
+                std::atomic<Node*>* head = &buckets_[bucketIndex(k)];
+                head->store(new Node(k, v, head->load()));
+                size_.fetch_add(1);
+            }
+        }
+
+        // Release the old value outside of the writer lock
+        delete replaced;
+    }
+
+    /**
+     * Retrieve an item from the registry. Never blocks.
+     * @param k Key to look up.
+     * @return The value at k or a default constructed value.
+     */
+    V get(const K& k) const {
+        ReadSection section(*this);
+        const Node* node = find(k);
+        return nullptr != node ? node->value : V();
+    }
+
+    /**
+     * Check if a key exists in the registry. Never blocks.
+     * @param k Key to be checked
+     * @return True if the key exists and false otherwise.
+     */
+    bool exists(const K& k) const {
+        ReadSection section(*this);
+        return nullptr != find(k);
+    }
+
+    /**
+     * Remove the item stored at k, if it exists.
+     * @param k Key to be removed.
+     * @return True if the item has been removed.
+     */
+    bool remove(const K& k) {
+        Node* removed = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            std::atomic<Node*>* link = &buckets_[bucketIndex(k)];
+            Node* node = link->load();
+
+            while (nullptr != node && !(node->key == k)) {
+                link = &node->next;
+                node = link->load();
+            }
+
+            if (nullptr == node) {
+                return false;
+            }
+
+            // Unlink and await for the readers which might still be on the node
+            link->store(node->next.load());
+            size_.fetch_sub(1);
+            removed = node;
+            synchronize();
+        }
+
+        // Release the value outside of the writer lock as it might run an arbitrary destructor
+        delete removed;
+        return true;
+    }
+
+    /**
+     * Returns a point-in-time copy of the values which is safe to iterate while the registry changes.
+     * Never blocks.
+     */
+    std::vector<V> snapshot() const {
+        std::vector<V> values;
+        values.reserve(size_.load());
+
+        ReadSection section(*this);
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            for (const Node* node = buckets_[i].load(); nullptr != node; node = node->next.load()) {
+                values.push_back(node->value);
+            }
+        }
+
+        return values;
+    }
+
+    /**
+     * Returns the number of items in the registry.
+     */
+    size_t size() const {
+        return size_.load();
+    }
+
+private:
+    struct Node {
+        Node(const K& k, const V& v, Node* n) : key(k), value(v), next(n) {}
+
+        const K key;
+        const V value;
+        std::atomic<Node*> next;
+    };
+
+    /**
+     * Reader counter padded to its own cache line to avoid false sharing between the epochs.
+     */
+    struct ReaderCount {
+        std::atomic<uint64_t> count;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    /**
+     * Scoped reader announcement. Entering and leaving are a single atomic increment/decrement.
+     */
+    class ReadSection {
+    public:
+        explicit ReadSection(const ConcurrentRegistry& registry)
+                : registry_(registry), index_(registry.epoch_.load() & 1) {
+            registry_.readers_[index_].count.fetch_add(1);
+        }
+
+        ~ReadSection() {
+            registry_.readers_[index_].count.fetch_sub(1);
+        }
+
+    private:
+        const ConcurrentRegistry& registry_;
+        const uint64_t index_;
+    };
+
+    size_t bucketIndex(const K& k) const {
+        // Fibonacci hashing spreads the pointer-like handles which have the low bits clear
+        uint64_t hash = static_cast<uint64_t>(std::hash<K>()(k)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(hash >> 32) & (BUCKET_COUNT - 1);
+    }
+
+    const Node* find(const K& k) const {
+        for (const Node* node = buckets_[bucketIndex(k)].load(); nullptr != node; node = node->next.load()) {
+            if (node->key == k) {
+                return node;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * Awaits for all of the readers that might have observed an unlinked node.
+     *
+     * NOTE: Must be called with the write_mutex_ held. The epoch is flipped twice so that the readers
+     * which sampled a stale epoch before the unlink are drained as well.
+     */
+    void synchronize() {
+        for (int phase = 0; phase < 2; phase++) {
+            uint64_t epoch = epoch_.load();
+            epoch_.store(epoch + 1);
+            while (0 != readers_[epoch & 1].count.load()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /**
+     * Hash buckets with singly linked chains of immutable nodes.
+     */
+    std::atomic<Node*> buckets_[BUCKET_COUNT];
+
+    /**
+     * Current reader epoch - the low bit selects the reader counter.
+     */
+    std::atomic<uint64_t> epoch_;
+
+    /**
+     * Number of active readers per epoch.
+     */
+    mutable ReaderCount readers_[2];
+
+    /**
+     * Number of items in the registry.
+     */
+    std::atomic<size_t> size_;
+
+    /**
+     * Serializes the writers.
+     */
+    std::mutex write_mutex_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -0,0 +1,208 @@
+#include "Logger.h"
+#include "ContentStoreSizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+LOGGER_TAG("com.amazonaws.kinesis.video");
+
+using std::chrono::duration;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+ContentStoreSizer::ContentStoreSizer(const ContentStoreSizerConfig& config, const std::string& state_path)
+        : config_(config),
+          state_path_(state_path),
+          published_size_(0) {
+    load();
+    if (!streams_.empty()) {
+        published_size_ = storageSize();
+        LOG_INFO("Content store sized at " << published_size_ << " bytes for the " << streams_.size()
+                 << " streams learned from " << state_path_);
+    }
+}
+
+void ContentStoreSizer::streamCreated(const std::string& stream_name, const ContentStoreStreamRate& declared_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = streams_.find(stream_name);
+    if (it == streams_.end()) {
+        StreamEstimate estimate;
+        estimate.rate = declared_rate;
+        estimate.bitrate_bps = (double) declared_rate.bitrate_bps;
+        estimate.frame_rate = (double) declared_rate.frame_rate;
+        it = streams_.insert(std::make_pair(stream_name, estimate)).first;
+    }
+
+    // The buffer duration is always taken from the caps, only the rates are learned
+    it->second.rate.buffer_duration = declared_rate.buffer_duration;
+    it->second.registered = true;
+    it->second.sampled = false;
+}
+
+void ContentStoreSizer::sample(const std::string& stream_name, const StreamCountersSnapshot& counters,
+                               steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = streams_.find(stream_name);
+    if (it == streams_.end() || !it->second.registered) {
+        return;
+    }
+
+    StreamEstimate& estimate = it->second;
+    double elapsed = duration<double>(now - estimate.sample_time).count();
+
+    // A recreated stream starts its counters over
+    if (estimate.sampled && elapsed > 0 && counters.bytes_put >= estimate.bytes_put && counters.frames_put >= estimate.frames_put) {
+        double bitrate_bps = 8 * (counters.bytes_put - estimate.bytes_put) / elapsed;
+        double frame_rate = (counters.frames_put - estimate.frames_put) / elapsed;
+        estimate.bitrate_bps += (bitrate_bps > estimate.bitrate_bps ? config_.rise : config_.decay) * (bitrate_bps - estimate.bitrate_bps);
+        estimate.frame_rate += (frame_rate > estimate.frame_rate ? config_.rise : config_.decay) * (frame_rate - estimate.frame_rate);
+    }
+
+    estimate.sampled = true;
+    estimate.bytes_put = counters.bytes_put;
+    estimate.frames_put = counters.frames_put;
+    estimate.sample_time = now;
+}
+
+bool ContentStoreSizer::getStreamRate(const std::string& stream_name, ContentStoreStreamRate& rate) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = streams_.find(stream_name);
+    if (it == streams_.end()) {
+        return false;
+    }
+
+    rate = it->second.rate;
+    rate.bitrate_bps = (uint64_t) it->second.bitrate_bps;
+    rate.frame_rate = std::max<uint32_t>(1, (uint32_t) std::lround(it->second.frame_rate));
+    return true;
+}
+
+uint64_t ContentStoreSizer::getStorageSize() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return storageSize();
+}
+
+uint32_t ContentStoreSizer::getStreamCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool any_registered = anyRegistered();
+    return (uint32_t) std::count_if(streams_.begin(), streams_.end(), [any_registered](const std::pair<const std::string, StreamEstimate>& stream) {
+        return stream.second.registered || !any_registered;
+    });
+}
+
+bool ContentStoreSizer::update(uint64_t& storage_size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        storage_size = storageSize();
+
+        // Keeps the estimates from flapping around the threshold
+        if (0 != published_size_ &&
+            std::fabs((double) storage_size - (double) published_size_) <= config_.resize_threshold * published_size_) {
+            storage_size = published_size_;
+            return false;
+        }
+
+        published_size_ = storage_size;
+    }
+
+    save();
+    return true;
+}
+
+bool ContentStoreSizer::save() const {
+    if (state_path_.empty()) {
+        return true;
+    }
+
+    std::ostringstream state;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& stream : streams_) {
+            if (stream.second.registered) {
+                state << stream.first << " " << (uint64_t) stream.second.bitrate_bps << " " << stream.second.frame_rate
+                      << " " << stream.second.rate.buffer_duration.count() << "\n";
+            }
+        }
+    }
+
+    // Written aside and renamed so that a crash never leaves a truncated state behind
+    std::string temporary_path = state_path_ + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::trunc);
+        file << state.str();
+        if (!file.flush()) {
+            LOG_WARN("Failed to write the content store sizing state " << temporary_path);
+            return false;
+        }
+    }
+
+#if defined(_WIN32)
+    remove(state_path_.c_str());
+#endif
+    if (0 != rename(temporary_path.c_str(), state_path_.c_str())) {
+        LOG_WARN("Failed to replace the content store sizing state " << state_path_);
+        return false;
+    }
+
+    return true;
+}
+
+void ContentStoreSizer::load() {
+    if (state_path_.empty()) {
+        return;
+    }
+
+    std::ifstream file(state_path_);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string stream_name;
+        double bitrate_bps, frame_rate;
+        uint64_t buffer_duration_ms;
+        if (!(fields >> stream_name >> bitrate_bps >> frame_rate >> buffer_duration_ms) || bitrate_bps < 0 || frame_rate < 0) {
+            LOG_WARN("Skipping the malformed content store sizing state line: " << line);
+            continue;
+        }
+
+        StreamEstimate estimate;
+        estimate.rate.bitrate_bps = (uint64_t) bitrate_bps;
+        estimate.rate.frame_rate = (uint32_t) frame_rate;
+        estimate.rate.buffer_duration = milliseconds(buffer_duration_ms);
+        estimate.bitrate_bps = bitrate_bps;
+        estimate.frame_rate = frame_rate;
+        estimate.registered = false;
+        estimate.sampled = false;
+        streams_[stream_name] = estimate;
+    }
+}
+
+uint64_t ContentStoreSizer::storageSize() const {
+    bool any_registered = anyRegistered();
+    double buffered_bytes = 0;
+    uint64_t overhead = 0;
+    for (auto& stream : streams_) {
+        if (stream.second.registered || !any_registered) {
+            buffered_bytes += stream.second.bitrate_bps / 8 * duration<double>(stream.second.rate.buffer_duration).count();
+            overhead += CONTENT_STORE_SIZER_STREAM_OVERHEAD;
+        }
+    }
+
+    uint64_t size = (uint64_t) (buffered_bytes * config_.headroom) + overhead;
+    return std::min(std::max(size, config_.min_size), config_.max_size);
+}
+
+bool ContentStoreSizer::anyRegistered() const {
+    return std::any_of(streams_.begin(), streams_.end(), [](const std::pair<const std::string, StreamEstimate>& stream) {
+        return stream.second.registered;
+    });
+}
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
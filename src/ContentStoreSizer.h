@@ -0,0 +1,167 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "StreamCounters.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Default factor the buffered bytes are scaled by for the key frame bursts, the packaging and the fragmentation
+ */
+#define CONTENT_STORE_SIZER_DEFAULT_HEADROOM 1.5
+
+/**
+ * Default bounds of the content store size
+ */
+#define CONTENT_STORE_SIZER_DEFAULT_MIN_SIZE (16 * 1024 * 1024ull)
+#define CONTENT_STORE_SIZER_DEFAULT_MAX_SIZE (2048 * 1024 * 1024ull)
+
+/**
+ * Default relative change of the size before a new target is published
+ */
+#define CONTENT_STORE_SIZER_DEFAULT_RESIZE_THRESHOLD 0.2
+
+/**
+ * Default weights of a sample in the rate estimates when the rate rises and when it drops
+ */
+#define CONTENT_STORE_SIZER_DEFAULT_RISE 0.5
+#define CONTENT_STORE_SIZER_DEFAULT_DECAY 0.05
+
+/**
+ * Bytes added per stream for the MKV headers, the tags and the partially sent frames
+ */
+#define CONTENT_STORE_SIZER_STREAM_OVERHEAD (1024 * 1024ull)
+
+struct ContentStoreSizerConfig {
+    ContentStoreSizerConfig()
+            : headroom(CONTENT_STORE_SIZER_DEFAULT_HEADROOM),
+              min_size(CONTENT_STORE_SIZER_DEFAULT_MIN_SIZE),
+              max_size(CONTENT_STORE_SIZER_DEFAULT_MAX_SIZE),
+              resize_threshold(CONTENT_STORE_SIZER_DEFAULT_RESIZE_THRESHOLD),
+              rise(CONTENT_STORE_SIZER_DEFAULT_RISE),
+              decay(CONTENT_STORE_SIZER_DEFAULT_DECAY) {}
+
+    double headroom;
+    uint64_t min_size;
+    uint64_t max_size;
+    double resize_threshold;
+    double rise;
+    double decay;
+};
+
+/**
+ * Rates of a stream as declared in its caps and refined by the observed ones.
+ */
+struct ContentStoreStreamRate {
+    uint64_t bitrate_bps;
+    uint32_t frame_rate;
+    std::chrono::milliseconds buffer_duration;
+};
+
+/**
+ * Sizes the content store from the sum of the buffer duration times the observed bitrate of the streams
+ * instead of a fixed guess, along with the bandwidth and frame rate caps of the streams.
+ *
+ * The estimates start from the caps the streams are created with and follow the put frame counters sampled
+ * by the producer: a rise in the bitrate is followed quickly while a drop decays slowly, so the store is
+ * sized for the recent peak. The estimates are kept in an optional state file so that the next run of the producer
+ * starts with the learned sizes before the streams are even created.
+ *
+ * Thread-safe.
+ */
+class ContentStoreSizer {
+public:
+    /**
+     * @param state_path File the estimates are loaded from and saved to, empty to keep them in memory only.
+     */
+    explicit ContentStoreSizer(const ContentStoreSizerConfig& config = ContentStoreSizerConfig(),
+                               const std::string& state_path = "");
+
+    /**
+     * Registers a stream with its declared rates. A learned bitrate and frame rate of the stream take
+     * precedence over the declared ones.
+     */
+    void streamCreated(const std::string& stream_name, const ContentStoreStreamRate& declared_rate);
+
+    /**
+     * Refines the rate estimate of the stream from its put frame counters.
+     */
+    void sample(const std::string& stream_name, const StreamCountersSnapshot& counters,
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+     * @return Whether the rate of the stream is known, either learned or declared.
+     */
+    bool getStreamRate(const std::string& stream_name, ContentStoreStreamRate& rate) const;
+
+    /**
+     * @return Content store size for the current estimates. Covers the streams registered in this run, or
+     *         the ones loaded from the state file until a stream is registered.
+     */
+    uint64_t getStorageSize() const;
+
+    /**
+     * @return Number of the streams the storage size covers.
+     */
+    uint32_t getStreamCount() const;
+
+    /**
+     * Publishes the storage size if it has moved past the resize threshold since the last publish and saves
+     * the estimates.
+     *
+     * @param storage_size Receives the published storage size.
+     * @return Whether a new storage size has been published.
+     */
+    bool update(uint64_t& storage_size);
+
+    /**
+     * Saves the estimates of the streams registered in this run into the state file.
+     */
+    bool save() const;
+
+private:
+    struct StreamEstimate {
+        ContentStoreStreamRate rate;
+
+        /**
+         * Bitrate and frame rate estimates, fractional to keep the slow decay from rounding away
+         */
+        double bitrate_bps;
+        double frame_rate;
+
+        /**
+         * Whether the stream has been registered in this run rather than only loaded from the state file
+         */
+        bool registered;
+
+        /**
+         * Counters at the previous sample
+         */
+        bool sampled;
+        uint64_t bytes_put;
+        uint64_t frames_put;
+        std::chrono::steady_clock::time_point sample_time;
+    };
+
+    void load();
+    uint64_t storageSize() const;
+    bool anyRegistered() const;
+
+    const ContentStoreSizerConfig config_;
+    const std::string state_path_;
+    mutable std::mutex mutex_;
+    std::map<std::string, StreamEstimate> streams_;
+    uint64_t published_size_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -189,6 +189,7 @@ STATUS DefaultCallbackProvider::droppedFrameReportHandler(UINT64 custom_data,
                                                           UINT64 timecode) {
     LOG_DEBUG("droppedFrameReportHandler invoked");
     auto this_obj = reinterpret_cast<DefaultCallbackProvider*>(custom_data);
+    this_obj->notifyDroppedFrame(stream_handle, timecode);
 
     // Call the client callback if any specified
     auto dropped_frame_callback = this_obj->stream_callback_provider_->getDroppedFrameReportCallback();
@@ -206,6 +207,7 @@ STATUS DefaultCallbackProvider::droppedFragmentReportHandler(UINT64 custom_data,
                                                              UINT64 timecode) {
     LOG_DEBUG("droppedFragmentReportHandler invoked");
     auto this_obj = reinterpret_cast<DefaultCallbackProvider*>(custom_data);
+    this_obj->notifyDroppedFragment(stream_handle, timecode);
 
     // Call the client callback if any specified
     auto dropped_fragment_callback = this_obj->stream_callback_provider_->getDroppedFragmentReportCallback();
@@ -271,6 +273,7 @@ STATUS DefaultCallbackProvider::fragmentAckReceivedHandler(UINT64 custom_data,
                                                            PFragmentAck fragment_ack) {
     LOG_DEBUG("fragmentAckReceivedHandler invoked");
     auto this_obj = reinterpret_cast<DefaultCallbackProvider*>(custom_data);
+    this_obj->notifyFragmentAck(stream_handle, fragment_ack);
 
     // Call the client callback if any specified
     auto fragment_ack_callback = this_obj->stream_callback_provider_->getFragmentAckReceivedCallback();
@@ -452,9 +455,20 @@ DefaultCallbackProvider::DefaultCallbackProvider(
 }
 
 DefaultCallbackProvider::~DefaultCallbackProvider() {
+    // The client is gone, stop refreshing before the provider gets destroyed
+    credentials_provider_->stopRefresher();
+
+    if (nullptr != api_call_cache_) {
+        ApiCallCache::detach(client_callbacks_->customData);
+    }
+
     freeCallbacksProvider(&client_callbacks_);
 }
 
+void DefaultCallbackProvider::setApiCallCache(std::shared_ptr<ApiCallCache> api_call_cache) {
+    api_call_cache_ = std::move(api_call_cache);
+}
+
 StreamCallbacks DefaultCallbackProvider::getStreamCallbacks() {
     MEMSET(&stream_callbacks_, 0, SIZEOF(stream_callbacks_));
     stream_callbacks_.customData = reinterpret_cast<uintptr_t>(this);
@@ -493,6 +507,10 @@ PlatformCallbacks DefaultCallbackProvider::getPlatformCallbacks() {
 }
 
 DefaultCallbackProvider::callback_t DefaultCallbackProvider::getCallbacks() {
+    if (nullptr != api_call_cache_) {
+        return ApiCallCache::attach(api_call_cache_, *client_callbacks_, region_);
+    }
+
     return *client_callbacks_;
 }
 
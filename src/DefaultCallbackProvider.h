@@ -5,8 +5,9 @@
 #include "CallbackProvider.h"
 #include "ClientCallbackProvider.h"
 #include "StreamCallbackProvider.h"
-#include "ThreadSafeMap.h"
+#include "ConcurrentRegistry.h"
 #include "GetTime.h"
+#include "ApiCallCache.h"
 
 #include "Auth.h"
 
@@ -74,6 +75,14 @@ public:
 
     virtual ~DefaultCallbackProvider();
 
+    /**
+     * Serves the first DescribeStream and GetDataEndpoint calls of the streams from the persistent cache
+     * before going to the network. Must be set before the provider is handed over to the producer.
+     *
+     * @param api_call_cache Cache to consult and to record the results into, shareable between the providers.
+     */
+    void setApiCallCache(std::shared_ptr<ApiCallCache> api_call_cache);
+
     callback_t getCallbacks() override;
 
     /**
@@ -464,6 +473,11 @@ protected:
      * Stores all platform callbacks from C++
      */
     PlatformCallbacks platform_callbacks_;
+
+    /**
+     * Persistent cache of the stream descriptions and endpoints, null if disabled
+     */
+    std::shared_ptr<ApiCallCache> api_call_cache_;
 };
 
 } // namespace video
@@ -3,7 +3,15 @@
 #include "DefaultDeviceInfoProvider.h"
 #include "Logger.h"
 
+#include <algorithm>
 #include <string>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/statvfs.h>
+#endif
 
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
@@ -78,8 +86,63 @@ DefaultDeviceInfoProvider::DefaultDeviceInfoProvider(const std::string &custom_u
     device_info_.clientInfo.loggerLogLevel = logLevel;
 }
 
+void DefaultDeviceInfoProvider::setStorageSpill(const std::string &spill_directory, uint32_t ram_percent) {
+    if (ram_percent > 100) {
+        LOG_AND_THROW("Invalid storage RAM share " << ram_percent << "%");
+    }
+
+    if (spill_directory.empty() || spill_directory.size() > MAX_PATH_LEN) {
+        LOG_AND_THROW("Invalid storage spill directory " << spill_directory);
+    }
+
+    struct stat directory_stat;
+    if (0 != stat(spill_directory.c_str(), &directory_stat)) {
+#if defined(_WIN32)
+        int result = _mkdir(spill_directory.c_str());
+#else
+        int result = mkdir(spill_directory.c_str(), 0700);
+#endif
+        if (0 != result) {
+            LOG_AND_THROW("Unable to create the storage spill directory " << spill_directory);
+        }
+    } else if (0 == (directory_stat.st_mode & S_IFDIR)) {
+        LOG_AND_THROW("Storage spill path " << spill_directory << " is not a directory");
+    }
+
+    uint64_t spill_size = device_info_.storageInfo.storageSize / 100 * (100 - ram_percent);
+
+#if !defined(_WIN32)
+    // Running out of disk space only shows up as failing allocations once the store is that full
+    struct statvfs file_system_stat;
+    if (0 == statvfs(spill_directory.c_str(), &file_system_stat) &&
+        (uint64_t) file_system_stat.f_bavail * file_system_stat.f_frsize < spill_size) {
+        LOG_WARN("Storage spill directory " << spill_directory << " has less than the " << spill_size << " bytes free which might be spilled");
+    }
+#endif
+
+    device_info_.storageInfo.storageType = DEVICE_STORAGE_TYPE_HYBRID_FILE;
+    device_info_.storageInfo.spillRatio = ram_percent;
+    spill_directory.copy(device_info_.storageInfo.rootDirectory, spill_directory.size());
+    device_info_.storageInfo.rootDirectory[spill_directory.size()] = '\0';
+
+    LOG_INFO("Content store keeps " << ram_percent << "% in RAM and spills up to " << spill_size << " bytes into " << spill_directory);
+}
+
+void DefaultDeviceInfoProvider::setAutoStorageSize(const std::string &state_path, const ContentStoreSizerConfig &config) {
+    content_store_sizer_ = std::make_shared<ContentStoreSizer>(config, state_path);
+}
+
 DeviceInfoProvider::device_info_t DefaultDeviceInfoProvider::getDeviceInfo() {
-    return device_info_;
+    DeviceInfo device_info = device_info_;
+    if (nullptr != content_store_sizer_) {
+        uint32_t stream_count = content_store_sizer_->getStreamCount();
+        if (0 != stream_count) {
+            device_info.storageInfo.storageSize = content_store_sizer_->getStorageSize();
+            device_info.streamCount = std::max(device_info.streamCount, stream_count);
+        }
+    }
+
+    return device_info;
 }
 
 const string DefaultDeviceInfoProvider::getCustomUserAgent() {
@@ -90,6 +153,18 @@ const string DefaultDeviceInfoProvider::getCertPath() {
     return cert_path_;
 }
 
+const string DefaultDeviceInfoProvider::getUploadJournalDirectory() {
+    return upload_journal_directory_;
+}
+
+const string DefaultDeviceInfoProvider::getApiCallCachePath() {
+    return api_call_cache_path_;
+}
+
+std::shared_ptr<ContentStoreSizer> DefaultDeviceInfoProvider::getContentStoreSizer() {
+    return content_store_sizer_;
+}
+
 
 } // namespace video
 } // namespace kinesis
@@ -7,17 +7,67 @@
 
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
+/**
+ * Default share of the storage size kept in RAM when the content store spills into files
+ */
+#define DEFAULT_STORAGE_SPILL_RAM_PERCENT 50
+
 class DefaultDeviceInfoProvider : public DeviceInfoProvider {
 public:
     DefaultDeviceInfoProvider(const std::string &custom_useragent = "", const std::string &cert_path = "");
+
+    /**
+     * Switches the content store to the hybrid heap which keeps the first ram_percent of the storage size
+     * in RAM and spills the allocations past it into files under the spill directory, so long outages can be
+     * buffered without holding the whole store in RAM.
+     *
+     * @param spill_directory Directory of the spill files, created if missing. Should be on persistent storage
+     *                        rather than on a RAM-backed file system such as /tmp on some distributions.
+     * @param ram_percent Share of the storage size kept in RAM, 100 disables spilling.
+     */
+    void setStorageSpill(const std::string &spill_directory, uint32_t ram_percent = DEFAULT_STORAGE_SPILL_RAM_PERCENT);
+
+    /**
+     * Journals the frames of the streams under the directory until they are persisted, see UploadJournal.
+     *
+     * @param upload_journal_directory Directory on persistent storage, created if missing. Empty disables the journal.
+     */
+    void setUploadJournalDirectory(const std::string &upload_journal_directory) {
+        upload_journal_directory_ = upload_journal_directory;
+    }
+
+    /**
+     * Caches the stream descriptions and endpoints in the file across restarts, see ApiCallCache.
+     *
+     * @param api_call_cache_path File on persistent storage, shareable between the producers of the host.
+     */
+    void setApiCallCachePath(const std::string &api_call_cache_path) {
+        api_call_cache_path_ = api_call_cache_path;
+    }
+
+    /**
+     * Sizes the content store and the stream caps from the observed stream bitrates instead of the fixed defaults.
+     * The storage size and the max stream count are taken from the state learned by the previous runs, the
+     * defaults are kept until there is any.
+     *
+     * @param state_path File the learned stream rates are kept in across the runs, empty to only learn within a run.
+     */
+    void setAutoStorageSize(const std::string &state_path = "", const ContentStoreSizerConfig &config = ContentStoreSizerConfig());
+
     device_info_t getDeviceInfo() override;
     const std::string getCustomUserAgent() override;
     const std::string getCertPath() override;
+    const std::string getUploadJournalDirectory() override;
+    const std::string getApiCallCachePath() override;
+    std::shared_ptr<ContentStoreSizer> getContentStoreSizer() override;
 protected:
 
     DeviceInfo device_info_;
     const std::string cert_path_;
     const std::string custom_useragent_;
+    std::string upload_journal_directory_;
+    std::string api_call_cache_path_;
+    std::shared_ptr<ContentStoreSizer> content_store_sizer_;
 };
 
 } // namespace video
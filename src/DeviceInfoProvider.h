@@ -1,10 +1,18 @@
 #pragma once
 
 #include "com/amazonaws/kinesis/video/client/Include.h"
+#include "ContentStoreSizer.h"
 #include <string>
+#include <chrono>
+#include <memory>
 
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
+/**
+ * Default period for the producer background metrics sampler
+ */
+#define DEFAULT_METRICS_SAMPLING_INTERVAL_IN_MILLIS 1000
+
 /**
 * Interface for the client implementation which will provide the Kinesis Video DeviceInfo struct.
 */
@@ -38,6 +46,40 @@ public:
         return "";
     }
 
+    /**
+     * Return the period at which the producer samples the client and stream metrics in the background.
+     * A zero period disables the sampler and the metrics are only retrieved on demand.
+     */
+    virtual std::chrono::milliseconds getMetricsSamplingInterval() {
+        return std::chrono::milliseconds(DEFAULT_METRICS_SAMPLING_INTERVAL_IN_MILLIS);
+    }
+
+    /**
+     * Return the directory the producer journals the frames of the streams into until they are persisted,
+     * so that they are re-uploaded in the background by the next createStream of the same stream name after a
+     * restart.
+     * An empty directory disables the journal.
+     */
+    virtual const std::string getUploadJournalDirectory() {
+        return "";
+    }
+
+    /**
+     * Return the file the stream descriptions and endpoints are cached in across restarts, see ApiCallCache.
+     * Used by the producer factories which create the DefaultCallbackProvider. An empty path disables the cache.
+     */
+    virtual const std::string getApiCallCachePath() {
+        return "";
+    }
+
+    /**
+     * Return the sizer the producer feeds with the observed stream bitrates and takes the stream caps from,
+     * or nullptr to use the caps of the stream definitions as they are.
+     */
+    virtual std::shared_ptr<ContentStoreSizer> getContentStoreSizer() {
+        return nullptr;
+    }
+
     virtual ~DeviceInfoProvider() {}
 };
 
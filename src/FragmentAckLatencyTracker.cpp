@@ -0,0 +1,89 @@
+#include "FragmentAckLatencyTracker.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+void FragmentAckLatencyTracker::frameSubmitted(const Frame& frame, steady_clock::time_point now) {
+    if (!CHECK_FRAME_FLAG_KEY_FRAME(frame.flags)) {
+        return;
+    }
+
+    PendingFragment fragment;
+    fragment.pts_ms = frame.presentationTs / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    fragment.dts_ms = frame.decodingTs / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    fragment.submitted = now;
+    fragment.buffering_recorded = false;
+    fragment.received_recorded = false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_fragments_.size() >= FRAGMENT_ACK_LATENCY_MAX_PENDING_FRAGMENTS) {
+        pending_fragments_.pop_front();
+    }
+
+    pending_fragments_.push_back(fragment);
+}
+
+void FragmentAckLatencyTracker::fragmentAckReceived(const FragmentAck& fragment_ack, steady_clock::time_point now) {
+    uint64_t timecode_ms = fragment_ack.timestamp / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_fragments_.begin();
+    while (it != pending_fragments_.end() && it->pts_ms != timecode_ms && it->dts_ms != timecode_ms) {
+        it++;
+    }
+
+    if (it == pending_fragments_.end()) {
+        return;
+    }
+
+    auto latency = duration_cast<microseconds>(now - it->submitted);
+    bool done = false;
+    switch (fragment_ack.ackType) {
+        case FRAGMENT_ACK_TYPE_BUFFERING:
+            if (!it->buffering_recorded) {
+                buffering_.record(latency);
+                it->buffering_recorded = true;
+            }
+            break;
+        case FRAGMENT_ACK_TYPE_RECEIVED:
+            if (!it->received_recorded) {
+                received_.record(latency);
+                it->received_recorded = true;
+            }
+            break;
+        case FRAGMENT_ACK_TYPE_PERSISTED:
+            persisted_.record(latency);
+            done = true;
+            break;
+        case FRAGMENT_ACK_TYPE_ERROR:
+            done = true;
+            break;
+        default:
+            return;
+    }
+
+    // The acks of the different types interleave, e.g. BUFFERING(N + 1) comes before PERSISTED(N), but the
+    // fragments are persisted in order so the older fragments won't get any more acks
+    if (done) {
+        pending_fragments_.erase(pending_fragments_.begin(), it + 1);
+    }
+}
+
+FragmentAckLatencies FragmentAckLatencyTracker::getLatencies() const {
+    FragmentAckLatencies latencies;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    latencies.buffering = buffering_.getPercentiles();
+    latencies.received = received_.getPercentiles();
+    latencies.persisted = persisted_.getPercentiles();
+
+    return latencies;
+}
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
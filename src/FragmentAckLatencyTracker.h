@@ -0,0 +1,80 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+#include "com/amazonaws/kinesis/video/client/Include.h"
+#include "LatencyHistogram.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Max number of fragments awaiting their acks. The oldest fragment stops being tracked when exceeded.
+ */
+#define FRAGMENT_ACK_LATENCY_MAX_PENDING_FRAGMENTS 256
+
+/**
+ * Latencies from putting the first frame of a fragment to the arrival of each of its acks.
+ */
+struct FragmentAckLatencies {
+    /**
+     * Until the service has started receiving the fragment
+     */
+    LatencyPercentiles buffering;
+
+    /**
+     * Until the service has received the whole fragment
+     */
+    LatencyPercentiles received;
+
+    /**
+     * Until the fragment has been persisted by the service
+     */
+    LatencyPercentiles persisted;
+};
+
+/**
+ * Correlates the fragment acks with the wall time the key frame starting the fragment has been put at.
+ *
+ * The acks carry the fragment timecode which is matched against the key frame timestamps in milliseconds,
+ * which requires the stream to use absolute fragment times.
+ */
+class FragmentAckLatencyTracker {
+public:
+    /**
+     * Tracks the fragment started by the frame if it's a key frame.
+     */
+    void frameSubmitted(const Frame& frame,
+                        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+     * Records the latency of the ack into the histogram of its type.
+     */
+    void fragmentAckReceived(const FragmentAck& fragment_ack,
+                             std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    FragmentAckLatencies getLatencies() const;
+
+private:
+    struct PendingFragment {
+        uint64_t pts_ms;
+        uint64_t dts_ms;
+        std::chrono::steady_clock::time_point submitted;
+        bool buffering_recorded;
+        bool received_recorded;
+    };
+
+    mutable std::mutex mutex_;
+    std::deque<PendingFragment> pending_fragments_;
+    LatencyHistogram buffering_;
+    LatencyHistogram received_;
+    LatencyHistogram persisted_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -0,0 +1,186 @@
+#include "Logger.h"
+#include "FrameAdmission.h"
+#include "NalAdapter.h"
+
+#include <algorithm>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+LOGGER_TAG("com.amazonaws.kinesis.video");
+
+using std::chrono::steady_clock;
+
+#define H264_NAL_TYPE_SLICE 1
+#define H264_NAL_TYPE_IDR_SLICE 5
+#define H265_NAL_TYPE_MAX_SUB_LAYER_NON_REFERENCE 14
+#define H265_NAL_TYPE_MIN_IRAP 16
+#define H265_NAL_TYPE_MAX_IRAP 23
+#define H265_NAL_TYPE_MAX_VCL 31
+
+namespace {
+    const char* const SHED_LEVEL_NAMES[] = {"none", "disposable", "GOP tail", "GOP"};
+
+    /**
+     * Calls the visitor with the header and the size of each NAL of the frame until it returns false
+     */
+    template <typename Visitor>
+    void forEachNal(bool annexb, const uint8_t* data, size_t size, Visitor visitor) {
+        const uint8_t* end = data + size;
+        if (annexb) {
+            const uint8_t* start_code = NalAdapter::findStartCode(data, end);
+            while (start_code != end) {
+                const uint8_t* nal = start_code + ANNEXB_START_CODE_SIZE;
+                start_code = NalAdapter::findStartCode(nal, end);
+                if (!visitor(nal, (size_t) (start_code - nal))) {
+                    return;
+                }
+            }
+
+            return;
+        }
+
+        const uint8_t* current = data;
+        while ((size_t) (end - current) >= AVCC_NAL_LENGTH_SIZE) {
+            size_t nal_size = ((size_t) current[0] << 24) | ((size_t) current[1] << 16) | ((size_t) current[2] << 8) | current[3];
+            current += AVCC_NAL_LENGTH_SIZE;
+            if (nal_size > (size_t) (end - current) || !visitor(current, nal_size)) {
+                return;
+            }
+
+            current += nal_size;
+        }
+    }
+}
+
+FrameAdmission::FrameAdmission(const FrameAdmissionConfig& config, OccupancySource occupancy_source)
+        : config_(config),
+          occupancy_source_(occupancy_source),
+          shed_level_(FRAME_SHED_REASON_NONE),
+          gop_shed_reason_(FRAME_SHED_REASON_NONE),
+          max_temporal_id_(0) {}
+
+FRAME_SHED_REASON FrameAdmission::admit(const Frame& frame, steady_clock::time_point now) {
+    if (frame.trackId != config_.track_id || CHECK_FRAME_FLAG_END_OF_FRAGMENT(frame.flags)) {
+        return FRAME_SHED_REASON_NONE;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (now >= occupancy_refresh_time_) {
+        updateShedLevel(occupancy_source_());
+        occupancy_refresh_time_ = now + config_.occupancy_refresh_interval;
+    }
+
+    // A GOP never depends on the frames shed from the previous one so the decision starts over at each key frame
+    if (CHECK_FRAME_FLAG_KEY_FRAME(frame.flags)) {
+        gop_shed_reason_ = FRAME_SHED_REASON_GOP == shed_level_ ? FRAME_SHED_REASON_GOP : FRAME_SHED_REASON_NONE;
+        return gop_shed_reason_;
+    }
+
+    if (FRAME_SHED_REASON_NONE != gop_shed_reason_) {
+        return gop_shed_reason_;
+    }
+
+    // Classified even without shedding to learn the temporal sub-layers of the stream
+    uint8_t temporal_id = 0;
+    FRAME_DEPENDENCY dependency = classify(config_.codec, config_.annexb, frame.frameData, frame.size, temporal_id);
+    max_temporal_id_ = std::max(max_temporal_id_, temporal_id);
+
+    if (FRAME_SHED_REASON_NONE == shed_level_) {
+        return FRAME_SHED_REASON_NONE;
+    }
+
+    // Lower sub-layer non-reference pictures might still be referenced by the higher sub-layers
+    if (FRAME_DEPENDENCY_DISPOSABLE == dependency && temporal_id >= max_temporal_id_) {
+        return FRAME_SHED_REASON_DISPOSABLE;
+    }
+
+    if (shed_level_ >= FRAME_SHED_REASON_GOP_TAIL) {
+        // The rest of the GOP might reference this frame
+        gop_shed_reason_ = FRAME_SHED_REASON_GOP_TAIL;
+        return gop_shed_reason_;
+    }
+
+    return FRAME_SHED_REASON_NONE;
+}
+
+FRAME_SHED_REASON FrameAdmission::getShedLevel() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return shed_level_;
+}
+
+void FrameAdmission::updateShedLevel(double occupancy) {
+    const double thresholds[FRAME_SHED_REASON_COUNT] = {0, config_.disposable_occupancy, config_.gop_tail_occupancy, config_.gop_occupancy};
+    int level = shed_level_;
+
+    while (level + 1 < FRAME_SHED_REASON_COUNT && occupancy >= thresholds[level + 1]) {
+        level++;
+    }
+
+    while (level > FRAME_SHED_REASON_NONE && occupancy < thresholds[level] - config_.hysteresis) {
+        level--;
+    }
+
+    if (level != shed_level_) {
+        LOG_INFO("Frame shedding for track " << config_.track_id << " changed from " << SHED_LEVEL_NAMES[shed_level_]
+                 << " to " << SHED_LEVEL_NAMES[level] << " at content store occupancy " << occupancy);
+        shed_level_ = (FRAME_SHED_REASON) level;
+    }
+}
+
+FRAME_DEPENDENCY FrameAdmission::classify(FRAME_ADMISSION_CODEC codec, bool annexb, const uint8_t* data, size_t size,
+                                          uint8_t& temporal_id) {
+    bool key = false, reference = false, vcl = false;
+    temporal_id = 0;
+
+    if (nullptr == data) {
+        return FRAME_DEPENDENCY_REFERENCE;
+    }
+
+    forEachNal(annexb, data, size, [&](const uint8_t* nal, size_t nal_size) {
+        if (FRAME_ADMISSION_CODEC_H264 == codec) {
+            if (nal_size < 1) {
+                return true;
+            }
+
+            uint8_t nal_type = nal[0] & 0x1f;
+            if (nal_type >= H264_NAL_TYPE_SLICE && nal_type <= H264_NAL_TYPE_IDR_SLICE) {
+                vcl = true;
+                key = key || H264_NAL_TYPE_IDR_SLICE == nal_type;
+                reference = reference || 0 != (nal[0] >> 5);
+            }
+        } else {
+            if (nal_size < 2) {
+                return true;
+            }
+
+            uint8_t nal_type = (nal[0] >> 1) & 0x3f;
+            if (nal_type <= H265_NAL_TYPE_MAX_VCL) {
+                vcl = true;
+                key = key || (nal_type >= H265_NAL_TYPE_MIN_IRAP && nal_type <= H265_NAL_TYPE_MAX_IRAP);
+
+                // The even types up to RSV_VCL_N14 are the sub-layer non-reference pictures
+                reference = reference || nal_type > H265_NAL_TYPE_MAX_SUB_LAYER_NON_REFERENCE || 0 != (nal_type & 1);
+
+                uint8_t temporal_id_plus1 = nal[1] & 0x07;
+                if (temporal_id_plus1 > 0) {
+                    temporal_id = std::max(temporal_id, (uint8_t) (temporal_id_plus1 - 1));
+                }
+            }
+        }
+
+        // All of the slices of a picture share the reference marking
+        return !reference;
+    });
+
+    if (key) {
+        return FRAME_DEPENDENCY_KEY;
+    }
+
+    // Frames without any recognized slice are kept as they might be needed
+    return vcl && !reference ? FRAME_DEPENDENCY_DISPOSABLE : FRAME_DEPENDENCY_REFERENCE;
+}
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -0,0 +1,172 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "com/amazonaws/kinesis/video/client/Include.h"
+#include "StreamDefinition.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Default content store occupancy from which the disposable frames are shed
+ */
+#define FRAME_ADMISSION_DEFAULT_DISPOSABLE_OCCUPANCY 0.5
+
+/**
+ * Default content store occupancy from which the inter frames are shed up to the next key frame
+ */
+#define FRAME_ADMISSION_DEFAULT_GOP_TAIL_OCCUPANCY 0.7
+
+/**
+ * Default content store occupancy from which the whole GOPs are shed
+ */
+#define FRAME_ADMISSION_DEFAULT_GOP_OCCUPANCY 0.85
+
+/**
+ * Default occupancy drop below a threshold before the shedding steps back down a level
+ */
+#define FRAME_ADMISSION_DEFAULT_HYSTERESIS 0.1
+
+/**
+ * Default interval the content store occupancy is re-read from the client at
+ */
+#define FRAME_ADMISSION_DEFAULT_OCCUPANCY_REFRESH_INTERVAL_MS 100
+
+typedef enum {
+    FRAME_ADMISSION_CODEC_H264,
+    FRAME_ADMISSION_CODEC_H265,
+} FRAME_ADMISSION_CODEC;
+
+/**
+ * Why a frame was shed. The reasons are also the shedding levels in the order they escalate.
+ */
+typedef enum {
+    FRAME_SHED_REASON_NONE,
+
+    // Non-reference frame no other frame depends on
+    FRAME_SHED_REASON_DISPOSABLE,
+
+    // Inter frame up to the next key frame, the key frames keep flowing
+    FRAME_SHED_REASON_GOP_TAIL,
+
+    // Any frame of a GOP shed from its key frame on
+    FRAME_SHED_REASON_GOP,
+
+    FRAME_SHED_REASON_COUNT,
+} FRAME_SHED_REASON;
+
+/**
+ * What the frame payload is needed for by the other frames of the GOP.
+ */
+typedef enum {
+    FRAME_DEPENDENCY_KEY,
+    FRAME_DEPENDENCY_REFERENCE,
+    FRAME_DEPENDENCY_DISPOSABLE,
+} FRAME_DEPENDENCY;
+
+struct FrameAdmissionConfig {
+    FrameAdmissionConfig()
+            : track_id(DEFAULT_TRACK_ID),
+              codec(FRAME_ADMISSION_CODEC_H264),
+              annexb(false),
+              disposable_occupancy(FRAME_ADMISSION_DEFAULT_DISPOSABLE_OCCUPANCY),
+              gop_tail_occupancy(FRAME_ADMISSION_DEFAULT_GOP_TAIL_OCCUPANCY),
+              gop_occupancy(FRAME_ADMISSION_DEFAULT_GOP_OCCUPANCY),
+              hysteresis(FRAME_ADMISSION_DEFAULT_HYSTERESIS),
+              occupancy_refresh_interval(FRAME_ADMISSION_DEFAULT_OCCUPANCY_REFRESH_INTERVAL_MS) {}
+
+    /**
+     * Video track the frames are shed from, the frames of the other tracks are always admitted
+     */
+    uint64_t track_id;
+
+    FRAME_ADMISSION_CODEC codec;
+
+    /**
+     * Whether the frames are Annex-B byte-stream rather than 4 byte length-prefixed NALs
+     */
+    bool annexb;
+
+    double disposable_occupancy;
+    double gop_tail_occupancy;
+    double gop_occupancy;
+    double hysteresis;
+    std::chrono::milliseconds occupancy_refresh_interval;
+};
+
+/**
+ * Admission stage in front of the client which sheds the cheapest frames of a video track first as the
+ * content store fills up, instead of leaving it to the client to evict the tail of the buffer.
+ *
+ * As the occupancy rises the stage escalates from the disposable frames (H.264 nal_ref_idc of 0, H.265
+ * sub-layer non-reference pictures of the highest temporal sub-layer) to the inter frames up to the next
+ * key frame and finally to whole GOPs. Shedding never leaves a frame behind whose reference was shed: once
+ * a reference frame is shed, the rest of its GOP is shed too. The key frames are only shed in the last level
+ * together with their GOP.
+ *
+ * Thread-safe.
+ */
+class FrameAdmission {
+public:
+    /**
+     * Returns the content store occupancy in the range of [0, 1].
+     */
+    using OccupancySource = std::function<double()>;
+
+    FrameAdmission(const FrameAdmissionConfig& config, OccupancySource occupancy_source);
+
+    const FrameAdmissionConfig& getConfig() const {
+        return config_;
+    }
+
+    /**
+     * Decides whether the frame is put or shed.
+     *
+     * @return FRAME_SHED_REASON_NONE if the frame is admitted or why it is shed.
+     */
+    FRAME_SHED_REASON admit(const Frame& frame,
+                            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+     * @return The current shedding level.
+     */
+    FRAME_SHED_REASON getShedLevel() const;
+
+    /**
+     * Classifies a video frame by the headers of its VCL NALs.
+     *
+     * @param temporal_id Receives the highest H.265 temporal ID of the frame, 0 for H.264.
+     * @return The dependency of the frame. Frames which can't be parsed are classified as reference frames.
+     */
+    static FRAME_DEPENDENCY classify(FRAME_ADMISSION_CODEC codec, bool annexb, const uint8_t* data, size_t size,
+                                     uint8_t& temporal_id);
+
+private:
+    void updateShedLevel(double occupancy);
+
+    const FrameAdmissionConfig config_;
+    const OccupancySource occupancy_source_;
+    mutable std::mutex mutex_;
+    FRAME_SHED_REASON shed_level_;
+    std::chrono::steady_clock::time_point occupancy_refresh_time_;
+
+    /**
+     * Reason the frames are shed for up to the next key frame, a shed reference breaks the rest of the GOP
+     */
+    FRAME_SHED_REASON gop_shed_reason_;
+
+    /**
+     * Highest H.265 temporal ID seen, only the non-reference pictures of this sub-layer are disposable
+     */
+    uint8_t max_temporal_id_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
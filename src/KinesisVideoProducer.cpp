@@ -9,6 +9,15 @@ using std::shared_ptr;
 using std::stringstream;
 using std::unique_ptr;
 
+namespace {
+    void setApiCallCache(DefaultCallbackProvider& callback_provider, DeviceInfoProvider& device_info_provider) {
+        const std::string api_call_cache_path = device_info_provider.getApiCallCachePath();
+        if (!api_call_cache_path.empty()) {
+            callback_provider.setApiCallCache(std::make_shared<ApiCallCache>(api_call_cache_path));
+        }
+    }
+}
+
 unique_ptr<KinesisVideoProducer> KinesisVideoProducer::create(
         unique_ptr<DeviceInfoProvider> device_info_provider,
         unique_ptr<ClientCallbackProvider> client_callback_provider,
@@ -29,6 +38,7 @@ unique_ptr<KinesisVideoProducer> KinesisVideoProducer::create(
             false,
             DEFAULT_ENDPOINT_CACHE_UPDATE_PERIOD));
 
+    setApiCallCache(*callback_provider, *device_info_provider);
     return KinesisVideoProducer::create(std::move(device_info_provider), std::move(callback_provider));
 }
 
@@ -53,6 +63,15 @@ unique_ptr<KinesisVideoProducer> KinesisVideoProducer::create(
 
     kinesis_video_producer->client_handle_ = client_handle;
     kinesis_video_producer->callback_provider_ = std::move(callback_provider);
+    kinesis_video_producer->content_store_sizer_ = device_info_provider->getContentStoreSizer();
+    kinesis_video_producer->content_store_size_ = device_info.storageInfo.storageSize;
+    kinesis_video_producer->observeStreamEvents();
+    kinesis_video_producer->startMetricsSampler(device_info_provider->getMetricsSamplingInterval());
+    kinesis_video_producer->upload_journal_directory_ = device_info_provider->getUploadJournalDirectory();
+    kinesis_video_producer->device_info_ = device_info;
+    // The tags are owned by the device info provider
+    kinesis_video_producer->device_info_.tagCount = 0;
+    kinesis_video_producer->device_info_.tags = nullptr;
 
     return kinesis_video_producer;
 }
@@ -79,6 +98,7 @@ unique_ptr<KinesisVideoProducer> KinesisVideoProducer::createSync(
             is_caching_endpoint,
             caching_update_period));
 
+    setApiCallCache(*callback_provider, *device_info_provider);
     return KinesisVideoProducer::createSync(std::move(device_info_provider), std::move(callback_provider));
 }
 
@@ -104,6 +124,7 @@ unique_ptr<KinesisVideoProducer> KinesisVideoProducer::createSync(
             api_call_caching,
             caching_update_period));
 
+    setApiCallCache(*callback_provider, *device_info_provider);
     return KinesisVideoProducer::createSync(std::move(device_info_provider), std::move(callback_provider));
 }
 
@@ -128,6 +149,15 @@ unique_ptr<KinesisVideoProducer> KinesisVideoProducer::createSync(
 
     kinesis_video_producer->client_handle_ = client_handle;
     kinesis_video_producer->callback_provider_ = std::move(callback_provider);
+    kinesis_video_producer->content_store_sizer_ = device_info_provider->getContentStoreSizer();
+    kinesis_video_producer->content_store_size_ = device_info.storageInfo.storageSize;
+    kinesis_video_producer->observeStreamEvents();
+    kinesis_video_producer->startMetricsSampler(device_info_provider->getMetricsSamplingInterval());
+    kinesis_video_producer->upload_journal_directory_ = device_info_provider->getUploadJournalDirectory();
+    kinesis_video_producer->device_info_ = device_info;
+    // The tags are owned by the device info provider
+    kinesis_video_producer->device_info_.tagCount = 0;
+    kinesis_video_producer->device_info_.tags = nullptr;
 
     return kinesis_video_producer;
 }
@@ -138,8 +168,17 @@ shared_ptr<KinesisVideoStream> KinesisVideoProducer::createStream(unique_ptr<Str
     if (stream_definition->getTrackCount() > MAX_SUPPORTED_TRACK_COUNT_PER_STREAM) {
         LOG_AND_THROW("Exceeded maximum track count: " + std::to_string(MAX_SUPPORTED_TRACK_COUNT_PER_STREAM));
     }
+    std::unique_ptr<UploadJournal> upload_journal;
+    if (!upload_journal_directory_.empty()) {
+        upload_journal.reset(new UploadJournal(upload_journal_directory_, stream_definition->getStreamName()));
+    }
+
     StreamInfo stream_info = stream_definition->getStreamInfo();
-    std::shared_ptr<KinesisVideoStream> kinesis_video_stream(new KinesisVideoStream(*this, stream_definition->getStreamName()), KinesisVideoStream::videoStreamDeleter);
+    if (nullptr != content_store_sizer_) {
+        sizeStream(stream_definition->getStreamName(), stream_info);
+    }
+
+    std::shared_ptr<KinesisVideoStream> kinesis_video_stream(new KinesisVideoStream(*this, stream_definition->getStreamName(), stream_info.streamCaps.trackInfoCount), KinesisVideoStream::videoStreamDeleter);
     STATUS status = createKinesisVideoStream(client_handle_, &stream_info, kinesis_video_stream->getStreamHandle());
 
     if (STATUS_FAILED(status)) {
@@ -149,9 +188,20 @@ shared_ptr<KinesisVideoStream> KinesisVideoProducer::createStream(unique_ptr<Str
                   " Error status: 0x" + status_strstrm.str());
     }
 
+    // A generation above zero means the journal has been left over by a previous stream of the name
+    uint64_t recovered_generation = 0;
+    if (nullptr != upload_journal) {
+        recovered_generation = upload_journal->getGeneration();
+        attachUploadJournal(*kinesis_video_stream, stream_info, std::move(upload_journal));
+    }
+
     // Add to the map
     active_streams_.put(*kinesis_video_stream->getStreamHandle(), kinesis_video_stream);
 
+    if (0 != recovered_generation) {
+        startUploadJournalRecovery(std::move(stream_definition), recovered_generation);
+    }
+
     return kinesis_video_stream;
 }
 
@@ -162,8 +212,17 @@ shared_ptr<KinesisVideoStream> KinesisVideoProducer::createStreamSync(unique_ptr
     if (stream_definition->getTrackCount() > MAX_SUPPORTED_TRACK_COUNT_PER_STREAM) {
         LOG_AND_THROW("Exceeded maximum track count: " + std::to_string(MAX_SUPPORTED_TRACK_COUNT_PER_STREAM));
     }
+    std::unique_ptr<UploadJournal> upload_journal;
+    if (!upload_journal_directory_.empty()) {
+        upload_journal.reset(new UploadJournal(upload_journal_directory_, stream_definition->getStreamName()));
+    }
+
     StreamInfo stream_info = stream_definition->getStreamInfo();
-    std::shared_ptr<KinesisVideoStream> kinesis_video_stream(new KinesisVideoStream(*this, stream_definition->getStreamName()), KinesisVideoStream::videoStreamDeleter);
+    if (nullptr != content_store_sizer_) {
+        sizeStream(stream_definition->getStreamName(), stream_info);
+    }
+
+    std::shared_ptr<KinesisVideoStream> kinesis_video_stream(new KinesisVideoStream(*this, stream_definition->getStreamName(), stream_info.streamCaps.trackInfoCount), KinesisVideoStream::videoStreamDeleter);
     STATUS status = createKinesisVideoStreamSync(client_handle_, &stream_info, kinesis_video_stream->getStreamHandle());
 
     if (STATUS_FAILED(status)) {
@@ -173,12 +232,224 @@ shared_ptr<KinesisVideoStream> KinesisVideoProducer::createStreamSync(unique_ptr
                   " Error status: 0x" + status_strstrm.str());
     }
 
+    // A generation above zero means the journal has been left over by a previous stream of the name
+    uint64_t recovered_generation = 0;
+    if (nullptr != upload_journal) {
+        recovered_generation = upload_journal->getGeneration();
+        attachUploadJournal(*kinesis_video_stream, stream_info, std::move(upload_journal));
+    }
+
     // Add to the map
     active_streams_.put(*kinesis_video_stream->getStreamHandle(), kinesis_video_stream);
 
+    if (0 != recovered_generation) {
+        startUploadJournalRecovery(std::move(stream_definition), recovered_generation);
+    }
+
     return kinesis_video_stream;
 }
 
+std::future<shared_ptr<KinesisVideoStream>> KinesisVideoProducer::createStreamAsync(unique_ptr<StreamDefinition> stream_definition) {
+    std::vector<unique_ptr<StreamDefinition>> stream_definitions;
+    stream_definitions.push_back(std::move(stream_definition));
+
+    return std::move(createStreams(std::move(stream_definitions), 1).front());
+}
+
+std::vector<std::future<shared_ptr<KinesisVideoStream>>> KinesisVideoProducer::createStreams(
+        std::vector<unique_ptr<StreamDefinition>> stream_definitions,
+        size_t max_in_flight) {
+    struct StreamCreation {
+        unique_ptr<StreamDefinition> stream_definition;
+        std::promise<shared_ptr<KinesisVideoStream>> promise;
+    };
+
+    // Shared with the workers which might outlive the call
+    auto creations = std::make_shared<std::vector<StreamCreation>>(stream_definitions.size());
+    auto next_creation = std::make_shared<std::atomic<size_t>>(0);
+    std::vector<std::future<shared_ptr<KinesisVideoStream>>> streams;
+
+    for (size_t i = 0; i < stream_definitions.size(); i++) {
+        assert(stream_definitions[i].get());
+        (*creations)[i].stream_definition = std::move(stream_definitions[i]);
+        streams.push_back((*creations)[i].promise.get_future());
+    }
+
+    // Each worker keeps picking up the next stream until all have been created
+    size_t worker_count = std::min(std::max<size_t>(max_in_flight, 1), creations->size());
+    for (size_t i = 0; i < worker_count; i++) {
+        startStreamCreationWorker([this, creations, next_creation]() {
+            size_t index;
+            while ((index = next_creation->fetch_add(1)) < creations->size()) {
+                StreamCreation& creation = (*creations)[index];
+                try {
+                    creation.promise.set_value(createStreamSync(std::move(creation.stream_definition)));
+                } catch (...) {
+                    creation.promise.set_exception(std::current_exception());
+                }
+            }
+        });
+    }
+
+    return streams;
+}
+
+void KinesisVideoProducer::startStreamCreationWorker(std::function<void()> work) {
+    std::lock_guard<std::mutex> lock(stream_creation_mutex_);
+
+    // Reap the workers which have finished
+    for (auto it = stream_creation_workers_.begin(); it != stream_creation_workers_.end();) {
+        if (it->done->load()) {
+            it->thread.join();
+            it = stream_creation_workers_.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    StreamCreationWorker worker;
+    worker.done = std::make_shared<std::atomic<bool>>(false);
+    auto done = worker.done;
+    worker.thread = std::thread([work, done]() {
+        work();
+        done->store(true);
+    });
+
+    stream_creation_workers_.push_back(std::move(worker));
+}
+
+void KinesisVideoProducer::joinStreamCreationWorkers() {
+    std::vector<StreamCreationWorker> workers;
+    {
+        std::lock_guard<std::mutex> lock(stream_creation_mutex_);
+        workers.swap(stream_creation_workers_);
+    }
+
+    for (auto& worker : workers) {
+        worker.thread.join();
+    }
+}
+
+void KinesisVideoProducer::startUploadJournalRecovery(unique_ptr<StreamDefinition> stream_definition, uint64_t generation) {
+    const std::string stream_name = stream_definition->getStreamName();
+    {
+        // The stream created next picks up what's left of a journal being recovered
+        std::lock_guard<std::mutex> lock(stream_creation_mutex_);
+        if (!recovering_streams_.insert(stream_name).second) {
+            return;
+        }
+    }
+
+    // The definition outlives the call for the stream info of the recovery stream
+    shared_ptr<StreamDefinition> definition(std::move(stream_definition));
+    startStreamCreationWorker([this, definition, generation, stream_name]() {
+        recoverUploadJournal(*definition, generation);
+
+        std::lock_guard<std::mutex> lock(stream_creation_mutex_);
+        recovering_streams_.erase(stream_name);
+    });
+}
+
+void KinesisVideoProducer::recoverUploadJournal(StreamDefinition& stream_definition, uint64_t generation) {
+    const std::string stream_name = stream_definition.getStreamName();
+
+    // The recovered fragments are older than anything the live stream will put so they go through their own stream
+    StreamInfo stream_info = stream_definition.getStreamInfo();
+    stream_info.streamCaps.streamingType = STREAMING_TYPE_OFFLINE;
+
+    // The client rejects a second stream with the name of the live one so the recovery stream gets a client of
+    // its own. The offline stream waits for the space in its smaller content store instead of dropping frames.
+    DeviceInfo device_info = device_info_;
+    device_info.streamCount = 1;
+    device_info.storageInfo.storageSize = std::min<UINT64>(device_info.storageInfo.storageSize, UPLOAD_JOURNAL_RECOVERY_STORAGE_SIZE);
+    CLIENT_HANDLE recovery_client = INVALID_CLIENT_HANDLE_VALUE;
+
+    std::shared_ptr<KinesisVideoStream> recovery_stream;
+    STATUS status = STATUS_SUCCESS;
+    auto start_time = std::chrono::steady_clock::now();
+
+    auto recovery = UploadJournal::recover(upload_journal_directory_, stream_name, [&](const UploadJournalRecord& record) {
+        if (upload_journal_recovery_stop_.load()) {
+            return false;
+        }
+
+        if (nullptr == recovery_stream) {
+            auto callbacks = callback_provider_->getCallbacks();
+            if (STATUS_FAILED(status = createKinesisVideoClientSync(&device_info, &callbacks, &recovery_client))) {
+                return false;
+            }
+
+            recovery_stream.reset(new KinesisVideoStream(*this, stream_name, stream_info.streamCaps.trackInfoCount), KinesisVideoStream::videoStreamDeleter);
+            if (STATUS_FAILED(status = createKinesisVideoStreamSync(recovery_client, &stream_info, recovery_stream->getStreamHandle()))) {
+                return false;
+            }
+
+            active_streams_.put(*recovery_stream->getStreamHandle(), recovery_stream);
+        }
+
+        if (UPLOAD_JOURNAL_RECORD_CODEC_PRIVATE_DATA == record.type) {
+            status = kinesisVideoStreamFormatChanged(recovery_stream->stream_handle_, record.size, (PBYTE) record.data, record.track_id);
+        } else {
+            Frame frame = record.frame;
+            status = recovery_stream->statusPutFrame(frame);
+        }
+
+        return STATUS_SUCCEEDED(status);
+    }, generation);
+
+    if (nullptr != recovery_stream) {
+        bool recovered = recovery.complete && recovery_stream->stopSync();
+        if (INVALID_STREAM_HANDLE_VALUE != recovery_stream->stream_handle_) {
+            freeStream(recovery_stream);
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+        if (!recovered) {
+            // The journal is kept for the next attempt
+            LOG_ERROR("Failed to re-upload the upload journal of " << stream_name << " with: 0x" << std::hex << status);
+        } else {
+            LOG_INFO("Re-uploaded " << std::dec << recovery.frame_count << " journaled frames (" << recovery.byte_count
+                     << " bytes) of " << stream_name << " in " << elapsed.count() << " ms");
+            UploadJournal::discard(upload_journal_directory_, stream_name, generation);
+        }
+    } else if (STATUS_FAILED(status)) {
+        LOG_ERROR("Failed to create the client re-uploading the upload journal of " << stream_name << " with: 0x" << std::hex << status);
+    } else if (recovery.complete && recovery.segment_count > 0) {
+        // Nothing left to re-upload
+        UploadJournal::discard(upload_journal_directory_, stream_name, generation);
+    }
+
+    if (INVALID_CLIENT_HANDLE_VALUE != recovery_client) {
+        ::freeKinesisVideoClient(&recovery_client);
+    }
+}
+
+void KinesisVideoProducer::sizeStream(const std::string& stream_name, StreamInfo& stream_info) {
+    ContentStoreStreamRate rate;
+    rate.bitrate_bps = stream_info.streamCaps.avgBandwidthBps;
+    rate.frame_rate = stream_info.streamCaps.frameRate;
+    rate.buffer_duration = std::chrono::milliseconds(stream_info.streamCaps.bufferDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+    content_store_sizer_->streamCreated(stream_name, rate);
+
+    if (content_store_sizer_->getStreamRate(stream_name, rate)) {
+        stream_info.streamCaps.avgBandwidthBps = (UINT32) std::min<uint64_t>(rate.bitrate_bps, MAX_UINT32);
+        stream_info.streamCaps.frameRate = rate.frame_rate;
+        LOG_INFO("Stream " << stream_name << " caps sized at " << rate.bitrate_bps << " bps and " << rate.frame_rate << " fps");
+    }
+}
+
+void KinesisVideoProducer::attachUploadJournal(KinesisVideoStream& kinesis_video_stream, const StreamInfo& stream_info,
+                                               std::unique_ptr<UploadJournal> upload_journal) {
+    for (UINT32 i = 0; i < stream_info.streamCaps.trackInfoCount; i++) {
+        const TrackInfo& track_info = stream_info.streamCaps.trackInfoList[i];
+        if (nullptr != track_info.codecPrivateData && 0 != track_info.codecPrivateDataSize) {
+            upload_journal->appendCodecPrivateData(track_info.trackId, track_info.codecPrivateData, track_info.codecPrivateDataSize);
+        }
+    }
+
+    kinesis_video_stream.upload_journal_ = std::move(upload_journal);
+}
+
 void KinesisVideoProducer::freeStream(std::shared_ptr<KinesisVideoStream> kinesis_video_stream) {
     if (nullptr == kinesis_video_stream) {
         LOG_AND_THROW("Kinesis Video stream can't be null");
@@ -200,10 +471,8 @@ void KinesisVideoProducer::freeStream(std::shared_ptr<KinesisVideoStream> kinesi
 void KinesisVideoProducer::freeStreams() {
     {
         std::lock_guard<std::mutex> lock(free_client_mutex_);
-        auto num_streams = active_streams_.getMap().size();
 
-        for (auto i = 0; i < num_streams; i++) {
-            auto stream = active_streams_.getAt(0);
+        for (auto& stream : active_streams_.snapshot()) {
             try {
                 freeStream(stream);
                 LOG_INFO("Completed freeing stream " << stream->stream_name_);
@@ -216,6 +485,18 @@ void KinesisVideoProducer::freeStreams() {
 }
 
 KinesisVideoProducer::~KinesisVideoProducer() {
+    // Stop sampling before tearing down the streams and the client
+    stopMetricsSampler();
+
+    // Let the in-flight stream creations and the journal recoveries settle so that they don't race the teardown,
+    // the recoveries stop at the next journal record and keep the rest for the next run
+    upload_journal_recovery_stop_ = true;
+    joinStreamCreationWorkers();
+
+    if (nullptr != content_store_sizer_) {
+        content_store_sizer_->save();
+    }
+
     // Free the streams
     freeStreams();
 
@@ -230,6 +511,115 @@ KinesisVideoProducerMetrics KinesisVideoProducer::getMetrics() const {
     return client_metrics_;
 }
 
+KinesisVideoProducerMetrics KinesisVideoProducer::getLatestMetrics() const {
+    KinesisVideoProducerMetrics metrics;
+    if (!client_metrics_snapshot_.read(metrics)) {
+        metrics = getMetrics();
+    }
+
+    return metrics;
+}
+
+void KinesisVideoProducer::startMetricsSampler(std::chrono::milliseconds interval) {
+    if (interval.count() <= 0) {
+        LOG_INFO("Background metrics sampling is disabled");
+        return;
+    }
+
+    metrics_sampler_thread_ = std::thread([this, interval]() {
+        std::unique_lock<std::mutex> lock(metrics_sampler_mutex_);
+        while (!metrics_sampler_cv_.wait_for(lock, interval, [this]() { return metrics_sampler_stop_; })) {
+            // Sample without the lock so neither the client nor the exporter hold up a stop or an exporter change
+            auto metrics_exporter = metrics_exporter_;
+            lock.unlock();
+            sampleMetrics(metrics_exporter);
+            lock.lock();
+        }
+    });
+}
+
+void KinesisVideoProducer::observeStreamEvents() {
+    callback_provider_->setFragmentAckObserver([this](STREAM_HANDLE stream_handle, const FragmentAck& fragment_ack) {
+        auto stream = active_streams_.get(stream_handle);
+        if (nullptr != stream) {
+            stream->fragmentAckReceived(fragment_ack);
+        }
+    });
+
+    callback_provider_->setDroppedFrameObserver([this](STREAM_HANDLE stream_handle, UINT64 timecode) {
+        UNUSED_PARAM(timecode);
+        auto stream = active_streams_.get(stream_handle);
+        if (nullptr != stream) {
+            stream->frameDropped();
+        }
+    });
+
+    callback_provider_->setDroppedFragmentObserver([this](STREAM_HANDLE stream_handle, UINT64 timecode) {
+        UNUSED_PARAM(timecode);
+        auto stream = active_streams_.get(stream_handle);
+        if (nullptr != stream) {
+            stream->fragmentDropped();
+        }
+    });
+}
+
+void KinesisVideoProducer::stopMetricsSampler() {
+    {
+        std::lock_guard<std::mutex> lock(metrics_sampler_mutex_);
+        metrics_sampler_stop_ = true;
+    }
+
+    metrics_sampler_cv_.notify_all();
+    if (metrics_sampler_thread_.joinable()) {
+        metrics_sampler_thread_.join();
+    }
+}
+
+void KinesisVideoProducer::sampleMetrics(std::shared_ptr<MetricsExporter> metrics_exporter) {
+    KinesisVideoProducerMetrics client_metrics;
+    STATUS status = ::getKinesisVideoMetrics(client_handle_, (PClientMetrics) client_metrics.getRawMetrics());
+    if (STATUS_FAILED(status)) {
+        LOG_WARN("Failed to sample producer client metrics with: 0x" << std::hex << status);
+        return;
+    }
+
+    client_metrics_snapshot_.publish(client_metrics);
+
+    MetricsSample metrics_sample;
+    for (auto& stream : active_streams_.snapshot()) {
+        stream->sampleMetrics(client_metrics);
+        if (nullptr != metrics_exporter) {
+            metrics_sample.stream_metrics.emplace_back(stream->getStreamName(), stream->getLatestMetrics());
+        }
+
+        if (nullptr != content_store_sizer_) {
+            content_store_sizer_->sample(stream->getStreamName(), stream->getCounters());
+        }
+    }
+
+    // The client can't resize its content store so a new size takes effect on the next start of the producer
+    uint64_t storage_size;
+    if (nullptr != content_store_sizer_ && content_store_sizer_->update(storage_size) && storage_size != content_store_size_) {
+        if (storage_size > content_store_size_) {
+            LOG_WARN("Observed stream bitrates need a " << storage_size << " byte content store while " << content_store_size_
+                     << " bytes are allocated, frames might get dropped until the producer is restarted");
+        } else {
+            LOG_INFO("Observed stream bitrates need a " << storage_size << " byte content store while " << content_store_size_
+                     << " bytes are allocated");
+        }
+    }
+
+    if (nullptr != metrics_exporter) {
+        metrics_sample.client_metrics = client_metrics;
+        metrics_exporter->exportMetrics(metrics_sample);
+    }
+}
+
+void KinesisVideoProducer::setMetricsExporter(std::shared_ptr<MetricsExporter> metrics_exporter) {
+    std::lock_guard<std::mutex> lock(metrics_sampler_mutex_);
+    metrics_exporter_ = metrics_exporter;
+}
+
 } // namespace video
 } // namespace kinesis
 } // namespace amazonaws
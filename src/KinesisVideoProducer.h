@@ -1,206 +1,407 @@
-/** Copyright 2017 Amazon.com. All rights reserved. */
-
-#pragma once
-
-#include "KinesisVideoStream.h"
-#include "CallbackProvider.h"
-#include "ClientCallbackProvider.h"
-#include "StreamCallbackProvider.h"
-#include "DefaultCallbackProvider.h"
-#include "DefaultDeviceInfoProvider.h"
-#include "DeviceInfoProvider.h"
-#include "StreamDefinition.h"
-#include "Auth.h"
-#include "KinesisVideoProducerMetrics.h"
-
-#include <cstring>
-
-#include <memory>
-#include <mutex>
-#include <iostream>
-
-#include "com/amazonaws/kinesis/video/cproducer/Include.h"
-
-#include "com/amazonaws/kinesis/video/client/Include.h"
-
-namespace com { namespace amazonaws { namespace kinesis { namespace video {
-
-/**
- * Client ready timeout duration.
- **/
-#define CLIENT_READY_TIMEOUT_DURATION_IN_SECONDS 15
-
-/**
- * Stream ready timeout duration.
- **/
-#define STREAM_READY_TIMEOUT_DURATION_IN_SECONDS 30
-
-/**
- * Default time in millis to await for the client callback to finish before proceeding with unlocking
- * We will add extra 10 milliseconds to account for thread scheduling to ensure the callback is complete.
- */
-#define CLIENT_STREAM_CLOSED_CALLBACK_AWAIT_TIME_MILLIS (10 + TIMEOUT_AFTER_STREAM_STOPPED + TIMEOUT_WAIT_FOR_CURL_BUFFER)
-#define CONTROL_PLANE_URI_ENV_VAR ((PCHAR) "CONTROL_PLANE_URI")
-/**
-* Kinesis Video client interface for real time streaming. The structure of this class is that each instance of type <T,U>
-* is a singleton where T is the implementation of the DeviceInfoProvider interface and U is the implementation of the
-* CallbackProvider interface. The reason for using the singleton is that Kinesis Video client has logic that benefits
-* throughput and network congestion avoidance by sharing state across multiple streams. We balance this benefit with
-* flexibility in the implementation of the application logic that provide the device information and Kinesis Video
-* user-implemented application callbacks. The division by type allows for easy migrations to new callback
-* implementations, such as different network thread implementations or different handling of latency pressure by the
-* application without perturbing the existing system.
-*
-* Example Usage:
-* @code:
-* auto client(KinesisVideoClient<DeviceInfoProviderImpl, CallbackProviderImpl>::getInstance());
-* @endcode
-*
-*/
-class KinesisVideoStream;
-class KinesisVideoProducer {
-public:
-    static std::unique_ptr<KinesisVideoProducer> create(
-            std::unique_ptr<DeviceInfoProvider> device_info_provider,
-            std::unique_ptr<ClientCallbackProvider> client_callback_provider,
-            std::unique_ptr<StreamCallbackProvider> stream_callback_provider,
-            std::unique_ptr<CredentialProvider> credential_provider,
-            const std::string &region = DEFAULT_AWS_REGION,
-            const std::string &control_plane_uri = "",
-            const std::string &user_agent_name = DEFAULT_USER_AGENT_NAME);
-
-    static std::unique_ptr<KinesisVideoProducer> create(
-            std::unique_ptr<DeviceInfoProvider> device_info_provider,
-            std::unique_ptr<CallbackProvider> callback_provider);
-
-    static std::unique_ptr<KinesisVideoProducer> createSync(
-            std::unique_ptr<DeviceInfoProvider> device_info_provider,
-            std::unique_ptr<ClientCallbackProvider> client_callback_provider,
-            std::unique_ptr<StreamCallbackProvider> stream_callback_provider,
-            std::unique_ptr<CredentialProvider> credential_provider,
-            const std::string &region = DEFAULT_AWS_REGION,
-            const std::string &control_plane_uri = "",
-            const std::string &user_agent_name = DEFAULT_USER_AGENT_NAME,
-            bool is_caching_endpoint = false,
-            uint64_t caching_update_period = DEFAULT_ENDPOINT_CACHE_UPDATE_PERIOD);
-
-    static std::unique_ptr<KinesisVideoProducer> createSync(
-            std::unique_ptr<DeviceInfoProvider> device_info_provider,
-            std::unique_ptr<ClientCallbackProvider> client_callback_provider,
-            std::unique_ptr<StreamCallbackProvider> stream_callback_provider,
-            std::unique_ptr<CredentialProvider> credential_provider,
-            API_CALL_CACHE_TYPE api_call_caching = API_CALL_CACHE_TYPE_ALL,
-            const std::string &region = DEFAULT_AWS_REGION,
-            const std::string &control_plane_uri = "",
-            const std::string &user_agent_name = DEFAULT_USER_AGENT_NAME,
-            uint64_t caching_update_period = DEFAULT_ENDPOINT_CACHE_UPDATE_PERIOD);
-
-    static std::unique_ptr<KinesisVideoProducer> createSync(
-            std::unique_ptr<DeviceInfoProvider> device_info_provider,
-            std::unique_ptr<CallbackProvider> callback_provider);
-
-    virtual ~KinesisVideoProducer();
-
-    /**
-     * Factory method for creating streams to Kinesis Video PIC. The full stream configuration is passed through the
-     * stream_definition object which is then used to initialize an KinesisVideoStream instance and return it to the caller.
-     *
-     * @param stream_definition A shared pointer to the StreamDefinition which describes the
-     *                          stream to be created.
-     * @return An KinesisVideoStream instance which is ready to start streaming.
-     */
-    std::shared_ptr<KinesisVideoStream> createStream(std::unique_ptr<StreamDefinition> stream_definition);
-
-    /**
-     * Synchronous version of the createStream
-     * @param stream_definition A unique pointer to the StreamDefinition which describes the
-     *                          stream to be created.
-     * @return An KinesisVideoStream instance which is ready to start streaming.
-     */
-    std::shared_ptr<KinesisVideoStream> createStreamSync(std::unique_ptr<StreamDefinition> stream_definition);
-
-    /**
-     * Frees the stream and removes it from the producer stream list.
-     *
-     * NOTE: This is a prompt operation and will stop the stream immediately without
-     * emptying the buffer.
-     *
-     * @param KinesisVideo_stream A unique pointer to the KinesisVideoStream to free and remove.
-     */
-    void freeStream(std::shared_ptr<KinesisVideoStream> kinesis_video_stream);
-
-    /**
-     * Stops and frees the active streams
-     */
-    void freeStreams();
-
-    /**
-     * Gets the client metrics.
-     *
-     * @return producer metrics object to be filled with the current metrics data.
-     */
-    KinesisVideoProducerMetrics getMetrics() const;
-
-    /**
-     * Returns the raw client handle
-     */
-    CLIENT_HANDLE getClientHandle() const {
-        return client_handle_;
-    }
-
-protected:
-
-    /**
-     * Frees the resources in the underlying Kinesis Video client.
-     */
-    void freeKinesisVideoClient() {
-        if (nullptr != callback_provider_) {
-            callback_provider_->shutdown();
-        }
-
-        std::call_once(free_kinesis_video_client_flag_, ::freeKinesisVideoClient, &client_handle_);
-    }
-
-    /**
-     * Initializes an empty class. The real initialization happens through the static functions.
-     */
-    KinesisVideoProducer() : client_handle_(INVALID_CLIENT_HANDLE_VALUE) {
-    }
-
-    /**
-     * pointer to the initialized client, stored as a integer value.
-     */
-    CLIENT_HANDLE client_handle_;
-
-    /**
-     * Flag used to ensure idempotency of freeKinesisVideoClient().
-     */
-    std::once_flag free_kinesis_video_client_flag_;
-
-    /**
-     * Used in a lock for freeing streams
-     */
-    std::mutex free_client_mutex_;
-
-    /**
-     * We keep the reference to callback_provider_ as a field variable
-     * to ensure its lifetime is the lifetime of the client because the API
-     * is a C only library and doesn't know about managed pointers.
-     */
-    std::unique_ptr<CallbackProvider> callback_provider_;
-
-    /**
-     * Client metrics
-     */
-    KinesisVideoProducerMetrics client_metrics_;
-
-    /**
-     * Map of the handle to stream object
-     */
-    ThreadSafeMap<STREAM_HANDLE, std::shared_ptr<KinesisVideoStream>> active_streams_;
-};
-
-} // namespace video
-} // namespace kinesis
-} // namespace amazonaws
-} // namespace com
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include "KinesisVideoStream.h"
+#include "CallbackProvider.h"
+#include "ClientCallbackProvider.h"
+#include "StreamCallbackProvider.h"
+#include "DefaultCallbackProvider.h"
+#include "DefaultDeviceInfoProvider.h"
+#include "DeviceInfoProvider.h"
+#include "StreamDefinition.h"
+#include "Auth.h"
+#include "KinesisVideoProducerMetrics.h"
+#include "SnapshotBuffer.h"
+#include "MetricsExporter.h"
+#include "UploadJournal.h"
+
+#include <cstring>
+
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <thread>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <set>
+#include <vector>
+
+#include "com/amazonaws/kinesis/video/cproducer/Include.h"
+
+#include "com/amazonaws/kinesis/video/client/Include.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Client ready timeout duration.
+ **/
+#define CLIENT_READY_TIMEOUT_DURATION_IN_SECONDS 15
+
+/**
+ * Stream ready timeout duration.
+ **/
+#define STREAM_READY_TIMEOUT_DURATION_IN_SECONDS 30
+
+/**
+ * Default time in millis to await for the client callback to finish before proceeding with unlocking
+ * We will add extra 10 milliseconds to account for thread scheduling to ensure the callback is complete.
+ */
+#define CLIENT_STREAM_CLOSED_CALLBACK_AWAIT_TIME_MILLIS (10 + TIMEOUT_AFTER_STREAM_STOPPED + TIMEOUT_WAIT_FOR_CURL_BUFFER)
+#define CONTROL_PLANE_URI_ENV_VAR ((PCHAR) "CONTROL_PLANE_URI")
+
+/**
+ * Default max number of streams createStreams() brings up concurrently.
+ */
+#define DEFAULT_STREAM_CREATION_MAX_IN_FLIGHT 8
+
+/**
+ * Max content store size of the client re-uploading an upload journal, capped by the device storage size.
+ */
+#define UPLOAD_JOURNAL_RECOVERY_STORAGE_SIZE (32 * 1024 * 1024)
+
+/**
+* Kinesis Video client interface for real time streaming. The structure of this class is that each instance of type <T,U>
+* is a singleton where T is the implementation of the DeviceInfoProvider interface and U is the implementation of the
+* CallbackProvider interface. The reason for using the singleton is that Kinesis Video client has logic that benefits
+* throughput and network congestion avoidance by sharing state across multiple streams. We balance this benefit with
+* flexibility in the implementation of the application logic that provide the device information and Kinesis Video
+* user-implemented application callbacks. The division by type allows for easy migrations to new callback
+* implementations, such as different network thread implementations or different handling of latency pressure by the
+* application without perturbing the existing system.
+*
+* Example Usage:
+* @code:
+* auto client(KinesisVideoClient<DeviceInfoProviderImpl, CallbackProviderImpl>::getInstance());
+* @endcode
+*
+*/
+class KinesisVideoStream;
+class KinesisVideoProducer {
+public:
+    static std::unique_ptr<KinesisVideoProducer> create(
+            std::unique_ptr<DeviceInfoProvider> device_info_provider,
+            std::unique_ptr<ClientCallbackProvider> client_callback_provider,
+            std::unique_ptr<StreamCallbackProvider> stream_callback_provider,
+            std::unique_ptr<CredentialProvider> credential_provider,
+            const std::string &region = DEFAULT_AWS_REGION,
+            const std::string &control_plane_uri = "",
+            const std::string &user_agent_name = DEFAULT_USER_AGENT_NAME);
+
+    static std::unique_ptr<KinesisVideoProducer> create(
+            std::unique_ptr<DeviceInfoProvider> device_info_provider,
+            std::unique_ptr<CallbackProvider> callback_provider);
+
+    static std::unique_ptr<KinesisVideoProducer> createSync(
+            std::unique_ptr<DeviceInfoProvider> device_info_provider,
+            std::unique_ptr<ClientCallbackProvider> client_callback_provider,
+            std::unique_ptr<StreamCallbackProvider> stream_callback_provider,
+            std::unique_ptr<CredentialProvider> credential_provider,
+            const std::string &region = DEFAULT_AWS_REGION,
+            const std::string &control_plane_uri = "",
+            const std::string &user_agent_name = DEFAULT_USER_AGENT_NAME,
+            bool is_caching_endpoint = false,
+            uint64_t caching_update_period = DEFAULT_ENDPOINT_CACHE_UPDATE_PERIOD);
+
+    static std::unique_ptr<KinesisVideoProducer> createSync(
+            std::unique_ptr<DeviceInfoProvider> device_info_provider,
+            std::unique_ptr<ClientCallbackProvider> client_callback_provider,
+            std::unique_ptr<StreamCallbackProvider> stream_callback_provider,
+            std::unique_ptr<CredentialProvider> credential_provider,
+            API_CALL_CACHE_TYPE api_call_caching = API_CALL_CACHE_TYPE_ALL,
+            const std::string &region = DEFAULT_AWS_REGION,
+            const std::string &control_plane_uri = "",
+            const std::string &user_agent_name = DEFAULT_USER_AGENT_NAME,
+            uint64_t caching_update_period = DEFAULT_ENDPOINT_CACHE_UPDATE_PERIOD);
+
+    static std::unique_ptr<KinesisVideoProducer> createSync(
+            std::unique_ptr<DeviceInfoProvider> device_info_provider,
+            std::unique_ptr<CallbackProvider> callback_provider);
+
+    virtual ~KinesisVideoProducer();
+
+    /**
+     * Factory method for creating streams to Kinesis Video PIC. The full stream configuration is passed through the
+     * stream_definition object which is then used to initialize an KinesisVideoStream instance and return it to the caller.
+     *
+     * With an upload journal directory set in the device info provider, the frames journaled but not persisted
+     * by a previous stream of the same name are re-uploaded in the background, see UploadJournal.
+     *
+     * @param stream_definition A shared pointer to the StreamDefinition which describes the
+     *                          stream to be created.
+     * @return An KinesisVideoStream instance which is ready to start streaming.
+     */
+    std::shared_ptr<KinesisVideoStream> createStream(std::unique_ptr<StreamDefinition> stream_definition);
+
+    /**
+     * Synchronous version of the createStream
+     * @param stream_definition A unique pointer to the StreamDefinition which describes the
+     *                          stream to be created.
+     * @return An KinesisVideoStream instance which is ready to start streaming.
+     */
+    std::shared_ptr<KinesisVideoStream> createStreamSync(std::unique_ptr<StreamDefinition> stream_definition);
+
+    /**
+     * Asynchronous version of the createStreamSync which doesn't block the caller on the control plane calls.
+     *
+     * @param stream_definition A unique pointer to the StreamDefinition which describes the
+     *                          stream to be created.
+     * @return A future which yields the stream ready to start streaming or rethrows the creation error.
+     */
+    std::future<std::shared_ptr<KinesisVideoStream>> createStreamAsync(std::unique_ptr<StreamDefinition> stream_definition);
+
+    /**
+     * Brings up multiple streams running their control plane calls concurrently. Returns immediately.
+     *
+     * @param stream_definitions The StreamDefinitions which describe the streams to be created.
+     * @param max_in_flight Max number of streams being created at the same time.
+     * @return A future per stream definition, in the same order, which yields the stream ready
+     *         to start streaming or rethrows the creation error.
+     */
+    std::vector<std::future<std::shared_ptr<KinesisVideoStream>>> createStreams(
+            std::vector<std::unique_ptr<StreamDefinition>> stream_definitions,
+            size_t max_in_flight = DEFAULT_STREAM_CREATION_MAX_IN_FLIGHT);
+
+    /**
+     * Frees the stream and removes it from the producer stream list.
+     *
+     * NOTE: This is a prompt operation and will stop the stream immediately without
+     * emptying the buffer.
+     *
+     * @param KinesisVideo_stream A unique pointer to the KinesisVideoStream to free and remove.
+     */
+    void freeStream(std::shared_ptr<KinesisVideoStream> kinesis_video_stream);
+
+    /**
+     * Stops and frees the active streams
+     */
+    void freeStreams();
+
+    /**
+     * Gets the client metrics.
+     *
+     * @return producer metrics object to be filled with the current metrics data.
+     */
+    KinesisVideoProducerMetrics getMetrics() const;
+
+    /**
+     * Returns the latest client metrics published by the background sampler without
+     * calling into the client. Falls back to getMetrics() if nothing has been sampled yet.
+     *
+     * @return Client metrics object filled with the latest sampled metrics data.
+     */
+    KinesisVideoProducerMetrics getLatestMetrics() const;
+
+    /**
+     * Sets the exporter the background metrics sampler hands every client and stream metrics sample to.
+     * The exporter never calls into the client so exporting adds no client lock contention.
+     *
+     * NOTE: Requires a non-zero metrics sampling interval in the device info provider.
+     *
+     * @param metrics_exporter Exporter or nullptr to stop exporting.
+     */
+    void setMetricsExporter(std::shared_ptr<MetricsExporter> metrics_exporter);
+
+    /**
+     * Returns the raw client handle
+     */
+    CLIENT_HANDLE getClientHandle() const {
+        return client_handle_;
+    }
+
+protected:
+
+    /**
+     * Frees the resources in the underlying Kinesis Video client.
+     */
+    void freeKinesisVideoClient() {
+        if (nullptr != callback_provider_) {
+            callback_provider_->shutdown();
+        }
+
+        std::call_once(free_kinesis_video_client_flag_, ::freeKinesisVideoClient, &client_handle_);
+    }
+
+    /**
+     * Re-uploads the journal generations of the stream below the generation of the created stream on a worker
+     * thread, unless the journal of the stream is being recovered already.
+     */
+    void startUploadJournalRecovery(std::unique_ptr<StreamDefinition> stream_definition, uint64_t generation);
+
+    /**
+     * Re-uploads the frames the journal generations below the generation hold from a previous run through an
+     * offline stream of the same name on a client of its own, then discards them.
+     *
+     * NOTE: Blocks until the recovered frames have been uploaded.
+     */
+    void recoverUploadJournal(StreamDefinition& stream_definition, uint64_t generation);
+
+    /**
+     * Hands the journal to the created stream along with the codec private data of its tracks.
+     */
+    void attachUploadJournal(KinesisVideoStream& kinesis_video_stream, const StreamInfo& stream_info,
+                             std::unique_ptr<UploadJournal> upload_journal);
+
+    /**
+     * Registers the stream with the content store sizer and replaces the bandwidth and frame rate caps
+     * with the learned ones.
+     */
+    void sizeStream(const std::string& stream_name, StreamInfo& stream_info);
+
+    /**
+     * Starts the background metrics sampler thread. No-op for a zero interval.
+     */
+    void startMetricsSampler(std::chrono::milliseconds interval);
+
+    /**
+     * Routes the fragment acks, the dropped frames and the dropped fragments reported by the callback provider
+     * to the active streams for the stream metrics.
+     */
+    void observeStreamEvents();
+
+    /**
+     * Stops and joins the background metrics sampler thread.
+     */
+    void stopMetricsSampler();
+
+    /**
+     * Samples the client and the active stream metrics and publishes the snapshots.
+     *
+     * @param metrics_exporter Exporter to hand the sample to, can be nullptr.
+     */
+    void sampleMetrics(std::shared_ptr<MetricsExporter> metrics_exporter);
+
+    /**
+     * Runs the work, a stream creation or a journal recovery, on a worker thread owned by the producer.
+     */
+    void startStreamCreationWorker(std::function<void()> work);
+
+    /**
+     * Awaits for the outstanding stream creations to finish.
+     */
+    void joinStreamCreationWorkers();
+
+    /**
+     * Initializes an empty class. The real initialization happens through the static functions.
+     */
+    KinesisVideoProducer() : client_handle_(INVALID_CLIENT_HANDLE_VALUE), metrics_sampler_stop_(false),
+                             upload_journal_recovery_stop_(false), content_store_size_(0) {
+    }
+
+    /**
+     * pointer to the initialized client, stored as a integer value.
+     */
+    CLIENT_HANDLE client_handle_;
+
+    /**
+     * Flag used to ensure idempotency of freeKinesisVideoClient().
+     */
+    std::once_flag free_kinesis_video_client_flag_;
+
+    /**
+     * Used in a lock for freeing streams
+     */
+    std::mutex free_client_mutex_;
+
+    /**
+     * We keep the reference to callback_provider_ as a field variable
+     * to ensure its lifetime is the lifetime of the client because the API
+     * is a C only library and doesn't know about managed pointers.
+     */
+    std::unique_ptr<CallbackProvider> callback_provider_;
+
+    /**
+     * Client metrics
+     */
+    KinesisVideoProducerMetrics client_metrics_;
+
+    /**
+     * Latest client metrics published by the background sampler
+     */
+    SnapshotBuffer<KinesisVideoProducerMetrics> client_metrics_snapshot_;
+
+    /**
+     * Background metrics sampler thread
+     */
+    std::thread metrics_sampler_thread_;
+
+    /**
+     * Guards the sampler stop flag and the metrics exporter
+     */
+    std::mutex metrics_sampler_mutex_;
+
+    /**
+     * Used to wake up the sampler on stop
+     */
+    std::condition_variable metrics_sampler_cv_;
+
+    /**
+     * Whether the sampler has been requested to stop
+     */
+    bool metrics_sampler_stop_;
+
+    /**
+     * Receives the metrics samples, guarded by the metrics_sampler_mutex_
+     */
+    std::shared_ptr<MetricsExporter> metrics_exporter_;
+
+    /**
+     * Stream creation worker thread along with its completion flag
+     */
+    struct StreamCreationWorker {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    /**
+     * Outstanding stream creation workers
+     */
+    std::vector<StreamCreationWorker> stream_creation_workers_;
+
+    /**
+     * Guards the stream creation workers
+     */
+    std::mutex stream_creation_mutex_;
+
+    /**
+     * Directory of the stream upload journals, empty if disabled
+     */
+    std::string upload_journal_directory_;
+
+    /**
+     * Names of the streams whose journal is being recovered, guarded by the stream_creation_mutex_
+     */
+    std::set<std::string> recovering_streams_;
+
+    /**
+     * Whether the journal recoveries have been requested to stop
+     */
+    std::atomic<bool> upload_journal_recovery_stop_;
+
+    /**
+     * Device info the client has been created with, without the tags. Creates the journal recovery clients.
+     */
+    DeviceInfo device_info_;
+
+    /**
+     * Learns the stream rates from the sampled counters, null if the caps are used as they are
+     */
+    std::shared_ptr<ContentStoreSizer> content_store_sizer_;
+
+    /**
+     * Size of the content store the client has been created with
+     */
+    uint64_t content_store_size_;
+
+    /**
+     * Map of the handle to stream object
+     */
+    ConcurrentRegistry<STREAM_HANDLE, std::shared_ptr<KinesisVideoStream>> active_streams_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -6,9 +6,10 @@ namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
 LOGGER_TAG("com.amazonaws.kinesis.video");
 
-KinesisVideoStream::KinesisVideoStream(const KinesisVideoProducer& kinesis_video_producer, const std::string stream_name)
+KinesisVideoStream::KinesisVideoStream(const KinesisVideoProducer& kinesis_video_producer, const std::string stream_name, uint32_t track_count)
         : stream_handle_(INVALID_STREAM_HANDLE_VALUE),
           stream_name_(stream_name),
+          track_count_(track_count),
           kinesis_video_producer_(kinesis_video_producer),
           debug_dump_frame_info_(false) {
     LOG_INFO("Creating Kinesis Video Stream " << stream_name_);
@@ -35,44 +36,80 @@ STATUS KinesisVideoStream::statusPutFrame(KinesisVideoFrame& frame) const {
                           << ", isKey: " << CHECK_FRAME_FLAG_KEY_FRAME(frame.flags));
     }
 
+    if (nullptr != frame_admission_) {
+        FRAME_SHED_REASON shed_reason = frame_admission_->admit(frame);
+        if (FRAME_SHED_REASON_NONE != shed_reason) {
+            counters_.frameShed(frame, shed_reason);
+            return STATUS_SUCCESS;
+        }
+    }
+
     assert(0 != stream_handle_);
     STATUS status = putKinesisVideoFrame(stream_handle_, &frame);
     if (STATUS_FAILED(status)) {
         LOG_ERROR("Put frame for " << this->stream_name_ << " failed with 0x" << std::hex << status);
-        return status;
-    }
-
-    // Print metrics on every key-frame
-    // TODO: this will create too much spam in case of audio
-    if (CHECK_FRAME_FLAG_KEY_FRAME(frame.flags)) {
-        // Extract metrics and print out
-        try {
-            auto stream_metrics = getMetrics();
-            auto client_metrics = kinesis_video_producer_.getMetrics();
-            auto total_transfer_tate = 8 * client_metrics.getTotalTransferRate();
-            auto transfer_rate = 8 * stream_metrics.getCurrentTransferRate();
-
-            LOG_DEBUG("Kinesis Video client and stream metrics for "
-                              << this->stream_name_
-                              << "\n\t>> Overall storage byte size: " << client_metrics.getContentStoreSizeSize()
-                              << "\n\t>> Available storage byte size: " << client_metrics.getContentStoreAvailableSize()
-                              << "\n\t>> Allocated storage byte size: " << client_metrics.getContentStoreAllocatedSize()
-                              << "\n\t>> Total view allocation byte size: " << client_metrics.getTotalContentViewsSize()
-                              << "\n\t>> Total streams elementary frame rate (fps): " << client_metrics.getTotalElementaryFrameRate()
-                              << "\n\t>> Total streams transfer rate (bps): " <<  total_transfer_tate << " (" << total_transfer_tate / 1024 << " Kbps)"
-                              << "\n\t>> Current view duration (ms): " << stream_metrics.getCurrentViewDuration().count()
-                              << "\n\t>> Overall view duration (ms): " << stream_metrics.getOverallViewDuration().count()
-                              << "\n\t>> Current view byte size: " << stream_metrics.getCurrentViewSize()
-                              << "\n\t>> Overall view byte size: " << stream_metrics.getOverallViewSize()
-                              << "\n\t>> Current elementary frame rate (fps): " << stream_metrics.getCurrentElementaryFrameRate()
-                              << "\n\t>> Current transfer rate (bps): " << transfer_rate << " (" << transfer_rate / 1024 << " Kbps)");
-        } catch (std::runtime_error &err) {
-            LOG_ERROR("Failed to get metrics. Error: " << err.what());
-        }
+        counters_.putFrameFailed(status);
+    } else if (!CHECK_FRAME_FLAG_END_OF_FRAGMENT(frame.flags)) {
+        counters_.framePut(frame);
+        fragment_ack_latency_tracker_.frameSubmitted(frame);
     }
+
+    if (STATUS_SUCCEEDED(status) && nullptr != upload_journal_) {
+        upload_journal_->appendFrame(frame);
+    }
+
     return status;
 }
 
+STATUS KinesisVideoStream::putFrameChunks(KinesisVideoFrame& frame,
+                                          const KinesisVideoFrameChunk* chunks,
+                                          size_t chunk_count) const {
+    if (nullptr == chunks && 0 != chunk_count) {
+        return STATUS_NULL_ARG;
+    }
+
+    if (1 == chunk_count) {
+        frame.frameData = const_cast<PBYTE>(chunks[0].data);
+        frame.size = static_cast<UINT32>(chunks[0].size);
+        return statusPutFrame(frame);
+    }
+
+    size_t size = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        size += chunks[i].size;
+    }
+
+    if (size > MAX_UINT32) {
+        return STATUS_INVALID_ARG;
+    }
+
+    // The client copies the payload while packaging so the staging buffer is only needed for the call
+    auto buffer = frame_gather_pool_.acquire(static_cast<uint32_t>(size));
+    size_t offset = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        MEMCPY(buffer.data() + offset, chunks[i].data, chunks[i].size);
+        offset += chunks[i].size;
+    }
+
+    frame.frameData = buffer.data();
+    frame.size = static_cast<UINT32>(size);
+    return statusPutFrame(frame);
+}
+
+void KinesisVideoStream::setFrameAdmission(const FrameAdmissionConfig& config) {
+    auto& producer = kinesis_video_producer_;
+    frame_admission_.reset(new FrameAdmission(config, [&producer]() {
+        // Read from the client at the refresh interval, the sampled metrics are only as fresh as the sampling interval
+        KinesisVideoProducerMetrics client_metrics;
+        if (STATUS_FAILED(::getKinesisVideoMetrics(producer.getClientHandle(), (PClientMetrics) client_metrics.getRawMetrics())) ||
+            0 == client_metrics.getContentStoreSizeSize()) {
+            return 0.0;
+        }
+
+        return 1.0 - (double) client_metrics.getContentStoreAvailableSize() / client_metrics.getContentStoreSizeSize();
+    }));
+}
+
 bool KinesisVideoStream::start(const std::string& hexEncodedCodecPrivateData, uint64_t trackId) {
     // Hex-decode the string
     const char* pStrCpd = hexEncodedCodecPrivateData.c_str();
@@ -116,10 +153,31 @@ bool KinesisVideoStream::start(const unsigned char* codecPrivateData, size_t cod
         return false;
     }
 
+    if (nullptr != upload_journal_) {
+        upload_journal_->appendCodecPrivateData(trackId, codecPrivateData, (uint32_t) codecPrivateDataSize);
+    }
+
     // Call the start after setting the CPD
     return start();
 }
 
+bool KinesisVideoStream::updateCodecPrivateData(const unsigned char* codecPrivateData, size_t codecPrivateDataSize, uint64_t trackId) {
+    STATUS status;
+
+    if (STATUS_FAILED(status = kinesisVideoStreamFormatChanged(stream_handle_, (UINT32) codecPrivateDataSize,
+                                                               (PBYTE) codecPrivateData, (UINT64) trackId))) {
+        LOG_WARN("Codec private data update rejected with: 0x" << std::hex << status << " for stream name: " << this->stream_name_);
+        return false;
+    }
+
+    if (nullptr != upload_journal_) {
+        upload_journal_->appendCodecPrivateData(trackId, codecPrivateData, (uint32_t) codecPrivateDataSize);
+    }
+
+    LOG_INFO("Updated the codec private data for track " << trackId << " of stream name: " << this->stream_name_);
+    return true;
+}
+
 bool KinesisVideoStream::start() {
     // No-op for now
 
@@ -152,6 +210,7 @@ void KinesisVideoStream::free() {
     LOG_INFO("Freeing Kinesis Video Stream for " << this->stream_name_);
 
     // Free the underlying stream
+    std::lock_guard<std::mutex> lock(free_mutex_);
     std::call_once(free_kinesis_video_stream_flag_, freeKinesisVideoStream, getStreamHandle());
 }
 
@@ -180,7 +239,78 @@ KinesisVideoStreamMetrics KinesisVideoStream::getMetrics() const {
     STATUS status = ::getKinesisVideoStreamMetrics(stream_handle_, (PStreamMetrics) stream_metrics_.getRawMetrics());
     LOG_AND_THROW_IF(STATUS_FAILED(status), "Failed to get stream metrics with: 0x" << std::hex << status << " for stream name: " << this->stream_name_);
 
-    return stream_metrics_;
+    KinesisVideoStreamMetrics stream_metrics = stream_metrics_;
+    stream_metrics.setFragmentAckLatencies(fragment_ack_latency_tracker_.getLatencies());
+    stream_metrics.setCounters(counters_.snapshot());
+    return stream_metrics;
+}
+
+KinesisVideoStreamMetrics KinesisVideoStream::getLatestMetrics() const {
+    KinesisVideoStreamMetrics metrics;
+    if (!stream_metrics_snapshot_.read(metrics)) {
+        metrics = getMetrics();
+    }
+
+    return metrics;
+}
+
+void KinesisVideoStream::sampleMetrics(const KinesisVideoProducerMetrics& client_metrics) {
+    KinesisVideoStreamMetrics stream_metrics;
+    STATUS status;
+
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+
+        // The stream might have been freed already
+        if (INVALID_STREAM_HANDLE_VALUE == stream_handle_) {
+            return;
+        }
+
+        status = ::getKinesisVideoStreamMetrics(stream_handle_, (PStreamMetrics) stream_metrics.getRawMetrics());
+    }
+
+    if (STATUS_FAILED(status)) {
+        LOG_WARN("Failed to sample stream metrics with: 0x" << std::hex << status << " for stream name: " << this->stream_name_);
+        return;
+    }
+
+    stream_metrics.setFragmentAckLatencies(fragment_ack_latency_tracker_.getLatencies());
+    stream_metrics.setCounters(counters_.snapshot());
+    stream_metrics_snapshot_.publish(stream_metrics);
+
+    if (LOG_IS_DEBUG_ENABLED) {
+        auto total_transfer_rate = 8 * client_metrics.getTotalTransferRate();
+        auto transfer_rate = 8 * stream_metrics.getCurrentTransferRate();
+        auto& ack_latencies = stream_metrics.getFragmentAckLatencies();
+
+        LOG_DEBUG("Kinesis Video client and stream metrics for "
+                          << this->stream_name_
+                          << "\n\t>> Overall storage byte size: " << client_metrics.getContentStoreSizeSize()
+                          << "\n\t>> Available storage byte size: " << client_metrics.getContentStoreAvailableSize()
+                          << "\n\t>> Allocated storage byte size: " << client_metrics.getContentStoreAllocatedSize()
+                          << "\n\t>> Total view allocation byte size: " << client_metrics.getTotalContentViewsSize()
+                          << "\n\t>> Total streams elementary frame rate (fps): " << client_metrics.getTotalElementaryFrameRate()
+                          << "\n\t>> Total streams transfer rate (bps): " <<  total_transfer_rate << " (" << total_transfer_rate / 1024 << " Kbps)"
+                          << "\n\t>> Current view duration (ms): " << stream_metrics.getCurrentViewDuration().count()
+                          << "\n\t>> Overall view duration (ms): " << stream_metrics.getOverallViewDuration().count()
+                          << "\n\t>> Current view byte size: " << stream_metrics.getCurrentViewSize()
+                          << "\n\t>> Overall view byte size: " << stream_metrics.getOverallViewSize()
+                          << "\n\t>> Current elementary frame rate (fps): " << stream_metrics.getCurrentElementaryFrameRate()
+                          << "\n\t>> Current transfer rate (bps): " << transfer_rate << " (" << transfer_rate / 1024 << " Kbps)"
+                          << "\n\t>> Buffering ack latency p50/p99/max (ms): " << ack_latencies.buffering.p50.count() / 1000
+                          << "/" << ack_latencies.buffering.p99.count() / 1000 << "/" << ack_latencies.buffering.max.count() / 1000
+                          << "\n\t>> Received ack latency p50/p99/max (ms): " << ack_latencies.received.p50.count() / 1000
+                          << "/" << ack_latencies.received.p99.count() / 1000 << "/" << ack_latencies.received.max.count() / 1000
+                          << "\n\t>> Persisted ack latency p50/p99/max (ms): " << ack_latencies.persisted.p50.count() / 1000
+                          << "/" << ack_latencies.persisted.p99.count() / 1000 << "/" << ack_latencies.persisted.max.count() / 1000);
+    }
+}
+
+void KinesisVideoStream::fragmentAckReceived(const FragmentAck& fragment_ack) {
+    fragment_ack_latency_tracker_.fragmentAckReceived(fragment_ack);
+    if (nullptr != upload_journal_) {
+        upload_journal_->fragmentAckReceived(fragment_ack);
+    }
 }
 
 bool KinesisVideoStream::putFragmentMetadata(const std::string &name, const std::string &value, bool persistent) {
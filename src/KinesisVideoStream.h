@@ -9,7 +9,14 @@
 
 #include "KinesisVideoProducer.h"
 #include "KinesisVideoStreamMetrics.h"
+#include "KinesisVideoProducerMetrics.h"
+#include "SnapshotBuffer.h"
 #include "StreamDefinition.h"
+#include "FrameBufferPool.h"
+#include "FragmentAckLatencyTracker.h"
+#include "StreamCounters.h"
+#include "FrameAdmission.h"
+#include "UploadJournal.h"
 
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
@@ -26,6 +33,14 @@ namespace com { namespace amazonaws { namespace kinesis { namespace video {
 */
 using KinesisVideoFrame = ::Frame;
 
+/**
+* A contiguous piece of the frame data for the frames which are held in several memory chunks.
+*/
+struct KinesisVideoFrameChunk {
+    const uint8_t* data;
+    size_t size;
+};
+
 /**
 * KinesisVideoStream is responsible for streaming any type of data into KinesisVideo service
 *
@@ -65,11 +80,28 @@ public:
     /**
      * Does putFrame, but returns a STATUS rather than a failure/success bool.
      *
+     * A frame shed by the frame admission is not put and returns STATUS_SUCCESS, it is counted
+     * in the stream counters instead.
+     *
      * @param frame The frame to be packaged and streamed.
      * @return STATUS of the putKinesisVideoFrame call.
      */
     STATUS statusPutFrame(KinesisVideoFrame& frame) const;
 
+    /**
+     * Packages and streams a frame whose data is held in several memory chunks without the caller
+     * having to flatten them first.
+     *
+     * A single chunk is packaged in place. Multiple chunks are gathered into a pooled staging buffer
+     * which is recycled as soon as the frame has been packaged into the content store.
+     *
+     * @param frame The frame to be packaged and streamed. The frame data and size are set from the chunks.
+     * @param chunks Array of the frame data chunks in order.
+     * @param chunk_count Number of chunks in the array.
+     * @return STATUS of the putKinesisVideoFrame call.
+     */
+    STATUS putFrameChunks(KinesisVideoFrame& frame, const KinesisVideoFrameChunk* chunks, size_t chunk_count) const;
+
     /**
      * Gets the stream metrics.
      *
@@ -77,6 +109,24 @@ public:
      */
     KinesisVideoStreamMetrics getMetrics() const;
 
+    /**
+     * Gets the latest stream metrics published by the producer background sampler without
+     * calling into the client. Falls back to getMetrics() if nothing has been sampled yet.
+     *
+     * @return Stream metrics object filled with the latest sampled metrics data.
+     */
+    KinesisVideoStreamMetrics getLatestMetrics() const;
+
+    /**
+     * Reads the frame, byte, failure and drop counters of the stream. Never calls into the client
+     * so it can be polled at any rate without contending with the putFrame callers.
+     *
+     * @return The current counter values.
+     */
+    StreamCountersSnapshot getCounters() const {
+        return counters_.snapshot();
+    }
+
     /**
      * Appends a "metadata" - a key/value string pair into the stream.
      *
@@ -120,6 +170,21 @@ public:
      */
     bool start();
 
+    /**
+     * Replaces the binary codec private data of the track identified by trackId after start().
+     * The PIC only accepts the change until the first frame is put. Returns false once the stream is
+     * streaming, the stream then has to be freed and created again with the new codec private data.
+     */
+    bool updateCodecPrivateData(const unsigned char* codecPrivateData, size_t codecPrivateDataSize, uint64_t trackId = DEFAULT_TRACK_ID);
+
+    /**
+     * Enables shedding the frames of a video track as the content store fills up, before the client has to
+     * evict the buffered ones. The shed frames are counted by the reason in the stream counters.
+     *
+     * NOTE: Must be called before the frames are put.
+     */
+    void setFrameAdmission(const FrameAdmissionConfig& config);
+
     /**
      * Pulses the current upload stream. This will effectively inject a stream termination event into the stream
      * causing it to re-set the upload stream and re-acquire a new connection.
@@ -160,7 +225,8 @@ public:
     KinesisVideoStream(const KinesisVideoStream &rhs)
             : stream_handle_(rhs.stream_handle_),
               kinesis_video_producer_(rhs.kinesis_video_producer_),
-              stream_name_(rhs.stream_name_) {}
+              stream_name_(rhs.stream_name_),
+              track_count_(rhs.track_count_) {}
 
     std::string getStreamName() {
         return stream_name_;
@@ -170,11 +236,18 @@ public:
         return kinesis_video_producer_;
     }
 
+    /**
+     * @return Number of tracks the stream was created with.
+     */
+    uint32_t getTrackCount() const {
+        return track_count_;
+    }
+
 protected:
     /**
      * Non-public constructor as streams should be only created by the producer client
      */
-    KinesisVideoStream(const KinesisVideoProducer& kinesis_video_producer, const std::string stream_name);
+    KinesisVideoStream(const KinesisVideoProducer& kinesis_video_producer, const std::string stream_name, uint32_t track_count);
 
     /**
      * Non-public destructor as the streams should be de-allocated by the producer client
@@ -188,6 +261,32 @@ protected:
         delete kinesis_video_stream;
     }
 
+    /**
+     * Samples the stream metrics, publishes the snapshot and dumps it to the debug log.
+     * Called from the producer background metrics sampler.
+     */
+    void sampleMetrics(const KinesisVideoProducerMetrics& client_metrics);
+
+    /**
+     * Records the ack latency of the fragment and retires the persisted fragments from the upload journal.
+     * Called by the producer for the acks of this stream.
+     */
+    void fragmentAckReceived(const FragmentAck& fragment_ack);
+
+    /**
+     * Counts a frame dropped by the client. Called by the producer for the dropped frames of this stream.
+     */
+    void frameDropped() {
+        counters_.frameDropped();
+    }
+
+    /**
+     * Counts a fragment dropped by the client. Called by the producer for the dropped fragments of this stream.
+     */
+    void fragmentDropped() {
+        counters_.fragmentDropped();
+    }
+
     /**
      * Stops the the stream immediately and frees the resources.
      * Consecutive calls will fail.
@@ -209,11 +308,21 @@ protected:
      */
     const std::string stream_name_;
 
+    /**
+     * Number of tracks in the stream
+     */
+    const uint32_t track_count_;
+
     /**
      * Flag used to ensure idempotency of freeKinesisVideoStream().
      */
     std::once_flag free_kinesis_video_stream_flag_;
 
+    /**
+     * Serializes freeing the stream with the metrics sampler reading it
+     */
+    std::mutex free_mutex_;
+
     /**
      * Whether the stream is closed
      */
@@ -224,10 +333,40 @@ protected:
      */
     KinesisVideoStreamMetrics stream_metrics_;
 
+    /**
+     * Latest stream metrics published by the producer background sampler
+     */
+    SnapshotBuffer<KinesisVideoStreamMetrics> stream_metrics_snapshot_;
+
     /**
      * Whether to dump frame info into file.
      */
     bool debug_dump_frame_info_;
+
+    /**
+     * Staging buffers for gathering the chunked frames
+     */
+    mutable FrameBufferPool frame_gather_pool_;
+
+    /**
+     * Correlates the fragment acks with the submission of the fragments
+     */
+    mutable FragmentAckLatencyTracker fragment_ack_latency_tracker_;
+
+    /**
+     * Hot path counters readable without calling into the client
+     */
+    mutable StreamCounters counters_;
+
+    /**
+     * Sheds the frames under the content store pressure, null unless enabled
+     */
+    std::unique_ptr<FrameAdmission> frame_admission_;
+
+    /**
+     * Journals the frames until persisted, null unless the producer has an upload journal directory
+     */
+    std::unique_ptr<UploadJournal> upload_journal_;
 };
 
 } // namespace video
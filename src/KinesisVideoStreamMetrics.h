@@ -3,6 +3,8 @@
 #pragma once
 
 #include "com/amazonaws/kinesis/video/client/Include.h"
+#include "FragmentAckLatencyTracker.h"
+#include "StreamCounters.h"
 
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
@@ -70,6 +72,35 @@ public:
         return stream_metrics_.currentTransferRate;
     }
 
+    /**
+     * Returns the latencies from putting the first frame of a fragment to the arrival of its acks
+     */
+    const FragmentAckLatencies& getFragmentAckLatencies() const {
+        return fragment_ack_latencies_;
+    }
+
+    void setFragmentAckLatencies(const FragmentAckLatencies& fragment_ack_latencies) {
+        fragment_ack_latencies_ = fragment_ack_latencies;
+    }
+
+    /**
+     * Returns the number of the frames dropped by the client
+     */
+    uint64_t getDroppedFrames() const {
+        return counters_.dropped_frames;
+    }
+
+    /**
+     * Returns the stream counters at the time the metrics were taken
+     */
+    const StreamCountersSnapshot& getCounters() const {
+        return counters_;
+    }
+
+    void setCounters(const StreamCountersSnapshot& counters) {
+        counters_ = counters;
+    }
+
     const ::StreamMetrics* getRawMetrics() const {
         return &stream_metrics_;
     }
@@ -79,6 +110,16 @@ private:
      * Underlying metrics object
      */
     ::StreamMetrics stream_metrics_;
+
+    /**
+     * Fragment ack latencies tracked by the stream
+     */
+    FragmentAckLatencies fragment_ack_latencies_;
+
+    /**
+     * Stream counters
+     */
+    StreamCountersSnapshot counters_;
 };
 
 } // namespace video
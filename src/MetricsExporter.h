@@ -0,0 +1,45 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "KinesisVideoProducerMetrics.h"
+#include "KinesisVideoStreamMetrics.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Client and stream metrics taken in a single sampling pass of the producer.
+ */
+struct MetricsSample {
+    KinesisVideoProducerMetrics client_metrics;
+
+    /**
+     * Stream name along with the stream metrics for each of the active streams
+     */
+    std::vector<std::pair<std::string, KinesisVideoStreamMetrics>> stream_metrics;
+};
+
+/**
+ * Pluggable sink for the producer metrics.
+ *
+ * The producer background metrics sampler hands every sample to the exporter right after taking it,
+ * so the exporter never has to call into the client itself. Requires a non-zero metrics sampling interval.
+ */
+class MetricsExporter {
+public:
+    /**
+     * Called on the metrics sampler thread. Must not block for long as it delays the next sample.
+     */
+    virtual void exportMetrics(const MetricsSample& metrics_sample) = 0;
+
+    virtual ~MetricsExporter() {}
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -0,0 +1,350 @@
+#include "Logger.h"
+#include "OpenMetricsExporter.h"
+
+#include <cstring>
+#include <sstream>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define CLOSE_SOCKET closesocket
+#define POLL_SOCKETS WSAPoll
+typedef SOCKET socket_t;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define CLOSE_SOCKET close
+#define POLL_SOCKETS poll
+typedef int socket_t;
+#endif
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+LOGGER_TAG("com.amazonaws.kinesis.video");
+
+using std::chrono::duration;
+using std::chrono::duration_cast;
+
+#define OPEN_METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+// Interval at which the server thread checks for the stop request
+#define OPEN_METRICS_POLL_INTERVAL_MS 200
+
+// Max size of a request head, larger requests are rejected
+#define OPEN_METRICS_MAX_REQUEST_SIZE 8192
+
+// A scraper hanging up early must not raise SIGPIPE in the application
+#if defined(MSG_NOSIGNAL)
+#define OPEN_METRICS_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define OPEN_METRICS_SEND_FLAGS 0
+#endif
+
+namespace {
+    void writeHeader(std::ostream& out, const char* name, const char* type, const char* help) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+    }
+
+    /**
+     * Writes the stream name as a label value, escaping it as required by the exposition format
+     */
+    void writeStreamLabel(std::ostream& out, const std::string& stream_name) {
+        out << "stream=\"";
+        for (char c : stream_name) {
+            switch (c) {
+                case '\\':
+                    out << "\\\\";
+                    break;
+                case '"':
+                    out << "\\\"";
+                    break;
+                case '\n':
+                    out << "\\n";
+                    break;
+                default:
+                    out << c;
+            }
+        }
+        out << "\"";
+    }
+
+    template <typename T, typename Getter>
+    void writeStreamMetric(std::ostream& out, const MetricsSample& metrics_sample, const char* name, const char* type,
+                           const char* help, Getter getter) {
+        writeHeader(out, name, type, help);
+        for (auto& stream : metrics_sample.stream_metrics) {
+            out << name << "{";
+            writeStreamLabel(out, stream.first);
+            out << "} " << static_cast<T>(getter(stream.second)) << "\n";
+        }
+    }
+
+    double toSeconds(std::chrono::microseconds value) {
+        return duration_cast<duration<double>>(value).count();
+    }
+
+    void writeAckLatencies(std::ostream& out, const MetricsSample& metrics_sample) {
+        static const char* ACK_TYPES[] = {"buffering", "received", "persisted"};
+        static const char* QUANTILES[] = {"0.5", "0.9", "0.99"};
+
+        writeHeader(out, "kvs_stream_fragment_ack_latency_seconds", "summary",
+                    "Time from putting the first frame of a fragment to receiving its ack.");
+        for (auto& stream : metrics_sample.stream_metrics) {
+            auto& latencies = stream.second.getFragmentAckLatencies();
+            const LatencyPercentiles* ack_latencies[] = {&latencies.buffering, &latencies.received, &latencies.persisted};
+            for (size_t i = 0; i < 3; i++) {
+                const std::chrono::microseconds quantile_values[] = {ack_latencies[i]->p50, ack_latencies[i]->p90, ack_latencies[i]->p99};
+                for (size_t j = 0; j < 3; j++) {
+                    out << "kvs_stream_fragment_ack_latency_seconds{";
+                    writeStreamLabel(out, stream.first);
+                    out << ",ack=\"" << ACK_TYPES[i] << "\",quantile=\"" << QUANTILES[j] << "\"} "
+                        << toSeconds(quantile_values[j]) << "\n";
+                }
+
+                out << "kvs_stream_fragment_ack_latency_seconds_sum{";
+                writeStreamLabel(out, stream.first);
+                out << ",ack=\"" << ACK_TYPES[i] << "\"} " << toSeconds(ack_latencies[i]->sum) << "\n";
+
+                out << "kvs_stream_fragment_ack_latency_seconds_count{";
+                writeStreamLabel(out, stream.first);
+                out << ",ack=\"" << ACK_TYPES[i] << "\"} " << ack_latencies[i]->count << "\n";
+            }
+        }
+
+        writeHeader(out, "kvs_stream_fragment_ack_latency_max_seconds", "gauge",
+                    "Max time from putting the first frame of a fragment to receiving its ack.");
+        for (auto& stream : metrics_sample.stream_metrics) {
+            auto& latencies = stream.second.getFragmentAckLatencies();
+            const LatencyPercentiles* ack_latencies[] = {&latencies.buffering, &latencies.received, &latencies.persisted};
+            for (size_t i = 0; i < 3; i++) {
+                out << "kvs_stream_fragment_ack_latency_max_seconds{";
+                writeStreamLabel(out, stream.first);
+                out << ",ack=\"" << ACK_TYPES[i] << "\"} " << toSeconds(ack_latencies[i]->max) << "\n";
+            }
+        }
+    }
+
+    void writeShedFrames(std::ostream& out, const MetricsSample& metrics_sample) {
+        static const char* SHED_REASONS[FRAME_SHED_REASON_COUNT] = {nullptr, "disposable", "gop_tail", "gop"};
+
+        writeHeader(out, "kvs_stream_frames_shed_total", "counter", "Frames shed by the frame admission.");
+        for (auto& stream : metrics_sample.stream_metrics) {
+            auto counters = stream.second.getCounters();
+            for (size_t i = FRAME_SHED_REASON_DISPOSABLE; i < FRAME_SHED_REASON_COUNT; i++) {
+                out << "kvs_stream_frames_shed_total{";
+                writeStreamLabel(out, stream.first);
+                out << ",reason=\"" << SHED_REASONS[i] << "\"} " << counters.frames_shed[i] << "\n";
+            }
+        }
+    }
+
+    void sendAll(intptr_t connection, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            auto result = send((socket_t) connection, data.data() + sent, (int) (data.size() - sent), OPEN_METRICS_SEND_FLAGS);
+            if (result <= 0) {
+                return;
+            }
+
+            sent += (size_t) result;
+        }
+    }
+}
+
+OpenMetricsExporter::OpenMetricsExporter(int32_t port, const std::string& bind_address)
+        : listen_socket_(-1),
+          port_(0),
+          stop_(false) {
+    if (OPEN_METRICS_NO_ENDPOINT == port) {
+        return;
+    }
+
+    if (port < 0 || port > UINT16_MAX) {
+        LOG_AND_THROW("Invalid metrics endpoint port " << port);
+    }
+
+#if defined(_WIN32)
+    WSADATA wsa_data;
+    WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t) port);
+    if (1 != inet_pton(AF_INET, bind_address.c_str(), &address.sin_addr)) {
+        LOG_AND_THROW("Invalid metrics endpoint bind address " << bind_address);
+    }
+
+    auto listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (const char*) &reuse, sizeof(reuse));
+    if (0 != bind(listen_socket, (struct sockaddr*) &address, sizeof(address)) || 0 != listen(listen_socket, SOMAXCONN)) {
+        CLOSE_SOCKET(listen_socket);
+        LOG_AND_THROW("Failed to start the metrics endpoint at " << bind_address << ":" << port);
+    }
+
+    // Read back the port the system picked for port 0
+    socklen_t address_size = sizeof(address);
+    getsockname(listen_socket, (struct sockaddr*) &address, &address_size);
+    port_ = ntohs(address.sin_port);
+
+    listen_socket_ = (intptr_t) listen_socket;
+    server_thread_ = std::thread(&OpenMetricsExporter::serve, this);
+    LOG_INFO("Serving metrics at http://" << bind_address << ":" << port_ << OPEN_METRICS_PATH);
+}
+
+OpenMetricsExporter::~OpenMetricsExporter() {
+    stop_ = true;
+    if (server_thread_.joinable()) {
+        server_thread_.join();
+    }
+
+    if (-1 != listen_socket_) {
+        CLOSE_SOCKET((socket_t) listen_socket_);
+    }
+}
+
+void OpenMetricsExporter::exportMetrics(const MetricsSample& metrics_sample) {
+    std::ostringstream out;
+    render(metrics_sample, out);
+
+    std::lock_guard<std::mutex> lock(metrics_text_mutex_);
+    metrics_text_ = out.str();
+}
+
+std::string OpenMetricsExporter::getMetricsText() const {
+    std::lock_guard<std::mutex> lock(metrics_text_mutex_);
+    return metrics_text_;
+}
+
+void OpenMetricsExporter::render(const MetricsSample& metrics_sample, std::ostream& out) {
+    auto& client_metrics = metrics_sample.client_metrics;
+
+    writeHeader(out, "kvs_producer_content_store_size_bytes", "gauge", "Overall size of the content store.");
+    out << "kvs_producer_content_store_size_bytes " << client_metrics.getContentStoreSizeSize() << "\n";
+    writeHeader(out, "kvs_producer_content_store_available_bytes", "gauge", "Available size of the content store.");
+    out << "kvs_producer_content_store_available_bytes " << client_metrics.getContentStoreAvailableSize() << "\n";
+    writeHeader(out, "kvs_producer_content_store_allocated_bytes", "gauge", "Allocated size of the content store.");
+    out << "kvs_producer_content_store_allocated_bytes " << client_metrics.getContentStoreAllocatedSize() << "\n";
+    writeHeader(out, "kvs_producer_content_views_bytes", "gauge", "Total size of the content views of all streams.");
+    out << "kvs_producer_content_views_bytes " << client_metrics.getTotalContentViewsSize() << "\n";
+    writeHeader(out, "kvs_producer_frame_rate", "gauge", "Total frame rate of all streams in frames per second.");
+    out << "kvs_producer_frame_rate " << client_metrics.getTotalFrameRate() << "\n";
+    writeHeader(out, "kvs_producer_transfer_rate_bytes", "gauge", "Total transfer rate of all streams in bytes per second.");
+    out << "kvs_producer_transfer_rate_bytes " << client_metrics.getTotalTransferRate() << "\n";
+
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_current_view_size_bytes", "gauge",
+                                "Size of the current view of the stream.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCurrentViewSize(); });
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_overall_view_size_bytes", "gauge",
+                                "Size of the overall view of the stream.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getOverallViewSize(); });
+    writeStreamMetric<double>(out, metrics_sample, "kvs_stream_current_view_duration_seconds", "gauge",
+                              "Duration of the current view of the stream.",
+                              [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCurrentViewDuration().count() / 1000.0; });
+    writeStreamMetric<double>(out, metrics_sample, "kvs_stream_overall_view_duration_seconds", "gauge",
+                              "Duration of the overall view of the stream.",
+                              [](const KinesisVideoStreamMetrics& metrics) { return metrics.getOverallViewDuration().count() / 1000.0; });
+    writeStreamMetric<double>(out, metrics_sample, "kvs_stream_frame_rate", "gauge",
+                              "Observed frame rate of the stream in frames per second.",
+                              [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCurrentFrameRate(); });
+    writeStreamMetric<double>(out, metrics_sample, "kvs_stream_elementary_frame_rate", "gauge",
+                              "Elementary frame rate of the stream in frames per second.",
+                              [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCurrentElementaryFrameRate(); });
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_transfer_rate_bytes", "gauge",
+                                "Observed transfer rate of the stream in bytes per second.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCurrentTransferRate(); });
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_frames_put_total", "counter",
+                                "Frames accepted by the stream.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCounters().frames_put; });
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_bytes_put_total", "counter",
+                                "Frame bytes accepted by the stream.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCounters().bytes_put; });
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_key_frames_put_total", "counter",
+                                "Key frames accepted by the stream.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCounters().key_frames_put; });
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_put_frame_failures_total", "counter",
+                                "Frames rejected by the stream.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCounters().put_frame_failures; });
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_dropped_frames_total", "counter",
+                                "Frames dropped by the stream.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getDroppedFrames(); });
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_dropped_fragments_total", "counter",
+                                "Fragments dropped by the stream.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCounters().dropped_fragments; });
+    writeShedFrames(out, metrics_sample);
+    writeStreamMetric<uint64_t>(out, metrics_sample, "kvs_stream_bytes_shed_total", "counter",
+                                "Frame bytes shed by the frame admission.",
+                                [](const KinesisVideoStreamMetrics& metrics) { return metrics.getCounters().bytes_shed; });
+
+    writeAckLatencies(out, metrics_sample);
+}
+
+void OpenMetricsExporter::serve() {
+    struct pollfd listen_poll;
+    listen_poll.fd = (socket_t) listen_socket_;
+    listen_poll.events = POLLIN;
+
+    while (!stop_) {
+        listen_poll.revents = 0;
+        if (POLL_SOCKETS(&listen_poll, 1, OPEN_METRICS_POLL_INTERVAL_MS) <= 0 || 0 == (listen_poll.revents & POLLIN)) {
+            continue;
+        }
+
+        auto connection = accept((socket_t) listen_socket_, nullptr, nullptr);
+        if (-1 == (intptr_t) connection) {
+            continue;
+        }
+
+        handleConnection((intptr_t) connection);
+        CLOSE_SOCKET(connection);
+    }
+}
+
+void OpenMetricsExporter::handleConnection(intptr_t connection) {
+    struct pollfd connection_poll;
+    connection_poll.fd = (socket_t) connection;
+    connection_poll.events = POLLIN;
+
+    // Only the request line matters, the rest of the head is read and dropped
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < OPEN_METRICS_MAX_REQUEST_SIZE) {
+        connection_poll.revents = 0;
+        if (POLL_SOCKETS(&connection_poll, 1, OPEN_METRICS_POLL_INTERVAL_MS) <= 0 || stop_) {
+            return;
+        }
+
+        auto received = recv((socket_t) connection, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return;
+        }
+
+        request.append(buffer, (size_t) received);
+    }
+
+    std::string status, body;
+    if (request.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+    } else if (request.compare(4, strlen(OPEN_METRICS_PATH), OPEN_METRICS_PATH) != 0 ||
+               (request[4 + strlen(OPEN_METRICS_PATH)] != ' ' && request[4 + strlen(OPEN_METRICS_PATH)] != '?')) {
+        status = "404 Not Found";
+    } else {
+        status = "200 OK";
+        body = getMetricsText();
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\nContent-Type: " << OPEN_METRICS_CONTENT_TYPE
+             << "\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n" << body;
+    sendAll(connection, response.str());
+}
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -0,0 +1,95 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "MetricsExporter.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Default address the metrics endpoint is bound to. Use "0.0.0.0" to expose it to remote scrapers.
+ */
+#define OPEN_METRICS_DEFAULT_BIND_ADDRESS "127.0.0.1"
+
+/**
+ * Port value for no HTTP endpoint
+ */
+#define OPEN_METRICS_NO_ENDPOINT -1
+
+/**
+ * Path the metrics are served at
+ */
+#define OPEN_METRICS_PATH "/metrics"
+
+/**
+ * Exports the producer metrics in the Prometheus text exposition format.
+ *
+ * The text is rendered once per metrics sample on the sampler thread and served as is to every scrape, so
+ * a scrape never calls into the client and never takes the client lock regardless of the scrape frequency.
+ *
+ * Given a port an embedded single threaded HTTP endpoint serves the text at OPEN_METRICS_PATH. Otherwise
+ * the text is only available through getMetricsText() for the application to serve itself.
+ *
+ * Example usage:
+ * @code:
+ * auto exporter = std::make_shared<OpenMetricsExporter>(9464);
+ * producer->setMetricsExporter(exporter);
+ * @endcode
+ */
+class OpenMetricsExporter : public MetricsExporter {
+public:
+    /**
+     * @param port Port to serve the metrics at, 0 for any free port or OPEN_METRICS_NO_ENDPOINT for no HTTP endpoint.
+     * @param bind_address IPv4 address to bind the endpoint to.
+     *
+     * @throws runtime_error if the endpoint fails to start.
+     */
+    explicit OpenMetricsExporter(int32_t port = OPEN_METRICS_NO_ENDPOINT,
+                                 const std::string& bind_address = OPEN_METRICS_DEFAULT_BIND_ADDRESS);
+
+    ~OpenMetricsExporter();
+
+    void exportMetrics(const MetricsSample& metrics_sample) override;
+
+    /**
+     * @return Port the endpoint is bound to or 0 if there is no endpoint.
+     */
+    uint16_t getPort() const {
+        return port_;
+    }
+
+    /**
+     * @return Metrics text rendered from the latest sample.
+     */
+    std::string getMetricsText() const;
+
+    /**
+     * Renders the sample in the Prometheus text exposition format.
+     */
+    static void render(const MetricsSample& metrics_sample, std::ostream& out);
+
+private:
+    void serve();
+
+    void handleConnection(intptr_t connection);
+
+    mutable std::mutex metrics_text_mutex_;
+    std::string metrics_text_;
+
+    intptr_t listen_socket_;
+    uint16_t port_;
+    std::atomic<bool> stop_;
+    std::thread server_thread_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
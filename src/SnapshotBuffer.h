@@ -0,0 +1,76 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Single writer/multiple reader double buffer for small values.
+ *
+ * The writer fills the slot that is not currently published and then flips the sequence, so readers
+ * copy the published slot while the next value is being written. Each slot has its own mutex so a copy
+ * never overlaps a write of the same slot - the writer only waits on a reader which is still copying a
+ * slot two publishes later, which for periodic publishers is practically never.
+ *
+ * @tparam T Copyable value type
+ */
+template <typename T> class SnapshotBuffer {
+public:
+    SnapshotBuffer() : sequence_(0) {}
+
+    /**
+     * Publishes a new value. Must be called from a single writer thread.
+     * @param value Value to publish
+     */
+    void publish(const T& value) {
+        uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+        uint32_t slot = (sequence + 1) & 1;
+
+        // Flipped within the slot lock so a reader that copied the new value never reads an older one afterwards
+        std::lock_guard<std::mutex> lock(slot_mutexes_[slot]);
+        slots_[slot] = value;
+        sequence_.store(sequence + 1, std::memory_order_release);
+    }
+
+    /**
+     * Reads the latest published value.
+     * @param value Value to be filled in
+     * @return true if a value has been published and false otherwise.
+     */
+    bool read(T& value) const {
+        uint64_t sequence = sequence_.load(std::memory_order_acquire);
+        if (0 == sequence) {
+            return false;
+        }
+
+        uint32_t slot = sequence & 1;
+        std::lock_guard<std::mutex> lock(slot_mutexes_[slot]);
+        value = slots_[slot];
+        return true;
+    }
+
+private:
+    /**
+     * Published values. The currently published slot is sequence_ % 2.
+     */
+    T slots_[2];
+
+    /**
+     * Guard the copies into and out of the slots
+     */
+    mutable std::mutex slot_mutexes_[2];
+
+    /**
+     * Number of published values
+     */
+    std::atomic<uint64_t> sequence_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
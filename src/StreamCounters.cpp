@@ -0,0 +1,76 @@
+#include "StreamCounters.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+StreamCounters::StreamCounters()
+        : frames_put_(0),
+          bytes_put_(0),
+          key_frames_put_(0),
+          bytes_shed_(0),
+          put_frame_failures_(0),
+          dropped_frames_(0),
+          dropped_fragments_(0) {
+    for (auto& count : frames_shed_) {
+        count.store(0);
+    }
+
+    for (size_t i = 0; i < STREAM_COUNTERS_MAX_FAILURE_STATUSES; i++) {
+        failure_statuses_[i].store(STATUS_SUCCESS);
+        failure_counts_[i].store(0);
+    }
+}
+
+void StreamCounters::framePut(const Frame& frame) {
+    frames_put_.fetch_add(1, std::memory_order_relaxed);
+    bytes_put_.fetch_add(frame.size, std::memory_order_relaxed);
+    if (CHECK_FRAME_FLAG_KEY_FRAME(frame.flags)) {
+        key_frames_put_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void StreamCounters::putFrameFailed(STATUS status) {
+    put_frame_failures_.fetch_add(1, std::memory_order_relaxed);
+
+    // Claim the first free slot for a status seen for the first time
+    for (size_t i = 0; i < STREAM_COUNTERS_MAX_FAILURE_STATUSES; i++) {
+        STATUS slot_status = failure_statuses_[i].load(std::memory_order_acquire);
+
+        // A failed exchange leaves the status claimed by another thread in slot_status
+        if (STATUS_SUCCESS == slot_status &&
+            failure_statuses_[i].compare_exchange_strong(slot_status, status, std::memory_order_acq_rel)) {
+            slot_status = status;
+        }
+
+        if (slot_status == status) {
+            failure_counts_[i].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+StreamCountersSnapshot StreamCounters::snapshot() const {
+    StreamCountersSnapshot snapshot;
+    snapshot.frames_put = frames_put_.load(std::memory_order_relaxed);
+    snapshot.bytes_put = bytes_put_.load(std::memory_order_relaxed);
+    snapshot.key_frames_put = key_frames_put_.load(std::memory_order_relaxed);
+    snapshot.put_frame_failures = put_frame_failures_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < STREAM_COUNTERS_MAX_FAILURE_STATUSES; i++) {
+        snapshot.put_frame_failures_by_status[i].status = failure_statuses_[i].load(std::memory_order_acquire);
+        snapshot.put_frame_failures_by_status[i].count = failure_counts_[i].load(std::memory_order_relaxed);
+    }
+
+    snapshot.dropped_frames = dropped_frames_.load(std::memory_order_relaxed);
+    snapshot.dropped_fragments = dropped_fragments_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < FRAME_SHED_REASON_COUNT; i++) {
+        snapshot.frames_shed[i] = frames_shed_[i].load(std::memory_order_relaxed);
+    }
+
+    snapshot.bytes_shed = bytes_shed_.load(std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -0,0 +1,131 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "com/amazonaws/kinesis/video/client/Include.h"
+#include "FrameAdmission.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Cache line size the counters written by different threads are kept apart by
+ */
+#define STREAM_COUNTERS_CACHE_LINE_SIZE 64
+
+/**
+ * Number of the distinct putFrame failure statuses counted separately. Further statuses are only
+ * counted in the failure total.
+ */
+#define STREAM_COUNTERS_MAX_FAILURE_STATUSES 8
+
+/**
+ * Values of the stream counters at the time they were read.
+ */
+struct StreamCountersSnapshot {
+    StreamCountersSnapshot() : frames_put(0), bytes_put(0), key_frames_put(0), put_frame_failures(0),
+                               dropped_frames(0), dropped_fragments(0), bytes_shed(0) {
+        for (auto& failure : put_frame_failures_by_status) {
+            failure.status = STATUS_SUCCESS;
+            failure.count = 0;
+        }
+
+        for (auto& count : frames_shed) {
+            count = 0;
+        }
+    }
+
+    uint64_t frames_put;
+    uint64_t bytes_put;
+    uint64_t key_frames_put;
+    uint64_t put_frame_failures;
+
+    /**
+     * The failure counts of the first distinct failure statuses, the unused entries have STATUS_SUCCESS
+     */
+    struct {
+        STATUS status;
+        uint64_t count;
+    } put_frame_failures_by_status[STREAM_COUNTERS_MAX_FAILURE_STATUSES];
+
+    uint64_t dropped_frames;
+    uint64_t dropped_fragments;
+
+    /**
+     * Frames shed by the frame admission, indexed by the FRAME_SHED_REASON
+     */
+    uint64_t frames_shed[FRAME_SHED_REASON_COUNT];
+    uint64_t bytes_shed;
+};
+
+/**
+ * Per-stream counters updated with relaxed atomics on the putFrame path and from the client callbacks.
+ *
+ * The counters written by the media threads and the ones written by the callback threads are padded
+ * onto separate cache lines so that neither bounces the other's line, and reading them never touches
+ * the client, so they can be polled at any rate.
+ */
+class StreamCounters {
+public:
+    StreamCounters();
+
+    /**
+     * Counts a frame accepted by the client
+     */
+    void framePut(const Frame& frame);
+
+    /**
+     * Counts a frame rejected by the client with the status
+     */
+    void putFrameFailed(STATUS status);
+
+    /**
+     * Counts a frame shed by the frame admission for the reason
+     */
+    void frameShed(const Frame& frame, FRAME_SHED_REASON reason) {
+        frames_shed_[reason].fetch_add(1, std::memory_order_relaxed);
+        bytes_shed_.fetch_add(frame.size, std::memory_order_relaxed);
+    }
+
+    void frameDropped() {
+        dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void fragmentDropped() {
+        dropped_fragments_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    StreamCountersSnapshot snapshot() const;
+
+private:
+    char leading_padding_[STREAM_COUNTERS_CACHE_LINE_SIZE];
+
+    // Written by the media threads
+    std::atomic<uint64_t> frames_put_;
+    std::atomic<uint64_t> bytes_put_;
+    std::atomic<uint64_t> key_frames_put_;
+    std::atomic<uint64_t> frames_shed_[FRAME_SHED_REASON_COUNT];
+    std::atomic<uint64_t> bytes_shed_;
+
+    char put_padding_[STREAM_COUNTERS_CACHE_LINE_SIZE];
+
+    // Written by the media threads on failures only
+    std::atomic<uint64_t> put_frame_failures_;
+    std::atomic<STATUS> failure_statuses_[STREAM_COUNTERS_MAX_FAILURE_STATUSES];
+    std::atomic<uint64_t> failure_counts_[STREAM_COUNTERS_MAX_FAILURE_STATUSES];
+
+    char failure_padding_[STREAM_COUNTERS_CACHE_LINE_SIZE];
+
+    // Written by the client callback threads
+    std::atomic<uint64_t> dropped_frames_;
+    std::atomic<uint64_t> dropped_fragments_;
+
+    char trailing_padding_[STREAM_COUNTERS_CACHE_LINE_SIZE];
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -10,6 +10,9 @@ namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
 /**
  * Thread safe implementation of std::map.
+ *
+ * Deprecated: no longer used by the producer, which keeps its streams in ConcurrentRegistry. Kept for the
+ * applications which include it.
  * @tparam K The key
  * @tparam V
  */
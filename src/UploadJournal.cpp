@@ -0,0 +1,629 @@
+#include "Logger.h"
+#include "UploadJournal.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+LOGGER_TAG("com.amazonaws.kinesis.video");
+
+#define UPLOAD_JOURNAL_MAGIC "KVSJ"
+#define UPLOAD_JOURNAL_VERSION 1
+#define UPLOAD_JOURNAL_SEGMENT_EXTENSION ".kvsj"
+#define UPLOAD_JOURNAL_SEGMENT_NAME_DIGITS 16
+
+// Magic, version and generation
+#define UPLOAD_JOURNAL_SEGMENT_HEADER_SIZE 16
+
+// Payload size, CRC32 of the type and the payload, type
+#define UPLOAD_JOURNAL_RECORD_HEADER_SIZE 9
+
+// Fragment, track, flags, decoding, presentation timestamps and duration
+#define UPLOAD_JOURNAL_FRAME_HEADER_SIZE 44
+
+// Anything larger is taken for a corrupt size field
+#define UPLOAD_JOURNAL_MAX_RECORD_SIZE (256 * 1024 * 1024)
+
+namespace {
+    uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t size) {
+        static uint32_t table[256];
+        static std::once_flag table_flag;
+        std::call_once(table_flag, []() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++) {
+                    value = (value & 1) ? (value >> 1) ^ 0xEDB88320 : value >> 1;
+                }
+
+                table[i] = value;
+            }
+        });
+
+        for (size_t i = 0; i < size; i++) {
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+
+        return crc;
+    }
+
+    void putUint32(uint8_t* buffer, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            buffer[i] = (uint8_t) (value >> (8 * i));
+        }
+    }
+
+    void putUint64(uint8_t* buffer, uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            buffer[i] = (uint8_t) (value >> (8 * i));
+        }
+    }
+
+    uint32_t getUint32(const uint8_t* buffer) {
+        uint32_t value = 0;
+        for (int i = 3; i >= 0; i--) {
+            value = (value << 8) | buffer[i];
+        }
+
+        return value;
+    }
+
+    uint64_t getUint64(const uint8_t* buffer) {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; i--) {
+            value = (value << 8) | buffer[i];
+        }
+
+        return value;
+    }
+
+    bool makeDirectory(const std::string& path) {
+        struct stat directory_stat;
+        if (0 == stat(path.c_str(), &directory_stat)) {
+            return 0 != (directory_stat.st_mode & S_IFDIR);
+        }
+
+#if defined(_WIN32)
+        return 0 == _mkdir(path.c_str());
+#else
+        return 0 == mkdir(path.c_str(), 0700);
+#endif
+    }
+
+    void syncFile(FILE* file) {
+#if defined(_WIN32)
+        _commit(_fileno(file));
+#else
+        fsync(fileno(file));
+#endif
+    }
+
+    std::string segmentPath(const std::string& journal_directory, uint64_t number) {
+        char name[UPLOAD_JOURNAL_SEGMENT_NAME_DIGITS + 1];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long) number);
+        return journal_directory + "/" + name + UPLOAD_JOURNAL_SEGMENT_EXTENSION;
+    }
+
+    bool parseSegmentName(const char* name, uint64_t& number) {
+        size_t length = strlen(name);
+        if (length != UPLOAD_JOURNAL_SEGMENT_NAME_DIGITS + strlen(UPLOAD_JOURNAL_SEGMENT_EXTENSION) ||
+            0 != strcmp(name + UPLOAD_JOURNAL_SEGMENT_NAME_DIGITS, UPLOAD_JOURNAL_SEGMENT_EXTENSION)) {
+            return false;
+        }
+
+        char* end = nullptr;
+        number = strtoull(name, &end, 16);
+        return end == name + UPLOAD_JOURNAL_SEGMENT_NAME_DIGITS;
+    }
+
+    /**
+     * Segment numbers in the journal directory in ascending order
+     */
+    std::vector<uint64_t> listSegments(const std::string& journal_directory, uint64_t before_number = UINT64_MAX) {
+        std::vector<uint64_t> numbers;
+        uint64_t number;
+
+#if defined(_WIN32)
+        struct _finddata_t file_info;
+        intptr_t find_handle = _findfirst((journal_directory + "/*" + UPLOAD_JOURNAL_SEGMENT_EXTENSION).c_str(), &file_info);
+        if (-1 != find_handle) {
+            do {
+                if (parseSegmentName(file_info.name, number) && number < before_number) {
+                    numbers.push_back(number);
+                }
+            } while (0 == _findnext(find_handle, &file_info));
+
+            _findclose(find_handle);
+        }
+#else
+        DIR* directory = opendir(journal_directory.c_str());
+        if (nullptr != directory) {
+            struct dirent* entry;
+            while (nullptr != (entry = readdir(directory))) {
+                if (parseSegmentName(entry->d_name, number) && number < before_number) {
+                    numbers.push_back(number);
+                }
+            }
+
+            closedir(directory);
+        }
+#endif
+
+        std::sort(numbers.begin(), numbers.end());
+        return numbers;
+    }
+
+    std::string journalDirectory(const std::string& directory, const std::string& stream_name) {
+        return directory + "/" + stream_name;
+    }
+
+    /**
+     * Reads the records of a segment up to the first torn or corrupt one
+     */
+    class SegmentReader {
+    public:
+        explicit SegmentReader(const std::string& path) : path_(path), file_(fopen(path.c_str(), "rb")), generation_(0) {}
+
+        ~SegmentReader() {
+            if (nullptr != file_) {
+                fclose(file_);
+            }
+        }
+
+        bool readHeader() {
+            uint8_t header[UPLOAD_JOURNAL_SEGMENT_HEADER_SIZE];
+            if (nullptr == file_ || 1 != fread(header, sizeof(header), 1, file_) ||
+                0 != memcmp(header, UPLOAD_JOURNAL_MAGIC, 4) || UPLOAD_JOURNAL_VERSION != getUint32(header + 4)) {
+                LOG_WARN("Skipping the upload journal segment " << path_ << " without a valid header");
+                return false;
+            }
+
+            generation_ = getUint64(header + 8);
+            return true;
+        }
+
+        /**
+         * @param skip_frames Seeks past the frame records without reading or checking them.
+         */
+        bool next(UPLOAD_JOURNAL_RECORD_TYPE& type, std::vector<uint8_t>& payload, bool skip_frames = false) {
+            uint8_t header[UPLOAD_JOURNAL_RECORD_HEADER_SIZE];
+            size_t read = fread(header, 1, sizeof(header), file_);
+            if (0 == read) {
+                return false;
+            }
+
+            uint32_t size = getUint32(header);
+            if (read == sizeof(header) && skip_frames && UPLOAD_JOURNAL_RECORD_FRAME == header[8]) {
+                type = UPLOAD_JOURNAL_RECORD_FRAME;
+                payload.clear();
+                return 0 == fseek(file_, size, SEEK_CUR);
+            }
+
+            if (read == sizeof(header) && size <= UPLOAD_JOURNAL_MAX_RECORD_SIZE) {
+                payload.resize(size);
+                if (0 == size || 1 == fread(payload.data(), size, 1, file_)) {
+                    uint32_t crc = crc32Update(0xffffffff, header + 8, 1);
+                    crc = crc32Update(crc, payload.data(), size) ^ 0xffffffff;
+                    if (crc == getUint32(header + 4)) {
+                        type = (UPLOAD_JOURNAL_RECORD_TYPE) header[8];
+                        return true;
+                    }
+                }
+            }
+
+            // Expected at the end of the last segment if the process went down mid-write
+            LOG_WARN("Upload journal segment " << path_ << " ends with a torn or corrupt record");
+            return false;
+        }
+
+        uint64_t getGeneration() const {
+            return generation_;
+        }
+
+    private:
+        const std::string path_;
+        FILE* file_;
+        uint64_t generation_;
+    };
+}
+
+UploadJournal::UploadJournal(const std::string& directory, const std::string& stream_name, const UploadJournalConfig& config)
+        : config_(config),
+          journal_directory_(journalDirectory(directory, stream_name)),
+          generation_(0),
+          file_(nullptr),
+          file_size_(0),
+          fragment_(0),
+          persisted_fragment_(0),
+          failed_(false),
+          sync_stop_(false) {
+    if (stream_name.empty() || std::string::npos != stream_name.find_first_of("/\\") || ".." == stream_name) {
+        LOG_AND_THROW("Invalid stream name for the upload journal " << stream_name);
+    }
+
+    if (!makeDirectory(directory) || !makeDirectory(journal_directory_)) {
+        LOG_AND_THROW("Unable to create the upload journal directory " << journal_directory_);
+    }
+
+    auto existing_segments = listSegments(journal_directory_);
+    generation_ = existing_segments.empty() ? 0 : existing_segments.back() + 1;
+    if (!openSegment(generation_)) {
+        LOG_AND_THROW("Unable to create the upload journal segment in " << journal_directory_);
+    }
+
+    if (config_.sync_interval.count() > 0) {
+        sync_thread_ = std::thread(&UploadJournal::runSync, this);
+    }
+
+    LOG_INFO("Upload journal generation " << generation_ << " opened in " << journal_directory_);
+}
+
+UploadJournal::~UploadJournal() {
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        sync_stop_ = true;
+    }
+
+    sync_cv_.notify_all();
+    if (sync_thread_.joinable()) {
+        sync_thread_.join();
+    }
+
+    syncSegments();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (nullptr != file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+
+    if (failed_ || !pending_fragments_.empty()) {
+        LOG_INFO("Upload journal in " << journal_directory_ << " keeps " << pending_fragments_.size() << " un-acked fragments");
+        return;
+    }
+
+    for (auto& segment : segments_) {
+        remove(segment.path.c_str());
+    }
+
+    // Fails while the journal holds older generations
+#if defined(_WIN32)
+    _rmdir(journal_directory_.c_str());
+#else
+    rmdir(journal_directory_.c_str());
+#endif
+}
+
+void UploadJournal::appendCodecPrivateData(uint64_t track_id, const uint8_t* data, uint32_t size) {
+    uint8_t header[8];
+    putUint64(header, track_id);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    codec_private_data_[track_id].assign(data, data + size);
+    if (!failed_) {
+        writeRecord(UPLOAD_JOURNAL_RECORD_CODEC_PRIVATE_DATA, header, sizeof(header), data, size);
+    }
+}
+
+void UploadJournal::appendFrame(const Frame& frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_) {
+        return;
+    }
+
+    if (CHECK_FRAME_FLAG_KEY_FRAME(frame.flags)) {
+        // A fragment never spans segments so that a segment can be deleted by the fragment acks
+        if (file_size_ >= config_.segment_size && 0 != fragment_) {
+            fflush(file_);
+            retired_files_.push_back(file_);
+            file_ = nullptr;
+            if (!openSegment(segments_.back().number + 1)) {
+                LOG_ERROR("Unable to roll over the upload journal in " << journal_directory_ << ", journaling stopped");
+                failed_ = true;
+                return;
+            }
+        }
+
+        fragment_++;
+        if (pending_fragments_.size() >= UPLOAD_JOURNAL_MAX_PENDING_FRAGMENTS) {
+            pending_fragments_.pop_front();
+        }
+
+        PendingFragment pending_fragment;
+        pending_fragment.fragment = fragment_;
+        pending_fragment.pts_ms = frame.presentationTs / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+        pending_fragment.dts_ms = frame.decodingTs / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+        pending_fragments_.push_back(pending_fragment);
+    }
+
+    uint8_t header[UPLOAD_JOURNAL_FRAME_HEADER_SIZE];
+    putUint64(header, fragment_);
+    putUint64(header + 8, frame.trackId);
+    putUint32(header + 16, (uint32_t) frame.flags);
+    putUint64(header + 20, frame.decodingTs);
+    putUint64(header + 28, frame.presentationTs);
+    putUint64(header + 36, frame.duration);
+    writeRecord(UPLOAD_JOURNAL_RECORD_FRAME, header, sizeof(header), frame.frameData, frame.size);
+    segments_.back().last_fragment = fragment_;
+}
+
+void UploadJournal::fragmentAckReceived(const FragmentAck& fragment_ack) {
+    if (FRAGMENT_ACK_TYPE_PERSISTED != fragment_ack.ackType && FRAGMENT_ACK_TYPE_ERROR != fragment_ack.ackType) {
+        return;
+    }
+
+    uint64_t timecode_ms = fragment_ack.timestamp / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_fragments_.begin();
+    while (it != pending_fragments_.end() && it->pts_ms != timecode_ms && it->dts_ms != timecode_ms) {
+        it++;
+    }
+
+    if (it == pending_fragments_.end()) {
+        return;
+    }
+
+    if (FRAGMENT_ACK_TYPE_ERROR == fragment_ack.ackType) {
+        LOG_WARN("Upload journal in " << journal_directory_ << " drops the fragment with timecode " << timecode_ms
+                 << " the service failed with " << fragment_ack.result);
+    }
+
+    // The acks arrive in the fragment order so the older fragments have been persisted as well
+    persisted_fragment_ = it->fragment;
+    pending_fragments_.erase(pending_fragments_.begin(), it + 1);
+
+    if (!failed_) {
+        uint8_t header[8];
+        putUint64(header, persisted_fragment_);
+        writeRecord(UPLOAD_JOURNAL_RECORD_ACK, header, sizeof(header), nullptr, 0);
+        deletePersistedSegments();
+    }
+}
+
+void UploadJournal::sync() {
+    syncSegments();
+}
+
+size_t UploadJournal::getPendingFragmentCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_fragments_.size();
+}
+
+bool UploadJournal::openSegment(uint64_t number) {
+    Segment segment;
+    segment.number = number;
+    segment.path = segmentPath(journal_directory_, number);
+    segment.last_fragment = fragment_;
+
+    file_ = fopen(segment.path.c_str(), "wb");
+    if (nullptr == file_) {
+        return false;
+    }
+
+    uint8_t header[UPLOAD_JOURNAL_SEGMENT_HEADER_SIZE];
+    memcpy(header, UPLOAD_JOURNAL_MAGIC, 4);
+    putUint32(header + 4, UPLOAD_JOURNAL_VERSION);
+    putUint64(header + 8, generation_);
+    if (1 != fwrite(header, sizeof(header), 1, file_)) {
+        fclose(file_);
+        file_ = nullptr;
+        remove(segment.path.c_str());
+        return false;
+    }
+
+    file_size_ = sizeof(header);
+    segments_.push_back(segment);
+
+    // The segment has to be replayable on its own once the previous ones are deleted
+    for (auto& codec_private_data : codec_private_data_) {
+        uint8_t track_header[8];
+        putUint64(track_header, codec_private_data.first);
+        writeRecord(UPLOAD_JOURNAL_RECORD_CODEC_PRIVATE_DATA, track_header, sizeof(track_header),
+                    codec_private_data.second.data(), (uint32_t) codec_private_data.second.size());
+    }
+
+    return !failed_;
+}
+
+void UploadJournal::writeRecord(UPLOAD_JOURNAL_RECORD_TYPE type, const uint8_t* header, uint32_t header_size,
+                                const uint8_t* data, uint32_t data_size) {
+    uint8_t record_header[UPLOAD_JOURNAL_RECORD_HEADER_SIZE];
+    putUint32(record_header, header_size + data_size);
+    record_header[8] = (uint8_t) type;
+
+    uint32_t crc = crc32Update(0xffffffff, record_header + 8, 1);
+    crc = crc32Update(crc, header, header_size);
+    if (data_size > 0) {
+        crc = crc32Update(crc, data, data_size);
+    }
+
+    putUint32(record_header + 4, crc ^ 0xffffffff);
+
+    if (1 != fwrite(record_header, sizeof(record_header), 1, file_) ||
+        1 != fwrite(header, header_size, 1, file_) ||
+        (data_size > 0 && 1 != fwrite(data, data_size, 1, file_))) {
+        LOG_ERROR("Failed to write the upload journal in " << journal_directory_ << ", journaling stopped");
+        failed_ = true;
+        return;
+    }
+
+    file_size_ += sizeof(record_header) + header_size + data_size;
+}
+
+void UploadJournal::deletePersistedSegments() {
+    // The current segment is kept for the records to come
+    while (segments_.size() > 1 && segments_.front().last_fragment <= persisted_fragment_) {
+        remove(segments_.front().path.c_str());
+        segments_.pop_front();
+    }
+}
+
+void UploadJournal::runSync() {
+    std::unique_lock<std::mutex> lock(sync_mutex_);
+    while (!sync_cv_.wait_for(lock, config_.sync_interval, [this]() { return sync_stop_; })) {
+        lock.unlock();
+        syncSegments();
+        lock.lock();
+    }
+}
+
+void UploadJournal::syncSegments() {
+    std::lock_guard<std::mutex> sync_lock(segment_sync_mutex_);
+    std::vector<FILE*> retired_files;
+    FILE* file;
+
+    // Only the buffer flush is done under the lock, the fsync doesn't hold up the writers
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (nullptr != file_) {
+            fflush(file_);
+        }
+
+        file = file_;
+        retired_files.swap(retired_files_);
+    }
+
+    // The retired files are only closed here so the current one stays open even if rolled over meanwhile
+    for (auto retired_file : retired_files) {
+        syncFile(retired_file);
+        fclose(retired_file);
+    }
+
+    if (nullptr != file) {
+        syncFile(file);
+    }
+}
+
+UploadJournalRecovery UploadJournal::recover(const std::string& directory, const std::string& stream_name,
+                                             RecordVisitor visitor, uint64_t before_generation) {
+    UploadJournalRecovery recovery;
+    std::string journal_directory = journalDirectory(directory, stream_name);
+
+    // A generation starts at its first segment number, the segments of the previous generations are below it
+    auto numbers = listSegments(journal_directory, before_generation);
+    recovery.segment_count = numbers.size();
+
+    UPLOAD_JOURNAL_RECORD_TYPE type;
+    std::vector<uint8_t> payload;
+
+    // The acks come after their frames so the persisted fragments are only known after a first pass over the acks
+    std::map<uint64_t, uint64_t> persisted_fragments;
+    for (auto number : numbers) {
+        SegmentReader reader(segmentPath(journal_directory, number));
+        if (!reader.readHeader()) {
+            continue;
+        }
+
+        while (reader.next(type, payload, true)) {
+            if (UPLOAD_JOURNAL_RECORD_ACK == type && payload.size() >= 8) {
+                uint64_t& persisted_fragment = persisted_fragments[reader.getGeneration()];
+                persisted_fragment = std::max(persisted_fragment, getUint64(payload.data()));
+            }
+        }
+    }
+
+    std::map<uint64_t, std::vector<uint8_t>> codec_private_data, visited_codec_private_data;
+    bool codec_private_data_changed = false;
+    UploadJournalRecord record;
+
+    for (auto number : numbers) {
+        SegmentReader reader(segmentPath(journal_directory, number));
+        if (!reader.readHeader()) {
+            continue;
+        }
+
+        auto persisted = persisted_fragments.find(reader.getGeneration());
+        while (reader.next(type, payload)) {
+            if (UPLOAD_JOURNAL_RECORD_CODEC_PRIVATE_DATA == type && payload.size() >= 8) {
+                codec_private_data[getUint64(payload.data())].assign(payload.begin() + 8, payload.end());
+                codec_private_data_changed = true;
+                continue;
+            }
+
+            if (UPLOAD_JOURNAL_RECORD_FRAME != type || payload.size() < UPLOAD_JOURNAL_FRAME_HEADER_SIZE) {
+                continue;
+            }
+
+            uint64_t fragment = getUint64(payload.data());
+            if (persisted != persisted_fragments.end() && fragment <= persisted->second) {
+                recovery.skipped_frame_count++;
+                continue;
+            }
+
+            if (codec_private_data_changed) {
+                for (auto& track_codec_private_data : codec_private_data) {
+                    auto& visited = visited_codec_private_data[track_codec_private_data.first];
+                    if (visited == track_codec_private_data.second) {
+                        continue;
+                    }
+
+                    visited = track_codec_private_data.second;
+                    memset(&record, 0, sizeof(record));
+                    record.type = UPLOAD_JOURNAL_RECORD_CODEC_PRIVATE_DATA;
+                    record.track_id = track_codec_private_data.first;
+                    record.data = visited.data();
+                    record.size = (uint32_t) visited.size();
+                    if (!visitor(record)) {
+                        recovery.complete = false;
+                        return recovery;
+                    }
+                }
+
+                codec_private_data_changed = false;
+            }
+
+            memset(&record, 0, sizeof(record));
+            record.type = UPLOAD_JOURNAL_RECORD_FRAME;
+            record.track_id = getUint64(payload.data() + 8);
+            record.data = payload.data() + UPLOAD_JOURNAL_FRAME_HEADER_SIZE;
+            record.size = (uint32_t) (payload.size() - UPLOAD_JOURNAL_FRAME_HEADER_SIZE);
+            record.frame.version = FRAME_CURRENT_VERSION;
+            record.frame.index = (UINT32) recovery.frame_count;
+            record.frame.flags = (FRAME_FLAGS) getUint32(payload.data() + 16);
+            record.frame.decodingTs = getUint64(payload.data() + 20);
+            record.frame.presentationTs = getUint64(payload.data() + 28);
+            record.frame.duration = getUint64(payload.data() + 36);
+            record.frame.trackId = record.track_id;
+            record.frame.size = record.size;
+            record.frame.frameData = record.size > 0 ? (PBYTE) record.data : nullptr;
+            if (!visitor(record)) {
+                recovery.complete = false;
+                return recovery;
+            }
+
+            recovery.frame_count++;
+            recovery.byte_count += record.size;
+        }
+    }
+
+    return recovery;
+}
+
+void UploadJournal::discard(const std::string& directory, const std::string& stream_name, uint64_t before_generation) {
+    std::string journal_directory = journalDirectory(directory, stream_name);
+    for (auto number : listSegments(journal_directory, before_generation)) {
+        remove(segmentPath(journal_directory, number).c_str());
+    }
+
+#if defined(_WIN32)
+    _rmdir(journal_directory.c_str());
+#else
+    rmdir(journal_directory.c_str());
+#endif
+}
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
@@ -0,0 +1,267 @@
+/** Copyright 2017 Amazon.com. All rights reserved. */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "com/amazonaws/kinesis/video/client/Include.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Default period the journal is flushed to the disk at
+ */
+#define UPLOAD_JOURNAL_DEFAULT_SYNC_INTERVAL_MS 1000
+
+/**
+ * Default size a journal segment is rolled over at, on the next key frame
+ */
+#define UPLOAD_JOURNAL_DEFAULT_SEGMENT_SIZE (16 * 1024 * 1024)
+
+/**
+ * Max number of fragments awaiting their persisted acks. The oldest fragment stops being tracked when exceeded
+ * and is re-uploaded on recovery.
+ */
+#define UPLOAD_JOURNAL_MAX_PENDING_FRAGMENTS 4096
+
+struct UploadJournalConfig {
+    UploadJournalConfig()
+            : sync_interval(UPLOAD_JOURNAL_DEFAULT_SYNC_INTERVAL_MS),
+              segment_size(UPLOAD_JOURNAL_DEFAULT_SEGMENT_SIZE) {}
+
+    /**
+     * Period of the background fsync. Zero leaves the flushing to the OS which still survives a process
+     * crash but not a power loss.
+     */
+    std::chrono::milliseconds sync_interval;
+
+    uint64_t segment_size;
+};
+
+typedef enum {
+    UPLOAD_JOURNAL_RECORD_CODEC_PRIVATE_DATA = 1,
+    UPLOAD_JOURNAL_RECORD_FRAME = 2,
+    UPLOAD_JOURNAL_RECORD_ACK = 3,
+} UPLOAD_JOURNAL_RECORD_TYPE;
+
+/**
+ * Journal record handed out by the recovery. The data is only valid for the duration of the visitor call.
+ */
+struct UploadJournalRecord {
+    UPLOAD_JOURNAL_RECORD_TYPE type;
+    uint64_t track_id;
+
+    /**
+     * Frame for the frame records with the frameData pointing to the data
+     */
+    Frame frame;
+
+    const uint8_t* data;
+    uint32_t size;
+};
+
+struct UploadJournalRecovery {
+    UploadJournalRecovery() : segment_count(0), frame_count(0), byte_count(0), skipped_frame_count(0), complete(true) {}
+
+    size_t segment_count;
+
+    /**
+     * Un-acked frames handed to the visitor along with their bytes
+     */
+    uint64_t frame_count;
+    uint64_t byte_count;
+
+    /**
+     * Frames of the persisted fragments
+     */
+    uint64_t skipped_frame_count;
+
+    /**
+     * Whether the visitor has been handed all of the records
+     */
+    bool complete;
+};
+
+/**
+ * Append-only write-ahead journal of the frames put into a stream along with the persisted fragment acks, so
+ * that the fragments buffered in the content store but not yet persisted survive a restart of the process.
+ *
+ * The journal lives in a directory per stream name and is written in segments which start at a key frame with
+ * the current codec private data. Each journal instance is a generation identified by its first segment number
+ * and the acks only cover the fragments of their own generation. A segment is deleted once all of its fragments
+ * have been persisted, and the whole journal once the stream is torn down with nothing left to persist.
+ *
+ * Records are length-prefixed and CRC32 checked so a write torn by the crash ends its segment on recovery.
+ * Writes go to the page cache immediately and are fsync-ed by a background thread every sync interval.
+ * The write is done on the thread putting the frame, under the journal lock, so that a frame accepted by the
+ * client survives a crash of the process: a copy into the stdio buffer, or a write system call for the
+ * frames larger than the buffer. Only the fsync is off that thread. BM_JournalAppend in tst/bench measures
+ * the per-frame cost along with the time a frame is held up by the background sync.
+ *
+ * The acks are correlated with the key frame timestamps in milliseconds which requires the stream to use
+ * absolute fragment times and the fragment acks. Frames are re-uploaded at least once: a fragment persisted
+ * but not yet acked when the process went down is uploaded again.
+ *
+ * Thread-safe.
+ */
+class UploadJournal {
+public:
+    using RecordVisitor = std::function<bool(const UploadJournalRecord&)>;
+
+    /**
+     * Opens a new generation of the journal of the stream. The segments of the previous generations are left
+     * in place for the recovery.
+     *
+     * @throws runtime_error if the journal directory or segment can't be created.
+     */
+    UploadJournal(const std::string& directory, const std::string& stream_name,
+                  const UploadJournalConfig& config = UploadJournalConfig());
+
+    /**
+     * Flushes the journal and deletes it if all of the fragments have been persisted.
+     */
+    ~UploadJournal();
+
+    /**
+     * Records the codec private data of the track. Written again at the start of each segment.
+     */
+    void appendCodecPrivateData(uint64_t track_id, const uint8_t* data, uint32_t size);
+
+    /**
+     * Records a frame accepted by the client. A key frame starts a new fragment.
+     *
+     * Writes the frame on the calling thread, see the class description.
+     */
+    void appendFrame(const Frame& frame);
+
+    /**
+     * Records the persisted acks and deletes the segments whose fragments have all been persisted.
+     * Error acks also retire their fragments as re-uploading them would fail the same way.
+     */
+    void fragmentAckReceived(const FragmentAck& fragment_ack);
+
+    /**
+     * Flushes the journal to the disk.
+     */
+    void sync();
+
+    /**
+     * @return Number of fragments awaiting their persisted acks.
+     */
+    size_t getPendingFragmentCount() const;
+
+    /**
+     * @return Generation of the journal, the previous generations are numbered below it.
+     */
+    uint64_t getGeneration() const {
+        return generation_;
+    }
+
+    /**
+     * Reads the journal of the stream and hands the records needed to re-upload the un-acked fragments to
+     * the visitor in order: the frames of the un-acked fragments, each preceded by the codec private data
+     * of the tracks where it differs from what has been handed out so far. Stops early if the visitor
+     * returns false.
+     *
+     * Only the generations below before_generation are read so that a journal opened alongside, e.g. by the
+     * live stream while the previous generations are re-uploaded, is left out.
+     */
+    static UploadJournalRecovery recover(const std::string& directory, const std::string& stream_name,
+                                         RecordVisitor visitor, uint64_t before_generation = UINT64_MAX);
+
+    /**
+     * Deletes the generations of the journal of the stream below before_generation, e.g. once they have been
+     * recovered, along with the journal directory once empty.
+     */
+    static void discard(const std::string& directory, const std::string& stream_name,
+                        uint64_t before_generation = UINT64_MAX);
+
+private:
+    struct Segment {
+        uint64_t number;
+        std::string path;
+
+        /**
+         * Last fragment with frames in the segment
+         */
+        uint64_t last_fragment;
+    };
+
+    struct PendingFragment {
+        uint64_t fragment;
+        uint64_t pts_ms;
+        uint64_t dts_ms;
+    };
+
+    bool openSegment(uint64_t number);
+    void writeRecord(UPLOAD_JOURNAL_RECORD_TYPE type, const uint8_t* header, uint32_t header_size,
+                     const uint8_t* data, uint32_t data_size);
+    void deletePersistedSegments();
+    void runSync();
+
+    /**
+     * Flushes the current segment and syncs it along with the retired ones, closing the latter.
+     */
+    void syncSegments();
+
+    const UploadJournalConfig config_;
+    const std::string journal_directory_;
+    mutable std::mutex mutex_;
+
+    /**
+     * First segment number of this journal instance
+     */
+    uint64_t generation_;
+
+    FILE* file_;
+    uint64_t file_size_;
+
+    /**
+     * Rolled over segments awaiting their final sync before being closed by the sync thread
+     */
+    std::vector<FILE*> retired_files_;
+
+    std::deque<Segment> segments_;
+    std::deque<PendingFragment> pending_fragments_;
+    std::map<uint64_t, std::vector<uint8_t>> codec_private_data_;
+
+    /**
+     * Fragment of the most recent frames, the frames before the first key frame are in fragment 0
+     */
+    uint64_t fragment_;
+
+    /**
+     * Last fragment known to be persisted
+     */
+    uint64_t persisted_fragment_;
+
+    /**
+     * Whether a write has failed, after which the journal stops recording
+     */
+    bool failed_;
+
+    /**
+     * Serializes the syncs of the background thread with the explicit ones
+     */
+    std::mutex segment_sync_mutex_;
+
+    std::mutex sync_mutex_;
+    std::condition_variable sync_cv_;
+    bool sync_stop_;
+    std::thread sync_thread_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
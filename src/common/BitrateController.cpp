@@ -0,0 +1,79 @@
+#include "BitrateController.h"
+
+#include <algorithm>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using std::chrono::steady_clock;
+
+BitrateController::BitrateController(const BitrateControllerConfig& config)
+        : config_(config),
+          transfer_rate_kbps_(0),
+          pressure_reported_(false),
+          pending_change_(false) {
+    uint32_t initial_kbps = 0 != config_.initial_bitrate_kbps ? config_.initial_bitrate_kbps : config_.max_bitrate_kbps;
+    target_kbps_ = std::max(config_.min_bitrate_kbps, std::min(config_.max_bitrate_kbps, initial_kbps));
+
+    // The encoder might run at anything, a cut mustn't end up raising its bitrate
+    applied_kbps_ = config_.initial_bitrate_kbps;
+    pending_change_.store(target_kbps_ != applied_kbps_, std::memory_order_release);
+}
+
+void BitrateController::reportPressure(steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_pressure_ = now;
+    if (pressure_reported_ && now - last_decrease_ < config_.decrease_interval) {
+        return;
+    }
+
+    pressure_reported_ = true;
+    last_decrease_ = now;
+
+    uint64_t decreased_kbps = (uint64_t) (target_kbps_ * config_.decrease_factor);
+    if (0 != transfer_rate_kbps_) {
+        decreased_kbps = std::min(decreased_kbps, (uint64_t) (transfer_rate_kbps_ * config_.transfer_rate_headroom));
+    }
+
+    target_kbps_ = (uint32_t) std::max((uint64_t) config_.min_bitrate_kbps, decreased_kbps);
+    if (target_kbps_ != applied_kbps_) {
+        pending_change_.store(true, std::memory_order_release);
+    }
+}
+
+void BitrateController::reportTransferRate(uint64_t bytes_per_second) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    transfer_rate_kbps_ = bytes_per_second * 8 / 1000;
+}
+
+bool BitrateController::update(uint32_t& bitrate_kbps, steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Climb back only once the pressure has been gone for the hold time
+    if (pressure_reported_ && target_kbps_ < config_.max_bitrate_kbps &&
+        now - last_pressure_ >= config_.increase_hold &&
+        now - last_increase_ >= config_.increase_interval) {
+        // 64-bit so neither the step nor the increased target can wrap around for large bitrates or steps
+        uint64_t step_kbps = std::max((uint64_t) 1, (uint64_t) config_.max_bitrate_kbps * config_.increase_step_percent / 100);
+        target_kbps_ = (uint32_t) std::min((uint64_t) config_.max_bitrate_kbps, (uint64_t) target_kbps_ + step_kbps);
+        last_increase_ = now;
+    }
+
+    pending_change_.store(false, std::memory_order_release);
+    if (target_kbps_ == applied_kbps_) {
+        return false;
+    }
+
+    applied_kbps_ = target_kbps_;
+    bitrate_kbps = applied_kbps_;
+    return true;
+}
+
+uint32_t BitrateController::getTargetBitrate() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return target_kbps_;
+}
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
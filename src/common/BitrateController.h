@@ -0,0 +1,126 @@
+#ifndef __BITRATE_CONTROLLER_H__
+#define __BITRATE_CONTROLLER_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Default factor a cut applies to the current target, a few cuts bring it well below the congestion point
+ */
+#define BITRATE_CONTROLLER_DEFAULT_DECREASE_FACTOR          0.75
+
+/**
+ * Default share of the measured transfer rate a cut never goes above so the backlog can drain
+ */
+#define BITRATE_CONTROLLER_DEFAULT_TRANSFER_RATE_HEADROOM   0.9
+
+/**
+ * Default additive increase step in percent of the max bitrate
+ */
+#define BITRATE_CONTROLLER_DEFAULT_INCREASE_STEP_PERCENT    5
+
+struct BitrateControllerConfig {
+    BitrateControllerConfig()
+            : min_bitrate_kbps(0),
+              max_bitrate_kbps(0),
+              initial_bitrate_kbps(0),
+              decrease_factor(BITRATE_CONTROLLER_DEFAULT_DECREASE_FACTOR),
+              transfer_rate_headroom(BITRATE_CONTROLLER_DEFAULT_TRANSFER_RATE_HEADROOM),
+              increase_step_percent(BITRATE_CONTROLLER_DEFAULT_INCREASE_STEP_PERCENT),
+              decrease_interval(std::chrono::seconds(2)),
+              increase_hold(std::chrono::seconds(10)),
+              increase_interval(std::chrono::seconds(5)) {}
+
+    uint32_t min_bitrate_kbps;
+    uint32_t max_bitrate_kbps;
+
+    /**
+     * Bitrate the encoder starts at. If 0 it's unknown and the first update() applies the max bitrate.
+     */
+    uint32_t initial_bitrate_kbps;
+
+    double decrease_factor;
+    double transfer_rate_headroom;
+    uint32_t increase_step_percent;
+
+    /**
+     * Pressure reported sooner than this after a cut is ignored, the encoder needs time to react
+     * and the client keeps reporting the backlog built before the cut.
+     */
+    std::chrono::milliseconds decrease_interval;
+
+    /**
+     * Time without pressure before the bitrate starts to climb back
+     */
+    std::chrono::milliseconds increase_hold;
+
+    /**
+     * Time between the increase steps
+     */
+    std::chrono::milliseconds increase_interval;
+};
+
+/**
+ * Turns the buffer pressure signals and the measured transfer rate into encoder bitrate targets.
+ *
+ * Multiplicative decrease on pressure, additive increase after a quiet period. The asymmetric timers
+ * are the hysteresis: a cut is immediate but rate limited, while the bitrate only climbs back after
+ * the pressure has been gone for a while, so it doesn't oscillate around the congestion point.
+ *
+ * The pressure and the transfer rate are reported from the client callback threads and only change
+ * the target. The media thread picks the target up with update() and applies it to the encoder.
+ */
+class BitrateController {
+public:
+    explicit BitrateController(const BitrateControllerConfig& config);
+
+    /**
+     * Reports the latency, buffer duration or storage pressure.
+     */
+    void reportPressure(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+     * Reports the measured upload rate the cuts are capped by.
+     */
+    void reportTransferRate(uint64_t bytes_per_second);
+
+    /**
+     * Steps the increase timer and returns the new target if it differs from the last one returned.
+     *
+     * @param bitrate_kbps Receives the new target.
+     * @return Whether the bitrate should be changed.
+     */
+    bool update(uint32_t& bitrate_kbps, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+     * Cheap check for the media thread whether a cut is waiting to be applied.
+     */
+    bool hasPendingChange() const {
+        return pending_change_.load(std::memory_order_acquire);
+    }
+
+    uint32_t getTargetBitrate() const;
+
+private:
+    const BitrateControllerConfig config_;
+    mutable std::mutex mutex_;
+    uint32_t target_kbps_;
+    uint32_t applied_kbps_;
+    uint64_t transfer_rate_kbps_;
+    bool pressure_reported_;
+    std::chrono::steady_clock::time_point last_pressure_;
+    std::chrono::steady_clock::time_point last_decrease_;
+    std::chrono::steady_clock::time_point last_increase_;
+    std::atomic<bool> pending_change_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
+
+#endif //__BITRATE_CONTROLLER_H__
@@ -0,0 +1,112 @@
+#include "FrameBufferPool.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+namespace {
+    uint32_t roundUpToPowerOfTwo(uint32_t size) {
+        uint32_t rounded = 1;
+        while (rounded < size && rounded < (1u << 31)) {
+            rounded <<= 1;
+        }
+
+        return rounded;
+    }
+}
+
+FrameBufferPool::FrameBufferPool(uint32_t min_buffer_size, uint32_t max_buffer_size, uint32_t max_free_per_class) :
+        min_buffer_size_(roundUpToPowerOfTwo(min_buffer_size)),
+        max_buffer_size_(roundUpToPowerOfTwo(max_buffer_size)),
+        max_free_per_class_(max_free_per_class),
+        allocation_count_(0) {
+    if (max_buffer_size_ < min_buffer_size_) {
+        max_buffer_size_ = min_buffer_size_;
+    }
+
+    uint32_t class_count = 1;
+    while (classSize(class_count - 1) < max_buffer_size_) {
+        class_count++;
+    }
+
+    size_classes_ = std::vector<SizeClass>(class_count);
+    for (auto& size_class : size_classes_) {
+        // Releasing never grows the free list so the recycling itself doesn't allocate
+        size_class.free_buffers.reserve(max_free_per_class_);
+    }
+}
+
+FrameBufferPool::~FrameBufferPool() {
+    for (auto& size_class : size_classes_) {
+        for (auto data : size_class.free_buffers) {
+            delete [] data;
+        }
+    }
+}
+
+FrameBufferPool::Buffer FrameBufferPool::acquire(uint32_t size) {
+    uint32_t index = classIndex(size);
+    if (index == size_classes_.size()) {
+        return Buffer(this, allocate(size), size);
+    }
+
+    SizeClass& size_class = size_classes_[index];
+    {
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        if (!size_class.free_buffers.empty()) {
+            uint8_t* data = size_class.free_buffers.back();
+            size_class.free_buffers.pop_back();
+            return Buffer(this, data, classSize(index));
+        }
+    }
+
+    return Buffer(this, allocate(classSize(index)), classSize(index));
+}
+
+void FrameBufferPool::reserve(uint32_t size, uint32_t count) {
+    uint32_t index = classIndex(size);
+    if (index == size_classes_.size()) {
+        return;
+    }
+
+    SizeClass& size_class = size_classes_[index];
+    std::lock_guard<std::mutex> lock(size_class.mutex);
+    while (size_class.free_buffers.size() < count && size_class.free_buffers.size() < max_free_per_class_) {
+        size_class.free_buffers.push_back(allocate(classSize(index)));
+    }
+}
+
+uint32_t FrameBufferPool::classIndex(uint32_t size) const {
+    if (size > max_buffer_size_) {
+        return (uint32_t) size_classes_.size();
+    }
+
+    uint32_t index = 0;
+    while (classSize(index) < size) {
+        index++;
+    }
+
+    return index;
+}
+
+uint8_t* FrameBufferPool::allocate(uint32_t size) {
+    allocation_count_++;
+    return new uint8_t[size];
+}
+
+void FrameBufferPool::release(uint8_t* data, uint32_t capacity) {
+    uint32_t index = classIndex(capacity);
+    if (index != size_classes_.size() && classSize(index) == capacity) {
+        SizeClass& size_class = size_classes_[index];
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        if (size_class.free_buffers.size() < max_free_per_class_) {
+            size_class.free_buffers.push_back(data);
+            return;
+        }
+    }
+
+    delete [] data;
+}
+
+}
+}
+}
+}
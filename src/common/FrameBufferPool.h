@@ -0,0 +1,168 @@
+#ifndef __FRAME_BUFFER_POOL_H__
+#define __FRAME_BUFFER_POOL_H__
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Default size of the smallest buffer size class
+ */
+#define DEFAULT_FRAME_BUFFER_POOL_MIN_SIZE                  (4 * 1024)
+
+/**
+ * Default size of the largest buffer size class
+ */
+#define DEFAULT_FRAME_BUFFER_POOL_MAX_SIZE                  (16 * 1024 * 1024)
+
+/**
+ * Default number of released buffers kept per size class
+ */
+#define DEFAULT_FRAME_BUFFER_POOL_MAX_FREE_PER_CLASS        8
+
+/**
+ * Thread-safe pool of frame staging buffers.
+ *
+ * Buffers are handed out in power of two size classes between the min and the max size and are recycled
+ * into the free list of their class when released, so a steady stream of similarly sized frames stops
+ * hitting the heap after the first few frames. Requests above the max size are served with an exact size
+ * allocation which is freed on release.
+ *
+ * NOTE: The pool must outlive the buffers acquired from it.
+ */
+class FrameBufferPool {
+public:
+    /**
+     * Move-only handle to a pooled buffer. Returns the buffer to the pool when reset or destroyed.
+     */
+    class Buffer {
+    public:
+        Buffer() : pool_(nullptr), data_(nullptr), capacity_(0) {}
+
+        Buffer(Buffer&& other) : pool_(other.pool_), data_(other.data_), capacity_(other.capacity_) {
+            other.pool_ = nullptr;
+            other.data_ = nullptr;
+            other.capacity_ = 0;
+        }
+
+        Buffer& operator=(Buffer&& other) {
+            if (this != &other) {
+                reset();
+                pool_ = other.pool_;
+                data_ = other.data_;
+                capacity_ = other.capacity_;
+                other.pool_ = nullptr;
+                other.data_ = nullptr;
+                other.capacity_ = 0;
+            }
+
+            return *this;
+        }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        ~Buffer() {
+            reset();
+        }
+
+        uint8_t* data() const {
+            return data_;
+        }
+
+        /**
+         * Usable size which is at least the requested size.
+         */
+        uint32_t capacity() const {
+            return capacity_;
+        }
+
+        /**
+         * Returns the buffer to the pool.
+         */
+        void reset() {
+            if (nullptr != pool_) {
+                pool_->release(data_, capacity_);
+            }
+
+            pool_ = nullptr;
+            data_ = nullptr;
+            capacity_ = 0;
+        }
+
+    private:
+        friend class FrameBufferPool;
+
+        Buffer(FrameBufferPool* pool, uint8_t* data, uint32_t capacity) : pool_(pool), data_(data), capacity_(capacity) {}
+
+        FrameBufferPool* pool_;
+        uint8_t* data_;
+        uint32_t capacity_;
+    };
+
+    /**
+     * @param min_buffer_size Smallest size class. Rounded up to a power of two.
+     * @param max_buffer_size Largest pooled size class. Rounded up to a power of two.
+     * @param max_free_per_class Max number of free buffers retained per size class.
+     */
+    FrameBufferPool(uint32_t min_buffer_size = DEFAULT_FRAME_BUFFER_POOL_MIN_SIZE,
+                    uint32_t max_buffer_size = DEFAULT_FRAME_BUFFER_POOL_MAX_SIZE,
+                    uint32_t max_free_per_class = DEFAULT_FRAME_BUFFER_POOL_MAX_FREE_PER_CLASS);
+
+    ~FrameBufferPool();
+
+    FrameBufferPool(const FrameBufferPool&) = delete;
+    FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+    /**
+     * Returns a buffer of at least the requested size, reusing a free one of the matching size class if possible.
+     */
+    Buffer acquire(uint32_t size);
+
+    /**
+     * Pre-allocates free buffers of the size class serving the given size.
+     */
+    void reserve(uint32_t size, uint32_t count);
+
+    /**
+     * Number of heap allocations the pool has made. Stays flat once the pool is warm.
+     */
+    uint64_t getAllocationCount() const {
+        return allocation_count_.load();
+    }
+
+private:
+    struct SizeClass {
+        std::mutex mutex;
+        std::vector<uint8_t*> free_buffers;
+    };
+
+    /**
+     * Index of the size class serving the size or the class count if the size is above the max.
+     */
+    uint32_t classIndex(uint32_t size) const;
+
+    uint32_t classSize(uint32_t index) const {
+        return min_buffer_size_ << index;
+    }
+
+    uint8_t* allocate(uint32_t size);
+
+    void release(uint8_t* data, uint32_t capacity);
+
+    uint32_t min_buffer_size_;
+    uint32_t max_buffer_size_;
+    const uint32_t max_free_per_class_;
+    std::vector<SizeClass> size_classes_;
+    std::atomic<uint64_t> allocation_count_;
+};
+
+}
+}
+}
+}
+
+#endif //__FRAME_BUFFER_POOL_H__
@@ -0,0 +1,129 @@
+#include "FrameReorderQueue.h"
+
+#include <algorithm>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+FrameReorderQueue::FrameReorderQueue(const std::vector<uint32_t>& max_track_queue_sizes,
+                                     std::chrono::milliseconds max_skew,
+                                     EmitFunc emit) :
+        max_skew_(std::chrono::duration_cast<std::chrono::nanoseconds>(max_skew).count() / DEFAULT_TIME_UNIT_IN_NANOS),
+        emit_(emit),
+        next_sequence_(0),
+        latest_pts_(0) {
+    tracks_.resize(max_track_queue_sizes.size());
+    for (size_t i = 0; i < tracks_.size(); i++) {
+        tracks_[i].max_size = std::max<uint32_t>(max_track_queue_sizes[i], 1);
+        tracks_[i].heap.reserve(tracks_[i].max_size);
+    }
+}
+
+FrameReorderQueue::~FrameReorderQueue() {
+    flush();
+}
+
+void FrameReorderQueue::push(uint32_t track_index, const Frame& frame, FrameBufferPool::Buffer buffer) {
+    TrackQueue& track = tracks_[track_index];
+
+    // Make room first so that the heap never outgrows its bound
+    while (track.heap.size() >= track.max_size) {
+        emitReady(true);
+    }
+
+    PendingFrame pending;
+    pending.frame = frame;
+    pending.buffer = std::move(buffer);
+    pending.sequence = next_sequence_++;
+    pending.queued_time = std::chrono::steady_clock::now();
+
+    track.heap.push_back(std::move(pending));
+    std::push_heap(track.heap.begin(), track.heap.end(), laterInDecodingOrder);
+    latest_pts_ = std::max<uint64_t>(latest_pts_, frame.presentationTs);
+
+    emitReady(false);
+}
+
+void FrameReorderQueue::flush() {
+    while (size() != 0) {
+        emitReady(true);
+    }
+}
+
+size_t FrameReorderQueue::size() const {
+    size_t size = 0;
+    for (auto& track : tracks_) {
+        size += track.heap.size();
+    }
+
+    return size;
+}
+
+bool FrameReorderQueue::laterInDecodingOrder(const PendingFrame& first, const PendingFrame& second) {
+    if (first.frame.decodingTs != second.frame.decodingTs) {
+        return first.frame.decodingTs > second.frame.decodingTs;
+    }
+
+    return first.sequence > second.sequence;
+}
+
+bool FrameReorderQueue::emitsBefore(const PendingFrame& first, const PendingFrame& second) {
+    if (first.frame.presentationTs != second.frame.presentationTs) {
+        return first.frame.presentationTs < second.frame.presentationTs;
+    }
+
+    // A key frame starts the cluster so it goes ahead of the other frames with the same timestamp
+    bool first_key = CHECK_FRAME_FLAG_KEY_FRAME(first.frame.flags);
+    bool second_key = CHECK_FRAME_FLAG_KEY_FRAME(second.frame.flags);
+    if (first_key != second_key) {
+        return first_key;
+    }
+
+    return first.sequence < second.sequence;
+}
+
+void FrameReorderQueue::emitReady(bool force) {
+    while (true) {
+        TrackQueue* next = nullptr;
+        bool all_tracks_pending = true;
+
+        for (auto& track : tracks_) {
+            if (track.heap.empty()) {
+                all_tracks_pending = false;
+            } else if (nullptr == next || emitsBefore(track.heap.front(), next->heap.front())) {
+                next = &track;
+            }
+        }
+
+        if (nullptr == next) {
+            return;
+        }
+
+        const Frame& head = next->heap.front().frame;
+        bool skewed = latest_pts_ > head.presentationTs && latest_pts_ - head.presentationTs > max_skew_;
+        if (!all_tracks_pending && !force && !skewed) {
+            return;
+        }
+
+        std::pop_heap(next->heap.begin(), next->heap.end(), laterInDecodingOrder);
+        PendingFrame pending = std::move(next->heap.back());
+        next->heap.pop_back();
+
+        auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - pending.queued_time);
+        stats_.frame_count++;
+        stats_.total_latency += latency;
+        stats_.max_latency = std::max(stats_.max_latency, latency);
+
+        emit_(pending.frame);
+
+        // Forced emission only needs to free up a single slot
+        if (force) {
+            return;
+        }
+    }
+}
+
+}
+}
+}
+}
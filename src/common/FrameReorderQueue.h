@@ -0,0 +1,131 @@
+#ifndef __FRAME_REORDER_QUEUE_H__
+#define __FRAME_REORDER_QUEUE_H__
+
+#include "FrameBufferPool.h"
+#include "com/amazonaws/kinesis/video/client/Include.h"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Default max presentation timestamp skew between the tracks before the pending frames are emitted anyway
+ */
+#define DEFAULT_MAX_TRACK_SKEW_MS                           500
+
+/**
+ * Multi-track reorder stage which emits the frames of several tracks in cluster safe order.
+ *
+ * Each track has a bounded min-heap of the pending frames keyed by the decoding timestamp so that a
+ * track is always emitted in its decoding order even with B-frames. Across the tracks the pending frame
+ * with the lowest presentation timestamp is emitted next, a key frame winning the ties, but only once
+ * every track has a frame pending - otherwise a late frame of a silent track could still land before
+ * a key frame which has already started a new cluster. A track which stays silent for more than the max
+ * skew, or a full track heap, lets the emission proceed without it.
+ *
+ * The cost is O(log n) per frame. With this stage in front of the stream the stream can use
+ * FRAME_ORDER_MODE_PASS_THROUGH.
+ */
+class FrameReorderQueue {
+public:
+    /**
+     * Receives the frames in emission order. The frame data is valid for the duration of the call only.
+     */
+    using EmitFunc = std::function<void(Frame& frame)>;
+
+    /**
+     * Time the frames spent in the reorder stage.
+     */
+    struct ReorderStats {
+        uint64_t frame_count = 0;
+        std::chrono::nanoseconds total_latency = std::chrono::nanoseconds::zero();
+        std::chrono::nanoseconds max_latency = std::chrono::nanoseconds::zero();
+    };
+
+    /**
+     * @param max_track_queue_sizes Max number of pending frames for each of the tracks.
+     * @param max_skew Max presentation time span to buffer while waiting for a silent track.
+     * @param emit Frame emission function.
+     */
+    FrameReorderQueue(const std::vector<uint32_t>& max_track_queue_sizes,
+                      std::chrono::milliseconds max_skew,
+                      EmitFunc emit);
+
+    /**
+     * Emits the frames still pending.
+     */
+    ~FrameReorderQueue();
+
+    /**
+     * Queues the frame and emits whatever has become safe to emit.
+     *
+     * @param track_index Index of the track in the max_track_queue_sizes.
+     * @param frame Frame to queue. The frame data must be held by the buffer.
+     * @param buffer Buffer holding the frame data, recycled once the frame has been emitted.
+     */
+    void push(uint32_t track_index, const Frame& frame, FrameBufferPool::Buffer buffer);
+
+    /**
+     * Emits all of the pending frames in order.
+     */
+    void flush();
+
+    /**
+     * Number of pending frames across the tracks.
+     */
+    size_t size() const;
+
+    const ReorderStats& getStats() const {
+        return stats_;
+    }
+
+private:
+    struct PendingFrame {
+        Frame frame;
+        FrameBufferPool::Buffer buffer;
+        uint64_t sequence;
+        std::chrono::steady_clock::time_point queued_time;
+    };
+
+    struct TrackQueue {
+        std::vector<PendingFrame> heap;
+        uint32_t max_size;
+    };
+
+    /**
+     * Heap comparator turning the vector into a min-heap on the decoding order.
+     */
+    static bool laterInDecodingOrder(const PendingFrame& first, const PendingFrame& second);
+
+    /**
+     * Whether the first frame has to be emitted before the second one across the tracks.
+     */
+    static bool emitsBefore(const PendingFrame& first, const PendingFrame& second);
+
+    /**
+     * Emits the frames which are safe to emit.
+     *
+     * @param force Whether to emit regardless of the silent tracks.
+     */
+    void emitReady(bool force);
+
+    std::vector<TrackQueue> tracks_;
+    const uint64_t max_skew_;
+    EmitFunc emit_;
+    uint64_t next_sequence_;
+
+    /**
+     * Highest presentation timestamp queued so far
+     */
+    uint64_t latest_pts_;
+    ReorderStats stats_;
+};
+
+}
+}
+}
+}
+
+#endif //__FRAME_REORDER_QUEUE_H__
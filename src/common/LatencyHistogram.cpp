@@ -0,0 +1,90 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using std::chrono::microseconds;
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::record(microseconds latency) {
+    uint64_t value = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) : 0;
+    counts_[bucketIndex(value)]++;
+    count_++;
+    sum_ += value;
+    max_ = std::max(max_, value);
+}
+
+microseconds LatencyHistogram::getPercentile(double percentile) const {
+    if (0 == count_) {
+        return microseconds(0);
+    }
+
+    uint64_t target = static_cast<uint64_t>(std::ceil(percentile / 100 * count_));
+    target = std::min(std::max(target, (uint64_t) 1), count_);
+
+    uint64_t cumulative = 0;
+    for (uint32_t i = 0; i < BUCKET_COUNT; i++) {
+        cumulative += counts_[i];
+        if (cumulative >= target) {
+            return microseconds(std::min(bucketHighestValue(i), max_));
+        }
+    }
+
+    return microseconds(max_);
+}
+
+LatencyPercentiles LatencyHistogram::getPercentiles() const {
+    LatencyPercentiles percentiles;
+    percentiles.count = count_;
+    percentiles.sum = microseconds(sum_);
+    percentiles.p50 = getPercentile(50);
+    percentiles.p90 = getPercentile(90);
+    percentiles.p99 = getPercentile(99);
+    percentiles.max = microseconds(max_);
+
+    return percentiles;
+}
+
+void LatencyHistogram::reset() {
+    counts_.fill(0);
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+}
+
+uint32_t LatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<uint32_t>(value);
+    }
+
+    value = std::min(value, ((uint64_t) 1 << LATENCY_HISTOGRAM_MAX_VALUE_BITS) - 1);
+    uint32_t msb = LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    while (value >> (msb + 1)) {
+        msb++;
+    }
+
+    // Keep the top bits of the value which fall into the upper half of the sub-buckets
+    uint32_t shift = msb - (LATENCY_HISTOGRAM_SUB_BUCKET_BITS - 1);
+    uint32_t sub_bucket = static_cast<uint32_t>(value >> shift);
+    return SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF_COUNT + sub_bucket - SUB_BUCKET_HALF_COUNT;
+}
+
+uint64_t LatencyHistogram::bucketHighestValue(uint32_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+
+    uint32_t shift = (index - SUB_BUCKET_COUNT) / SUB_BUCKET_HALF_COUNT + 1;
+    uint64_t sub_bucket = (index - SUB_BUCKET_COUNT) % SUB_BUCKET_HALF_COUNT + SUB_BUCKET_HALF_COUNT;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+}
+}
+}
+}
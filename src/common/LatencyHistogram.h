@@ -0,0 +1,92 @@
+#ifndef __LATENCY_HISTOGRAM_H__
+#define __LATENCY_HISTOGRAM_H__
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Sub-buckets per power of two as a power of two, 2^6 keep the recorded values within ~3% of the actual ones
+ */
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS                   6
+
+/**
+ * Latencies are tracked in microseconds up to 2^36us (~19h), longer ones land in the highest bucket
+ */
+#define LATENCY_HISTOGRAM_MAX_VALUE_BITS                    36
+
+/**
+ * Percentiles of the latencies recorded into a histogram.
+ */
+struct LatencyPercentiles {
+    LatencyPercentiles() : count(0), sum(0), p50(0), p90(0), p99(0), max(0) {}
+
+    uint64_t count;
+    std::chrono::microseconds sum;
+    std::chrono::microseconds p50;
+    std::chrono::microseconds p90;
+    std::chrono::microseconds p99;
+    std::chrono::microseconds max;
+};
+
+/**
+ * Fixed size HDR-style latency histogram.
+ *
+ * The buckets are linear below 2^LATENCY_HISTOGRAM_SUB_BUCKET_BITS microseconds and split every further
+ * power of two into the same number of sub-buckets, so the relative precision is constant over the whole
+ * range while recording is a few shifts and an increment without any allocation.
+ *
+ * NOTE: The histogram is not thread-safe.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    /**
+     * Records a single latency. Negative latencies are recorded as zero.
+     */
+    void record(std::chrono::microseconds latency);
+
+    /**
+     * @return Number of the recorded latencies.
+     */
+    uint64_t getCount() const {
+        return count_;
+    }
+
+    /**
+     * @param percentile Percentile in the range of (0, 100].
+     * @return The highest latency equivalent to the one at the given percentile or 0 if nothing has been recorded.
+     */
+    std::chrono::microseconds getPercentile(double percentile) const;
+
+    /**
+     * @return The count, sum, p50, p90, p99 and the max of the recorded latencies.
+     */
+    LatencyPercentiles getPercentiles() const;
+
+    void reset();
+
+private:
+    static const uint32_t SUB_BUCKET_COUNT = 1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    static const uint32_t SUB_BUCKET_HALF_COUNT = SUB_BUCKET_COUNT / 2;
+    static const uint32_t BUCKET_COUNT = SUB_BUCKET_COUNT +
+            (LATENCY_HISTOGRAM_MAX_VALUE_BITS - LATENCY_HISTOGRAM_SUB_BUCKET_BITS) * SUB_BUCKET_HALF_COUNT;
+
+    static uint32_t bucketIndex(uint64_t value);
+    static uint64_t bucketHighestValue(uint32_t index);
+
+    std::array<uint64_t, BUCKET_COUNT> counts_;
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
+}
+}
+}
+}
+
+#endif //__LATENCY_HISTOGRAM_H__
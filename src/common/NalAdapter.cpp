@@ -0,0 +1,359 @@
+#include "NalAdapter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NAL_ADAPTER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define NAL_ADAPTER_NEON
+#endif
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+namespace {
+    const uint8_t H264_NAL_TYPE_SPS = 7;
+    const uint8_t H264_NAL_TYPE_PPS = 8;
+    const uint8_t H265_NAL_TYPE_VPS = 32;
+    const uint8_t H265_NAL_TYPE_SPS = 33;
+    const uint8_t H265_NAL_TYPE_PPS = 34;
+    const size_t H265_PROFILE_TIER_LEVEL_SIZE = 12;
+
+    struct NalUnit {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    /**
+     * Splits AVCC data into its NALs, stopping at the first malformed length.
+     */
+    std::vector<NalUnit> splitAvcc(const uint8_t* avcc, size_t size) {
+        std::vector<NalUnit> nals;
+        size_t offset = 0;
+        while (offset + AVCC_NAL_LENGTH_SIZE <= size) {
+            size_t nal_size = ((size_t) avcc[offset] << 24) | ((size_t) avcc[offset + 1] << 16) |
+                              ((size_t) avcc[offset + 2] << 8) | avcc[offset + 3];
+            offset += AVCC_NAL_LENGTH_SIZE;
+            if (nal_size == 0 || nal_size > size - offset) {
+                break;
+            }
+
+            NalUnit nal = {avcc + offset, nal_size};
+            nals.push_back(nal);
+            offset += nal_size;
+        }
+
+        return nals;
+    }
+
+    bool nalLess(const NalUnit& first, const NalUnit& second) {
+        return std::lexicographical_compare(first.data, first.data + first.size, second.data, second.data + second.size);
+    }
+
+    bool nalEqual(const NalUnit& first, const NalUnit& second) {
+        return first.size == second.size && !memcmp(first.data, second.data, first.size);
+    }
+
+    /**
+     * Orders the parameter sets by their bytes and removes the repeated ones so that an encoder re-sending the
+     * same parameter sets in another order or more than once builds the same codec private data.
+     */
+    void normalizeParameterSets(std::vector<NalUnit>& nals) {
+        std::sort(nals.begin(), nals.end(), nalLess);
+        nals.erase(std::unique(nals.begin(), nals.end(), nalEqual), nals.end());
+    }
+
+    void appendNal(std::vector<uint8_t>& cpd, const NalUnit& nal) {
+        cpd.push_back((uint8_t) (nal.size >> 8));
+        cpd.push_back((uint8_t) nal.size);
+        cpd.insert(cpd.end(), nal.data, nal.data + nal.size);
+    }
+
+    /**
+     * Reads the exp-Golomb coded fields of an RBSP, the emulation prevention bytes removed.
+     */
+    class BitReader {
+    public:
+        BitReader(const std::vector<uint8_t>& rbsp, size_t byte_offset) : rbsp_(rbsp), position_(byte_offset * 8) {}
+
+        uint32_t readBits(uint32_t count) {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                value = (value << 1) | readBit();
+            }
+
+            return value;
+        }
+
+        void skipBits(size_t count) {
+            position_ += count;
+        }
+
+        uint32_t readUnsignedExpGolomb() {
+            uint32_t leading_zeros = 0;
+            while (!overrun() && readBit() == 0 && leading_zeros < 32) {
+                leading_zeros++;
+            }
+
+            return (uint32_t) ((1ull << leading_zeros) - 1 + readBits(leading_zeros));
+        }
+
+        bool overrun() const {
+            return position_ > rbsp_.size() * 8;
+        }
+
+    private:
+        uint32_t readBit() {
+            size_t byte = position_ >> 3;
+            uint32_t bit = byte < rbsp_.size() ? (rbsp_[byte] >> (7 - (position_ & 7))) & 1 : 0;
+            position_++;
+            return bit;
+        }
+
+        const std::vector<uint8_t>& rbsp_;
+        size_t position_;
+    };
+
+    std::vector<uint8_t> removeEmulationPrevention(const NalUnit& nal) {
+        std::vector<uint8_t> rbsp;
+        rbsp.reserve(nal.size);
+        uint32_t zero_count = 0;
+        for (size_t i = 0; i < nal.size; i++) {
+            if (zero_count >= 2 && nal.data[i] == 3) {
+                zero_count = 0;
+                continue;
+            }
+
+            zero_count = nal.data[i] == 0 ? zero_count + 1 : 0;
+            rbsp.push_back(nal.data[i]);
+        }
+
+        return rbsp;
+    }
+}
+
+const uint8_t* NalAdapter::findStartCode(const uint8_t* begin, const uint8_t* end) {
+    const uint8_t* current = begin;
+
+#if defined(NAL_ADAPTER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    // Three overlapping loads match 00 00 01 at each of the 16 positions, the match itself is found below
+    while (end - current >= 16 + 2) {
+        __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) current), zero);
+        __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (current + 1)), zero);
+        __m128i third = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (current + 2)), one);
+        if (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(first, second), third)) != 0) {
+            break;
+        }
+
+        current += 16;
+    }
+#elif defined(NAL_ADAPTER_NEON)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+    while (end - current >= 16 + 2) {
+        uint8x16_t first = vceqq_u8(vld1q_u8(current), zero);
+        uint8x16_t second = vceqq_u8(vld1q_u8(current + 1), zero);
+        uint8x16_t third = vceqq_u8(vld1q_u8(current + 2), one);
+        uint64x2_t match = vreinterpretq_u64_u8(vandq_u8(vandq_u8(first, second), third));
+        if ((vgetq_lane_u64(match, 0) | vgetq_lane_u64(match, 1)) != 0) {
+            break;
+        }
+
+        current += 16;
+    }
+#endif
+
+    for (; end - current >= (ptrdiff_t) ANNEXB_START_CODE_SIZE; current++) {
+        if (current[0] == 0 && current[1] == 0 && current[2] == 1) {
+            return current;
+        }
+    }
+
+    return end;
+}
+
+bool NalAdapter::isAnnexB(const uint8_t* data, size_t size) {
+    size_t offset = 0;
+    while (offset < size && data[offset] == 0) {
+        offset++;
+    }
+
+    return offset >= 2 && offset < size && data[offset] == 1;
+}
+
+size_t NalAdapter::annexBToAvcc(const uint8_t* annexb, size_t size, uint8_t* avcc, size_t capacity) {
+    if (!isAnnexB(annexb, size)) {
+        return 0;
+    }
+
+    const uint8_t* end = annexb + size;
+    const uint8_t* start_code = findStartCode(annexb, end);
+    size_t written = 0;
+
+    while (start_code != end) {
+        const uint8_t* nal = start_code + ANNEXB_START_CODE_SIZE;
+        const uint8_t* next_start_code = findStartCode(nal, end);
+
+        // A NAL never ends with a zero byte so these are the trailing zeros or the zero of a 4 byte start code
+        const uint8_t* nal_end = next_start_code;
+        while (nal_end > nal && nal_end[-1] == 0) {
+            nal_end--;
+        }
+
+        size_t nal_size = nal_end - nal;
+        if (nal_size != 0) {
+            if (written + AVCC_NAL_LENGTH_SIZE + nal_size > capacity || nal_size > UINT32_MAX) {
+                return 0;
+            }
+
+            avcc[written] = (uint8_t) (nal_size >> 24);
+            avcc[written + 1] = (uint8_t) (nal_size >> 16);
+            avcc[written + 2] = (uint8_t) (nal_size >> 8);
+            avcc[written + 3] = (uint8_t) nal_size;
+            memcpy(avcc + written + AVCC_NAL_LENGTH_SIZE, nal, nal_size);
+            written += AVCC_NAL_LENGTH_SIZE + nal_size;
+        }
+
+        start_code = next_start_code;
+    }
+
+    return written;
+}
+
+bool NalAdapter::buildH264Cpd(const uint8_t* avcc, size_t size, std::vector<uint8_t>& cpd) {
+    std::vector<NalUnit> sps, pps;
+    for (auto& nal : splitAvcc(avcc, size)) {
+        uint8_t type = nal.data[0] & 0x1f;
+        if (type == H264_NAL_TYPE_SPS && nal.size >= 4) {
+            sps.push_back(nal);
+        } else if (type == H264_NAL_TYPE_PPS) {
+            pps.push_back(nal);
+        }
+    }
+
+    normalizeParameterSets(sps);
+    normalizeParameterSets(pps);
+    if (sps.empty() || pps.empty() || sps.size() > 0x1f || pps.size() > 0xff) {
+        return false;
+    }
+
+    cpd.clear();
+    cpd.push_back(1);
+    // Profile, profile compatibility and level from the first SPS
+    cpd.insert(cpd.end(), sps[0].data + 1, sps[0].data + 4);
+    // 4 byte NAL lengths
+    cpd.push_back(0xfc | (AVCC_NAL_LENGTH_SIZE - 1));
+    cpd.push_back((uint8_t) (0xe0 | sps.size()));
+    for (auto& nal : sps) {
+        appendNal(cpd, nal);
+    }
+
+    cpd.push_back((uint8_t) pps.size());
+    for (auto& nal : pps) {
+        appendNal(cpd, nal);
+    }
+
+    return true;
+}
+
+bool NalAdapter::buildH265Cpd(const uint8_t* avcc, size_t size, std::vector<uint8_t>& cpd) {
+    // Parameter set arrays in the VPS, SPS, PPS order the record expects
+    std::vector<NalUnit> parameter_sets[3];
+    for (auto& nal : splitAvcc(avcc, size)) {
+        uint8_t type = (nal.data[0] >> 1) & 0x3f;
+        if (type >= H265_NAL_TYPE_VPS && type <= H265_NAL_TYPE_PPS && nal.size >= 2) {
+            parameter_sets[type - H265_NAL_TYPE_VPS].push_back(nal);
+        }
+    }
+
+    for (auto& nals : parameter_sets) {
+        normalizeParameterSets(nals);
+        if (nals.empty()) {
+            return false;
+        }
+    }
+
+    // The NAL header, the VPS id, the sub-layer count and the nesting flag precede the general profile, tier and level
+    std::vector<uint8_t> sps = removeEmulationPrevention(parameter_sets[1][0]);
+    if (sps.size() < 3 + H265_PROFILE_TIER_LEVEL_SIZE) {
+        return false;
+    }
+
+    uint32_t max_sub_layers_minus1 = (sps[2] >> 1) & 0x07;
+    uint32_t temporal_id_nesting = sps[2] & 0x01;
+
+    BitReader reader(sps, 3 + H265_PROFILE_TIER_LEVEL_SIZE);
+    bool sub_layer_profile_present[8] = {false}, sub_layer_level_present[8] = {false};
+    for (uint32_t i = 0; i < max_sub_layers_minus1; i++) {
+        sub_layer_profile_present[i] = reader.readBits(1) != 0;
+        sub_layer_level_present[i] = reader.readBits(1) != 0;
+    }
+
+    if (max_sub_layers_minus1 > 0) {
+        reader.skipBits(2 * (8 - max_sub_layers_minus1));
+    }
+
+    for (uint32_t i = 0; i < max_sub_layers_minus1; i++) {
+        reader.skipBits((sub_layer_profile_present[i] ? 88 : 0) + (sub_layer_level_present[i] ? 8 : 0));
+    }
+
+    // sps_seq_parameter_set_id
+    reader.readUnsignedExpGolomb();
+    uint32_t chroma_format_idc = reader.readUnsignedExpGolomb();
+    if (chroma_format_idc == 3) {
+        // separate_colour_plane_flag
+        reader.skipBits(1);
+    }
+
+    // Picture width and height
+    reader.readUnsignedExpGolomb();
+    reader.readUnsignedExpGolomb();
+    if (reader.readBits(1) != 0) {
+        // Conformance window offsets
+        for (uint32_t i = 0; i < 4; i++) {
+            reader.readUnsignedExpGolomb();
+        }
+    }
+
+    uint32_t bit_depth_luma_minus8 = reader.readUnsignedExpGolomb();
+    uint32_t bit_depth_chroma_minus8 = reader.readUnsignedExpGolomb();
+    if (reader.overrun() || chroma_format_idc > 3 || bit_depth_luma_minus8 > 7 || bit_depth_chroma_minus8 > 7) {
+        return false;
+    }
+
+    cpd.clear();
+    cpd.push_back(1);
+    cpd.insert(cpd.end(), sps.begin() + 3, sps.begin() + 3 + H265_PROFILE_TIER_LEVEL_SIZE);
+    // No min spatial segmentation, unknown parallelism
+    cpd.push_back(0xf0);
+    cpd.push_back(0x00);
+    cpd.push_back(0xfc);
+    cpd.push_back((uint8_t) (0xfc | chroma_format_idc));
+    cpd.push_back((uint8_t) (0xf8 | bit_depth_luma_minus8));
+    cpd.push_back((uint8_t) (0xf8 | bit_depth_chroma_minus8));
+    // Unknown average frame rate
+    cpd.push_back(0x00);
+    cpd.push_back(0x00);
+    cpd.push_back((uint8_t) (((max_sub_layers_minus1 + 1) << 3) | (temporal_id_nesting << 2) | (AVCC_NAL_LENGTH_SIZE - 1)));
+    cpd.push_back(3);
+    for (uint8_t i = 0; i < 3; i++) {
+        // Complete array of the parameter sets of the type
+        cpd.push_back((uint8_t) (0x80 | (H265_NAL_TYPE_VPS + i)));
+        cpd.push_back((uint8_t) (parameter_sets[i].size() >> 8));
+        cpd.push_back((uint8_t) parameter_sets[i].size());
+        for (auto& nal : parameter_sets[i]) {
+            appendNal(cpd, nal);
+        }
+    }
+
+    return true;
+}
+
+}
+}
+}
+}
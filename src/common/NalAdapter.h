@@ -0,0 +1,83 @@
+#ifndef __NAL_ADAPTER_H__
+#define __NAL_ADAPTER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Size of the shortest Annex-B start code
+ */
+#define ANNEXB_START_CODE_SIZE                              3
+
+/**
+ * Size of the NAL unit length prefix in the AVCC format
+ */
+#define AVCC_NAL_LENGTH_SIZE                                4
+
+/**
+ * Adapts H.264/H.265 elementary streams from the Annex-B byte-stream format to the length-prefixed AVCC
+ * format the stream is packaged in, so byte-stream input doesn't have to be rewritten upstream by a parser.
+ *
+ * The start code scan compares 16 bytes at a time with SSE2 or NEON where available, which is where
+ * nearly all of the time goes as the payload between the start codes is only copied.
+ */
+class NalAdapter {
+public:
+    /**
+     * Finds the next 00 00 01 start code.
+     *
+     * @return Pointer to the first byte of the start code or end if there is none.
+     */
+    static const uint8_t* findStartCode(const uint8_t* begin, const uint8_t* end);
+
+    /**
+     * Whether the data starts with a start code, optionally preceded by zero bytes.
+     */
+    static bool isAnnexB(const uint8_t* data, size_t size);
+
+    /**
+     * Capacity which is always enough for the AVCC adaptation of the Annex-B data of the given size.
+     */
+    static size_t maxAvccSize(size_t annexb_size) {
+        // Worst case is a 3 byte start code in front of every single byte NAL
+        return annexb_size + annexb_size / (ANNEXB_START_CODE_SIZE + 1) + AVCC_NAL_LENGTH_SIZE;
+    }
+
+    /**
+     * Replaces the start codes with the 4 byte big-endian NAL lengths, dropping the trailing zero bytes
+     * and the empty NALs.
+     *
+     * @param annexb Annex-B data starting with a start code.
+     * @param size Size of the Annex-B data.
+     * @param avcc Output buffer, must not overlap with the input.
+     * @param capacity Size of the output buffer, maxAvccSize() is always enough.
+     * @return Size of the AVCC data or 0 if the input is not Annex-B or the output doesn't fit.
+     */
+    static size_t annexBToAvcc(const uint8_t* annexb, size_t size, uint8_t* avcc, size_t capacity);
+
+    /**
+     * Builds the AVCDecoderConfigurationRecord from the SPS and PPS NALs of an AVCC access unit. The parameter
+     * sets are sorted and deduplicated so that the same parameter sets always build the same record.
+     *
+     * @return Whether the access unit carries an SPS and a PPS.
+     */
+    static bool buildH264Cpd(const uint8_t* avcc, size_t size, std::vector<uint8_t>& cpd);
+
+    /**
+     * Builds the HEVCDecoderConfigurationRecord from the VPS, SPS and PPS NALs of an AVCC access unit, the
+     * parameter sets normalized like for H.264.
+     *
+     * @return Whether the access unit carries a VPS, an SPS and a PPS and the SPS could be parsed.
+     */
+    static bool buildH265Cpd(const uint8_t* avcc, size_t size, std::vector<uint8_t>& cpd);
+};
+
+}
+}
+}
+}
+
+#endif //__NAL_ADAPTER_H__
@@ -1,43 +1,73 @@
 #include "PutFrameHelper.h"
 #include <Logger.h>
 
+#include <algorithm>
+
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
 LOGGER_TAG("com.amazonaws.kinesis.video");
 
 using std::shared_ptr;
 
+namespace {
+    const uint32_t VIDEO_TRACK_INDEX = 0;
+    const uint32_t AUDIO_TRACK_INDEX = 1;
+}
+
 PutFrameHelper::PutFrameHelper(
         shared_ptr<KinesisVideoStream> kinesis_video_stream,
         uint64_t mkv_timecode_scale_ns,
         uint32_t max_audio_queue_size,
         uint32_t max_video_queue_size,
         uint32_t initial_buffer_size_audio,
-        uint32_t initial_buffer_size_video) :
+        uint32_t initial_buffer_size_video,
+        std::chrono::milliseconds max_track_skew) :
             kinesis_video_stream(kinesis_video_stream),
-            data_buffer_size(max_video_queue_size),
-            put_frame_status(true) {
-    data_buffer = new uint8_t[data_buffer_size];
+            put_frame_status(true),
+            // Every queued frame holds on to a buffer and one more is being filled
+            audio_buffer_pool(DEFAULT_FRAME_BUFFER_POOL_MIN_SIZE, DEFAULT_FRAME_BUFFER_POOL_MAX_SIZE, max_audio_queue_size + 1),
+            video_buffer_pool(DEFAULT_FRAME_BUFFER_POOL_MIN_SIZE, DEFAULT_FRAME_BUFFER_POOL_MAX_SIZE, max_video_queue_size + 1),
+            multi_track(kinesis_video_stream->getTrackCount() > 1),
+            reorder_queue(multi_track ? std::vector<uint32_t>{max_video_queue_size, max_audio_queue_size}
+                                      : std::vector<uint32_t>{std::max(max_video_queue_size, max_audio_queue_size)},
+                          max_track_skew, [this](Frame& frame) {
+                if (this->kinesis_video_stream->statusPutFrame(frame) != STATUS_SUCCESS) {
+                    put_frame_status = false;
+                    LOG_WARN("Failed to put normal frame");
+                }
+            }) {
+    // Warm up the size classes the frames are expected to land in
+    audio_buffer_pool.reserve(initial_buffer_size_audio, 1);
+    video_buffer_pool.reserve(initial_buffer_size_video, 1);
 }
 
 void PutFrameHelper::putFrameMultiTrack(Frame frame, bool isVideo) {
-    if (kinesis_video_stream->statusPutFrame(frame) != STATUS_SUCCESS) {
-        put_frame_status = false;
-        LOG_WARN("Failed to put normal frame");
+    FrameBufferPool::Buffer& buffer = isVideo ? video_buffer : audio_buffer;
+
+    // The frame data has to outlive the call while queued. Stage it if it's not in our buffer
+    if (frame.size != 0 && (frame.frameData != buffer.data() || frame.size > buffer.capacity())) {
+        buffer = (isVideo ? video_buffer_pool : audio_buffer_pool).acquire(frame.size);
+        memcpy(buffer.data(), frame.frameData, frame.size);
     }
+
+    frame.frameData = buffer.data();
+    reorder_queue.push(isVideo || !multi_track ? VIDEO_TRACK_INDEX : AUDIO_TRACK_INDEX, frame, std::move(buffer));
 }
 
 void PutFrameHelper::flush() {
-    // no-op
+    reorder_queue.flush();
 }
 
 uint8_t *PutFrameHelper::getFrameDataBuffer(uint32_t requested_buffer_size, bool isVideo) {
-    if (requested_buffer_size > data_buffer_size) {
-        delete [] data_buffer;
-        data_buffer_size = requested_buffer_size + requested_buffer_size / 2;
-        data_buffer = new uint8_t[data_buffer_size];
+    FrameBufferPool::Buffer& buffer = isVideo ? video_buffer : audio_buffer;
+
+    if (requested_buffer_size > buffer.capacity()) {
+        // Return the outgrown buffer before taking a larger one
+        buffer.reset();
+        buffer = (isVideo ? video_buffer_pool : audio_buffer_pool).acquire(requested_buffer_size);
     }
-    return data_buffer;
+
+    return buffer.data();
 }
 
 bool PutFrameHelper::putFrameFailed() {
@@ -45,6 +75,9 @@ bool PutFrameHelper::putFrameFailed() {
 }
 
 void PutFrameHelper::putEofr() {
+    // Everything queued belongs to the fragment being closed
+    reorder_queue.flush();
+
     Frame frame = EOFR_FRAME_INITIALIZER;
     if (kinesis_video_stream->statusPutFrame(frame) != STATUS_SUCCESS) {
         put_frame_status = false;
@@ -52,8 +85,15 @@ void PutFrameHelper::putEofr() {
     }
 }
 
+uint64_t PutFrameHelper::getFrameBufferAllocationCount() const {
+    return audio_buffer_pool.getAllocationCount() + video_buffer_pool.getAllocationCount();
+}
+
+const FrameReorderQueue::ReorderStats& PutFrameHelper::getReorderStats() const {
+    return reorder_queue.getStats();
+}
+
 PutFrameHelper::~PutFrameHelper() {
-    delete [] data_buffer;
 }
 
 }
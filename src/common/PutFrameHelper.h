@@ -2,6 +2,8 @@
 #define __PUT_FRAME_HELPER_H__
 
 #include "KinesisVideoProducer.h"
+#include "FrameBufferPool.h"
+#include "FrameReorderQueue.h"
 #include <memory>
 #include <queue>
 #include <vector>
@@ -28,12 +30,33 @@ namespace com { namespace amazonaws { namespace kinesis { namespace video {
  * if the video frame is not a key frame, everything can be put into the stream. If the video frame is a key frame, we
  * need to wait until an audio frame whose pts is greater than or equal to video key frame's pts is enqueued, then the
  * video key frame can be put into the stream.
+ *
+ * The frames are queued in a FrameReorderQueue which emits them in that order so the stream can be created with
+ * FRAME_ORDER_MODE_PASS_THROUGH instead of having the frames reordered again in the client.
  */
 class PutFrameHelper {
     std::shared_ptr<KinesisVideoStream> kinesis_video_stream;
     bool put_frame_status;
-    uint8_t* data_buffer;
-    uint32_t data_buffer_size;
+
+    /**
+     * Frame staging buffers per track type
+     */
+    FrameBufferPool audio_buffer_pool;
+    FrameBufferPool video_buffer_pool;
+
+    /**
+     * Buffers handed out by getFrameDataBuffer(), queued along with their frames and recycled once put
+     */
+    FrameBufferPool::Buffer audio_buffer;
+    FrameBufferPool::Buffer video_buffer;
+
+    /**
+     * Whether the stream has an audio track next to the video track. Otherwise the frames aren't held back
+     * waiting for an audio track that never gets any.
+     */
+    bool multi_track;
+
+    FrameReorderQueue reorder_queue;
 public:
     PutFrameHelper(
             std::shared_ptr<KinesisVideoStream> kinesis_video_stream,
@@ -41,12 +64,14 @@ public:
             uint32_t max_audio_queue_size = DEFAULT_MAX_AUDIO_QUEUE_SIZE,
             uint32_t max_video_queue_size = DEFAULT_MAX_VIDEO_QUEUE_SIZE,
             uint32_t initial_buffer_size_audio = DEFAULT_BUFFER_SIZE_AUDIO,
-            uint32_t initial_buffer_size_video = DEFAULT_BUFFER_SIZE_VIDEO);
+            uint32_t initial_buffer_size_video = DEFAULT_BUFFER_SIZE_VIDEO,
+            std::chrono::milliseconds max_track_skew = std::chrono::milliseconds(DEFAULT_MAX_TRACK_SKEW_MS));
 
     ~PutFrameHelper();
 
     /*
      * application should call getFrameDataBuffer() to get a buffer to store frame data before calling putFrameMultiTrack()
+     * The buffer is valid until the frame is passed to putFrameMultiTrack().
      */
     uint8_t *getFrameDataBuffer(uint32_t requested_buffer_size, bool isVideo);
 
@@ -61,9 +86,22 @@ public:
      */
     void flush();
 
+    /*
+     * Despite its name, returns true as long as none of the frames have failed to put.
+     */
     bool putFrameFailed();
 
     void putEofr();
+
+    /*
+     * Number of heap allocations made for the frame buffers, stays flat in the steady state.
+     */
+    uint64_t getFrameBufferAllocationCount() const;
+
+    /*
+     * Time the frames have spent waiting to be put in order.
+     */
+    const FrameReorderQueue::ReorderStats& getReorderStats() const;
 };
 
 }
@@ -0,0 +1,337 @@
+#include "CredentialFileWatcher.h"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+LOGGER_TAG("com.amazonaws.kinesis.video");
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+#define CREDENTIAL_FILE_PREFIX                              "CREDENTIALS"
+
+#ifdef __linux__
+/**
+ * Writes into the directory which may replace a credential file. Writes in place, renames and symlink swaps.
+ */
+#define CREDENTIAL_FILE_WATCH_MASK                          (IN_CLOSE_WRITE | IN_MOVED_TO)
+#endif
+
+namespace {
+    std::string directoryOf(const std::string& path) {
+        auto separator = path.find_last_of('/');
+        if (std::string::npos == separator) {
+            return ".";
+        }
+
+        return 0 == separator ? "/" : path.substr(0, separator);
+    }
+}
+
+bool CredentialFileWatcher::FileId::operator!=(const FileId& other) const {
+    return device != other.device || inode != other.inode || size != other.size
+           || modification_time != other.modification_time;
+}
+
+CredentialFileWatcher::CredentialFileWatcher()
+        : next_subscription_(1),
+          parse_count_(0),
+          inotify_fd_(-1) {
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        LOG_WARN("Unable to watch the credential files, errno " << errno << ". Checking them for changes on reads instead");
+    } else {
+        watch_thread_ = std::thread(&CredentialFileWatcher::watchRoutine, this);
+        watch_thread_.detach();
+    }
+#endif
+}
+
+CredentialFileWatcher& CredentialFileWatcher::getInstance() {
+    // Never destroyed, its thread blocks on the inotify instance for the lifetime of the process
+    static CredentialFileWatcher* watcher = new CredentialFileWatcher();
+    return *watcher;
+}
+
+bool CredentialFileWatcher::parse(const std::string& contents, Credentials& credentials) {
+    std::istringstream stream(contents);
+    std::vector<std::string> tokens;
+    std::string token;
+    while (stream >> token) {
+        tokens.push_back(token);
+    }
+
+    if (tokens.size() < 3 || tokens.size() > 5 || CREDENTIAL_FILE_PREFIX != tokens[0]) {
+        return false;
+    }
+
+    std::chrono::duration<uint64_t> expiration(MAX_UINT64);
+    if (tokens.size() > 3) {
+        std::chrono::seconds parsed_expiration;
+        if (!parseIso8601Time(tokens[2], parsed_expiration)) {
+            return false;
+        }
+
+        expiration = std::chrono::duration<uint64_t>(parsed_expiration.count());
+    }
+
+    credentials = Credentials(tokens[1], tokens[tokens.size() == 3 ? 2 : 3], tokens.size() == 5 ? tokens[4] : "", expiration);
+    return true;
+}
+
+uint64_t CredentialFileWatcher::subscribe(const std::string& path, listener_t listener) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto inserted = files_.insert(std::make_pair(path, WatchedFile()));
+    WatchedFile& watched_file = inserted.first->second;
+    if (watched_file.directory.empty()) {
+        watched_file.directory = directoryOf(path);
+    }
+
+#ifdef __linux__
+    if (inotify_fd_ >= 0) {
+        watched_file.watched = false;
+        for (auto& directory : watched_directories_) {
+            watched_file.watched = watched_file.watched || directory.second == watched_file.directory;
+        }
+
+        if (!watched_file.watched) {
+            int watch_descriptor = inotify_add_watch(inotify_fd_, watched_file.directory.c_str(), CREDENTIAL_FILE_WATCH_MASK);
+            if (watch_descriptor < 0) {
+                // E.g. a missing directory or out of watches, the file is then checked on reads
+                LOG_WARN("Unable to watch " << watched_file.directory << ", errno " << errno << ". Checking "
+                         << path << " for changes on reads instead");
+            } else {
+                watched_directories_[watch_descriptor] = watched_file.directory;
+                setWatched(watched_file.directory, true);
+            }
+        }
+    }
+#endif
+
+    if (inserted.second || watched_file.listeners.empty()) {
+        refresh(path, watched_file);
+    }
+
+    uint64_t subscription = next_subscription_++;
+    watched_file.listeners[subscription] = std::move(listener);
+    subscriptions_[subscription] = path;
+    return subscription;
+}
+
+void CredentialFileWatcher::unsubscribe(uint64_t subscription) {
+    std::lock_guard<std::mutex> dispatch_lock(dispatch_mutex_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto subscription_it = subscriptions_.find(subscription);
+    if (subscription_it == subscriptions_.end()) {
+        return;
+    }
+
+    auto file_it = files_.find(subscription_it->second);
+    subscriptions_.erase(subscription_it);
+    if (file_it == files_.end()) {
+        return;
+    }
+
+    file_it->second.listeners.erase(subscription);
+    if (!file_it->second.listeners.empty()) {
+        return;
+    }
+
+    std::string directory = file_it->second.directory;
+    files_.erase(file_it);
+
+#ifdef __linux__
+    for (auto& file : files_) {
+        if (file.second.directory == directory && !file.second.listeners.empty()) {
+            return;
+        }
+    }
+
+    for (auto it = watched_directories_.begin(); it != watched_directories_.end(); ++it) {
+        if (it->second == directory) {
+            inotify_rm_watch(inotify_fd_, it->first);
+            watched_directories_.erase(it);
+            setWatched(directory, false);
+            break;
+        }
+    }
+#endif
+}
+
+CredentialFile CredentialFileWatcher::get(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(path);
+    if (it == files_.end()) {
+        it = files_.insert(std::make_pair(path, WatchedFile())).first;
+        it->second.directory = directoryOf(path);
+    }
+
+    if (!it->second.watched || it->second.listeners.empty()) {
+        // Not watched, the change is only noticed here
+        refresh(path, it->second);
+    }
+
+    return it->second.file;
+}
+
+uint64_t CredentialFileWatcher::getParseCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return parse_count_;
+}
+
+bool CredentialFileWatcher::refresh(const std::string& path, WatchedFile& watched_file) {
+    struct stat file_stat;
+    if (0 != stat(path.c_str(), &file_stat)) {
+        if (watched_file.file.valid && -1 != watched_file.id.size) {
+            LOG_WARN("Credential file " << path << " is gone, keeping its last credentials");
+        }
+
+        watched_file.id = FileId();
+        return false;
+    }
+
+    FileId id;
+    id.device = (uint64_t) file_stat.st_dev;
+    id.inode = (uint64_t) file_stat.st_ino;
+    id.size = (int64_t) file_stat.st_size;
+#ifdef __linux__
+    id.modification_time = (int64_t) file_stat.st_mtim.tv_sec * 1000000000LL + file_stat.st_mtim.tv_nsec;
+#else
+    id.modification_time = (int64_t) file_stat.st_mtime;
+#endif
+    if (!(id != watched_file.id)) {
+        return false;
+    }
+
+    watched_file.id = id;
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    parse_count_++;
+
+    Credentials credentials;
+    if (!parse(contents.str(), credentials)) {
+        // Possibly caught halfway through a write in place, parsed again once the writer closes the file
+        LOG_WARN("Unable to parse the credential file " << path << ", keeping its last credentials");
+        return false;
+    }
+
+    auto& current = watched_file.file.credentials;
+    if (watched_file.file.valid
+        && current.getAccessKey() == credentials.getAccessKey()
+        && current.getSecretKey() == credentials.getSecretKey()
+        && current.getSessionToken() == credentials.getSessionToken()
+        && current.getExpiration() == credentials.getExpiration()) {
+        return false;
+    }
+
+    LOG_INFO("Loaded the credentials of " << path << " expiring at " << credentials.getExpiration().count());
+    watched_file.file.credentials = credentials;
+    watched_file.file.valid = true;
+    watched_file.file.version++;
+    return true;
+}
+
+void CredentialFileWatcher::watchRoutine() {
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            LOG_ERROR("Watching the credential files failed, errno " << errno << ". Checking them for changes on reads instead");
+            std::lock_guard<std::mutex> lock(mutex_);
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+            watched_directories_.clear();
+            for (auto& file : files_) {
+                file.second.watched = false;
+            }
+
+            return;
+        }
+
+        std::set<std::string> changed_paths;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::set<std::string> directories;
+            bool overflow = false;
+            for (char* position = buffer; position < buffer + length; ) {
+                auto event = reinterpret_cast<struct inotify_event*>(position);
+                auto directory = watched_directories_.find(event->wd);
+                if (directory != watched_directories_.end()) {
+                    directories.insert(directory->second);
+
+                    // The watch is gone along with the directory, its files are checked on reads from now on
+                    if (0 != (event->mask & IN_IGNORED)) {
+                        LOG_WARN("Stopped watching " << directory->second << ". Checking its credential files for changes on reads instead");
+                        setWatched(directory->second, false);
+                        watched_directories_.erase(directory);
+                    }
+                }
+
+                overflow = overflow || 0 != (event->mask & IN_Q_OVERFLOW);
+                position += sizeof(struct inotify_event) + event->len;
+            }
+
+            // The event names aren't matched, a symlink swap renames an entry other than the file itself
+            for (auto& file : files_) {
+                if ((overflow || directories.count(file.second.directory) > 0)
+                    && !file.second.listeners.empty() && refresh(file.first, file.second)) {
+                    changed_paths.insert(file.first);
+                }
+            }
+        }
+
+        if (!changed_paths.empty()) {
+            dispatch(changed_paths);
+        }
+    }
+#endif
+}
+
+void CredentialFileWatcher::setWatched(const std::string& directory, bool watched) {
+    for (auto& file : files_) {
+        if (file.second.directory == directory) {
+            file.second.watched = watched;
+        }
+    }
+}
+
+void CredentialFileWatcher::dispatch(const std::set<std::string>& paths) {
+    std::lock_guard<std::mutex> dispatch_lock(dispatch_mutex_);
+    std::vector<listener_t> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& path : paths) {
+            auto it = files_.find(path);
+            if (it != files_.end()) {
+                for (auto& listener : it->second.listeners) {
+                    listeners.push_back(listener.second);
+                }
+            }
+        }
+    }
+
+    for (auto& listener : listeners) {
+        listener();
+    }
+}
+
+}
+}
+}
+}
@@ -0,0 +1,148 @@
+#ifndef _CREDENTIAL_FILE_WATCHER_H_
+#define _CREDENTIAL_FILE_WATCHER_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <Auth.h>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Credentials parsed from a credential file, one line of
+ *
+ * CREDENTIALS <access key id> [<expiration>] <secret access key> [<session token>]
+ *
+ * with the expiration in ISO 8601 UTC. The credentials of a file without an expiration don't expire.
+ */
+struct CredentialFile {
+    CredentialFile() : valid(false), version(0) {}
+
+    /**
+     * Whether the file has been parsed successfully at least once. A file which is missing or can't be parsed
+     * keeps its last credentials.
+     */
+    bool valid;
+    Credentials credentials;
+
+    /**
+     * Incremented with each change of the credentials
+     */
+    uint64_t version;
+};
+
+/**
+ * Process-wide watcher of the credential files. Parses a file only when it changes and calls the listeners of
+ * the file from its thread once it has been parsed, so that the token path never reads the file.
+ *
+ * The directories of the files are watched with a single inotify instance, which also catches the files being
+ * replaced by a rename or a symlink swap. Where inotify isn't available or the directory of a file can't be
+ * watched, the file is checked for a change of its size, modification time or inode whenever it is read.
+ *
+ * Thread-safe.
+ */
+class CredentialFileWatcher {
+public:
+    using listener_t = std::function<void()>;
+
+    static CredentialFileWatcher& getInstance();
+
+    CredentialFileWatcher(const CredentialFileWatcher&) = delete;
+    CredentialFileWatcher& operator=(const CredentialFileWatcher&) = delete;
+
+    /**
+     * Starts watching the file, parsing it unless it is watched already.
+     *
+     * @param listener Called on the watcher thread after the credentials of the file have changed.
+     * @return Id of the subscription.
+     */
+    uint64_t subscribe(const std::string& path, listener_t listener);
+
+    /**
+     * Stops calling the listener, waiting for a call in progress to return.
+     */
+    void unsubscribe(uint64_t subscription);
+
+    /**
+     * Gets the last parsed credentials of the file.
+     */
+    CredentialFile get(const std::string& path);
+
+    /**
+     * @return Number of times the files have been parsed.
+     */
+    uint64_t getParseCount() const;
+
+    /**
+     * Parses the contents of a credential file.
+     */
+    static bool parse(const std::string& contents, Credentials& credentials);
+
+private:
+    struct FileId {
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        int64_t size = -1;
+        int64_t modification_time = 0;
+        bool operator!=(const FileId& other) const;
+    };
+
+    struct WatchedFile {
+        WatchedFile() : watched(false) {}
+
+        CredentialFile file;
+        FileId id;
+        std::string directory;
+
+        /**
+         * Whether the directory of the file has an inotify watch. The unwatched files are checked for a change
+         * whenever they are read.
+         */
+        bool watched;
+        std::map<uint64_t, listener_t> listeners;
+    };
+
+    CredentialFileWatcher();
+
+    /**
+     * Re-parses the file if it has changed since it was last parsed. Must be called with mutex_ held.
+     *
+     * @return Whether the credentials have changed.
+     */
+    bool refresh(const std::string& path, WatchedFile& watched_file);
+
+    void watchRoutine();
+
+    /**
+     * Marks the files of the directory as watched or not. Must be called with mutex_ held.
+     */
+    void setWatched(const std::string& directory, bool watched);
+    void dispatch(const std::set<std::string>& paths);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, WatchedFile> files_;
+    std::map<uint64_t, std::string> subscriptions_;
+    uint64_t next_subscription_;
+    uint64_t parse_count_;
+
+    /**
+     * Held while calling the listeners so that unsubscribe can wait for them
+     */
+    std::mutex dispatch_mutex_;
+
+    int inotify_fd_;
+    std::map<int, std::string> watched_directories_;
+    std::thread watch_thread_;
+};
+
+}
+}
+}
+}
+
+#endif //_CREDENTIAL_FILE_WATCHER_H_
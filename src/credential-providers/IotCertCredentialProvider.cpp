@@ -1,28 +1,29 @@
 #include "IotCertCredentialProvider.h"
+#include "IotTokenBroker.h"
 
 LOGGER_TAG("com.amazonaws.kinesis.video");
 
 using namespace com::amazonaws::kinesis::video;
 
-IotCertCredentialProvider::callback_t IotCertCredentialProvider::getCallbacks(PClientCallbacks client_callbacks)
+void IotCertCredentialProvider::updateCredentials(Credentials& credentials)
 {
-    STATUS retStatus = STATUS_SUCCESS;
+    IotTokenRequest request;
+    request.endpoint = iot_get_credential_endpoint_;
+    request.cert_path = cert_path_;
+    request.private_key_path = private_key_path_;
+    request.ca_cert_path = ca_cert_path_;
+    request.role_alias = role_alias_;
+    request.thing_name = stream_name_;
+    request.connection_timeout = connectionTimeout_;
+    request.completion_timeout = completionTimeout_;
 
-    LOG_DEBUG("Creating IoT auth callbacks.");
-    if (STATUS_FAILED(retStatus = createIotAuthCallbacksWithTimeouts(client_callbacks,
-                                                                     STRING_TO_PCHAR(iot_get_credential_endpoint_),
-                                                                     STRING_TO_PCHAR(cert_path_),
-                                                                     STRING_TO_PCHAR(private_key_path_),
-                                                                     STRING_TO_PCHAR(ca_cert_path_),
-                                                                     STRING_TO_PCHAR(role_alias_),
-                                                                     STRING_TO_PCHAR(stream_name_),
-                                                                     connectionTimeout_,
-                                                                     completionTimeout_,
-                                                                     &iot_callbacks))) {
-        std::stringstream status_strstrm;
-        status_strstrm << std::hex << retStatus;
-        LOG_AND_THROW("Unable to create Iot Credential provider. Error status: 0x" + status_strstrm.str());
+    try {
+        credentials = IotTokenBroker::getInstance().getCredentials(request);
+    } catch (const std::exception& e) {
+        // Keep the current credentials, the refresh retries. Never fetched ones are expired rather than never expiring.
+        LOG_ERROR("Unable to get the IoT credentials of " << stream_name_ << ": " << e.what());
+        if (credentials.getAccessKey().empty()) {
+            credentials.setExpiration(std::chrono::seconds(0));
+        }
     }
-
-    return *iot_callbacks;
 }
@@ -5,8 +5,11 @@
 #include <Auth.h>
 
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
+    /**
+     * Gets the credentials of the thing from the IoT credentials endpoint through the process-wide IotTokenBroker,
+     * so that the providers of many streams share the calls and the cached tokens.
+     */
     class IotCertCredentialProvider : public CredentialProvider {
-        PAuthCallbacks iot_callbacks = nullptr;
         const std::string iot_get_credential_endpoint_, cert_path_, private_key_path_, ca_cert_path_,
 	                  role_alias_,stream_name_;
         uint64_t connectionTimeout_ = 0, completionTimeout_ = 0;
@@ -42,11 +45,12 @@ namespace com { namespace amazonaws { namespace kinesis { namespace video {
                 connectionTimeout_ (connectionTimeout),
                 completionTimeout_ (completionTimeout) {}
 
-        void updateCredentials(Credentials& credentials) override {
-            // no-op as credential update is handled in c producer iot auth callbacks
+        ~IotCertCredentialProvider() {
+            // The refresher reads the members
+            stopRefresher();
         }
 
-        callback_t getCallbacks(PClientCallbacks) override;
+        void updateCredentials(Credentials& credentials) override;
     };
 
 }
@@ -0,0 +1,426 @@
+#include "IotTokenBroker.h"
+
+#include <cctype>
+
+#include <curl/curl.h>
+
+LOGGER_TAG("com.amazonaws.kinesis.video");
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+#define IOT_TOKEN_BROKER_THING_NAME_HEADER                  "x-amzn-iot-thingname: "
+#define IOT_TOKEN_BROKER_HTTPS_SCHEME                       "https://"
+
+// Nesting the response is read up to
+#define IOT_TOKEN_BROKER_MAX_JSON_DEPTH                     16
+
+namespace {
+    void lockShared(CURL* handle, curl_lock_data data, curl_lock_access access, void* user_data) {
+        UNUSED_PARAM(handle);
+        UNUSED_PARAM(access);
+        if (data < IOT_TOKEN_BROKER_SHARE_LOCK_COUNT) {
+            reinterpret_cast<std::mutex*>(user_data)[data].lock();
+        }
+    }
+
+    void unlockShared(CURL* handle, curl_lock_data data, void* user_data) {
+        UNUSED_PARAM(handle);
+        if (data < IOT_TOKEN_BROKER_SHARE_LOCK_COUNT) {
+            reinterpret_cast<std::mutex*>(user_data)[data].unlock();
+        }
+    }
+
+    size_t writeBody(char* data, size_t size, size_t count, void* user_data) {
+        reinterpret_cast<std::string*>(user_data)->append(data, size * count);
+        return size * count;
+    }
+
+    /**
+     * Reader of the JSON response of the IoT credentials endpoint. Parses the whole document, decoding the escapes
+     * of the strings, and keeps the string members of the object under a top-level key.
+     */
+    class JsonObjectReader {
+    public:
+        JsonObjectReader(const std::string& body, const std::string& object_name)
+                : body_(body), object_name_(object_name), position_(0) {}
+
+        /**
+         * @return Whether the body is a well-formed JSON object.
+         */
+        bool read() {
+            if (!readValue(0, false)) {
+                return false;
+            }
+
+            skipWhitespace();
+            return position_ == body_.size();
+        }
+
+        /**
+         * @return String member of the object, empty if missing.
+         */
+        const std::string& getString(const std::string& name) {
+            return members_[name];
+        }
+
+    private:
+        void skipWhitespace() {
+            while (position_ < body_.size() && (' ' == body_[position_] || '\t' == body_[position_]
+                                                || '\r' == body_[position_] || '\n' == body_[position_])) {
+                position_++;
+            }
+        }
+
+        bool consume(char c) {
+            skipWhitespace();
+            if (position_ < body_.size() && body_[position_] == c) {
+                position_++;
+                return true;
+            }
+
+            return false;
+        }
+
+        bool readHex(uint32_t& code_point) {
+            if (body_.size() - position_ < 4) {
+                return false;
+            }
+
+            code_point = 0;
+            for (int i = 0; i < 4; i++) {
+                char c = body_[position_++];
+                code_point <<= 4;
+                if (c >= '0' && c <= '9') {
+                    code_point |= (uint32_t) (c - '0');
+                } else if (c >= 'a' && c <= 'f') {
+                    code_point |= (uint32_t) (c - 'a' + 10);
+                } else if (c >= 'A' && c <= 'F') {
+                    code_point |= (uint32_t) (c - 'A' + 10);
+                } else {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        void appendUtf8(std::string& value, uint32_t code_point) {
+            if (code_point < 0x80) {
+                value += (char) code_point;
+            } else if (code_point < 0x800) {
+                value += (char) (0xc0 | (code_point >> 6));
+                value += (char) (0x80 | (code_point & 0x3f));
+            } else if (code_point < 0x10000) {
+                value += (char) (0xe0 | (code_point >> 12));
+                value += (char) (0x80 | ((code_point >> 6) & 0x3f));
+                value += (char) (0x80 | (code_point & 0x3f));
+            } else {
+                value += (char) (0xf0 | (code_point >> 18));
+                value += (char) (0x80 | ((code_point >> 12) & 0x3f));
+                value += (char) (0x80 | ((code_point >> 6) & 0x3f));
+                value += (char) (0x80 | (code_point & 0x3f));
+            }
+        }
+
+        bool readString(std::string& value) {
+            if (!consume('"')) {
+                return false;
+            }
+
+            value.clear();
+            while (position_ < body_.size()) {
+                char c = body_[position_++];
+                if ('"' == c) {
+                    return true;
+                }
+
+                if ((unsigned char) c < 0x20) {
+                    return false;
+                }
+
+                if ('\\' != c) {
+                    value += c;
+                    continue;
+                }
+
+                if (position_ == body_.size()) {
+                    return false;
+                }
+
+                uint32_t code_point;
+                switch (body_[position_++]) {
+                    case '"': value += '"'; break;
+                    case '\\': value += '\\'; break;
+                    case '/': value += '/'; break;
+                    case 'b': value += '\b'; break;
+                    case 'f': value += '\f'; break;
+                    case 'n': value += '\n'; break;
+                    case 'r': value += '\r'; break;
+                    case 't': value += '\t'; break;
+                    case 'u':
+                        if (!readHex(code_point)) {
+                            return false;
+                        }
+
+                        // A high surrogate has to be followed by the escaped low one
+                        if (code_point >= 0xd800 && code_point <= 0xdbff) {
+                            uint32_t low_surrogate;
+                            if (body_.compare(position_, 2, "\\u") != 0) {
+                                return false;
+                            }
+
+                            position_ += 2;
+                            if (!readHex(low_surrogate) || low_surrogate < 0xdc00 || low_surrogate > 0xdfff) {
+                                return false;
+                            }
+
+                            code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low_surrogate - 0xdc00);
+                        } else if (code_point >= 0xdc00 && code_point <= 0xdfff) {
+                            return false;
+                        }
+
+                        appendUtf8(value, code_point);
+                        break;
+                    default:
+                        return false;
+                }
+            }
+
+            return false;
+        }
+
+        bool readLiteral() {
+            // Numbers, true, false and null, none of which the credentials are read from
+            size_t start = position_;
+            while (position_ < body_.size() && (isalnum((unsigned char) body_[position_]) || '+' == body_[position_]
+                                                || '-' == body_[position_] || '.' == body_[position_])) {
+                position_++;
+            }
+
+            return position_ != start;
+        }
+
+        /**
+         * @param keep Whether the string members of the value are the ones being looked for
+         */
+        bool readValue(uint32_t depth, bool keep) {
+            if (depth > IOT_TOKEN_BROKER_MAX_JSON_DEPTH) {
+                return false;
+            }
+
+            skipWhitespace();
+            if (position_ == body_.size()) {
+                return false;
+            }
+
+            std::string value;
+            switch (body_[position_]) {
+                case '"':
+                    return readString(value);
+                case '[':
+                    position_++;
+                    if (consume(']')) {
+                        return true;
+                    }
+
+                    do {
+                        if (!readValue(depth + 1, false)) {
+                            return false;
+                        }
+                    } while (consume(','));
+
+                    return consume(']');
+                case '{':
+                    position_++;
+                    if (consume('}')) {
+                        return true;
+                    }
+
+                    do {
+                        std::string name;
+                        if (!readString(name) || !consume(':')) {
+                            return false;
+                        }
+
+                        skipWhitespace();
+                        if (keep && position_ < body_.size() && '"' == body_[position_]) {
+                            if (!readString(members_[name])) {
+                                return false;
+                            }
+                        } else if (!readValue(depth + 1, 0 == depth && name == object_name_)) {
+                            return false;
+                        }
+                    } while (consume(','));
+
+                    return consume('}');
+                default:
+                    return 0 != depth && readLiteral();
+            }
+        }
+
+        const std::string& body_;
+        const std::string object_name_;
+        size_t position_;
+        std::map<std::string, std::string> members_;
+    };
+
+    uint64_t timeoutMillis(uint64_t timeout, uint64_t default_seconds) {
+        return 0 == timeout ? default_seconds * 1000 : timeout / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    }
+}
+
+IotTokenBroker::IotTokenBroker(std::chrono::seconds refresh_margin)
+        : refresh_margin_(refresh_margin),
+          fetch_count_(0) {
+    curl_global_init(CURL_GLOBAL_ALL);
+    CURLSH* share = curl_share_init();
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShared);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShared);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, share_mutexes_);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    share_ = share;
+}
+
+IotTokenBroker::~IotTokenBroker() {
+    curl_share_cleanup(reinterpret_cast<CURLSH*>(share_));
+    curl_global_cleanup();
+}
+
+IotTokenBroker& IotTokenBroker::getInstance() {
+    // Never destroyed, the providers may outlive the static destructors and closing the cached connections at exit
+    // would write to sockets which may be gone
+    static IotTokenBroker* broker = new IotTokenBroker();
+    return *broker;
+}
+
+uint64_t IotTokenBroker::getFetchCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fetch_count_;
+}
+
+Credentials IotTokenBroker::getCredentials(const IotTokenRequest& request) {
+    key_t key(request.endpoint, request.role_alias, request.thing_name,
+              request.cert_path, request.private_key_path, request.ca_cert_path);
+    std::shared_future<Credentials> in_flight;
+    std::promise<Credentials> promise;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Entry& entry = entries_[key];
+        auto now_time = std::chrono::duration_cast<std::chrono::seconds>(systemCurrentTime().time_since_epoch());
+        if (entry.cached && now_time + refresh_margin_ < entry.credentials.getExpiration()) {
+            return entry.credentials;
+        }
+
+        if (entry.in_flight.valid()) {
+            // Another provider is fetching the same credentials
+            in_flight = entry.in_flight;
+        } else {
+            entry.in_flight = promise.get_future().share();
+            fetch_count_++;
+        }
+    }
+
+    if (in_flight.valid()) {
+        return in_flight.get();
+    }
+
+    try {
+        auto credentials = fetch(request);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Entry& entry = entries_[key];
+            entry.credentials = credentials;
+            entry.cached = true;
+            entry.in_flight = std::shared_future<Credentials>();
+        }
+
+        promise.set_value(credentials);
+        return credentials;
+    } catch (...) {
+        // Not cached, the next request retries
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_[key].in_flight = std::shared_future<Credentials>();
+        }
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+Credentials IotTokenBroker::fetch(const IotTokenRequest& request) {
+    std::string url = request.endpoint.find("://") == std::string::npos
+            ? IOT_TOKEN_BROKER_HTTPS_SCHEME + request.endpoint
+            : request.endpoint;
+    url += "/role-aliases/" + request.role_alias + "/credentials";
+    std::string thing_name_header = IOT_TOKEN_BROKER_THING_NAME_HEADER + request.thing_name;
+    std::string body;
+    char error_buffer[CURL_ERROR_SIZE] = {0};
+    long response_code = 0;
+
+    LOG_DEBUG("Fetching IoT credentials of " << request.thing_name << " from " << url);
+    CURL* curl = curl_easy_init();
+    LOG_AND_THROW_IF(nullptr == curl, "Unable to create a curl handle for the IoT credentials of " << request.thing_name);
+
+    struct curl_slist* headers = curl_slist_append(nullptr, thing_name_header.c_str());
+    curl_easy_setopt(curl, CURLOPT_SHARE, reinterpret_cast<CURLSH*>(share_));
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE, "PEM");
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, request.cert_path.c_str());
+    curl_easy_setopt(curl, CURLOPT_SSLKEY, request.private_key_path.c_str());
+    if (!request.ca_cert_path.empty()) {
+        curl_easy_setopt(curl, CURLOPT_CAINFO, request.ca_cert_path.c_str());
+    }
+
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS,
+                     (long) timeoutMillis(request.connection_timeout, IOT_TOKEN_BROKER_DEFAULT_CONNECTION_TIMEOUT_SECONDS));
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS,
+                     (long) timeoutMillis(request.completion_timeout, IOT_TOKEN_BROKER_DEFAULT_COMPLETION_TIMEOUT_SECONDS));
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeBody);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+
+    CURLcode result = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+
+    LOG_AND_THROW_IF(CURLE_OK != result, "Fetching the IoT credentials of " << request.thing_name << " failed: "
+            << ('\0' != error_buffer[0] ? error_buffer : curl_easy_strerror(result)));
+    LOG_AND_THROW_IF(200 != response_code, "Fetching the IoT credentials of " << request.thing_name
+            << " failed with HTTP status " << response_code << ": " << body);
+
+    Credentials credentials;
+    LOG_AND_THROW_IF(!parseCredentials(body, credentials), "Unable to parse the IoT credentials of " << request.thing_name);
+
+    LOG_INFO("Fetched IoT credentials of " << request.thing_name << " expiring at " << credentials.getExpiration().count());
+    return credentials;
+}
+
+bool IotTokenBroker::parseCredentials(const std::string& body, Credentials& credentials) {
+    JsonObjectReader reader(body, "credentials");
+    if (!reader.read()) {
+        return false;
+    }
+
+    auto& access_key = reader.getString("accessKeyId");
+    auto& secret_key = reader.getString("secretAccessKey");
+    auto& session_token = reader.getString("sessionToken");
+    std::chrono::seconds expiration;
+    if (access_key.empty() || secret_key.empty() || session_token.empty()
+        || !parseIso8601Time(reader.getString("expiration"), expiration)) {
+        return false;
+    }
+
+    credentials = Credentials(access_key, secret_key, session_token, expiration);
+    return true;
+}
+
+}
+}
+}
+}
@@ -0,0 +1,123 @@
+#ifndef _IOT_TOKEN_BROKER_H_
+#define _IOT_TOKEN_BROKER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include <Auth.h>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Remaining lifetime below which a cached token is fetched again. Has to be longer than the grace and the prefetch
+ * periods of CredentialProvider so that its rotation gets fresh credentials rather than the ones it rotates away from.
+ */
+#define IOT_TOKEN_BROKER_REFRESH_MARGIN_SECONDS             (5 * 60)
+
+/**
+ * Timeouts used when the request doesn't set them
+ */
+#define IOT_TOKEN_BROKER_DEFAULT_CONNECTION_TIMEOUT_SECONDS 10
+#define IOT_TOKEN_BROKER_DEFAULT_COMPLETION_TIMEOUT_SECONDS 30
+
+/**
+ * Locks of the data shared between the calls, indexed by curl_lock_data
+ */
+#define IOT_TOKEN_BROKER_SHARE_LOCK_COUNT                   8
+
+struct IotTokenRequest {
+    IotTokenRequest() : connection_timeout(0), completion_timeout(0) {}
+
+    /**
+     * IoT credentials endpoint, the host with an optional port and scheme
+     */
+    std::string endpoint;
+    std::string cert_path;
+    std::string private_key_path;
+    std::string ca_cert_path;
+    std::string role_alias;
+    std::string thing_name;
+
+    /**
+     * Timeouts in Kinesis Video time, 0 for the defaults
+     */
+    uint64_t connection_timeout;
+    uint64_t completion_timeout;
+};
+
+/**
+ * Process-wide broker of the credentials obtained from the IoT credentials endpoint.
+ *
+ * The credentials are cached per endpoint, role alias, thing and certificate until they get within the refresh
+ * margin of their expiration, and concurrent requests for the same credentials share a single call. The calls
+ * share the TLS sessions and connections, so the credential providers of many streams cost a single handshake.
+ *
+ * Thread-safe.
+ */
+class IotTokenBroker {
+public:
+    explicit IotTokenBroker(std::chrono::seconds refresh_margin = std::chrono::seconds(IOT_TOKEN_BROKER_REFRESH_MARGIN_SECONDS));
+    ~IotTokenBroker();
+
+    IotTokenBroker(const IotTokenBroker&) = delete;
+    IotTokenBroker& operator=(const IotTokenBroker&) = delete;
+
+    /**
+     * @return The broker shared by the credential providers of the process.
+     */
+    static IotTokenBroker& getInstance();
+
+    /**
+     * Returns the cached credentials or waits for them to be fetched.
+     *
+     * @throws std::runtime_error if the call to the endpoint fails.
+     */
+    Credentials getCredentials(const IotTokenRequest& request);
+
+    /**
+     * @return Number of calls made to the IoT credentials endpoints.
+     */
+    uint64_t getFetchCount() const;
+
+    /**
+     * Parses the response of the IoT credentials endpoint, the accessKeyId, secretAccessKey, sessionToken and
+     * expiration strings of its credentials object.
+     *
+     * @return Whether the response is a JSON object holding the credentials.
+     */
+    static bool parseCredentials(const std::string& body, Credentials& credentials);
+
+private:
+    using key_t = std::tuple<std::string, std::string, std::string, std::string, std::string, std::string>;
+
+    struct Entry {
+        Credentials credentials;
+        bool cached = false;
+        std::shared_future<Credentials> in_flight;
+    };
+
+    Credentials fetch(const IotTokenRequest& request);
+
+    const std::chrono::seconds refresh_margin_;
+    mutable std::mutex mutex_;
+    std::map<key_t, Entry> entries_;
+    uint64_t fetch_count_;
+
+    /**
+     * Curl share handle along with a lock per kind of data it shares
+     */
+    void* share_;
+    std::mutex share_mutexes_[IOT_TOKEN_BROKER_SHARE_LOCK_COUNT];
+};
+
+}
+}
+}
+}
+
+#endif //_IOT_TOKEN_BROKER_H_
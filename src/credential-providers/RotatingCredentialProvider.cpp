@@ -1,22 +1,32 @@
 #include "RotatingCredentialProvider.h"
-#include <iostream>
-#include <fstream>
-#include <vector>
+#include "CredentialFileWatcher.h"
 
 LOGGER_TAG("com.amazonaws.kinesis.video");
 
 using namespace com::amazonaws::kinesis::video;
 using namespace std;
 
-RotatingCredentialProvider::callback_t RotatingCredentialProvider::getCallbacks(PClientCallbacks client_callbacks) {
-    STATUS retStatus = STATUS_SUCCESS;
+RotatingCredentialProvider::RotatingCredentialProvider(std::string credential_file_path)
+        : credential_file_path_(std::move(credential_file_path)) {
+    subscription_ = CredentialFileWatcher::getInstance().subscribe(credential_file_path_, [this]() {
+        // Publish the new credentials rather than waiting for the old ones to be rotated
+        Credentials credentials;
+        getUpdatedCredentials(credentials);
+    });
+}
+
+RotatingCredentialProvider::~RotatingCredentialProvider() {
+    stopRefresher();
+    CredentialFileWatcher::getInstance().unsubscribe(subscription_);
+}
 
-    if (STATUS_FAILED(retStatus = createFileAuthCallbacks(client_callbacks,
-                           STRING_TO_PCHAR(credential_file_path_),
-                           &rotating_callbacks))) {
-        std::stringstream status_strstrm;
-        status_strstrm << std::hex << retStatus;
-        LOG_AND_THROW("Unable to create Rotating Credential provider. Error status: 0x" + status_strstrm.str());
+void RotatingCredentialProvider::updateCredentials(Credentials& credentials) {
+    auto credential_file = CredentialFileWatcher::getInstance().get(credential_file_path_);
+    if (credential_file.valid) {
+        credentials = credential_file.credentials;
+    } else {
+        // Never loaded ones are expired rather than never expiring, so that they get refreshed
+        LOG_ERROR("No credentials could be loaded from " << credential_file_path_);
+        credentials.setExpiration(std::chrono::seconds(0));
     }
-    return *rotating_callbacks;
 }
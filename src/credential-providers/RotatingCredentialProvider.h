@@ -5,15 +5,17 @@
 
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
+    /**
+     * Serves the credentials of a file which gets periodically rewritten by an authentication module. The file is
+     * parsed by the CredentialFileWatcher only when it changes and the new credentials are published right away.
+     */
     class RotatingCredentialProvider : public CredentialProvider {
         std::string credential_file_path_;
-        PAuthCallbacks rotating_callbacks = nullptr;
+        uint64_t subscription_;
     public:
-        RotatingCredentialProvider(std::string credential_file_path): credential_file_path_(credential_file_path) {}
-        void updateCredentials(Credentials& credentials) override {
-            // no-op as credential update is handled in c producer file auth callbacks
-        }
-        callback_t getCallbacks(PClientCallbacks) override;
+        RotatingCredentialProvider(std::string credential_file_path);
+        ~RotatingCredentialProvider();
+        void updateCredentials(Credentials& credentials) override;
     };
 
 }
@@ -22,4 +24,4 @@ namespace com { namespace amazonaws { namespace kinesis { namespace video {
 }
 
 
-#endif /* __ROTATING_CREDENTIAL_PROVIDER_H__ */
\ No newline at end of file
+#endif /* __ROTATING_CREDENTIAL_PROVIDER_H__ */
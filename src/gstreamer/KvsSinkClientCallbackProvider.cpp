@@ -1,11 +1,32 @@
 #include "KvsSinkClientCallbackProvider.h"
+#include "KvsSinkProducerPool.h"
+#include "gstkvssink.h"
 
 LOGGER_TAG("com.amazonaws.kinesis.video.gstkvs");
 
 using namespace com::amazonaws::kinesis::video;
 
 STATUS KvsSinkClientCallbackProvider::storageOverflowPressure(UINT64 custom_handle, UINT64 remaining_bytes) {
-    UNUSED_PARAM(custom_handle);
+    auto provider = reinterpret_cast<KvsSinkClientCallbackProvider*>(custom_handle);
     LOG_WARN("Reported storage overflow. Bytes remaining " << remaining_bytes);
+    if (provider == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    if (provider->data != nullptr) {
+        auto bitrate_controller = std::atomic_load(&provider->data->bitrate_controller);
+        if (bitrate_controller != nullptr) {
+            bitrate_controller->reportPressure();
+        }
+    } else {
+        // The content store is shared by the streams of the pooled producer only
+        for (auto& stream_data : KvsSinkProducerPool::getInstance().getStreamData()) {
+            auto bitrate_controller = std::atomic_load(&stream_data->bitrate_controller);
+            if (stream_data->producer_key == provider->producer_key && bitrate_controller != nullptr) {
+                bitrate_controller->reportPressure();
+            }
+        }
+    }
+
     return STATUS_SUCCESS;
 }
\ No newline at end of file
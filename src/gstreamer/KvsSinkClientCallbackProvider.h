@@ -4,10 +4,27 @@
 #include <ClientCallbackProvider.h>
 #include <Logger.h>
 
+#include <memory>
+#include <string>
+
+typedef struct _KvsSinkCustomData KvsSinkCustomData;
+
 namespace com { namespace amazonaws { namespace kinesis { namespace video {
 
     class KvsSinkClientCallbackProvider: public ClientCallbackProvider {
+        std::shared_ptr<KvsSinkCustomData> data;
+        std::string producer_key;
     public:
+        /**
+         * @param data The element data the storage pressure is reported to.
+         */
+        KvsSinkClientCallbackProvider(std::shared_ptr<KvsSinkCustomData> data) : data(data) {}
+
+        /**
+         * @param producer_key Key of a pooled producer, the storage pressure is reported to all of the
+         *                     streams attached to that producer.
+         */
+        KvsSinkClientCallbackProvider(const std::string& producer_key) : producer_key(producer_key) {}
 
         StorageOverflowPressureFunc getStorageOverflowPressureCallback() override {
             return storageOverflowPressure;
@@ -9,15 +9,21 @@ namespace com { namespace amazonaws { namespace kinesis { namespace video {
         uint64_t stop_stream_timeout_sec_;
         uint64_t service_call_connection_timeout_sec_;
         uint64_t service_call_completion_timeout_sec_;
+        uint32_t stream_count_;
     public:
         KvsSinkDeviceInfoProvider(uint64_t storage_size_mb,
                                   uint64_t stop_stream_timeout_sec,
                                   uint64_t service_call_connection_timeout_sec,
-                                  uint64_t service_call_completion_timeout_sec):
+                                  uint64_t service_call_completion_timeout_sec,
+                                  uint32_t stream_count = 0):
                 storage_size_mb_(storage_size_mb),
                 stop_stream_timeout_sec_(stop_stream_timeout_sec),
                 service_call_connection_timeout_sec_(service_call_connection_timeout_sec),
-                service_call_completion_timeout_sec_(service_call_completion_timeout_sec) {}
+                service_call_completion_timeout_sec_(service_call_completion_timeout_sec),
+                stream_count_(stream_count) {
+            // Known up front for the spill size checks
+            device_info_.storageInfo.storageSize = static_cast<UINT64>(storage_size_mb_) * 1024 * 1024;
+        }
         device_info_t getDeviceInfo() override;
         const std::string getCertPath() override;
     };
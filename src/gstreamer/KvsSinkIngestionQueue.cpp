@@ -0,0 +1,187 @@
+#include "KvsSinkIngestionQueue.h"
+#include <Logger.h>
+
+LOGGER_TAG("com.amazonaws.kinesis.video.gstkvs");
+
+using namespace com::amazonaws::kinesis::video;
+
+KvsSinkIngestionQueue::KvsSinkIngestionQueue(const std::vector<gpointer>& tracks, guint depth, bool leaky, ProcessFunc process)
+        : leaky_(leaky),
+          process_(process),
+          next_sequence_(0),
+          in_flight_(0),
+          dropped_count_(0),
+          flow_return_(GST_FLOW_OK),
+          stopping_(false),
+          discarding_(false) {
+    for (auto track : tracks) {
+        track_queues_.push_back(std::unique_ptr<TrackQueue>(new TrackQueue(track, depth)));
+    }
+
+    worker_ = std::thread(&KvsSinkIngestionQueue::workerRoutine, this);
+}
+
+KvsSinkIngestionQueue::~KvsSinkIngestionQueue() {
+    stop();
+}
+
+GstFlowReturn KvsSinkIngestionQueue::push(gpointer track, GstBuffer* buffer) {
+    TrackQueue* track_queue = findTrackQueue(track);
+    GstFlowReturn ret = (GstFlowReturn) flow_return_.load();
+
+    if (stopping_ || nullptr == track_queue || ret != GST_FLOW_OK) {
+        gst_buffer_unref(buffer);
+        return stopping_ ? GST_FLOW_FLUSHING : (nullptr == track_queue ? GST_FLOW_ERROR : ret);
+    }
+
+    bool delta_unit = GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    QueuedBuffer queued = {buffer, next_sequence_++};
+
+    if (leaky_ && ((track_queue->dropping && delta_unit) || !track_queue->ring.tryPush(queued))) {
+        // The delta units following a dropped buffer can't be decoded until the next key frame
+        track_queue->dropping = true;
+        dropped_count_++;
+        gst_buffer_unref(buffer);
+        LOG_DEBUG("Ingestion queue is full, dropped buffer. Total dropped: " << dropped_count_.load());
+        return GST_FLOW_OK;
+    }
+
+    if (leaky_) {
+        track_queue->dropping = false;
+    } else if (!track_queue->ring.tryPush(queued)) {
+        // Block the streaming thread until the worker frees up a slot
+        bool pushed = false;
+        std::unique_lock<std::mutex> lock(mutex_);
+        progress_cv_.wait(lock, [&]() {
+            pushed = track_queue->ring.tryPush(queued);
+            return pushed || stopping_;
+        });
+
+        if (!pushed) {
+            gst_buffer_unref(buffer);
+            return GST_FLOW_FLUSHING;
+        }
+    }
+
+    {
+        // Accounted for under the lock so that the worker can't miss the wakeup
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_++;
+    }
+    item_cv_.notify_one();
+
+    return GST_FLOW_OK;
+}
+
+void KvsSinkIngestionQueue::drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    progress_cv_.wait(lock, [this]() {
+        return 0 >= in_flight_ || stopping_;
+    });
+}
+
+void KvsSinkIngestionQueue::flush() {
+    discarding_ = true;
+    drain();
+    discarding_ = false;
+
+    for (auto& track_queue : track_queues_) {
+        track_queue->dropping = false;
+    }
+
+    flow_return_ = GST_FLOW_OK;
+}
+
+void KvsSinkIngestionQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+
+    item_cv_.notify_all();
+    progress_cv_.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+
+    // Release whatever didn't make it
+    QueuedBuffer queued;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& track_queue : track_queues_) {
+        while (track_queue->ring.tryPop(queued)) {
+            gst_buffer_unref(queued.buffer);
+            in_flight_--;
+        }
+    }
+
+    flow_return_ = GST_FLOW_OK;
+}
+
+guint KvsSinkIngestionQueue::getLevel() const {
+    size_t level = 0;
+    for (auto& track_queue : track_queues_) {
+        level += track_queue->ring.size();
+    }
+
+    return (guint) level;
+}
+
+void KvsSinkIngestionQueue::workerRoutine() {
+    QueuedBuffer queued;
+    TrackQueue* track_queue;
+
+    while (!stopping_) {
+        if (nullptr == (track_queue = nextTrackQueue())) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            item_cv_.wait(lock, [this]() {
+                return stopping_ || 0 != getLevel();
+            });
+
+            continue;
+        }
+
+        track_queue->ring.tryPop(queued);
+        if (discarding_) {
+            gst_buffer_unref(queued.buffer);
+        } else {
+            GstFlowReturn ret = process_(track_queue->track, queued.buffer);
+            if (ret != GST_FLOW_OK) {
+                // Surfaced to the streaming thread on the next push until the next flush
+                flow_return_ = ret;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_flight_--;
+        }
+        progress_cv_.notify_all();
+    }
+}
+
+KvsSinkIngestionQueue::TrackQueue* KvsSinkIngestionQueue::nextTrackQueue() {
+    TrackQueue* oldest = nullptr;
+    uint64_t oldest_sequence = 0;
+
+    // Preserve the order in which GstCollectPads handed the buffers over across the pads
+    for (auto& track_queue : track_queues_) {
+        QueuedBuffer* front = track_queue->ring.front();
+        if (nullptr != front && (nullptr == oldest || front->sequence < oldest_sequence)) {
+            oldest = track_queue.get();
+            oldest_sequence = front->sequence;
+        }
+    }
+
+    return oldest;
+}
+
+KvsSinkIngestionQueue::TrackQueue* KvsSinkIngestionQueue::findTrackQueue(gpointer track) {
+    for (auto& track_queue : track_queues_) {
+        if (track_queue->track == track) {
+            return track_queue.get();
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,206 @@
+#ifndef __KVS_SINK_INGESTION_QUEUE_H__
+#define __KVS_SINK_INGESTION_QUEUE_H__
+
+#include <gst/gst.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Bounded lock-free single producer/single consumer ring.
+ */
+template <typename T> class KvsSinkSpscRing {
+public:
+    explicit KvsSinkSpscRing(size_t capacity) : slots_(capacity + 1), head_(0), tail_(0) {}
+
+    /**
+     * Producer side. Returns false if the ring is full.
+     */
+    bool tryPush(const T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t next = (head + 1) % slots_.size();
+        if (next == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        slots_[head] = item;
+        head_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer side. Returns the oldest item without removing it or nullptr if the ring is empty.
+     */
+    T* front() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        return &slots_[tail];
+    }
+
+    /**
+     * Consumer side. Returns false if the ring is empty.
+     */
+    bool tryPop(T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        item = slots_[tail];
+        tail_.store((tail + 1) % slots_.size(), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Approximate number of items in the ring. Safe to call from any thread.
+     */
+    size_t size() const {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return (head + slots_.size() - tail) % slots_.size();
+    }
+
+private:
+    std::vector<T> slots_;
+
+    // Keep the producer and consumer indexes on separate cache lines
+    std::atomic<size_t> head_;
+    char padding_[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_;
+};
+
+/**
+ * Decouples the GstCollectPads streaming thread from the SDK.
+ *
+ * Each pad gets a bounded SPSC ring which the streaming thread fills and a single sink-owned worker thread
+ * drains in the original arrival order. When a ring is full the streaming thread either blocks until the
+ * worker catches up or, in leaky mode, drops the incoming buffer. A dropped buffer takes the delta units
+ * following it on the same pad along with it up to the next key frame, as they can't be decoded without it.
+ */
+class KvsSinkIngestionQueue {
+public:
+    /**
+     * Processes a buffer on the worker thread. Takes the ownership of the buffer.
+     */
+    using ProcessFunc = std::function<GstFlowReturn(gpointer track, GstBuffer* buffer)>;
+
+    /**
+     * Creates the queue and starts the worker thread.
+     *
+     * @param tracks Opaque per-pad keys - one ring is created for each.
+     * @param depth Max number of buffers queued per pad.
+     * @param leaky Whether to drop the incoming buffers rather than block when a ring is full.
+     * @param process Buffer processing function invoked on the worker thread.
+     */
+    KvsSinkIngestionQueue(const std::vector<gpointer>& tracks, guint depth, bool leaky, ProcessFunc process);
+
+    ~KvsSinkIngestionQueue();
+
+    /**
+     * Queues the buffer for the given track. Called from the streaming thread. Takes the ownership of the buffer.
+     *
+     * @return GST_FLOW_FLUSHING if the queue is stopping, the last worker error since the last flush if any or GST_FLOW_OK.
+     */
+    GstFlowReturn push(gpointer track, GstBuffer* buffer);
+
+    /**
+     * Blocks until all of the queued buffers have been processed.
+     * Used to serialize events which must be applied after the preceding buffers.
+     */
+    void drain();
+
+    /**
+     * Releases the queued buffers without processing them and clears the last worker error.
+     * Called from the streaming thread on a flush.
+     */
+    void flush();
+
+    /**
+     * Unblocks the streaming thread, stops the worker and releases any buffers still queued.
+     */
+    void stop();
+
+    /**
+     * Current number of buffers queued across all of the pads.
+     */
+    guint getLevel() const;
+
+    /**
+     * Number of buffers dropped in leaky mode.
+     */
+    guint64 getDroppedCount() const {
+        return dropped_count_.load();
+    }
+
+private:
+    struct QueuedBuffer {
+        GstBuffer* buffer;
+        uint64_t sequence;
+    };
+
+    struct TrackQueue {
+        TrackQueue(gpointer track, guint depth) : track(track), ring(depth), dropping(false) {}
+
+        gpointer track;
+        KvsSinkSpscRing<QueuedBuffer> ring;
+
+        /**
+         * Whether the delta units are being dropped until the next key frame. Only touched by the streaming thread.
+         */
+        bool dropping;
+    };
+
+    void workerRoutine();
+
+    /**
+     * Returns the track queue holding the oldest buffer or nullptr if all are empty. Worker thread only.
+     */
+    TrackQueue* nextTrackQueue();
+
+    TrackQueue* findTrackQueue(gpointer track);
+
+    std::vector<std::unique_ptr<TrackQueue>> track_queues_;
+    const bool leaky_;
+    ProcessFunc process_;
+
+    /**
+     * Arrival order across the pads. Only touched by the streaming thread.
+     */
+    uint64_t next_sequence_;
+
+    /**
+     * Buffers queued or being processed. Guarded by mutex_, transiently negative when the worker finishes a
+     * buffer before the streaming thread has accounted for it.
+     */
+    int64_t in_flight_;
+    std::atomic<guint64> dropped_count_;
+    std::atomic<int> flow_return_;
+    std::atomic<bool> stopping_;
+
+    /**
+     * Whether the worker releases the buffers rather than processing them
+     */
+    std::atomic<bool> discarding_;
+
+    std::mutex mutex_;
+    std::condition_variable item_cv_;
+    std::condition_variable progress_cv_;
+    std::thread worker_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
+
+#endif //__KVS_SINK_INGESTION_QUEUE_H__
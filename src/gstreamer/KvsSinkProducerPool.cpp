@@ -0,0 +1,68 @@
+#include "KvsSinkProducerPool.h"
+#include <Logger.h>
+
+LOGGER_TAG("com.amazonaws.kinesis.video.gstkvs");
+
+using namespace com::amazonaws::kinesis::video;
+
+KvsSinkProducerPool& KvsSinkProducerPool::getInstance() {
+    static KvsSinkProducerPool instance;
+    return instance;
+}
+
+std::shared_ptr<KinesisVideoProducer> KvsSinkProducerPool::acquire(const std::string& key, const ProducerFactory& factory) {
+    // Creating under the lock makes the elements starting up concurrently wait for a single producer
+    std::lock_guard<std::mutex> lock(producers_mutex_);
+
+    auto it = producers_.find(key);
+    if (it != producers_.end()) {
+        auto producer = it->second.lock();
+        if (nullptr != producer) {
+            LOG_INFO("Attaching to the shared producer");
+            return producer;
+        }
+
+        producers_.erase(it);
+    }
+
+    LOG_INFO("Creating a new shared producer");
+    std::shared_ptr<KinesisVideoProducer> producer(factory());
+    producers_[key] = producer;
+
+    return producer;
+}
+
+void KvsSinkProducerPool::attachStream(STREAM_HANDLE stream_handle, std::shared_ptr<KvsSinkCustomData> data) {
+    streams_.put(stream_handle, data);
+}
+
+void KvsSinkProducerPool::detachStream(STREAM_HANDLE stream_handle) {
+    streams_.remove(stream_handle);
+}
+
+void KvsSinkProducerPool::attachPendingStream(const std::string& stream_name, std::shared_ptr<KvsSinkCustomData> data) {
+    pending_streams_.put(stream_name, data);
+}
+
+void KvsSinkProducerPool::detachPendingStream(const std::string& stream_name) {
+    pending_streams_.remove(stream_name);
+}
+
+std::shared_ptr<KvsSinkCustomData> KvsSinkProducerPool::findStreamData(STREAM_HANDLE stream_handle) const {
+    auto data = streams_.get(stream_handle);
+    if (nullptr != data || 0 == pending_streams_.size()) {
+        return data;
+    }
+
+    // Callback of a stream still being created
+    PStreamInfo stream_info = nullptr;
+    if (STATUS_FAILED(kinesisVideoStreamGetStreamInfo(stream_handle, &stream_info)) || nullptr == stream_info) {
+        return nullptr;
+    }
+
+    return pending_streams_.get(stream_info->name);
+}
+
+std::vector<std::shared_ptr<KvsSinkCustomData>> KvsSinkProducerPool::getStreamData() const {
+    return streams_.snapshot();
+}
@@ -0,0 +1,104 @@
+#ifndef __KVS_SINK_PRODUCER_POOL_H__
+#define __KVS_SINK_PRODUCER_POOL_H__
+
+#include <KinesisVideoProducer.h>
+#include <ConcurrentRegistry.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef struct _KvsSinkCustomData KvsSinkCustomData;
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+/**
+ * Max number of streams a shared producer is created with.
+ */
+#define KVS_SINK_SHARED_PRODUCER_MAX_STREAM_COUNT 128
+
+/**
+ * Process-wide pool of the producers shared across the kvssink elements.
+ *
+ * Elements with the same region, credentials and storage settings attach to the same producer as streams
+ * instead of each creating its own client, content store, credential provider and endpoint cache.
+ * A pooled producer is released when the last element using it lets it go.
+ *
+ * The stream callbacks of a shared producer are routed back to the owning element by the stream handle. While
+ * a stream is being created its handle isn't known to the element yet, so the callbacks fired during the
+ * creation are routed by the stream name instead.
+ */
+class KvsSinkProducerPool {
+public:
+    using ProducerFactory = std::function<std::unique_ptr<KinesisVideoProducer>()>;
+
+    static KvsSinkProducerPool& getInstance();
+
+    /**
+     * Returns the pooled producer for the key, creating it with the factory if there is none.
+     *
+     * @param key Producer configuration key.
+     * @param factory Creates the producer on a pool miss. Might throw.
+     */
+    std::shared_ptr<KinesisVideoProducer> acquire(const std::string& key, const ProducerFactory& factory);
+
+    /**
+     * Routes the stream callbacks for the stream handle to the element data.
+     */
+    void attachStream(STREAM_HANDLE stream_handle, std::shared_ptr<KvsSinkCustomData> data);
+
+    /**
+     * Stops routing the stream callbacks for the stream handle.
+     */
+    void detachStream(STREAM_HANDLE stream_handle);
+
+    /**
+     * Routes the stream callbacks for the stream of the name to the element data until the stream is attached
+     * by its handle. Set before the stream gets created.
+     */
+    void attachPendingStream(const std::string& stream_name, std::shared_ptr<KvsSinkCustomData> data);
+
+    /**
+     * Stops routing the stream callbacks for the stream name once the stream creation has completed or failed.
+     */
+    void detachPendingStream(const std::string& stream_name);
+
+    /**
+     * Returns the element data the stream is attached to or nullptr.
+     */
+    std::shared_ptr<KvsSinkCustomData> findStreamData(STREAM_HANDLE stream_handle) const;
+
+    /**
+     * Returns the element data of all of the attached streams.
+     */
+    std::vector<std::shared_ptr<KvsSinkCustomData>> getStreamData() const;
+
+private:
+    KvsSinkProducerPool() = default;
+
+    /**
+     * Pooled producers, not owned - the elements hold the references.
+     */
+    std::map<std::string, std::weak_ptr<KinesisVideoProducer>> producers_;
+    std::mutex producers_mutex_;
+
+    /**
+     * Looked up on every stream callback so it never blocks.
+     */
+    ConcurrentRegistry<STREAM_HANDLE, std::shared_ptr<KvsSinkCustomData>> streams_;
+
+    /**
+     * Streams being created by their names
+     */
+    ConcurrentRegistry<std::string, std::shared_ptr<KvsSinkCustomData>> pending_streams_;
+};
+
+} // namespace video
+} // namespace kinesis
+} // namespace amazonaws
+} // namespace com
+
+#endif //__KVS_SINK_PRODUCER_POOL_H__
@@ -1,12 +1,33 @@
 #include "KvsSinkStreamCallbackProvider.h"
+#include "KvsSinkProducerPool.h"
 
 LOGGER_TAG("com.amazonaws.kinesis.video.gstkvs");
 
 using namespace com::amazonaws::kinesis::video;
 
+std::shared_ptr<KvsSinkCustomData>
+KvsSinkStreamCallbackProvider::getCustomData(UINT64 custom_data, STREAM_HANDLE stream_handle) {
+    auto provider = reinterpret_cast<KvsSinkStreamCallbackProvider*>(custom_data);
+    if (provider == NULL) {
+        return nullptr;
+    }
+
+    if (provider->data != nullptr) {
+        return provider->data;
+    }
+
+    return KvsSinkProducerPool::getInstance().findStreamData(stream_handle);
+}
+
 STATUS
 KvsSinkStreamCallbackProvider::bufferDurationOverflowPressureHandler(UINT64 custom_data, STREAM_HANDLE stream_handle, UINT64 remainDuration) {
-    UNUSED_PARAM(custom_data);
+    auto customDataObj = getCustomData(custom_data, stream_handle);
+    LOG_WARN("Reported bufferDurationOverflowPressure callback for stream handle " << stream_handle << ". Remaining duration in 100ns: " << remainDuration);
+    auto bitrate_controller = customDataObj != NULL ? std::atomic_load(&customDataObj->bitrate_controller) : nullptr;
+    if (bitrate_controller != nullptr) {
+        bitrate_controller->reportPressure();
+    }
+
     return STATUS_SUCCESS;
 }
 
@@ -30,8 +51,8 @@ KvsSinkStreamCallbackProvider::streamErrorReportHandler(UINT64 custom_data,
                                                         UPLOAD_HANDLE upload_handle,
                                                         UINT64 errored_timecode,
                                                         STATUS status_code) {
-    auto customDataObj = reinterpret_cast<KvsSinkCustomData*>(custom_data);
-    LOG_ERROR("Reported stream error. Errored timecode: " << errored_timecode << " Status: 0x" << std::hex << status_code << " for " << customDataObj->kvs_sink->stream_name);
+    auto customDataObj = getCustomData(custom_data, stream_handle);
+    LOG_ERROR("Reported stream error. Errored timecode: " << errored_timecode << " Status: 0x" << std::hex << status_code << " for " << (customDataObj != NULL ? customDataObj->kvs_sink->stream_name : ""));
     if(customDataObj != NULL && (!IS_RECOVERABLE_ERROR(status_code))) {
         customDataObj->stream_status = status_code;
         g_signal_emit(G_OBJECT(customDataObj->kvs_sink), customDataObj->err_signal_id, 0, status_code);
@@ -62,8 +83,13 @@ STATUS
 KvsSinkStreamCallbackProvider::streamLatencyPressureHandler(UINT64 custom_data,
                                                             STREAM_HANDLE stream_handle,
                                                             UINT64 current_buffer_duration) {
-    UNUSED_PARAM(custom_data);
+    auto customDataObj = getCustomData(custom_data, stream_handle);
     LOG_WARN("Reported streamLatencyPressure callback for stream handle " << stream_handle << ". Current buffer duration in 100ns: " << current_buffer_duration);
+    auto bitrate_controller = customDataObj != NULL ? std::atomic_load(&customDataObj->bitrate_controller) : nullptr;
+    if (bitrate_controller != nullptr) {
+        bitrate_controller->reportPressure();
+    }
+
     return STATUS_SUCCESS;
 }
 
@@ -72,7 +98,7 @@ KvsSinkStreamCallbackProvider::streamClosedHandler(UINT64 custom_data,
                                                    STREAM_HANDLE stream_handle,
                                                    UPLOAD_HANDLE upload_handle) {
     std::string streamName = "";
-    auto customDataObj = reinterpret_cast<KvsSinkCustomData*>(custom_data);
+    auto customDataObj = getCustomData(custom_data, stream_handle);
     if(customDataObj != NULL && customDataObj->kvs_sink != NULL) {
         streamName = customDataObj->kvs_sink->stream_name;
     }
@@ -85,7 +111,7 @@ KvsSinkStreamCallbackProvider::fragmentAckReceivedHandler(UINT64 custom_data,
                                                   STREAM_HANDLE stream_handle,
                                                   UPLOAD_HANDLE upload_handle,
                                                   PFragmentAck pFragmentAck) {
-    auto customDataObj = reinterpret_cast<KvsSinkCustomData*>(custom_data);
+    auto customDataObj = getCustomData(custom_data, stream_handle);
 
     if(customDataObj != NULL && customDataObj->kvs_sink != NULL && pFragmentAck != NULL) {
         LOG_TRACE("[" << customDataObj->kvs_sink->stream_name << "] Ack timestamp for " <<  pFragmentAck->ackType << " is " << pFragmentAck->timestamp);
@@ -8,10 +8,14 @@ namespace com { namespace amazonaws { namespace kinesis { namespace video {
     class KvsSinkStreamCallbackProvider : public StreamCallbackProvider {
         std::shared_ptr<KvsSinkCustomData> data;
     public:
+        /**
+         * @param data The element data or nullptr for a shared producer, in which case the callbacks
+         *             are routed to the element by the stream handle.
+         */
         KvsSinkStreamCallbackProvider(std::shared_ptr<KvsSinkCustomData> data) : data(data) {}
 
         UINT64 getCallbackCustomData() override {
-            return reinterpret_cast<UINT64> (data.get());
+            return reinterpret_cast<UINT64> (this);
         }
 
         StreamUnderflowReportFunc getStreamUnderflowReportCallback() override {
@@ -51,6 +55,8 @@ namespace com { namespace amazonaws { namespace kinesis { namespace video {
         }
 
     private:
+        static std::shared_ptr<KvsSinkCustomData> getCustomData(UINT64 custom_data, STREAM_HANDLE stream_handle);
+
         static STATUS
         streamUnderflowReportHandler(UINT64 custom_data, STREAM_HANDLE stream_handle);
 
@@ -59,8 +59,10 @@
 #include "KvsSinkStreamCallbackProvider.h"
 #include "KvsSinkClientCallbackProvider.h"
 #include "KvsSinkDeviceInfoProvider.h"
+#include "KvsSinkProducerPool.h"
 #include <IotCertCredentialProvider.h>
 #include "Util/KvsSinkUtil.h"
+#include "NalAdapter.h"
 
 LOGGER_TAG("com.amazonaws.kinesis.video.gstkvs");
 
@@ -109,6 +111,9 @@ GST_DEBUG_CATEGORY_STATIC (gst_kvs_sink_debug);
 #define DEFAULT_ROTATION_PERIOD_SECONDS 3600
 #define DEFAULT_LOG_FILE_PATH "../kvs_log_configuration"
 #define DEFAULT_STORAGE_SIZE_MB 128
+#define DEFAULT_STORAGE_SPILL_PATH ""
+#define DEFAULT_API_CALL_CACHE_PATH ""
+#define DEFAULT_STORAGE_SIZE_STATE_PATH ""
 #define DEFAULT_STOP_STREAM_TIMEOUT_SEC 120
 #define DEFAULT_SERVICE_CONNECTION_TIMEOUT_SEC 5
 #define DEFAULT_SERVICE_COMPLETION_TIMEOUT_SEC 10
@@ -116,6 +121,15 @@ GST_DEBUG_CATEGORY_STATIC (gst_kvs_sink_debug);
 #define DEFAULT_IOT_COMPLETION_TIMEOUT_SEC 5
 #define DEFAULT_CREDENTIAL_FILE_PATH ".kvs/credential"
 #define DEFAULT_FRAME_DURATION_MS 2
+#define DEFAULT_INGESTION_QUEUE_DEPTH 0
+#define DEFAULT_INGESTION_QUEUE_LEAKY FALSE
+#define DEFAULT_SHARED_PRODUCER FALSE
+#define DEFAULT_ADAPTIVE_BITRATE FALSE
+#define DEFAULT_ENCODER_NAME ""
+#define DEFAULT_MIN_BITRATE_KBPS 250
+#define DEFAULT_MAX_BITRATE_KBPS 4000
+#define DEFAULT_ENCODER_BITRATE_SCALE 1
+#define DEFAULT_FRAME_SHEDDING FALSE
 
 #define KVS_ADD_METADATA_G_STRUCT_NAME "kvs-add-metadata"
 #define KVS_ADD_METADATA_NAME "name"
@@ -123,6 +137,14 @@ GST_DEBUG_CATEGORY_STATIC (gst_kvs_sink_debug);
 #define KVS_ADD_METADATA_PERSISTENT "persist"
 #define KVS_CLIENT_USER_AGENT_NAME "AWS-SDK-KVS-CPP-CLIENT"
 
+// Upstream event requesting the encoder to change the bitrate, sent when no encoder-name is set
+#define KVS_BITRATE_REQUEST_G_STRUCT_NAME "kvs-bitrate-request"
+#define KVS_BITRATE_REQUEST_BITRATE "bitrate"
+#define KVS_ENCODER_BITRATE_PROPERTY "bitrate"
+
+// Max number of memories in a GstBuffer, see gst_buffer_get_max_memory()
+#define KVS_SINK_MAX_BUFFER_MEMORY_COUNT 16
+
 #define DEFAULT_AUDIO_TRACK_NAME "audio"
 #define DEFAULT_AUDIO_CODEC_ID_AAC "A_AAC"
 #define DEFAULT_AUDIO_CODEC_ID_PCM "A_MS/ACM"
@@ -174,6 +196,10 @@ enum {
     PROP_ROTATION_PERIOD,
     PROP_LOG_CONFIG_PATH,
     PROP_STORAGE_SIZE,
+    PROP_STORAGE_SPILL_PATH,
+    PROP_STORAGE_RAM_PERCENT,
+    PROP_API_CALL_CACHE_PATH,
+    PROP_STORAGE_SIZE_STATE_PATH,
     PROP_STOP_STREAM_TIMEOUT,
     PROP_SERVICE_CONNECTION_TIMEOUT,
     PROP_SERVICE_COMPLETION_TIMEOUT,
@@ -185,7 +211,18 @@ enum {
     PROP_USE_ORIGINAL_PTS,
     PROP_GET_METRICS,
     PROP_ALLOW_CREATE_STREAM,
-    PROP_USER_AGENT_NAME
+    PROP_USER_AGENT_NAME,
+    PROP_INGESTION_QUEUE_DEPTH,
+    PROP_INGESTION_QUEUE_LEAKY,
+    PROP_INGESTION_QUEUE_LEVEL,
+    PROP_INGESTION_QUEUE_DROPPED,
+    PROP_SHARED_PRODUCER,
+    PROP_ADAPTIVE_BITRATE,
+    PROP_ENCODER_NAME,
+    PROP_MIN_BITRATE,
+    PROP_MAX_BITRATE,
+    PROP_ENCODER_BITRATE_SCALE,
+    PROP_FRAME_SHEDDING
 };
 
 #define GST_TYPE_KVS_SINK_STREAMING_TYPE (gst_kvs_sink_streaming_type_get_type())
@@ -223,7 +260,7 @@ static GstStaticPadTemplate videosink_templ =
                                  GST_PAD_SINK,
                                  GST_PAD_REQUEST,
                                  GST_STATIC_CAPS (
-                                         "video/x-h264, stream-format = (string) avc, alignment = (string) au, width = (int) [ 16, MAX ], height = (int) [ 16, MAX ] ; " \
+                                         "video/x-h264, stream-format = (string) { avc, byte-stream }, alignment = (string) au, width = (int) [ 16, MAX ], height = (int) [ 16, MAX ] ; " \
                                          "video/x-h265, alignment = (string) au, width = (int) [ 16, MAX ], height = (int) [ 16, MAX ] ;"
                                  )
         );
@@ -260,18 +297,76 @@ static void gst_kvs_sink_release_pad (GstElement *element, GstPad *pad);
 void closed(UINT64 custom_data, STREAM_HANDLE stream_handle, UPLOAD_HANDLE upload_handle) {
     LOG_INFO("Closed connection with stream handle "<<stream_handle<<" and upload handle "<<upload_handle);
 }
+
+/**
+ * Joins the stream restart if it has completed or, with wait set, waits for it.
+ *
+ * @return Whether the stream can be used, false while the restart still runs or once it has failed.
+ */
+static bool
+gst_kvs_sink_join_restart(GstKvsSink *kvssink, bool wait) {
+    auto data = kvssink->data;
+    if (data->stream_restart_thread.joinable()) {
+        if (!wait && data->stream_restarting.load()) {
+            return false;
+        }
+
+        data->stream_restart_thread.join();
+        LOG_INFO("Dropped " << data->restart_dropped_frames << " frames of " << kvssink->stream_name
+                 << " during the restart");
+    }
+
+    return data->kinesis_video_stream != nullptr;
+}
+
+void kinesis_video_stream_release(GstKvsSink *kvssink) {
+    auto data = kvssink->data;
+
+    gst_kvs_sink_join_restart(kvssink, true);
+    if (data->kinesis_video_stream == nullptr) {
+        return;
+    }
+
+    if (kvssink->shared_producer) {
+        // Other elements keep streaming through the shared producer so only free our own stream
+        KvsSinkProducerPool::getInstance().detachStream(*data->kinesis_video_stream->getStreamHandle());
+        data->kinesis_video_producer->freeStream(data->kinesis_video_stream);
+    }
+
+    data->kinesis_video_stream.reset();
+}
+
 void kinesis_video_producer_init(GstKvsSink *kvssink)
 {
     auto data = kvssink->data;
 
     KVSSINK_THROW_IF_NULL(kvssink->stream_name);
 
-    unique_ptr<DeviceInfoProvider> device_info_provider(new KvsSinkDeviceInfoProvider(kvssink->storage_size,
+    // Re-initializing after a READY->NULL->READY cycle
+    kinesis_video_stream_release(kvssink);
+
+    unique_ptr<KvsSinkDeviceInfoProvider> kvs_sink_device_info_provider(new KvsSinkDeviceInfoProvider(kvssink->storage_size,
                                                         kvssink->stop_stream_timeout,
                                                         kvssink->service_connection_timeout,
-                                                        kvssink->service_completion_timeout));
-    unique_ptr<ClientCallbackProvider> client_callback_provider(new KvsSinkClientCallbackProvider());
-    unique_ptr<StreamCallbackProvider> stream_callback_provider(new KvsSinkStreamCallbackProvider(data));
+                                                        kvssink->service_completion_timeout,
+                                                        kvssink->shared_producer ? KVS_SINK_SHARED_PRODUCER_MAX_STREAM_COUNT : 0));
+    if (kvssink->storage_spill_path != nullptr && kvssink->storage_spill_path[0] != '\0') {
+        kvs_sink_device_info_provider->setStorageSpill(kvssink->storage_spill_path, kvssink->storage_ram_percent);
+    }
+
+    if (kvssink->api_call_cache_path != nullptr) {
+        kvs_sink_device_info_provider->setApiCallCachePath(kvssink->api_call_cache_path);
+    }
+
+    if (kvssink->storage_size_state_path != nullptr && kvssink->storage_size_state_path[0] != '\0') {
+        kvs_sink_device_info_provider->setAutoStorageSize(kvssink->storage_size_state_path);
+    }
+
+    unique_ptr<DeviceInfoProvider> device_info_provider(std::move(kvs_sink_device_info_provider));
+    unique_ptr<ClientCallbackProvider> client_callback_provider(new KvsSinkClientCallbackProvider(data));
+    // The stream callbacks of a shared producer are routed by the stream handle instead
+    unique_ptr<StreamCallbackProvider> stream_callback_provider(
+            new KvsSinkStreamCallbackProvider(kvssink->shared_producer ? nullptr : data));
 
     kvssink->data->kvs_sink = kvssink;
 
@@ -330,10 +425,10 @@ void kinesis_video_producer_init(GstKvsSink *kvssink)
     }
 
     unique_ptr<CredentialProvider> credential_provider;
+    std::map<std::string, std::string> iot_cert_params;
 
     if (kvssink->iot_certificate) {
         LOG_INFO("Using iot credential provider within KVS sink for " << kvssink->stream_name);
-        std::map<std::string, std::string> iot_cert_params;
         uint64_t iot_connection_timeout = DEFAULT_IOT_CONNECTION_TIMEOUT_SEC * HUNDREDS_OF_NANOS_IN_A_SECOND;
         uint64_t iot_completion_timeout = DEFAULT_IOT_COMPLETION_TIMEOUT_SEC * HUNDREDS_OF_NANOS_IN_A_SECOND;
         if (!kvs_sink_util::parseIotCredentialGstructure(kvssink->iot_certificate, iot_cert_params)){
@@ -381,14 +476,101 @@ void kinesis_video_producer_init(GstKvsSink *kvssink)
     KVSSINK_THROW_IF_NULL(kvssink->user_agent);
 
     LOG_INFO("User agent string: " << kvssink->user_agent);
-    data->kinesis_video_producer = KinesisVideoProducer::createSync(std::move(device_info_provider),
-                                                                    std::move(client_callback_provider),
-                                                                    std::move(stream_callback_provider),
-                                                                    std::move(credential_provider),
-                                                                    API_CALL_CACHE_TYPE_ALL,
-                                                                    region_str,
-                                                                    control_plane_uri_str,
-                                                                    kvssink->user_agent);
+    if (!kvssink->shared_producer) {
+        data->kinesis_video_producer = KinesisVideoProducer::createSync(std::move(device_info_provider),
+                                                                        std::move(client_callback_provider),
+                                                                        std::move(stream_callback_provider),
+                                                                        std::move(credential_provider),
+                                                                        API_CALL_CACHE_TYPE_ALL,
+                                                                        region_str,
+                                                                        control_plane_uri_str,
+                                                                        kvssink->user_agent);
+        return;
+    }
+
+    // Everything that ends up in the client configuration identifies the shared producer. The secrets are only
+    // hashed as the key might end up in the logs
+    ostringstream producer_key;
+    producer_key << region_str << '|' << control_plane_uri_str << '|' << kvssink->user_agent << '|'
+                 << access_key_str << '|' << std::hash<std::string>()(secret_key_str + '|' + session_token_str) << '|'
+                 << (kvssink->credential_file_path != nullptr ? kvssink->credential_file_path : "") << '|'
+                 << kvssink->storage_size << '|' << (kvssink->storage_spill_path != nullptr ? kvssink->storage_spill_path : "") << '|'
+                 << kvssink->storage_ram_percent << '|' << (kvssink->api_call_cache_path != nullptr ? kvssink->api_call_cache_path : "") << '|'
+                 << (kvssink->storage_size_state_path != nullptr ? kvssink->storage_size_state_path : "") << '|'
+                 << kvssink->stop_stream_timeout << '|'
+                 << kvssink->service_connection_timeout << '|' << kvssink->service_completion_timeout;
+
+    // Resolved parameters, the thing name defaults to the stream name and scopes the IoT credentials
+    for (auto& iot_cert_param : iot_cert_params) {
+        producer_key << '|' << iot_cert_param.first << '=' << iot_cert_param.second;
+    }
+
+    // The storage pressure of the pooled producer only backs off the streams attached to it
+    data->producer_key = producer_key.str();
+    client_callback_provider.reset(new KvsSinkClientCallbackProvider(data->producer_key));
+    data->kinesis_video_producer = KvsSinkProducerPool::getInstance().acquire(data->producer_key, [&]() {
+        return KinesisVideoProducer::createSync(std::move(device_info_provider),
+                                                std::move(client_callback_provider),
+                                                std::move(stream_callback_provider),
+                                                std::move(credential_provider),
+                                                API_CALL_CACHE_TYPE_ALL,
+                                                region_str,
+                                                control_plane_uri_str,
+                                                kvssink->user_agent);
+    });
+}
+
+/**
+ * Returns the referenced encoder-name element if it has a bitrate property, otherwise NULL.
+ */
+static GstElement *
+gst_kvs_sink_get_encoder(GstKvsSink *kvssink) {
+    GstObject *parent = NULL;
+    GstElement *encoder = NULL;
+
+    if (kvssink->encoder_name == NULL || kvssink->encoder_name[0] == '\0') {
+        return NULL;
+    }
+
+    parent = gst_object_get_parent(GST_OBJECT(kvssink));
+    if (parent != NULL && GST_IS_BIN(parent)) {
+        encoder = gst_bin_get_by_name_recurse_up(GST_BIN(parent), kvssink->encoder_name);
+    }
+
+    if (parent != NULL) {
+        gst_object_unref(parent);
+    }
+
+    if (encoder == NULL) {
+        LOG_WARN("Encoder " << kvssink->encoder_name << " not found for " << kvssink->stream_name);
+    } else if (g_object_class_find_property(G_OBJECT_GET_CLASS(encoder), KVS_ENCODER_BITRATE_PROPERTY) == NULL) {
+        LOG_WARN("Encoder " << kvssink->encoder_name << " has no " KVS_ENCODER_BITRATE_PROPERTY " property for " << kvssink->stream_name);
+        gst_object_unref(encoder);
+        encoder = NULL;
+    }
+
+    return encoder;
+}
+
+/**
+ * Returns the bitrate the encoder-name element runs at in kbps or 0 if it's unknown.
+ */
+static uint32_t
+gst_kvs_sink_get_encoder_bitrate(GstKvsSink *kvssink) {
+    uint32_t bitrate_kbps = 0;
+    GstElement *encoder = gst_kvs_sink_get_encoder(kvssink);
+
+    if (encoder != NULL) {
+        // Transformed from the type of the encoder property by GObject
+        GValue value = G_VALUE_INIT;
+        g_value_init(&value, G_TYPE_UINT);
+        g_object_get_property(G_OBJECT(encoder), KVS_ENCODER_BITRATE_PROPERTY, &value);
+        bitrate_kbps = g_value_get_uint(&value) / MAX(kvssink->encoder_bitrate_scale, 1u);
+        g_value_unset(&value);
+        gst_object_unref(encoder);
+    }
+
+    return bitrate_kbps;
 }
 
 void create_kinesis_video_stream(GstKvsSink *kvssink) {
@@ -420,8 +602,9 @@ void create_kinesis_video_stream(GstKvsSink *kvssink) {
             kvssink->framerate = MAX(kvssink->framerate, DEFAULT_STREAM_FRAMERATE_HIGH_DENSITY);
             break;
         case AUDIO_ONLY:
+            // Copied as the stream is created again on a codec private data change
             g_free(kvssink->codec_id);
-            kvssink->codec_id = kvssink->audio_codec_id;
+            kvssink->codec_id = g_strdup(kvssink->audio_codec_id);
             g_free(kvssink->track_name);
             kvssink->track_name = g_strdup(DEFAULT_AUDIO_TRACK_NAME);
             kvssink->track_info_type = MKV_TRACK_INFO_TYPE_AUDIO;
@@ -477,7 +660,47 @@ void create_kinesis_video_stream(GstKvsSink *kvssink) {
         stream_definition->setFrameOrderMode(FRAME_ORDERING_MODE_MULTI_TRACK_AV_COMPARE_PTS_ONE_MS_COMPENSATE_EOFR);
     }
 
-    data->kinesis_video_stream = data->kinesis_video_producer->createStreamSync(std::move(stream_definition));
+    // Set up before the stream exists as the pressure callbacks read it from the client threads. Without the
+    // encoder bitrate the target is applied to the encoder at the first frame.
+    shared_ptr<BitrateController> bitrate_controller;
+    if (kvssink->adaptive_bitrate) {
+        BitrateControllerConfig bitrate_config;
+        bitrate_config.min_bitrate_kbps = MIN(kvssink->min_bitrate_kbps, kvssink->max_bitrate_kbps);
+        bitrate_config.max_bitrate_kbps = kvssink->max_bitrate_kbps;
+        bitrate_config.initial_bitrate_kbps = gst_kvs_sink_get_encoder_bitrate(kvssink);
+        bitrate_controller = make_shared<BitrateController>(bitrate_config);
+    }
+
+    std::atomic_store(&data->bitrate_controller, bitrate_controller);
+
+    // The callbacks fired while a shared producer creates the stream reach the element by the stream name,
+    // so that a failing bring-up still gets reported
+    if (kvssink->shared_producer) {
+        KvsSinkProducerPool::getInstance().attachPendingStream(kvssink->stream_name, data);
+    }
+
+    try {
+        data->kinesis_video_stream = data->kinesis_video_producer->createStreamSync(std::move(stream_definition));
+    } catch (...) {
+        if (kvssink->shared_producer) {
+            KvsSinkProducerPool::getInstance().detachPendingStream(kvssink->stream_name);
+        }
+
+        throw;
+    }
+
+    if (kvssink->frame_shedding && data->media_type != AUDIO_ONLY) {
+        // The sink always puts length-prefixed NALs, byte-stream input is adapted before
+        FrameAdmissionConfig admission_config;
+        admission_config.track_id = KVS_SINK_DEFAULT_TRACKID;
+        admission_config.codec = !strcmp(kvssink->codec_id, DEFAULT_CODEC_ID_H265) ? FRAME_ADMISSION_CODEC_H265 : FRAME_ADMISSION_CODEC_H264;
+        data->kinesis_video_stream->setFrameAdmission(admission_config);
+    }
+
+    if (kvssink->shared_producer) {
+        KvsSinkProducerPool::getInstance().attachStream(*data->kinesis_video_stream->getStreamHandle(), data);
+        KvsSinkProducerPool::getInstance().detachPendingStream(kvssink->stream_name);
+    }
     data->frame_count = 0;
     cout << "Stream is ready" << endl;
 }
@@ -648,6 +871,22 @@ gst_kvs_sink_class_init(GstKvsSinkClass *klass) {
                                      g_param_spec_uint ("storage-size", "Storage Size",
                                                         "Storage Size. Unit: MB", 0, G_MAXUINT, DEFAULT_STORAGE_SIZE_MB, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
+    g_object_class_install_property (gobject_class, PROP_STORAGE_SPILL_PATH,
+                                     g_param_spec_string ("storage-spill-path", "Storage spill directory",
+                                                          "Directory the content store spills into once its RAM share is used up, e.g. on eMMC. Empty keeps the whole store in RAM", DEFAULT_STORAGE_SPILL_PATH, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_STORAGE_RAM_PERCENT,
+                                     g_param_spec_uint ("storage-ram-percent", "Storage RAM share",
+                                                        "Percentage of the storage size kept in RAM when storage-spill-path is set", 0, 100, DEFAULT_STORAGE_SPILL_RAM_PERCENT, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_API_CALL_CACHE_PATH,
+                                     g_param_spec_string ("api-call-cache-path", "API call cache file",
+                                                          "File the stream descriptions and endpoints are cached in across restarts. Empty disables the cache", DEFAULT_API_CALL_CACHE_PATH, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_STORAGE_SIZE_STATE_PATH,
+                                     g_param_spec_string ("storage-size-state-path", "Storage size state file",
+                                                          "File the observed stream bitrates are kept in across restarts. Once learned, the storage size and stream count are sized from them in place of storage-size. Empty disables the auto sizing", DEFAULT_STORAGE_SIZE_STATE_PATH, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
     g_object_class_install_property (gobject_class, PROP_STOP_STREAM_TIMEOUT,
                                      g_param_spec_uint ("stop-stream-timeout", "Stop stream timeout",
                                                         "Stop stream timeout: seconds", 0, G_MAXUINT, DEFAULT_STOP_STREAM_TIMEOUT_SEC, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
@@ -699,6 +938,54 @@ gst_kvs_sink_class_init(GstKvsSinkClass *klass) {
                                                            "Set to true if allowing create stream call, false otherwise", DEFAULT_ALLOW_CREATE_STREAM,
                                                            (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
+    g_object_class_install_property (gobject_class, PROP_INGESTION_QUEUE_DEPTH,
+                                     g_param_spec_uint ("ingestion-queue-depth", "Ingestion queue depth",
+                                                        "Max number of buffers queued per pad for the ingestion worker thread. 0 processes the buffers on the streaming thread", 0, G_MAXUINT, DEFAULT_INGESTION_QUEUE_DEPTH, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_INGESTION_QUEUE_LEAKY,
+                                     g_param_spec_boolean ("ingestion-queue-leaky", "Drop buffers when the ingestion queue is full",
+                                                           "Set to true to drop the incoming buffers up to the next key frame when the ingestion queue is full, otherwise the streaming thread blocks", DEFAULT_INGESTION_QUEUE_LEAKY,
+                                                           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_INGESTION_QUEUE_LEVEL,
+                                     g_param_spec_uint ("ingestion-queue-level", "Ingestion queue level",
+                                                        "Current number of buffers in the ingestion queue across all of the pads", 0, G_MAXUINT, 0, (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_INGESTION_QUEUE_DROPPED,
+                                     g_param_spec_uint64 ("ingestion-queue-dropped", "Ingestion queue dropped buffers",
+                                                          "Number of buffers dropped by the leaky ingestion queue", 0, G_MAXUINT64, 0, (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_SHARED_PRODUCER,
+                                     g_param_spec_boolean ("shared-producer", "Share the producer with the other kvssink elements",
+                                                           "Set to true to attach the stream to a process-wide producer shared by the kvssink elements with the same region, credentials and storage settings, sharing a single content store", DEFAULT_SHARED_PRODUCER,
+                                                           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_ADAPTIVE_BITRATE,
+                                     g_param_spec_boolean ("adaptive-bitrate", "Adapt the encoder bitrate to the upload pressure",
+                                                           "Set to true to lower the encoder bitrate on latency, buffer duration and storage pressure and raise it back once the pressure is gone", DEFAULT_ADAPTIVE_BITRATE,
+                                                           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_ENCODER_NAME,
+                                     g_param_spec_string ("encoder-name", "Encoder element name",
+                                                          "Name of the encoder element in the pipeline whose \"bitrate\" property is adapted. If empty, a \"" KVS_BITRATE_REQUEST_G_STRUCT_NAME "\" custom upstream event is sent instead. The bitrate starts from the one of the encoder, otherwise max-bitrate is requested at the first frame", DEFAULT_ENCODER_NAME, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_MIN_BITRATE,
+                                     g_param_spec_uint ("min-bitrate", "Min bitrate",
+                                                        "Lowest bitrate in kbps the encoder is lowered to", 1, G_MAXUINT, DEFAULT_MIN_BITRATE_KBPS, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_MAX_BITRATE,
+                                     g_param_spec_uint ("max-bitrate", "Max bitrate",
+                                                        "Bitrate in kbps the encoder starts at and is raised back to", 1, G_MAXUINT, DEFAULT_MAX_BITRATE_KBPS, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_ENCODER_BITRATE_SCALE,
+                                     g_param_spec_uint ("encoder-bitrate-scale", "Encoder bitrate scale",
+                                                        "Multiplier from kbps to the unit of the encoder \"bitrate\" property, e.g. 1000 for encoders taking bit/sec", 1, G_MAXUINT, DEFAULT_ENCODER_BITRATE_SCALE, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property (gobject_class, PROP_FRAME_SHEDDING,
+                                     g_param_spec_boolean ("frame-shedding", "Shed video frames as the content store fills up",
+                                                           "Set to true to shed the non-reference frames, then the rest of the GOPs and finally whole GOPs as the content store fills up, before the buffered frames get evicted", DEFAULT_FRAME_SHEDDING,
+                                                           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
     gst_element_class_set_static_metadata(gstelement_class,
                                           "KVS Sink",
                                           "Sink/Video/Network",
@@ -764,6 +1051,10 @@ gst_kvs_sink_init(GstKvsSink *kvssink) {
     kvssink->rotation_period = DEFAULT_ROTATION_PERIOD_SECONDS;
     kvssink->log_config_path = g_strdup (DEFAULT_LOG_FILE_PATH);
     kvssink->storage_size = DEFAULT_STORAGE_SIZE_MB;
+    kvssink->storage_spill_path = g_strdup (DEFAULT_STORAGE_SPILL_PATH);
+    kvssink->storage_ram_percent = DEFAULT_STORAGE_SPILL_RAM_PERCENT;
+    kvssink->api_call_cache_path = g_strdup (DEFAULT_API_CALL_CACHE_PATH);
+    kvssink->storage_size_state_path = g_strdup (DEFAULT_STORAGE_SIZE_STATE_PATH);
     kvssink->stop_stream_timeout = DEFAULT_STOP_STREAM_TIMEOUT_SEC;
     kvssink->service_connection_timeout = DEFAULT_SERVICE_CONNECTION_TIMEOUT_SEC;
     kvssink->service_completion_timeout = DEFAULT_SERVICE_COMPLETION_TIMEOUT_SEC;
@@ -772,6 +1063,15 @@ gst_kvs_sink_init(GstKvsSink *kvssink) {
             systemCurrentTime().time_since_epoch()).count();
     kvssink->track_info_type = MKV_TRACK_INFO_TYPE_VIDEO;
     kvssink->audio_codec_id = g_strdup (DEFAULT_AUDIO_CODEC_ID_AAC);
+    kvssink->ingestion_queue_depth = DEFAULT_INGESTION_QUEUE_DEPTH;
+    kvssink->ingestion_queue_leaky = DEFAULT_INGESTION_QUEUE_LEAKY;
+    kvssink->shared_producer = DEFAULT_SHARED_PRODUCER;
+    kvssink->adaptive_bitrate = DEFAULT_ADAPTIVE_BITRATE;
+    kvssink->encoder_name = g_strdup (DEFAULT_ENCODER_NAME);
+    kvssink->min_bitrate_kbps = DEFAULT_MIN_BITRATE_KBPS;
+    kvssink->max_bitrate_kbps = DEFAULT_MAX_BITRATE_KBPS;
+    kvssink->encoder_bitrate_scale = DEFAULT_ENCODER_BITRATE_SCALE;
+    kvssink->frame_shedding = DEFAULT_FRAME_SHEDDING;
 
     kvssink->data = make_shared<KvsSinkCustomData>();
     kvssink->data->err_signal_id = KvsSinkSignals::err_signal_id;
@@ -789,6 +1089,9 @@ static void
 gst_kvs_sink_finalize(GObject *object) {
     GstKvsSink *kvssink = GST_KVS_SINK (object);
 
+    // The restart reads the properties freed below
+    gst_kvs_sink_join_restart(kvssink, true);
+
     gst_object_unref(kvssink->collect);
     g_free(kvssink->stream_name);
     g_free(kvssink->user_agent);
@@ -803,6 +1106,10 @@ gst_kvs_sink_finalize(GObject *object) {
     g_free(kvssink->kms_key_id);
     g_free(kvssink->log_config_path);
     g_free(kvssink->credential_file_path);
+    g_free(kvssink->encoder_name);
+    g_free(kvssink->storage_spill_path);
+    g_free(kvssink->api_call_cache_path);
+    g_free(kvssink->storage_size_state_path);
 
     if (kvssink->iot_certificate) {
         gst_structure_free(kvssink->iot_certificate);
@@ -811,6 +1118,9 @@ gst_kvs_sink_finalize(GObject *object) {
         gst_structure_free(kvssink->stream_tags);
     }
 
+    // Detach from the shared producer which might outlive us
+    kinesis_video_stream_release(kvssink);
+
     // Reset the smart pointers to properly release the data
     kvssink->credentials_.reset();
     kvssink->data.reset();
@@ -925,6 +1235,21 @@ gst_kvs_sink_set_property(GObject *object, guint prop_id,
         case PROP_STORAGE_SIZE:
             kvssink->storage_size = g_value_get_uint (value);
             break;
+        case PROP_STORAGE_SPILL_PATH:
+            g_free(kvssink->storage_spill_path);
+            kvssink->storage_spill_path = g_strdup (g_value_get_string (value));
+            break;
+        case PROP_STORAGE_RAM_PERCENT:
+            kvssink->storage_ram_percent = g_value_get_uint (value);
+            break;
+        case PROP_API_CALL_CACHE_PATH:
+            g_free(kvssink->api_call_cache_path);
+            kvssink->api_call_cache_path = g_strdup (g_value_get_string (value));
+            break;
+        case PROP_STORAGE_SIZE_STATE_PATH:
+            g_free(kvssink->storage_size_state_path);
+            kvssink->storage_size_state_path = g_strdup (g_value_get_string (value));
+            break;
         case PROP_STOP_STREAM_TIMEOUT:
             kvssink->stop_stream_timeout = g_value_get_uint (value);
             break;
@@ -974,6 +1299,34 @@ gst_kvs_sink_set_property(GObject *object, guint prop_id,
         case PROP_ALLOW_CREATE_STREAM:
             kvssink->allow_create_stream = g_value_get_boolean(value);
             break;
+        case PROP_INGESTION_QUEUE_DEPTH:
+            kvssink->ingestion_queue_depth = g_value_get_uint(value);
+            break;
+        case PROP_INGESTION_QUEUE_LEAKY:
+            kvssink->ingestion_queue_leaky = g_value_get_boolean(value);
+            break;
+        case PROP_SHARED_PRODUCER:
+            kvssink->shared_producer = g_value_get_boolean(value);
+            break;
+        case PROP_ADAPTIVE_BITRATE:
+            kvssink->adaptive_bitrate = g_value_get_boolean(value);
+            break;
+        case PROP_ENCODER_NAME:
+            g_free(kvssink->encoder_name);
+            kvssink->encoder_name = g_strdup (g_value_get_string (value));
+            break;
+        case PROP_MIN_BITRATE:
+            kvssink->min_bitrate_kbps = g_value_get_uint(value);
+            break;
+        case PROP_MAX_BITRATE:
+            kvssink->max_bitrate_kbps = g_value_get_uint(value);
+            break;
+        case PROP_ENCODER_BITRATE_SCALE:
+            kvssink->encoder_bitrate_scale = g_value_get_uint(value);
+            break;
+        case PROP_FRAME_SHEDDING:
+            kvssink->frame_shedding = g_value_get_boolean(value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
             break;
@@ -1072,6 +1425,18 @@ gst_kvs_sink_get_property(GObject *object, guint prop_id, GValue *value,
         case PROP_STORAGE_SIZE:
             g_value_set_uint (value, kvssink->storage_size);
             break;
+        case PROP_STORAGE_SPILL_PATH:
+            g_value_set_string (value, kvssink->storage_spill_path);
+            break;
+        case PROP_STORAGE_RAM_PERCENT:
+            g_value_set_uint (value, kvssink->storage_ram_percent);
+            break;
+        case PROP_API_CALL_CACHE_PATH:
+            g_value_set_string (value, kvssink->api_call_cache_path);
+            break;
+        case PROP_STORAGE_SIZE_STATE_PATH:
+            g_value_set_string (value, kvssink->storage_size_state_path);
+            break;
         case PROP_STOP_STREAM_TIMEOUT:
             g_value_set_uint (value, kvssink->stop_stream_timeout);
             break;
@@ -1108,12 +1473,115 @@ gst_kvs_sink_get_property(GObject *object, guint prop_id, GValue *value,
         case PROP_ALLOW_CREATE_STREAM:
             g_value_set_boolean (value, kvssink->allow_create_stream);
             break;
+        case PROP_INGESTION_QUEUE_DEPTH:
+            g_value_set_uint (value, kvssink->ingestion_queue_depth);
+            break;
+        case PROP_INGESTION_QUEUE_LEAKY:
+            g_value_set_boolean (value, kvssink->ingestion_queue_leaky);
+            break;
+        case PROP_INGESTION_QUEUE_LEVEL:
+            g_value_set_uint (value, nullptr != kvssink->data->ingestion_queue ? kvssink->data->ingestion_queue->getLevel() : 0);
+            break;
+        case PROP_INGESTION_QUEUE_DROPPED:
+            g_value_set_uint64 (value, nullptr != kvssink->data->ingestion_queue ? kvssink->data->ingestion_queue->getDroppedCount() : 0);
+            break;
+        case PROP_SHARED_PRODUCER:
+            g_value_set_boolean (value, kvssink->shared_producer);
+            break;
+        case PROP_ADAPTIVE_BITRATE:
+            g_value_set_boolean (value, kvssink->adaptive_bitrate);
+            break;
+        case PROP_ENCODER_NAME:
+            g_value_set_string (value, kvssink->encoder_name);
+            break;
+        case PROP_MIN_BITRATE:
+            g_value_set_uint (value, kvssink->min_bitrate_kbps);
+            break;
+        case PROP_MAX_BITRATE:
+            g_value_set_uint (value, kvssink->max_bitrate_kbps);
+            break;
+        case PROP_ENCODER_BITRATE_SCALE:
+            g_value_set_uint (value, kvssink->encoder_bitrate_scale);
+            break;
+        case PROP_FRAME_SHEDDING:
+            g_value_set_boolean (value, kvssink->frame_shedding);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
             break;
     }
 }
 
+/**
+ * Restarts the stream with the current codec private data of the tracks on a thread of its own so the streaming
+ * thread doesn't wait for it. The stream stops taking frames right away, what was put with the previous codec
+ * private data is uploaded before the stream is freed and created again.
+ */
+static void
+gst_kvs_sink_restart_stream(GstKvsSink *kvssink) {
+    auto data = kvssink->data;
+
+    LOG_INFO("Restarting stream " << kvssink->stream_name << " for the codec private data change");
+    data->kinesis_video_stream->stop();
+    data->stream_restarting = true;
+    data->wait_for_key_frame = true;
+    data->restart_dropped_frames = 0;
+    auto track_cpd = data->track_cpd;
+    data->stream_restart_thread = std::thread([kvssink, data, track_cpd]() {
+        string err_msg;
+        auto stream = std::move(data->kinesis_video_stream);
+        stream->stopSync();
+        if (kvssink->shared_producer) {
+            KvsSinkProducerPool::getInstance().detachStream(*stream->getStreamHandle());
+        }
+
+        data->kinesis_video_producer->freeStream(std::move(stream));
+
+        bool started = kinesis_video_stream_init(kvssink, err_msg);
+        for (auto it = track_cpd.begin(); started && it != track_cpd.end(); ++it) {
+            if (!data->kinesis_video_stream->start(it->second.data(), it->second.size(), it->first)) {
+                err_msg = "Failed to start the restarted stream";
+                started = false;
+            }
+        }
+
+        if (!started) {
+            LOG_ERROR(err_msg);
+            data->kinesis_video_stream.reset();
+            GST_ELEMENT_ERROR(kvssink, STREAM, FAILED, (NULL), ("[%s] %s", kvssink->stream_name, err_msg.c_str()));
+        }
+
+        data->stream_restarting = false;
+    });
+}
+
+/**
+ * Starts the track with the codec private data the first time and switches the stream to the updated codec
+ * private data whenever it changes afterwards, e.g. on a resolution change. The PIC only accepts a format
+ * change before the stream starts streaming, the stream is restarted in the background when it rejects the change.
+ */
+static bool
+gst_kvs_sink_apply_cpd(GstKvsSink *kvssink, uint64_t track_id, const guint8 *cpd, gsize cpd_size) {
+    auto data = kvssink->data;
+    auto it = data->track_cpd.find(track_id);
+    if (it == data->track_cpd.end()) {
+        data->track_cpd[track_id].assign(cpd, cpd + cpd_size);
+        return data->kinesis_video_stream->start(cpd, cpd_size, track_id);
+    }
+
+    if (it->second.size() == cpd_size && (cpd_size == 0 || !memcmp(it->second.data(), cpd, cpd_size))) {
+        return true;
+    }
+
+    LOG_INFO("Codec private data changed for track " << track_id << " of " << kvssink->stream_name);
+    it->second.assign(cpd, cpd + cpd_size);
+    if (!data->kinesis_video_stream->updateCodecPrivateData(cpd, cpd_size, track_id)) {
+        gst_kvs_sink_restart_stream(kvssink);
+    }
+
+    return true;
+}
+
 static gboolean
 gst_kvs_sink_handle_sink_event (GstCollectPads *pads,
                                 GstCollectData *track_data, GstEvent * event, gpointer user_data) {
@@ -1128,6 +1596,22 @@ gst_kvs_sink_handle_sink_event (GstCollectPads *pads,
     gint samplerate = 0, channels = 0;
     const gchar *media_type;
 
+    // Serialized events must be applied after the buffers which preceded them, a flush discards the buffers instead
+    if (data->ingestion_queue != nullptr && GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+        data->ingestion_queue->flush();
+    } else if (data->ingestion_queue != nullptr && GST_EVENT_IS_SERIALIZED(event)) {
+        data->ingestion_queue->drain();
+    }
+
+    // The events applied to the stream wait for a restart in progress, the buffers don't
+    if ((GST_EVENT_TYPE(event) == GST_EVENT_CAPS || GST_EVENT_TYPE(event) == GST_EVENT_CUSTOM_DOWNSTREAM) &&
+        !gst_kvs_sink_join_restart(kvssink, true)) {
+        ret = FALSE;
+        goto CleanUp;
+    } else if (GST_EVENT_TYPE(event) == GST_EVENT_EOS) {
+        gst_kvs_sink_join_restart(kvssink, true);
+    }
+
     switch (GST_EVENT_TYPE (event)) {
         case GST_EVENT_CAPS: {
             gst_event_parse_caps(event, &gstcaps);
@@ -1135,6 +1619,12 @@ gst_kvs_sink_handle_sink_event (GstCollectPads *pads,
             GST_INFO ("structure is %" GST_PTR_FORMAT, gststructforcaps);
             media_type = gst_structure_get_name (gststructforcaps);
 
+            if (kvs_sink_track_data->track_type == MKV_TRACK_INFO_TYPE_VIDEO) {
+                // Byte-stream frames are adapted in the sink, the CPD comes from the in-band parameter sets
+                const gchar *stream_format = gst_structure_get_string(gststructforcaps, "stream-format");
+                kvs_sink_track_data->annexb = stream_format != NULL && !strcmp(stream_format, "byte-stream");
+            }
+
             if (!strcmp (media_type, GSTREAMER_MEDIA_TYPE_ALAW) || !strcmp (media_type, GSTREAMER_MEDIA_TYPE_MULAW)) {
                 guint8 codec_private_data[KVS_PCM_CPD_SIZE_BYTE];
                 KVS_PCM_FORMAT_CODE format = KVS_PCM_FORMAT_CODE_MULAW;
@@ -1161,17 +1651,22 @@ gst_kvs_sink_handle_sink_event (GstCollectPads *pads,
                 }
 
                 // Send cpd to kinesis video stream
-                ret = data->kinesis_video_stream->start(codec_private_data, KVS_PCM_CPD_SIZE_BYTE, track_id);
+                ret = gst_kvs_sink_apply_cpd(kvssink, track_id, codec_private_data, KVS_PCM_CPD_SIZE_BYTE);
 
-            } else if (data->track_cpd_received.count(track_id) == 0 && gst_structure_has_field(gststructforcaps, "codec_data")) {
-                const GValue *gstStreamFormat = gst_structure_get_value(gststructforcaps, "codec_data");
-                gchar *cpd = gst_value_serialize(gstStreamFormat);
-                string cpd_str = string(cpd);
-                data->track_cpd_received.insert(track_id);
-                g_free(cpd);
+            } else if (gst_structure_has_field(gststructforcaps, "codec_data")) {
+                const GValue *codec_data_value = gst_structure_get_value(gststructforcaps, "codec_data");
+                GstBuffer *codec_data = GST_VALUE_HOLDS_BUFFER(codec_data_value) ? gst_value_get_buffer(codec_data_value) : NULL;
+                GstMapInfo codec_data_info;
 
-                // Send cpd to kinesis video stream
-                ret = data->kinesis_video_stream->start(cpd_str, track_id);
+                if (codec_data == NULL || !gst_buffer_map(codec_data, &codec_data_info, GST_MAP_READ)) {
+                    GST_ERROR_OBJECT (kvssink, "Failed to map codec_data on caps");
+                    ret = FALSE;
+                    goto CleanUp;
+                }
+
+                // Send cpd to kinesis video stream straight from the mapped buffer
+                ret = gst_kvs_sink_apply_cpd(kvssink, track_id, codec_data_info.data, codec_data_info.size);
+                gst_buffer_unmap(codec_data, &codec_data_info);
             }
 
             gst_event_unref (event);
@@ -1250,31 +1745,31 @@ CleanUp:
 }
 
 void create_kinesis_video_frame(Frame *frame, const nanoseconds &pts, const nanoseconds &dts, FRAME_FLAGS flags,
-                                void *frame_data, size_t len, uint64_t track_id, uint32_t index) {
+                                uint64_t track_id, uint32_t index) {
     frame->flags = flags;
     frame->index = index;
     frame->decodingTs = static_cast<UINT64>(dts.count()) / DEFAULT_TIME_UNIT_IN_NANOS;
     frame->presentationTs = static_cast<UINT64>(pts.count()) / DEFAULT_TIME_UNIT_IN_NANOS;
     frame->duration = 0; // with audio, frame can get as close as 0.01ms
-    frame->size = static_cast<UINT32>(len);
-    frame->frameData = reinterpret_cast<PBYTE>(frame_data);
+    frame->size = 0;
+    frame->frameData = NULL;
     frame->trackId = static_cast<UINT64>(track_id);
 }
 
 STATUS
-put_frame(std::shared_ptr<KvsSinkCustomData> data, void *frame_data, size_t len, const nanoseconds &pts,
-          const nanoseconds &dts, FRAME_FLAGS flags, uint64_t track_id, uint32_t index) {
+put_frame(std::shared_ptr<KvsSinkCustomData> data, const KinesisVideoFrameChunk *chunks, size_t chunk_count,
+          const nanoseconds &pts, const nanoseconds &dts, FRAME_FLAGS flags, uint64_t track_id, uint32_t index) {
 
     STATUS put_frame_status = STATUS_SUCCESS;
     Frame frame;
 
-    create_kinesis_video_frame(&frame, pts, dts, flags, frame_data, len, track_id, index);
-    put_frame_status = data->kinesis_video_stream->statusPutFrame(frame);
+    create_kinesis_video_frame(&frame, pts, dts, flags, track_id, index);
+    put_frame_status = data->kinesis_video_stream->putFrameChunks(frame, chunks, chunk_count);
     if (data->get_metrics && STATUS_SUCCEEDED(put_frame_status)) {
         if (CHECK_FRAME_FLAG_KEY_FRAME(flags) || data->on_first_frame) {
             KvsSinkMetric *kvs_sink_metric = new KvsSinkMetric();
-            kvs_sink_metric->stream_metrics = data->kinesis_video_stream->getMetrics();
-            kvs_sink_metric->client_metrics = data->kinesis_video_producer->getMetrics();
+            kvs_sink_metric->stream_metrics = data->kinesis_video_stream->getLatestMetrics();
+            kvs_sink_metric->client_metrics = data->kinesis_video_producer->getLatestMetrics();
             kvs_sink_metric->frame_pts = frame.presentationTs;
             kvs_sink_metric->on_first_frame = data->on_first_frame;
             data->on_first_frame = false;
@@ -1285,12 +1780,110 @@ put_frame(std::shared_ptr<KvsSinkCustomData> data, void *frame_data, size_t len,
     return put_frame_status;
 }
 
+/**
+ * Adapts the Annex-B chunks of a frame into a single AVCC chunk. The CPD is built from the in-band parameter
+ * sets of the key frames and applied, so a change of the parameter sets switches the stream over.
+ */
+static bool
+gst_kvs_sink_adapt_annexb(GstKvsSink *kvssink, GstKvsSinkTrackData *kvs_sink_track_data, bool key_frame,
+                          KinesisVideoFrameChunk *chunks, guint &chunk_count, FrameBufferPool::Buffer &adapted) {
+    auto data = kvssink->data;
+    FrameBufferPool::Buffer gathered;
+    bool chunk_aligned = true;
+    size_t size = 0, capacity = 0;
+
+    for (guint i = 0; i < chunk_count; i++) {
+        size += chunks[i].size;
+        capacity += NalAdapter::maxAvccSize(chunks[i].size);
+        chunk_aligned = chunk_aligned && NalAdapter::isAnnexB(chunks[i].data, chunks[i].size);
+    }
+
+    // Parsers put each NAL in its own memory, otherwise a NAL might span memories and has to be gathered first
+    if (!chunk_aligned && chunk_count > 1) {
+        gathered = data->nal_adaptation_pool.acquire(static_cast<uint32_t>(size));
+        size_t offset = 0;
+        for (guint i = 0; i < chunk_count; i++) {
+            MEMCPY(gathered.data() + offset, chunks[i].data, chunks[i].size);
+            offset += chunks[i].size;
+        }
+
+        chunks[0].data = gathered.data();
+        chunks[0].size = size;
+        chunk_count = 1;
+        capacity = NalAdapter::maxAvccSize(size);
+    }
+
+    adapted = data->nal_adaptation_pool.acquire(static_cast<uint32_t>(capacity));
+    size = 0;
+    for (guint i = 0; i < chunk_count; i++) {
+        size_t written = NalAdapter::annexBToAvcc(chunks[i].data, chunks[i].size, adapted.data() + size, capacity - size);
+        if (written == 0) {
+            return false;
+        }
+
+        size += written;
+    }
+
+    chunks[0].data = adapted.data();
+    chunks[0].size = size;
+    chunk_count = 1;
+
+    // Encoders repeat the parameter sets with the IDR frames only
+    if (!key_frame) {
+        return true;
+    }
+
+    vector<uint8_t> cpd;
+    bool h265 = !strcmp(kvssink->codec_id, DEFAULT_CODEC_ID_H265);
+    bool found = h265 ? NalAdapter::buildH265Cpd(adapted.data(), size, cpd) :
+                        NalAdapter::buildH264Cpd(adapted.data(), size, cpd);
+    if (found && !gst_kvs_sink_apply_cpd(kvssink, kvs_sink_track_data->track_id, cpd.data(), cpd.size())) {
+        GST_ELEMENT_ERROR(kvssink, STREAM, FAILED, (NULL), ("Failed to start stream"));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Feeds the measured transfer rate to the bitrate controller and applies its target to the encoder, either
+ * through the "bitrate" property of the encoder-name element or with an upstream request event.
+ */
+static void
+gst_kvs_sink_update_bitrate(GstKvsSink *kvssink, GstKvsSinkTrackData *kvs_sink_track_data,
+                            BitrateController &bitrate_controller) {
+    auto data = kvssink->data;
+    uint32_t bitrate_kbps = 0;
+    GstElement *encoder = NULL;
+
+    bitrate_controller.reportTransferRate(data->kinesis_video_stream->getLatestMetrics().getCurrentTransferRate());
+    if (!bitrate_controller.update(bitrate_kbps)) {
+        return;
+    }
+
+    LOG_INFO("Changing the encoder bitrate to " << bitrate_kbps << " kbps for " << kvssink->stream_name);
+    if (kvssink->encoder_name == NULL || kvssink->encoder_name[0] == '\0') {
+        GstStructure *structure = gst_structure_new(KVS_BITRATE_REQUEST_G_STRUCT_NAME,
+                                                    KVS_BITRATE_REQUEST_BITRATE, G_TYPE_UINT, bitrate_kbps, NULL);
+        gst_pad_push_event(kvs_sink_track_data->collect.pad, gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, structure));
+        return;
+    }
+
+    encoder = gst_kvs_sink_get_encoder(kvssink);
+    if (encoder != NULL) {
+        // Transformed to the type of the encoder property by GObject
+        GValue value = G_VALUE_INIT;
+        g_value_init(&value, G_TYPE_UINT);
+        g_value_set_uint(&value, (guint) MIN((guint64) bitrate_kbps * kvssink->encoder_bitrate_scale, (guint64) G_MAXUINT));
+        g_object_set_property(G_OBJECT(encoder), KVS_ENCODER_BITRATE_PROPERTY, &value);
+        g_value_unset(&value);
+        gst_object_unref(encoder);
+    }
+}
+
 static GstFlowReturn
-gst_kvs_sink_handle_buffer (GstCollectPads * pads,
-                            GstCollectData * track_data, GstBuffer * buf, gpointer user_data) {
-    GstKvsSink *kvssink = GST_KVS_SINK(user_data);
+gst_kvs_sink_process_buffer (GstKvsSink *kvssink, GstKvsSinkTrackData *kvs_sink_track_data, GstBuffer * buf) {
     GstFlowReturn ret = GST_FLOW_OK;
-    GstKvsSinkTrackData *kvs_sink_track_data = (GstKvsSinkTrackData *) track_data;
     auto data = kvssink->data;
     string err_msg;
     bool isDroppable;
@@ -1299,10 +1892,22 @@ gst_kvs_sink_handle_buffer (GstCollectPads * pads,
     bool delta;
     uint64_t track_id;
     FRAME_FLAGS kinesis_video_flags = FRAME_FLAG_NONE;
-    GstMapInfo info;
+    GstMapInfo infos[KVS_SINK_MAX_BUFFER_MEMORY_COUNT];
+    KinesisVideoFrameChunk chunks[KVS_SINK_MAX_BUFFER_MEMORY_COUNT];
+    guint memory_count = 0, mapped_count = 0, chunk_count = 0;
+    FrameBufferPool::Buffer adapted;
     STATUS put_frame_status = STATUS_SUCCESS;
 
-    info.data = NULL;
+    if (!gst_kvs_sink_join_restart(kvssink, false)) {
+        if (!data->stream_restarting.load()) {
+            // The failed restart has posted the error
+            ret = GST_FLOW_ERROR;
+        } else if (buf != NULL) {
+            data->restart_dropped_frames++;
+        }
+
+        goto CleanUp;
+    }
 
     if (STATUS_FAILED(stream_status)) {
         // in offline case, we cant tell the pipeline to restream the file again in case of network outage.
@@ -1351,12 +1956,49 @@ gst_kvs_sink_handle_buffer (GstCollectPads * pads,
         data->last_dts = buf->dts;
         track_id = kvs_sink_track_data->track_id;
 
-        if (!gst_buffer_map(buf, &info, GST_MAP_READ)){
+        // The mapping only needs to live until put_frame returns as the payload is copied into the
+        // content store while packaging. Keeping the buffer referenced until it's acked would starve
+        // pool-backed upstream elements for up to the buffer duration.
+        // The memories are mapped one by one as gst_buffer_map would allocate and merge a multi-memory
+        // buffer, e.g. the SPS/PPS and slice NALs from a parser, into a single copy first.
+        memory_count = gst_buffer_n_memory(buf);
+        if (memory_count > KVS_SINK_MAX_BUFFER_MEMORY_COUNT) {
             goto CleanUp;
         }
 
+        for (; mapped_count < memory_count; mapped_count++) {
+            if (!gst_memory_map(gst_buffer_peek_memory(buf, mapped_count), &infos[mapped_count], GST_MAP_READ)) {
+                goto CleanUp;
+            }
+
+            chunks[mapped_count].data = infos[mapped_count].data;
+            chunks[mapped_count].size = infos[mapped_count].size;
+        }
+
+        chunk_count = memory_count;
         delta = GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
 
+        // A restarted stream starts over from a key frame
+        if (data->wait_for_key_frame) {
+            if (delta || (data->media_type == AUDIO_VIDEO && kvs_sink_track_data->track_type != MKV_TRACK_INFO_TYPE_VIDEO)) {
+                data->restart_dropped_frames++;
+                goto CleanUp;
+            }
+
+            data->wait_for_key_frame = false;
+        }
+
+        if (kvs_sink_track_data->annexb && !gst_kvs_sink_adapt_annexb(kvssink, kvs_sink_track_data, !delta, chunks, chunk_count, adapted)) {
+            LOG_WARN("Dropping frame which is not Annex-B for " << kvssink->stream_name);
+            goto CleanUp;
+        }
+
+        // The parameter sets of the frame restarted the stream, it's put from the next key frame on
+        if (data->stream_restarting.load()) {
+            data->restart_dropped_frames++;
+            goto CleanUp;
+        }
+
         switch (data->media_type) {
             case AUDIO_ONLY:
             case VIDEO_ONLY:
@@ -1390,17 +2032,24 @@ gst_kvs_sink_handle_buffer (GstCollectPads * pads,
             }
         }
 
-        put_frame_status = put_frame(data, info.data, info.size,
+        put_frame_status = put_frame(data, chunks, chunk_count,
                                      std::chrono::nanoseconds(buf->pts),
                                      std::chrono::nanoseconds(buf->dts), kinesis_video_flags, track_id, data->frame_count);
         data->frame_count++;
+
+        // Steps the controller once per GOP or as soon as a pressure cut is waiting
+        auto bitrate_controller = std::atomic_load(&data->bitrate_controller);
+        if (bitrate_controller != nullptr && kvs_sink_track_data->track_type == MKV_TRACK_INFO_TYPE_VIDEO &&
+            (!delta || bitrate_controller->hasPendingChange())) {
+            gst_kvs_sink_update_bitrate(kvssink, kvs_sink_track_data, *bitrate_controller);
+        }
     } else {
         LOG_WARN("GStreamer buffer is invalid for " << kvssink->stream_name);
     }
 
 CleanUp:
-    if (info.data != NULL) {
-        gst_buffer_unmap(buf, &info);
+    for (guint i = 0; i < mapped_count; i++) {
+        gst_memory_unmap(gst_buffer_peek_memory(buf, i), &infos[i]);
     }
 
     if (buf != NULL) {
@@ -1415,6 +2064,26 @@ CleanUp:
     return ret;
 }
 
+static GstFlowReturn
+gst_kvs_sink_handle_buffer (GstCollectPads * pads,
+                            GstCollectData * track_data, GstBuffer * buf, gpointer user_data) {
+    GstKvsSink *kvssink = GST_KVS_SINK(user_data);
+    GstKvsSinkTrackData *kvs_sink_track_data = (GstKvsSinkTrackData *) track_data;
+    auto data = kvssink->data;
+
+    if (buf == NULL || data->ingestion_queue == nullptr) {
+        // The end of the stream follows the buffers still queued
+        if (data->ingestion_queue != nullptr) {
+            data->ingestion_queue->drain();
+        }
+
+        return gst_kvs_sink_process_buffer(kvssink, kvs_sink_track_data, buf);
+    }
+
+    // Hand the buffer over to the ingestion worker so that the streaming thread is not held up by the SDK
+    return data->ingestion_queue->push(kvs_sink_track_data, buf);
+}
+
 static GstPad *
 gst_kvs_sink_request_new_pad (GstElement * element, GstPadTemplate * templ,
                                     const gchar * req_name, const GstCaps * caps)
@@ -1687,12 +2356,28 @@ gst_kvs_sink_change_state(GstElement *element, GstStateChange transition) {
             }
             break;
         case GST_STATE_CHANGE_READY_TO_PAUSED:
+            if (kvssink->ingestion_queue_depth > 0) {
+                std::vector<gpointer> tracks;
+                for (GSList *walk = kvssink->collect->data; walk != NULL; walk = g_slist_next(walk)) {
+                    tracks.push_back(walk->data);
+                }
+
+                LOG_INFO("Using ingestion queue with depth " << kvssink->ingestion_queue_depth << " per pad for " << kvssink->stream_name);
+                data->ingestion_queue.reset(new KvsSinkIngestionQueue(tracks, kvssink->ingestion_queue_depth,
+                        kvssink->ingestion_queue_leaky == TRUE, [kvssink](gpointer track, GstBuffer *buf) {
+                    return gst_kvs_sink_process_buffer(kvssink, (GstKvsSinkTrackData *) track, buf);
+                }));
+            }
             gst_collect_pads_start (kvssink->collect);
             break;
 
         // (Downward Transition) gst_collect_pads_stop must be called prior to parent class PAUSED->READY transition.
         case GST_STATE_CHANGE_PAUSED_TO_READY:
             LOG_INFO("Stopping kvssink for " << kvssink->stream_name);
+            // Unblock the streaming thread in case it's waiting on a full ingestion queue
+            if (data->ingestion_queue != nullptr) {
+                data->ingestion_queue->stop();
+            }
             gst_collect_pads_stop(kvssink->collect);
             break;
         default:
@@ -1708,7 +2393,11 @@ gst_kvs_sink_change_state(GstElement *element, GstStateChange transition) {
     // Downward transitions
     switch (transition) {
         case GST_STATE_CHANGE_PAUSED_TO_READY:
-            data->kinesis_video_stream->stopSync();
+            // The streaming threads are gone by now
+            data->ingestion_queue.reset();
+            if (gst_kvs_sink_join_restart(kvssink, true)) {
+                data->kinesis_video_stream->stopSync();
+            }
             LOG_INFO("Stopped kvssink for " << kvssink->stream_name);
             break;
         case GST_STATE_CHANGE_READY_TO_NULL:
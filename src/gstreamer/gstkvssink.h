@@ -36,9 +36,14 @@
 #include <string.h>
 #include <mutex>
 #include <atomic>
+#include <thread>
 #include <fstream>
 #include <gst/base/gstcollectpads.h>
-#include <unordered_set>
+#include <unordered_map>
+#include <vector>
+#include "KvsSinkIngestionQueue.h"
+#include "FrameBufferPool.h"
+#include "BitrateController.h"
 
 using namespace com::amazonaws::kinesis::video;
 
@@ -75,6 +80,7 @@ typedef struct _GstKvsSinkTrackData {
     MKV_TRACK_INFO_TYPE track_type;
     GstKvsSink *kvssink;
     guint track_id;
+    gboolean annexb;              /* byte-stream input adapted to AVCC by the sink */
 } GstKvsSinkTrackData;
 
 typedef enum _MediaType {
@@ -125,6 +131,10 @@ struct _GstKvsSink {
     guint                       rotation_period;
     gchar                       *log_config_path;
     guint                       storage_size;
+    gchar                       *storage_spill_path;
+    guint                       storage_ram_percent;
+    gchar                       *api_call_cache_path;
+    gchar                       *storage_size_state_path;
     guint                       stop_stream_timeout;
     guint                       service_connection_timeout;
     guint                       service_completion_timeout;
@@ -134,6 +144,15 @@ struct _GstKvsSink {
     guint64                     file_start_time;
     MKV_TRACK_INFO_TYPE         track_info_type;
     gchar                       *audio_codec_id;
+    guint                       ingestion_queue_depth;
+    gboolean                    ingestion_queue_leaky;
+    gboolean                    shared_producer;
+    gboolean                    adaptive_bitrate;
+    gchar                       *encoder_name;
+    guint                       min_bitrate_kbps;
+    guint                       max_bitrate_kbps;
+    guint                       encoder_bitrate_scale;
+    gboolean                    frame_shedding;
 
 
     guint                       num_streams;
@@ -166,16 +185,38 @@ struct _KvsSinkCustomData {
             pts_base(0),
             media_type(VIDEO_ONLY),
             first_video_frame(true),
+            stream_restarting(false),
+            wait_for_key_frame(false),
+            restart_dropped_frames(0),
             use_original_pts(false),
             get_metrics(false),
             on_first_frame(true),
             frame_count(0),
             first_pts(GST_CLOCK_TIME_NONE),
             producer_start_time(GST_CLOCK_TIME_NONE) {}
-    std::unique_ptr<KinesisVideoProducer> kinesis_video_producer;
+    std::shared_ptr<KinesisVideoProducer> kinesis_video_producer;
     std::shared_ptr<KinesisVideoStream> kinesis_video_stream;
+    std::unique_ptr<KvsSinkIngestionQueue> ingestion_queue;
 
-    std::unordered_set<uint64_t> track_cpd_received;
+    // Last codec private data applied to each track, a different one restarts the stream
+    std::unordered_map<uint64_t, std::vector<uint8_t>> track_cpd;
+
+    // Restarts the stream off the streaming thread when the codec private data change is rejected. The data path
+    // leaves the stream alone while it runs, dropping the frames, and then drops them up to the next key frame.
+    std::thread stream_restart_thread;
+    std::atomic<bool> stream_restarting;
+    bool wait_for_key_frame;
+    uint64_t restart_dropped_frames;
+
+    // Encoder bitrate control driven by the pressure callbacks, null unless adaptive-bitrate is set.
+    // Replaced while the callbacks read it so only accessed through std::atomic_load/atomic_store.
+    std::shared_ptr<BitrateController> bitrate_controller;
+
+    // Key of the pooled producer the stream is attached to, empty unless shared-producer is set
+    std::string producer_key;
+
+    // Staging buffers for the frames adapted from Annex-B
+    FrameBufferPool nal_adaptation_pool;
     GstKvsSink *kvs_sink = nullptr;
     MediaType media_type;
     bool first_video_frame;
@@ -0,0 +1,148 @@
+#include "ProducerTestFixture.h"
+#include "ApiCallCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using std::chrono::hours;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+
+#define TEST_CACHE_REGION                                   "us-west-2"
+#define TEST_CACHE_STREAM_NAME                              "cache_test_stream"
+#define TEST_CACHE_STREAM_ARN                               "arn:aws:kinesisvideo:us-west-2:11111111111:stream/cache_test_stream/1234"
+#define TEST_CACHE_ENDPOINT                                 "https://s-1234.kinesisvideo.us-west-2.amazonaws.com"
+
+class ApiCallCacheTest : public ::testing::Test {
+protected:
+    void SetUp() {
+        directory_ = createTestTempDirectory("kvs_api_cache_test_");
+        ASSERT_FALSE(directory_.empty());
+        path_ = directory_ + "/api_call_cache";
+
+        describe_count_ = endpoint_count_ = put_stream_count_ = tag_count_ = 0;
+        MEMSET(&callbacks_, 0, SIZEOF(callbacks_));
+        callbacks_.customData = reinterpret_cast<UINT64>(this);
+        callbacks_.describeStreamFn = describeStream;
+        callbacks_.getStreamingEndpointFn = getStreamingEndpoint;
+        callbacks_.putStreamFn = putStream;
+        callbacks_.tagResourceFn = tagResource;
+    }
+
+    void TearDown() {
+        ApiCallCache::detach(callbacks_.customData);
+        remove(path_.c_str());
+        removeTestDirectory(directory_);
+    }
+
+    static STATUS describeStream(UINT64 custom_data, PCHAR, PServiceCallContext) {
+        reinterpret_cast<ApiCallCacheTest*>(custom_data)->describe_count_++;
+        return STATUS_SUCCESS;
+    }
+
+    static STATUS getStreamingEndpoint(UINT64 custom_data, PCHAR, PCHAR, PServiceCallContext) {
+        reinterpret_cast<ApiCallCacheTest*>(custom_data)->endpoint_count_++;
+        return STATUS_SUCCESS;
+    }
+
+    static STATUS putStream(UINT64 custom_data, PCHAR, PCHAR, UINT64, BOOL, BOOL, PCHAR, PServiceCallContext) {
+        reinterpret_cast<ApiCallCacheTest*>(custom_data)->put_stream_count_++;
+        return STATUS_SUCCESS;
+    }
+
+    static STATUS tagResource(UINT64 custom_data, PCHAR, UINT32, PTag, PServiceCallContext) {
+        reinterpret_cast<ApiCallCacheTest*>(custom_data)->tag_count_++;
+        return STATUS_SUCCESS;
+    }
+
+    string directory_;
+    string path_;
+    ClientCallbacks callbacks_;
+    uint32_t describe_count_;
+    uint32_t endpoint_count_;
+    uint32_t put_stream_count_;
+    uint32_t tag_count_;
+};
+
+TEST_F(ApiCallCacheTest, entries_survive_restart_until_expired)
+{
+    auto now = system_clock::now();
+    {
+        ApiCallCache cache(path_, hours(1));
+        cache.storeArn(TEST_CACHE_REGION, TEST_CACHE_STREAM_NAME, TEST_CACHE_STREAM_ARN, now);
+
+        // Not usable without the endpoint
+        ApiCallCacheEntry entry;
+        EXPECT_FALSE(cache.lookup(TEST_CACHE_REGION, TEST_CACHE_STREAM_NAME, entry, now));
+        cache.storeEndpoint(TEST_CACHE_REGION, TEST_CACHE_STREAM_NAME, TEST_CACHE_ENDPOINT, now);
+    }
+
+    ApiCallCache cache(path_, hours(1));
+    ApiCallCacheEntry entry;
+    ASSERT_TRUE(cache.lookup(TEST_CACHE_REGION, TEST_CACHE_STREAM_NAME, entry, now));
+    EXPECT_EQ(TEST_CACHE_ENDPOINT, entry.streaming_endpoint);
+    EXPECT_EQ(TEST_CACHE_STREAM_ARN, entry.stream_arn);
+
+    // Keyed by the region too
+    EXPECT_FALSE(cache.lookup("eu-west-1", TEST_CACHE_STREAM_NAME, entry, now));
+    EXPECT_FALSE(cache.lookup(TEST_CACHE_REGION, TEST_CACHE_STREAM_NAME, entry, now + hours(2)));
+
+    cache.invalidate(TEST_CACHE_REGION, TEST_CACHE_STREAM_NAME);
+    EXPECT_FALSE(cache.lookup(TEST_CACHE_REGION, TEST_CACHE_STREAM_NAME, entry));
+    EXPECT_FALSE(ApiCallCache(path_).lookup(TEST_CACHE_REGION, TEST_CACHE_STREAM_NAME, entry));
+}
+
+TEST_F(ApiCallCacheTest, producers_merge_into_shared_file)
+{
+    ApiCallCache first(path_);
+    ApiCallCache second(path_);
+    first.storeEndpoint(TEST_CACHE_REGION, "stream_1", TEST_CACHE_ENDPOINT);
+    second.storeEndpoint(TEST_CACHE_REGION, "stream_2", TEST_CACHE_ENDPOINT);
+
+    ApiCallCache cache(path_);
+    ApiCallCacheEntry entry;
+    EXPECT_TRUE(cache.lookup(TEST_CACHE_REGION, "stream_1", entry));
+    EXPECT_TRUE(cache.lookup(TEST_CACHE_REGION, "stream_2", entry));
+}
+
+TEST_F(ApiCallCacheTest, attached_callbacks_record_results_and_forward_misses)
+{
+    auto cache = make_shared<ApiCallCache>(path_);
+    ClientCallbacks callbacks = ApiCallCache::attach(cache, callbacks_, TEST_CACHE_REGION);
+    ServiceCallContext service_call_ctx;
+    MEMSET(&service_call_ctx, 0, SIZEOF(service_call_ctx));
+
+    // Nothing cached yet
+    EXPECT_EQ(STATUS_SUCCESS, callbacks.describeStreamFn(callbacks.customData, (PCHAR) TEST_CACHE_STREAM_NAME, &service_call_ctx));
+    EXPECT_EQ(STATUS_SUCCESS, callbacks.getStreamingEndpointFn(callbacks.customData, (PCHAR) TEST_CACHE_STREAM_NAME,
+                                                               (PCHAR) "PUT_MEDIA", &service_call_ctx));
+    EXPECT_EQ(1, describe_count_);
+    EXPECT_EQ(1, endpoint_count_);
+
+    EXPECT_EQ(STATUS_SUCCESS, callbacks.tagResourceFn(callbacks.customData, (PCHAR) TEST_CACHE_STREAM_ARN, 0, nullptr,
+                                                      &service_call_ctx));
+    EXPECT_EQ(STATUS_SUCCESS, callbacks.putStreamFn(callbacks.customData, (PCHAR) TEST_CACHE_STREAM_NAME, (PCHAR) "video/h264",
+                                                    0, TRUE, TRUE, (PCHAR) TEST_CACHE_ENDPOINT, &service_call_ctx));
+    EXPECT_EQ(1, tag_count_);
+    EXPECT_EQ(1, put_stream_count_);
+
+    ApiCallCacheEntry entry;
+    ASSERT_TRUE(ApiCallCache(path_).lookup(TEST_CACHE_REGION, TEST_CACHE_STREAM_NAME, entry));
+    EXPECT_EQ(TEST_CACHE_ENDPOINT, entry.streaming_endpoint);
+    EXPECT_EQ(TEST_CACHE_STREAM_ARN, entry.stream_arn);
+
+    // The first lookups of the stream have been made, the later ones go to the network
+    EXPECT_EQ(STATUS_SUCCESS, callbacks.describeStreamFn(callbacks.customData, (PCHAR) TEST_CACHE_STREAM_NAME, &service_call_ctx));
+    EXPECT_EQ(STATUS_SUCCESS, callbacks.getStreamingEndpointFn(callbacks.customData, (PCHAR) TEST_CACHE_STREAM_NAME,
+                                                               (PCHAR) "PUT_MEDIA", &service_call_ctx));
+    EXPECT_EQ(2, describe_count_);
+    EXPECT_EQ(2, endpoint_count_);
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,133 @@
+#include "ProducerTestFixture.h"
+#include "BitrateController.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using namespace std::chrono;
+
+class BitrateControllerTest : public ::testing::Test {
+protected:
+    BitrateControllerTest() : start_(steady_clock::now()) {
+        config_.min_bitrate_kbps = 500;
+        config_.max_bitrate_kbps = 4000;
+    }
+
+    steady_clock::time_point at(milliseconds offset) {
+        return start_ + offset;
+    }
+
+    BitrateControllerConfig config_;
+    steady_clock::time_point start_;
+};
+
+TEST_F(BitrateControllerTest, starts_at_initial_without_change)
+{
+    config_.initial_bitrate_kbps = 2000;
+    BitrateController controller(config_);
+    uint32_t bitrate = 0;
+    EXPECT_EQ(2000, controller.getTargetBitrate());
+    EXPECT_FALSE(controller.hasPendingChange());
+    EXPECT_FALSE(controller.update(bitrate, at(seconds(60))));
+
+    controller.reportPressure(at(seconds(60)));
+    EXPECT_TRUE(controller.update(bitrate, at(seconds(60))));
+    EXPECT_EQ(1500, bitrate);
+}
+
+TEST_F(BitrateControllerTest, unknown_initial_bitrate_applied_first)
+{
+    BitrateController controller(config_);
+    uint32_t bitrate = 0;
+    EXPECT_EQ(4000, controller.getTargetBitrate());
+    EXPECT_TRUE(controller.hasPendingChange());
+    EXPECT_TRUE(controller.update(bitrate, at(seconds(0))));
+    EXPECT_EQ(4000, bitrate);
+    EXPECT_FALSE(controller.update(bitrate, at(seconds(60))));
+}
+
+TEST_F(BitrateControllerTest, pressure_decreases_once_per_interval_down_to_min)
+{
+    BitrateController controller(config_);
+    uint32_t bitrate = 0;
+
+    controller.reportPressure(at(seconds(0)));
+    EXPECT_TRUE(controller.hasPendingChange());
+    EXPECT_TRUE(controller.update(bitrate, at(seconds(0))));
+    EXPECT_EQ(3000, bitrate);
+    EXPECT_FALSE(controller.hasPendingChange());
+
+    // Within the decrease interval
+    controller.reportPressure(at(milliseconds(500)));
+    EXPECT_FALSE(controller.hasPendingChange());
+    EXPECT_FALSE(controller.update(bitrate, at(milliseconds(500))));
+
+    for (uint32_t i = 1; i < 10; i++) {
+        controller.reportPressure(at(seconds(2 * i)));
+    }
+
+    EXPECT_TRUE(controller.update(bitrate, at(seconds(18))));
+    EXPECT_EQ(500, bitrate);
+}
+
+TEST_F(BitrateControllerTest, decrease_capped_by_transfer_rate)
+{
+    BitrateController controller(config_);
+    uint32_t bitrate = 0;
+
+    // 125000 B/s is 1000 kbps
+    controller.reportTransferRate(125000);
+    controller.reportPressure(at(seconds(0)));
+    EXPECT_TRUE(controller.update(bitrate, at(seconds(0))));
+    EXPECT_EQ(900, bitrate);
+}
+
+TEST_F(BitrateControllerTest, increases_after_quiet_hold)
+{
+    BitrateController controller(config_);
+    uint32_t bitrate = 0;
+
+    controller.reportPressure(at(seconds(0)));
+    controller.update(bitrate, at(seconds(0)));
+    EXPECT_EQ(3000, bitrate);
+
+    // Pressure keeps the bitrate down even though it's within the decrease interval
+    controller.reportPressure(at(seconds(1)));
+    EXPECT_FALSE(controller.update(bitrate, at(seconds(10))));
+
+    EXPECT_TRUE(controller.update(bitrate, at(seconds(11))));
+    EXPECT_EQ(3200, bitrate);
+
+    // Next step only after the increase interval
+    EXPECT_FALSE(controller.update(bitrate, at(seconds(13))));
+    EXPECT_TRUE(controller.update(bitrate, at(seconds(16))));
+    EXPECT_EQ(3400, bitrate);
+
+    for (uint32_t i = 0; i < 10; i++) {
+        controller.update(bitrate, at(seconds(21 + 5 * i)));
+    }
+
+    EXPECT_EQ(4000, bitrate);
+    EXPECT_EQ(4000, controller.getTargetBitrate());
+}
+
+TEST_F(BitrateControllerTest, increase_step_does_not_overflow)
+{
+    config_.max_bitrate_kbps = 4000000000u;
+    config_.initial_bitrate_kbps = 3000000000u;
+    config_.increase_step_percent = 50;
+    BitrateController controller(config_);
+    uint32_t bitrate = 0;
+
+    controller.reportPressure(at(seconds(0)));
+    controller.update(bitrate, at(seconds(0)));
+    EXPECT_EQ(2250000000u, bitrate);
+
+    EXPECT_TRUE(controller.update(bitrate, at(seconds(10))));
+    EXPECT_EQ(4000000000u, bitrate);
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,159 @@
+#include "ProducerTestFixture.h"
+#include "StubCallbackProvider.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+
+#define TEST_CPD_CHANGE_FRAME_COUNT                         50
+#define TEST_CPD_CHANGE_DRAIN_BUFFER_SIZE                   (64 * 1024)
+
+class CodecPrivateDataChangeTest : public ::testing::Test {
+protected:
+    void SetUp() {
+        std::unique_ptr<StubCallbackProvider> callback_provider(new StubCallbackProvider());
+        callback_provider_ = callback_provider.get();
+        std::unique_ptr<DeviceInfoProvider> device_info_provider(
+                new TestDeviceInfoProvider(TEST_STORAGE_SIZE_IN_BYTES, AUTOMATIC_STREAMING_INTERMITTENT_PRODUCER));
+        kinesis_video_producer_ = KinesisVideoProducer::createSync(std::move(device_info_provider),
+                                                                   std::move(callback_provider));
+        timestamp_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count() / DEFAULT_TIME_UNIT_IN_NANOS;
+
+        // Same SPS, the PPS tells the two apart in the packaged data whichever NAL format the generator stores
+        pps_ = {0x68, 0xEE, 0x3C, 0xB0};
+        updated_pps_ = {0x68, 0xEE, 0x3C, 0x80};
+        cpd_ = {0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x34,
+                0xAC, 0x2B, 0x40, 0x1E, 0x00, 0x78, 0xD8, 0x08,
+                0x80, 0x00, 0x01, 0xF4, 0x00, 0x00, 0xEA, 0x60,
+                0x47, 0xA5, 0x50, 0x00, 0x00, 0x00, 0x01};
+        updated_cpd_ = cpd_;
+        cpd_.insert(cpd_.end(), pps_.begin(), pps_.end());
+        updated_cpd_.insert(updated_cpd_.end(), updated_pps_.begin(), updated_pps_.end());
+    }
+
+    void TearDown() {
+        if (stream_ != nullptr) {
+            kinesis_video_producer_->freeStream(std::move(stream_));
+        }
+
+        kinesis_video_producer_.reset();
+    }
+
+    void createStream() {
+        // No acks so that the drained data is trimmed right away
+        std::unique_ptr<StreamDefinition> stream_definition(new StreamDefinition("cpd_change_test_stream",
+                std::chrono::hours(2),
+                nullptr,
+                "",
+                STREAMING_TYPE_REALTIME,
+                "video/h264",
+                std::chrono::milliseconds::zero(),
+                std::chrono::seconds(2),
+                std::chrono::milliseconds(1),
+                true,
+                true,
+                true,
+                false,
+                true,
+                true,
+                true,
+                NAL_ADAPTATION_FLAG_NONE,
+                TEST_FPS,
+                4 * 1024 * 1024,
+                std::chrono::seconds(120),
+                std::chrono::seconds(40),
+                std::chrono::seconds(0)));
+        stream_ = kinesis_video_producer_->createStreamSync(std::move(stream_definition));
+    }
+
+    // Same restart as kvssink does when the PIC rejects the change
+    void restartStream(const vector<BYTE>& cpd) {
+        kinesis_video_producer_->freeStream(std::move(stream_));
+        createStream();
+        ASSERT_TRUE(stream_->start(cpd.data(), cpd.size(), DEFAULT_TRACK_ID));
+    }
+
+    void putFrames(uint32_t count) {
+        vector<BYTE> frame_data(TEST_FRAME_SIZE, 0x55);
+        for (uint32_t i = 0; i < count; i++) {
+            KinesisVideoFrame frame;
+            frame.version = FRAME_CURRENT_VERSION;
+            frame.index = i;
+            frame.flags = i % TEST_FPS == 0 ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+            frame.decodingTs = timestamp_;
+            frame.presentationTs = timestamp_;
+            frame.duration = TEST_FRAME_DURATION;
+            frame.size = (UINT32) frame_data.size();
+            frame.frameData = frame_data.data();
+            frame.trackId = DEFAULT_TRACK_ID;
+            EXPECT_TRUE(stream_->putFrame(frame));
+            timestamp_ += TEST_FRAME_DURATION;
+        }
+    }
+
+    // Pulls the packaged data the way the curl upload would
+    vector<BYTE> drain() {
+        vector<BYTE> drained;
+        vector<BYTE> buffer(TEST_CPD_CHANGE_DRAIN_BUFFER_SIZE);
+        UINT32 filled = 0;
+        STATUS status;
+        do {
+            status = getKinesisVideoStreamData(*stream_->getStreamHandle(), callback_provider_->getUploadHandle(),
+                                               buffer.data(), (UINT32) buffer.size(), &filled);
+            drained.insert(drained.end(), buffer.begin(), buffer.begin() + filled);
+        } while (STATUS_SUCCESS == status && filled != 0);
+
+        return drained;
+    }
+
+    static bool contains(const vector<BYTE>& data, const vector<BYTE>& pattern) {
+        return search(data.begin(), data.end(), pattern.begin(), pattern.end()) != data.end();
+    }
+
+    std::unique_ptr<KinesisVideoProducer> kinesis_video_producer_;
+    std::shared_ptr<KinesisVideoStream> stream_;
+    StubCallbackProvider* callback_provider_;
+    uint64_t timestamp_;
+    vector<BYTE> pps_;
+    vector<BYTE> updated_pps_;
+    vector<BYTE> cpd_;
+    vector<BYTE> updated_cpd_;
+};
+
+TEST_F(CodecPrivateDataChangeTest, cpd_change_on_streaming_stream_reaches_the_upload)
+{
+    createStream();
+    ASSERT_TRUE(stream_->start(cpd_.data(), cpd_.size(), DEFAULT_TRACK_ID));
+    putFrames(TEST_CPD_CHANGE_FRAME_COUNT);
+    auto drained = drain();
+    EXPECT_TRUE(contains(drained, pps_));
+    EXPECT_FALSE(contains(drained, updated_pps_));
+
+    // The PIC doesn't take a format change once streaming
+    EXPECT_FALSE(stream_->updateCodecPrivateData(updated_cpd_.data(), updated_cpd_.size(), DEFAULT_TRACK_ID));
+    restartStream(updated_cpd_);
+    putFrames(TEST_CPD_CHANGE_FRAME_COUNT);
+    drained = drain();
+    EXPECT_TRUE(contains(drained, updated_pps_));
+    EXPECT_FALSE(contains(drained, pps_));
+}
+
+TEST_F(CodecPrivateDataChangeTest, cpd_change_before_streaming_is_accepted)
+{
+    createStream();
+    ASSERT_TRUE(stream_->start(cpd_.data(), cpd_.size(), DEFAULT_TRACK_ID));
+    EXPECT_TRUE(stream_->updateCodecPrivateData(updated_cpd_.data(), updated_cpd_.size(), DEFAULT_TRACK_ID));
+    putFrames(TEST_CPD_CHANGE_FRAME_COUNT);
+    auto drained = drain();
+    EXPECT_TRUE(contains(drained, updated_pps_));
+    EXPECT_FALSE(contains(drained, pps_));
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
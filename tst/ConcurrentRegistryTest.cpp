@@ -0,0 +1,87 @@
+#include "ProducerTestFixture.h"
+#include "ConcurrentRegistry.h"
+
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+
+#define TEST_REGISTRY_STREAM_COUNT                          512
+
+class ConcurrentRegistryTest : public ::testing::Test {
+protected:
+    /**
+     * Fake stream handles - the real ones are pointers so keep the low bits clear.
+     */
+    static STREAM_HANDLE testHandle(uint32_t index) {
+        return static_cast<STREAM_HANDLE>(0x10000 + index * 0x100);
+    }
+};
+
+TEST_F(ConcurrentRegistryTest, put_get_remove)
+{
+    ConcurrentRegistry<STREAM_HANDLE, shared_ptr<uint32_t>> registry;
+
+    EXPECT_EQ(nullptr, registry.get(testHandle(0)));
+    EXPECT_FALSE(registry.exists(testHandle(0)));
+    EXPECT_FALSE(registry.remove(testHandle(0)));
+
+    for (uint32_t i = 0; i < TEST_REGISTRY_STREAM_COUNT; i++) {
+        registry.put(testHandle(i), make_shared<uint32_t>(i));
+    }
+
+    EXPECT_EQ(TEST_REGISTRY_STREAM_COUNT, registry.size());
+    for (uint32_t i = 0; i < TEST_REGISTRY_STREAM_COUNT; i++) {
+        EXPECT_TRUE(registry.exists(testHandle(i)));
+        EXPECT_EQ(i, *registry.get(testHandle(i)));
+    }
+
+    // Replacing keeps the size
+    registry.put(testHandle(3), make_shared<uint32_t>(1000));
+    EXPECT_EQ(1000, *registry.get(testHandle(3)));
+    EXPECT_EQ(TEST_REGISTRY_STREAM_COUNT, registry.size());
+
+    for (uint32_t i = 0; i < TEST_REGISTRY_STREAM_COUNT; i += 2) {
+        EXPECT_TRUE(registry.remove(testHandle(i)));
+    }
+
+    EXPECT_EQ(TEST_REGISTRY_STREAM_COUNT / 2, registry.size());
+    for (uint32_t i = 0; i < TEST_REGISTRY_STREAM_COUNT; i++) {
+        EXPECT_EQ(i % 2 != 0, registry.exists(testHandle(i)));
+    }
+}
+
+TEST_F(ConcurrentRegistryTest, snapshot_is_stable_during_removal)
+{
+    ConcurrentRegistry<STREAM_HANDLE, shared_ptr<uint32_t>> registry;
+
+    for (uint32_t i = 0; i < TEST_REGISTRY_STREAM_COUNT; i++) {
+        registry.put(testHandle(i), make_shared<uint32_t>(i));
+    }
+
+    // Removing while iterating the snapshot must visit every item exactly once
+    auto snapshot = registry.snapshot();
+    EXPECT_EQ(TEST_REGISTRY_STREAM_COUNT, snapshot.size());
+
+    vector<bool> visited(TEST_REGISTRY_STREAM_COUNT, false);
+    for (auto& value : snapshot) {
+        EXPECT_FALSE(visited[*value]);
+        visited[*value] = true;
+        EXPECT_TRUE(registry.remove(testHandle(*value)));
+    }
+
+    EXPECT_EQ(0, registry.size());
+    EXPECT_TRUE(registry.snapshot().empty());
+
+    // Values in the snapshot outlive their removal from the registry
+    for (uint32_t i = 0; i < TEST_REGISTRY_STREAM_COUNT; i++) {
+        EXPECT_TRUE(visited[i]);
+        EXPECT_EQ(1, snapshot[i].use_count());
+    }
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
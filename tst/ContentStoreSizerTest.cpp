@@ -0,0 +1,166 @@
+#include "ProducerTestFixture.h"
+#include "ContentStoreSizer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+
+#define TEST_SIZER_MIB                                      (1024 * 1024ull)
+
+class ContentStoreSizerTest : public ::testing::Test {
+protected:
+    ContentStoreSizerTest() : bytes_put_(0), frames_put_(0) {
+        // Sized exactly to the buffered bytes so the expectations stay readable
+        config_.headroom = 1;
+        config_.min_size = 0;
+    }
+
+    void SetUp() {
+        directory_ = createTestTempDirectory("kvs_sizer_test_");
+        ASSERT_FALSE(directory_.empty());
+        state_path_ = directory_ + "/sizer.state";
+        start_ = steady_clock::now();
+    }
+
+    void TearDown() {
+        remove(state_path_.c_str());
+        removeTestDirectory(directory_);
+    }
+
+    static ContentStoreStreamRate rate(uint64_t bitrate_bps, uint32_t frame_rate, milliseconds buffer_duration) {
+        ContentStoreStreamRate rate;
+        rate.bitrate_bps = bitrate_bps;
+        rate.frame_rate = frame_rate;
+        rate.buffer_duration = buffer_duration;
+        return rate;
+    }
+
+    // Feeds a second of frames at the given rates into the sizer
+    void putSecond(ContentStoreSizer& sizer, const string& stream_name, uint64_t bitrate_bps, uint32_t frame_rate, uint32_t second) {
+        bytes_put_ += bitrate_bps / 8;
+        frames_put_ += frame_rate;
+        StreamCountersSnapshot counters;
+        counters.bytes_put = bytes_put_;
+        counters.frames_put = frames_put_;
+        sizer.sample(stream_name, counters, start_ + seconds(second));
+    }
+
+    ContentStoreSizerConfig config_;
+    string directory_;
+    string state_path_;
+    steady_clock::time_point start_;
+    uint64_t bytes_put_;
+    uint64_t frames_put_;
+};
+
+TEST_F(ContentStoreSizerTest, sizes_from_declared_caps)
+{
+    ContentStoreSizer sizer(config_);
+    EXPECT_EQ(0, sizer.getStreamCount());
+
+    // 8 Mbps for 120 seconds and 800 Kbps for 10 seconds
+    sizer.streamCreated("camera1", rate(8 * 1000 * 1000, 25, seconds(120)));
+    sizer.streamCreated("camera2", rate(800 * 1000, 10, seconds(10)));
+    EXPECT_EQ(2, sizer.getStreamCount());
+    EXPECT_EQ(120 * 1000 * 1000ull + 1000 * 1000ull + 2 * CONTENT_STORE_SIZER_STREAM_OVERHEAD, sizer.getStorageSize());
+
+    ContentStoreStreamRate stream_rate;
+    ASSERT_TRUE(sizer.getStreamRate("camera2", stream_rate));
+    EXPECT_EQ(800 * 1000, stream_rate.bitrate_bps);
+    EXPECT_EQ(10, stream_rate.frame_rate);
+    EXPECT_FALSE(sizer.getStreamRate("camera3", stream_rate));
+
+    // Unregistered streams aren't sampled
+    putSecond(sizer, "camera3", 1000, 1, 0);
+    EXPECT_EQ(2, sizer.getStreamCount());
+}
+
+TEST_F(ContentStoreSizerTest, follows_rises_quickly_and_drops_slowly)
+{
+    ContentStoreSizer sizer(config_);
+    sizer.streamCreated("camera", rate(4 * 1000 * 1000, 25, seconds(10)));
+    ContentStoreStreamRate stream_rate;
+
+    // The first sample only sets the baseline
+    putSecond(sizer, "camera", 0, 0, 0);
+    for (uint32_t second = 1; second <= 10; second++) {
+        putSecond(sizer, "camera", 16 * 1000 * 1000, 30, second);
+    }
+
+    ASSERT_TRUE(sizer.getStreamRate("camera", stream_rate));
+    EXPECT_NEAR(16 * 1000 * 1000.0, (double) stream_rate.bitrate_bps, 16 * 1000.0);
+    EXPECT_EQ(30, stream_rate.frame_rate);
+
+    // A single quiet second barely moves the estimate
+    putSecond(sizer, "camera", 0, 0, 11);
+    ASSERT_TRUE(sizer.getStreamRate("camera", stream_rate));
+    EXPECT_GT(stream_rate.bitrate_bps, 15 * 1000 * 1000ull);
+    EXPECT_EQ(28, stream_rate.frame_rate);
+
+    // While a sustained drop gets there eventually
+    for (uint32_t second = 12; second <= 200; second++) {
+        putSecond(sizer, "camera", 500 * 1000, 30, second);
+    }
+
+    ASSERT_TRUE(sizer.getStreamRate("camera", stream_rate));
+    EXPECT_NEAR(500 * 1000.0, (double) stream_rate.bitrate_bps, 1000.0);
+}
+
+TEST_F(ContentStoreSizerTest, publishes_past_threshold_and_clamps)
+{
+    config_.min_size = 4 * TEST_SIZER_MIB;
+    config_.max_size = 64 * TEST_SIZER_MIB;
+    ContentStoreSizer sizer(config_);
+    uint64_t storage_size;
+
+    sizer.streamCreated("camera", rate(800 * 1000, 25, seconds(10)));
+    EXPECT_TRUE(sizer.update(storage_size));
+    EXPECT_EQ(4 * TEST_SIZER_MIB, storage_size);
+    EXPECT_FALSE(sizer.update(storage_size));
+    EXPECT_EQ(4 * TEST_SIZER_MIB, storage_size);
+
+    putSecond(sizer, "camera", 0, 0, 0);
+    putSecond(sizer, "camera", 1000 * 1000 * 1000, 25, 1);
+    EXPECT_TRUE(sizer.update(storage_size));
+    EXPECT_EQ(64 * TEST_SIZER_MIB, storage_size);
+}
+
+TEST_F(ContentStoreSizerTest, learned_rates_survive_restart)
+{
+    {
+        ContentStoreSizer sizer(config_, state_path_);
+        sizer.streamCreated("camera", rate(4 * 1000 * 1000, 25, seconds(60)));
+        putSecond(sizer, "camera", 0, 0, 0);
+        for (uint32_t second = 1; second <= 20; second++) {
+            putSecond(sizer, "camera", 400 * 1000, 10, second);
+        }
+
+        EXPECT_TRUE(sizer.save());
+    }
+
+    // The next run is sized before the stream is created
+    ContentStoreSizer sizer(config_, state_path_);
+    EXPECT_EQ(1, sizer.getStreamCount());
+    uint64_t storage_size = sizer.getStorageSize();
+    EXPECT_LT(storage_size, 4 * 1000 * 1000ull / 8 * 60);
+    EXPECT_GT(storage_size, 400 * 1000ull / 8 * 60);
+
+    // And the learned rates win over the declared caps
+    sizer.streamCreated("camera", rate(4 * 1000 * 1000, 25, seconds(60)));
+    ContentStoreStreamRate stream_rate;
+    ASSERT_TRUE(sizer.getStreamRate("camera", stream_rate));
+    EXPECT_LT(stream_rate.bitrate_bps, 4 * 1000 * 1000ull);
+    EXPECT_LT(stream_rate.frame_rate, 25);
+    EXPECT_EQ(storage_size, sizer.getStorageSize());
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
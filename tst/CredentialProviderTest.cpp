@@ -0,0 +1,153 @@
+#include "ProducerTestFixture.h"
+#include "Auth.h"
+
+#include <atomic>
+#include <stdexcept>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using std::chrono::duration;
+using std::chrono::seconds;
+
+#define TEST_REFRESH_WAIT_SECONDS                           10
+
+/**
+ * Hands out credentials expiring after the given lifetime, counting the updates
+ */
+class CountingCredentialProvider : public CredentialProvider {
+public:
+    CountingCredentialProvider(seconds lifetime, uint32_t failing_updates = 0)
+            : lifetime_(lifetime), update_count_(0), failing_updates_(failing_updates) {}
+
+    ~CountingCredentialProvider() {
+        stopRefresher();
+    }
+
+    uint32_t getUpdateCount() const {
+        return update_count_.load();
+    }
+
+    // The refresh starts rotating once the expiration is within the grace and the prefetch periods
+    seconds getLeadTime() const {
+        return std::chrono::duration_cast<seconds>(CredentialProviderGracePeriod + CredentialProviderPrefetchPeriod);
+    }
+
+    void setLifetime(seconds lifetime) {
+        lifetime_ = lifetime;
+    }
+
+private:
+    void updateCredentials(Credentials& credentials) override {
+        auto count = ++update_count_;
+        if (count <= failing_updates_) {
+            throw std::runtime_error("Credentials source unavailable");
+        }
+
+        auto now_time = std::chrono::duration_cast<seconds>(systemCurrentTime().time_since_epoch());
+        credentials.setAccessKey("AccessKey" + to_string(count));
+        credentials.setSecretKey("SecretKey");
+        credentials.setExpiration(seconds(now_time.count() + lifetime_.load().count()));
+    }
+
+    std::atomic<seconds> lifetime_;
+    std::atomic<uint32_t> update_count_;
+    const uint32_t failing_updates_;
+};
+
+TEST(CredentialProviderTest, snapshot_is_served_until_it_gets_close_to_expiration)
+{
+    CountingCredentialProvider provider(std::chrono::hours(1));
+    auto snapshot = provider.getCredentialsSnapshot();
+    ASSERT_NE(nullptr, snapshot);
+    ASSERT_EQ(STATUS_SUCCESS, snapshot->getStatus());
+    EXPECT_EQ("AccessKey1", snapshot->getCredentials().getAccessKey());
+    ASSERT_NE(nullptr, snapshot->getAwsCredentials());
+    EXPECT_EQ(snapshot->getCredentials().getExpiration().count() * HUNDREDS_OF_NANOS_IN_A_SECOND,
+              snapshot->getAwsCredentials()->expiration);
+
+    // Served as is without refreshing
+    EXPECT_EQ(snapshot, provider.getCredentialsSnapshot());
+    EXPECT_EQ(1, provider.getUpdateCount());
+
+    // Refreshed on demand once within the grace period
+    Credentials credentials;
+    provider.setLifetime(seconds(1));
+    provider.getUpdatedCredentials(credentials);
+    EXPECT_EQ("AccessKey2", credentials.getAccessKey());
+    provider.setLifetime(std::chrono::hours(1));
+    snapshot = provider.getCredentialsSnapshot();
+    EXPECT_EQ("AccessKey3", snapshot->getCredentials().getAccessKey());
+    EXPECT_EQ(3, provider.getUpdateCount());
+}
+
+TEST(CredentialProviderTest, refresher_rotates_ahead_of_expiration)
+{
+    CountingCredentialProvider provider(seconds(0));
+
+    // Credentials that become due for the rotation a second after they are handed out
+    provider.setLifetime(provider.getLeadTime() + seconds(1));
+    ClientCallbacks client_callbacks;
+    MEMSET(&client_callbacks, 0, SIZEOF(client_callbacks));
+    provider.getCallbacks(&client_callbacks);
+
+    auto deadline = std::chrono::steady_clock::now() + seconds(TEST_REFRESH_WAIT_SECONDS);
+    while (provider.getUpdateCount() < 1 && std::chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    ASSERT_LE(1, provider.getUpdateCount());
+    auto first = provider.getCredentialsSnapshot();
+
+    // The next ones live long enough to stay put
+    provider.setLifetime(std::chrono::hours(1));
+    while (provider.getUpdateCount() < 2 && std::chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    ASSERT_EQ(2, provider.getUpdateCount());
+    auto second = provider.getCredentialsSnapshot();
+    EXPECT_NE(first, second);
+    EXPECT_GT(second->getCredentials().getExpiration(), first->getCredentials().getExpiration());
+
+    // Served from the rotated snapshot without a refresh on the calling thread
+    EXPECT_EQ(second, provider.getCredentialsSnapshot());
+    EXPECT_EQ(2, provider.getUpdateCount());
+    provider.stopRefresher();
+}
+
+TEST(CredentialProviderTest, refresher_waits_before_retrying_a_failed_first_refresh)
+{
+    // No snapshot exists yet when the first refresh fails
+    CountingCredentialProvider provider(std::chrono::hours(1), 1);
+    ClientCallbacks client_callbacks;
+    MEMSET(&client_callbacks, 0, SIZEOF(client_callbacks));
+    provider.getCallbacks(&client_callbacks);
+
+    auto deadline = std::chrono::steady_clock::now() + seconds(TEST_REFRESH_WAIT_SECONDS);
+    while (provider.getUpdateCount() < 1 && std::chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    ASSERT_EQ(1, provider.getUpdateCount());
+
+    // No retry within the retry period
+    this_thread::sleep_for(seconds(1));
+    EXPECT_EQ(1, provider.getUpdateCount());
+
+    while (provider.getUpdateCount() < 2 && std::chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    ASSERT_EQ(2, provider.getUpdateCount());
+    auto snapshot = provider.getCredentialsSnapshot();
+    ASSERT_NE(nullptr, snapshot);
+    EXPECT_EQ("AccessKey2", snapshot->getCredentials().getAccessKey());
+    EXPECT_EQ(2, provider.getUpdateCount());
+    provider.stopRefresher();
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,91 @@
+#include "ProducerTestFixture.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+
+class DefaultDeviceInfoProviderTest : public ::testing::Test {
+protected:
+    void SetUp() {
+        directory_ = createTestTempDirectory("kvs_spill_test_");
+        ASSERT_FALSE(directory_.empty());
+    }
+
+    void TearDown() {
+        removeTestDirectory(directory_ + "/spill");
+        remove((directory_ + "/file").c_str());
+        removeTestDirectory(directory_);
+    }
+
+    string directory_;
+};
+
+TEST_F(DefaultDeviceInfoProviderTest, in_memory_by_default)
+{
+    DefaultDeviceInfoProvider device_info_provider;
+    auto device_info = device_info_provider.getDeviceInfo();
+    EXPECT_EQ(DEVICE_STORAGE_TYPE_IN_MEM, device_info.storageInfo.storageType);
+}
+
+TEST_F(DefaultDeviceInfoProviderTest, spill_creates_directory_and_selects_hybrid_heap)
+{
+    DefaultDeviceInfoProvider device_info_provider;
+    string spill_directory = directory_ + "/spill";
+    device_info_provider.setStorageSpill(spill_directory, 25);
+
+    struct stat directory_stat;
+    ASSERT_EQ(0, stat(spill_directory.c_str(), &directory_stat));
+    EXPECT_EQ(S_IFDIR, directory_stat.st_mode & S_IFMT);
+
+    auto device_info = device_info_provider.getDeviceInfo();
+    EXPECT_EQ(DEVICE_STORAGE_TYPE_HYBRID_FILE, device_info.storageInfo.storageType);
+    EXPECT_EQ(25, device_info.storageInfo.spillRatio);
+    EXPECT_STREQ(spill_directory.c_str(), device_info.storageInfo.rootDirectory);
+}
+
+TEST_F(DefaultDeviceInfoProviderTest, spill_rejects_invalid_settings)
+{
+    DefaultDeviceInfoProvider device_info_provider;
+    string file_path = directory_ + "/file";
+    FILE* file = fopen(file_path.c_str(), "w");
+    ASSERT_NE(nullptr, file);
+    fclose(file);
+
+    EXPECT_THROW(device_info_provider.setStorageSpill(file_path), runtime_error);
+    EXPECT_THROW(device_info_provider.setStorageSpill(directory_, 101), runtime_error);
+    EXPECT_THROW(device_info_provider.setStorageSpill(""), runtime_error);
+    EXPECT_EQ(DEVICE_STORAGE_TYPE_IN_MEM, device_info_provider.getDeviceInfo().storageInfo.storageType);
+}
+
+TEST_F(DefaultDeviceInfoProviderTest, auto_storage_size_uses_learned_rates)
+{
+    string state_path = directory_ + "/file";
+    DefaultDeviceInfoProvider device_info_provider;
+    auto default_device_info = device_info_provider.getDeviceInfo();
+
+    // Defaults until anything has been learned
+    device_info_provider.setAutoStorageSize(state_path);
+    EXPECT_NE(nullptr, device_info_provider.getContentStoreSizer());
+    EXPECT_EQ(default_device_info.storageInfo.storageSize, device_info_provider.getDeviceInfo().storageInfo.storageSize);
+
+    // A 2 Mbps stream buffering 2 minutes learned by a previous run
+    FILE* file = fopen(state_path.c_str(), "w");
+    ASSERT_NE(nullptr, file);
+    fprintf(file, "camera 2000000 15 120000\n");
+    fclose(file);
+
+    ContentStoreSizerConfig config;
+    device_info_provider.setAutoStorageSize(state_path, config);
+    auto device_info = device_info_provider.getDeviceInfo();
+    EXPECT_EQ((uint64_t) (2000000 / 8 * 120 * config.headroom) + CONTENT_STORE_SIZER_STREAM_OVERHEAD, device_info.storageInfo.storageSize);
+    EXPECT_EQ(default_device_info.streamCount, device_info.streamCount);
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,156 @@
+#include "ProducerTestFixture.h"
+#include "FragmentAckLatencyTracker.h"
+#include "LatencyHistogram.h"
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using namespace std::chrono;
+
+class FragmentAckLatencyTest : public ::testing::Test {
+protected:
+    void submit(uint64_t timestamp_ms, bool key_frame, steady_clock::time_point now) {
+        Frame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.presentationTs = timestamp_ms * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+        frame.decodingTs = frame.presentationTs;
+        frame.flags = key_frame ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+        tracker_.frameSubmitted(frame, now);
+    }
+
+    void ack(uint64_t timestamp_ms, FRAGMENT_ACK_TYPE ack_type, steady_clock::time_point now) {
+        FragmentAck fragment_ack;
+        memset(&fragment_ack, 0, sizeof(fragment_ack));
+        fragment_ack.version = FRAGMENT_ACK_CURRENT_VERSION;
+        fragment_ack.ackType = ack_type;
+        fragment_ack.timestamp = timestamp_ms * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+        tracker_.fragmentAckReceived(fragment_ack, now);
+    }
+
+    FragmentAckLatencyTracker tracker_;
+    steady_clock::time_point start_ = steady_clock::now();
+};
+
+TEST_F(FragmentAckLatencyTest, histogram_percentiles_within_precision)
+{
+    LatencyHistogram histogram;
+    EXPECT_EQ(0, histogram.getPercentile(50).count());
+
+    for (int64_t i = 1; i <= 10000; i++) {
+        histogram.record(microseconds(i * 100));
+    }
+
+    auto percentiles = histogram.getPercentiles();
+    EXPECT_EQ(10000, percentiles.count);
+    EXPECT_EQ(5000500000, percentiles.sum.count());
+    EXPECT_NEAR(500000, percentiles.p50.count(), 500000 * 0.04);
+    EXPECT_NEAR(900000, percentiles.p90.count(), 900000 * 0.04);
+    EXPECT_NEAR(990000, percentiles.p99.count(), 990000 * 0.04);
+    EXPECT_EQ(1000000, percentiles.max.count());
+
+    // Values below the sub-bucket count are exact
+    histogram.reset();
+    histogram.record(microseconds(7));
+    histogram.record(microseconds(-5));
+    EXPECT_EQ(7, histogram.getPercentile(100).count());
+    EXPECT_EQ(0, histogram.getPercentile(50).count());
+}
+
+TEST_F(FragmentAckLatencyTest, histogram_clamps_huge_values)
+{
+    LatencyHistogram histogram;
+    histogram.record(hours(24 * 365));
+    histogram.record(microseconds(1));
+
+    EXPECT_EQ(duration_cast<microseconds>(hours(24 * 365)).count(), histogram.getPercentiles().max.count());
+    EXPECT_EQ(1, histogram.getPercentile(50).count());
+}
+
+TEST_F(FragmentAckLatencyTest, acks_correlated_with_key_frames)
+{
+    submit(1000, true, start_);
+    submit(1033, false, start_ + milliseconds(33));
+    submit(3000, true, start_ + milliseconds(2000));
+
+    ack(1000, FRAGMENT_ACK_TYPE_BUFFERING, start_ + milliseconds(100));
+    ack(1000, FRAGMENT_ACK_TYPE_RECEIVED, start_ + milliseconds(2100));
+    ack(1000, FRAGMENT_ACK_TYPE_PERSISTED, start_ + milliseconds(2300));
+    ack(3000, FRAGMENT_ACK_TYPE_BUFFERING, start_ + milliseconds(2050));
+
+    auto latencies = tracker_.getLatencies();
+    EXPECT_EQ(2, latencies.buffering.count);
+    EXPECT_EQ(100000, latencies.buffering.max.count());
+    EXPECT_NEAR(50000, latencies.buffering.p50.count(), 50000 * 0.04);
+    EXPECT_EQ(1, latencies.received.count);
+    EXPECT_EQ(2100000, latencies.received.max.count());
+    EXPECT_EQ(1, latencies.persisted.count);
+    EXPECT_EQ(2300000, latencies.persisted.max.count());
+}
+
+TEST_F(FragmentAckLatencyTest, unknown_and_repeated_acks_ignored)
+{
+    submit(1000, true, start_);
+    submit(2000, true, start_ + milliseconds(1000));
+
+    // Not a fragment start
+    ack(1500, FRAGMENT_ACK_TYPE_BUFFERING, start_ + milliseconds(1600));
+
+    ack(2000, FRAGMENT_ACK_TYPE_BUFFERING, start_ + milliseconds(1100));
+    ack(1000, FRAGMENT_ACK_TYPE_RECEIVED, start_ + milliseconds(1200));
+
+    // Re-sent after a reconnect
+    ack(2000, FRAGMENT_ACK_TYPE_BUFFERING, start_ + milliseconds(5000));
+    ack(1000, FRAGMENT_ACK_TYPE_RECEIVED, start_ + milliseconds(5000));
+
+    // The persisted ack of the second fragment retires the first one
+    ack(2000, FRAGMENT_ACK_TYPE_PERSISTED, start_ + milliseconds(1500));
+    ack(1000, FRAGMENT_ACK_TYPE_PERSISTED, start_ + milliseconds(1600));
+    ack(2000, FRAGMENT_ACK_TYPE_PERSISTED, start_ + milliseconds(5000));
+
+    auto latencies = tracker_.getLatencies();
+    EXPECT_EQ(1, latencies.buffering.count);
+    EXPECT_EQ(100000, latencies.buffering.max.count());
+    EXPECT_EQ(1, latencies.received.count);
+    EXPECT_EQ(1200000, latencies.received.max.count());
+    EXPECT_EQ(1, latencies.persisted.count);
+    EXPECT_EQ(500000, latencies.persisted.max.count());
+}
+
+TEST_F(FragmentAckLatencyTest, interleaved_acks_recorded)
+{
+    submit(1000, true, start_);
+    submit(3000, true, start_ + milliseconds(2000));
+    submit(5000, true, start_ + milliseconds(4000));
+
+    // The order the service sends them in, the next fragment is buffering before the previous one is persisted
+    ack(1000, FRAGMENT_ACK_TYPE_BUFFERING, start_ + milliseconds(100));
+    ack(1000, FRAGMENT_ACK_TYPE_RECEIVED, start_ + milliseconds(2050));
+    ack(3000, FRAGMENT_ACK_TYPE_BUFFERING, start_ + milliseconds(2100));
+    ack(1000, FRAGMENT_ACK_TYPE_PERSISTED, start_ + milliseconds(2400));
+    ack(3000, FRAGMENT_ACK_TYPE_RECEIVED, start_ + milliseconds(4050));
+    ack(5000, FRAGMENT_ACK_TYPE_BUFFERING, start_ + milliseconds(4100));
+    ack(3000, FRAGMENT_ACK_TYPE_PERSISTED, start_ + milliseconds(4300));
+
+    auto latencies = tracker_.getLatencies();
+    EXPECT_EQ(3, latencies.buffering.count);
+    EXPECT_EQ(100000, latencies.buffering.max.count());
+    EXPECT_EQ(2, latencies.received.count);
+    EXPECT_EQ(2050000, latencies.received.max.count());
+    EXPECT_EQ(2, latencies.persisted.count);
+    EXPECT_EQ(2400000, latencies.persisted.max.count());
+    EXPECT_NEAR(2300000, latencies.persisted.p50.count(), 2300000 * 0.04);
+}
+
+TEST_F(FragmentAckLatencyTest, error_ack_retires_fragment)
+{
+    submit(1000, true, start_);
+    ack(1000, FRAGMENT_ACK_TYPE_ERROR, start_ + milliseconds(100));
+    ack(1000, FRAGMENT_ACK_TYPE_PERSISTED, start_ + milliseconds(200));
+
+    EXPECT_EQ(0, tracker_.getLatencies().persisted.count);
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,169 @@
+#include "ProducerTestFixture.h"
+#include "FrameAdmission.h"
+
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using namespace std::chrono;
+
+class FrameAdmissionTest : public ::testing::Test {
+protected:
+    FrameAdmissionTest() : occupancy_(0) {
+        config_.occupancy_refresh_interval = milliseconds(0);
+    }
+
+    void SetUp() {
+        admission_.reset(new FrameAdmission(config_, [this]() { return occupancy_; }));
+    }
+
+    // AVCC H.264 slice with the given nal_ref_idc
+    static vector<uint8_t> h264Frame(uint8_t nal_type, uint8_t nal_ref_idc) {
+        return {0x00, 0x00, 0x00, 0x02, (uint8_t) ((nal_ref_idc << 5) | nal_type), 0x88};
+    }
+
+    FRAME_SHED_REASON admit(vector<uint8_t>& payload, bool key_frame) {
+        Frame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.trackId = DEFAULT_TRACK_ID;
+        frame.flags = key_frame ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+        frame.frameData = payload.data();
+        frame.size = (UINT32) payload.size();
+        return admission_->admit(frame);
+    }
+
+    FRAME_SHED_REASON admitKey() {
+        auto payload = h264Frame(5, 3);
+        return admit(payload, true);
+    }
+
+    FRAME_SHED_REASON admitReference() {
+        auto payload = h264Frame(1, 2);
+        return admit(payload, false);
+    }
+
+    FRAME_SHED_REASON admitDisposable() {
+        auto payload = h264Frame(1, 0);
+        return admit(payload, false);
+    }
+
+    FrameAdmissionConfig config_;
+    double occupancy_;
+    unique_ptr<FrameAdmission> admission_;
+};
+
+TEST_F(FrameAdmissionTest, classifies_h264_by_nal_ref_idc)
+{
+    uint8_t temporal_id;
+    auto idr = h264Frame(5, 3);
+    auto reference = h264Frame(1, 2);
+    auto disposable = h264Frame(1, 0);
+
+    // SEI in front of the slice
+    vector<uint8_t> with_sei = {0x00, 0x00, 0x00, 0x02, 0x06, 0x05};
+    with_sei.insert(with_sei.end(), disposable.begin(), disposable.end());
+
+    EXPECT_EQ(FRAME_DEPENDENCY_KEY, FrameAdmission::classify(FRAME_ADMISSION_CODEC_H264, false, idr.data(), idr.size(), temporal_id));
+    EXPECT_EQ(FRAME_DEPENDENCY_REFERENCE, FrameAdmission::classify(FRAME_ADMISSION_CODEC_H264, false, reference.data(), reference.size(), temporal_id));
+    EXPECT_EQ(FRAME_DEPENDENCY_DISPOSABLE, FrameAdmission::classify(FRAME_ADMISSION_CODEC_H264, false, disposable.data(), disposable.size(), temporal_id));
+    EXPECT_EQ(FRAME_DEPENDENCY_DISPOSABLE, FrameAdmission::classify(FRAME_ADMISSION_CODEC_H264, false, with_sei.data(), with_sei.size(), temporal_id));
+
+    // Truncated NAL is kept
+    vector<uint8_t> truncated = {0x00, 0x00, 0x00, 0x10, 0x01, 0x88};
+    EXPECT_EQ(FRAME_DEPENDENCY_REFERENCE, FrameAdmission::classify(FRAME_ADMISSION_CODEC_H264, false, truncated.data(), truncated.size(), temporal_id));
+}
+
+TEST_F(FrameAdmissionTest, classifies_h265_annexb_by_nal_type_and_temporal_id)
+{
+    uint8_t temporal_id;
+
+    // TRAIL_N in temporal sub-layer 2
+    vector<uint8_t> trail_n = {0x00, 0x00, 0x00, 0x01, 0x00, 0x03, 0xaf};
+    // TRAIL_R in sub-layer 0
+    vector<uint8_t> trail_r = {0x00, 0x00, 0x01, 0x02, 0x01, 0xaf};
+    // IDR_W_RADL
+    vector<uint8_t> idr = {0x00, 0x00, 0x01, 0x26, 0x01, 0xaf};
+
+    EXPECT_EQ(FRAME_DEPENDENCY_DISPOSABLE, FrameAdmission::classify(FRAME_ADMISSION_CODEC_H265, true, trail_n.data(), trail_n.size(), temporal_id));
+    EXPECT_EQ(2, temporal_id);
+    EXPECT_EQ(FRAME_DEPENDENCY_REFERENCE, FrameAdmission::classify(FRAME_ADMISSION_CODEC_H265, true, trail_r.data(), trail_r.size(), temporal_id));
+    EXPECT_EQ(0, temporal_id);
+    EXPECT_EQ(FRAME_DEPENDENCY_KEY, FrameAdmission::classify(FRAME_ADMISSION_CODEC_H265, true, idr.data(), idr.size(), temporal_id));
+}
+
+TEST_F(FrameAdmissionTest, admits_everything_without_pressure)
+{
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitKey());
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitDisposable());
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitReference());
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admission_->getShedLevel());
+}
+
+TEST_F(FrameAdmissionTest, sheds_disposable_frames_first)
+{
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitKey());
+    occupancy_ = 0.6;
+    EXPECT_EQ(FRAME_SHED_REASON_DISPOSABLE, admitDisposable());
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitReference());
+    EXPECT_EQ(FRAME_SHED_REASON_DISPOSABLE, admitDisposable());
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitKey());
+
+    // Within the hysteresis
+    occupancy_ = 0.45;
+    EXPECT_EQ(FRAME_SHED_REASON_DISPOSABLE, admitDisposable());
+
+    occupancy_ = 0.3;
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitDisposable());
+}
+
+TEST_F(FrameAdmissionTest, sheds_gop_tail_up_to_next_key_frame)
+{
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitKey());
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitReference());
+    occupancy_ = 0.75;
+    EXPECT_EQ(FRAME_SHED_REASON_GOP_TAIL, admitReference());
+
+    // The rest of the GOP might reference the shed frame even though the pressure is gone
+    occupancy_ = 0;
+    EXPECT_EQ(FRAME_SHED_REASON_GOP_TAIL, admitReference());
+    EXPECT_EQ(FRAME_SHED_REASON_GOP_TAIL, admitDisposable());
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitKey());
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitReference());
+}
+
+TEST_F(FrameAdmissionTest, sheds_whole_gops_from_key_frame)
+{
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitKey());
+    occupancy_ = 0.9;
+
+    // Mid-GOP the key frame is already in, only the tail is shed
+    EXPECT_EQ(FRAME_SHED_REASON_GOP_TAIL, admitReference());
+    EXPECT_EQ(FRAME_SHED_REASON_GOP, admitKey());
+    EXPECT_EQ(FRAME_SHED_REASON_GOP, admitReference());
+
+    // Steps down to the GOP tail level at the next key frame
+    occupancy_ = 0.74;
+    EXPECT_EQ(FRAME_SHED_REASON_GOP, admitDisposable());
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admitKey());
+    EXPECT_EQ(FRAME_SHED_REASON_GOP_TAIL, admission_->getShedLevel());
+    EXPECT_EQ(FRAME_SHED_REASON_GOP_TAIL, admitReference());
+}
+
+TEST_F(FrameAdmissionTest, other_tracks_and_eofr_admitted)
+{
+    occupancy_ = 1;
+    Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.trackId = DEFAULT_TRACK_ID + 1;
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admission_->admit(frame));
+
+    frame.trackId = DEFAULT_TRACK_ID;
+    frame.flags = FRAME_FLAG_END_OF_FRAGMENT;
+    EXPECT_EQ(FRAME_SHED_REASON_NONE, admission_->admit(frame));
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,138 @@
+#include "ProducerTestFixture.h"
+#include "FrameBufferPool.h"
+#include "PutFrameHelper.h"
+
+#include <thread>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+
+#define TEST_POOL_FRAME_COUNT                               10000
+#define TEST_POOL_THREAD_COUNT                              8
+
+class FrameBufferPoolTest : public ::testing::Test {
+protected:
+    /**
+     * Varying frame sizes within the 64KB size class, roughly what an encoder emits between key frames.
+     */
+    static uint32_t testFrameSize(uint32_t index) {
+        return 32 * 1024 + 1 + (index * 7919) % (32 * 1024 - 1);
+    }
+};
+
+TEST_F(FrameBufferPoolTest, size_classes_round_up)
+{
+    FrameBufferPool pool(1000, 100000);
+
+    auto small = pool.acquire(1);
+    EXPECT_EQ(1024, small.capacity());
+
+    auto exact = pool.acquire(4096);
+    EXPECT_EQ(4096, exact.capacity());
+
+    auto rounded = pool.acquire(4097);
+    EXPECT_EQ(8192, rounded.capacity());
+
+    // Above the max size class the allocation is exact
+    auto oversized = pool.acquire(200000);
+    EXPECT_EQ(200000, oversized.capacity());
+    EXPECT_NE(nullptr, oversized.data());
+}
+
+TEST_F(FrameBufferPoolTest, steady_state_makes_no_allocations)
+{
+    FrameBufferPool pool;
+
+    pool.reserve(testFrameSize(0), 1);
+    uint64_t warm_allocations = pool.getAllocationCount();
+    EXPECT_EQ(1, warm_allocations);
+
+    for (uint32_t i = 0; i < TEST_POOL_FRAME_COUNT; i++) {
+        auto buffer = pool.acquire(testFrameSize(i));
+        ASSERT_GE(buffer.capacity(), testFrameSize(i));
+        memset(buffer.data(), (int) i, testFrameSize(i));
+    }
+
+    EXPECT_EQ(warm_allocations, pool.getAllocationCount());
+}
+
+TEST_F(FrameBufferPoolTest, released_buffers_are_reused)
+{
+    FrameBufferPool pool;
+
+    auto buffer = pool.acquire(testFrameSize(0));
+    uint8_t* data = buffer.data();
+    buffer.reset();
+    EXPECT_EQ(nullptr, buffer.data());
+
+    buffer = pool.acquire(testFrameSize(1));
+    EXPECT_EQ(data, buffer.data());
+
+    // Moving the handle doesn't recycle the buffer
+    FrameBufferPool::Buffer moved(std::move(buffer));
+    EXPECT_EQ(data, moved.data());
+    EXPECT_EQ(nullptr, buffer.data());
+    EXPECT_EQ(1, pool.getAllocationCount());
+}
+
+TEST_F(FrameBufferPoolTest, oversized_buffers_are_not_pooled)
+{
+    FrameBufferPool pool(1024, 64 * 1024);
+
+    for (uint32_t i = 0; i < 10; i++) {
+        auto buffer = pool.acquire(128 * 1024);
+    }
+
+    EXPECT_EQ(10, pool.getAllocationCount());
+}
+
+TEST_F(FrameBufferPoolTest, concurrent_tracks_make_bounded_allocations)
+{
+    FrameBufferPool pool;
+    vector<thread> threads;
+
+    for (uint32_t t = 0; t < TEST_POOL_THREAD_COUNT; t++) {
+        threads.push_back(thread([&, t]() {
+            for (uint32_t i = 0; i < TEST_POOL_FRAME_COUNT; i++) {
+                auto buffer = pool.acquire(testFrameSize(i + t));
+                buffer.data()[0] = (uint8_t) t;
+                buffer.data()[buffer.capacity() - 1] = (uint8_t) t;
+            }
+        }));
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // At most one buffer per thread is ever outstanding
+    EXPECT_GE((uint64_t) TEST_POOL_THREAD_COUNT, pool.getAllocationCount());
+}
+
+TEST_F(FrameBufferPoolTest, put_frame_helper_buffers_per_track)
+{
+    PutFrameHelper put_frame_helper(nullptr);
+    uint64_t warm_allocations = put_frame_helper.getFrameBufferAllocationCount();
+
+    // Sized from the initial audio and video sizes
+    uint8_t* video = put_frame_helper.getFrameDataBuffer(DEFAULT_BUFFER_SIZE_VIDEO, true);
+    uint8_t* audio = put_frame_helper.getFrameDataBuffer(DEFAULT_BUFFER_SIZE_AUDIO, false);
+    EXPECT_NE(video, audio);
+    EXPECT_EQ(warm_allocations, put_frame_helper.getFrameBufferAllocationCount());
+
+    // Smaller frames reuse the outstanding buffer
+    EXPECT_EQ(video, put_frame_helper.getFrameDataBuffer(1024, true));
+    EXPECT_EQ(audio, put_frame_helper.getFrameDataBuffer(1024, false));
+
+    // Growing only allocates once per size class
+    put_frame_helper.getFrameDataBuffer(DEFAULT_BUFFER_SIZE_VIDEO * 4, true);
+    put_frame_helper.getFrameDataBuffer(DEFAULT_BUFFER_SIZE_VIDEO * 4, true);
+    EXPECT_EQ(warm_allocations + 1, put_frame_helper.getFrameBufferAllocationCount());
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
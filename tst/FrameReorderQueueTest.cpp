@@ -0,0 +1,201 @@
+#include "ProducerTestFixture.h"
+#include "FrameReorderQueue.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using namespace std::chrono;
+
+#define TEST_VIDEO_TRACK                                    0
+#define TEST_AUDIO_TRACK                                    1
+#define TEST_REORDER_QUEUE_SIZE                             16
+#define TEST_REORDER_MAX_SKEW_MS                            100
+
+class FrameReorderQueueTest : public ::testing::Test {
+protected:
+    FrameReorderQueueTest() : buffer_pool_(64, 1024),
+                              reorder_queue_({TEST_REORDER_QUEUE_SIZE, TEST_REORDER_QUEUE_SIZE},
+                                             milliseconds(TEST_REORDER_MAX_SKEW_MS),
+                                             [this](Frame& frame) {
+                                                 // The frame data is only valid during the call
+                                                 emitted_.push_back(frame);
+                                                 emitted_payloads_.push_back(*(uint32_t*) frame.frameData);
+                                             }) {}
+
+    /**
+     * Queues a frame with the timestamps in milliseconds. The index tags the frame in the emitted list.
+     */
+    void push(uint32_t track, uint32_t index, uint64_t pts_ms, uint64_t dts_ms, bool key_frame = false) {
+        Frame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.index = index;
+        frame.presentationTs = pts_ms * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+        frame.decodingTs = dts_ms * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+        frame.flags = key_frame ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+        frame.trackId = track;
+
+        auto buffer = buffer_pool_.acquire(sizeof(index));
+        memcpy(buffer.data(), &index, sizeof(index));
+        frame.frameData = buffer.data();
+        frame.size = sizeof(index);
+
+        reorder_queue_.push(track, frame, std::move(buffer));
+    }
+
+    vector<uint32_t> emittedIndexes() const {
+        vector<uint32_t> indexes;
+        for (auto& frame : emitted_) {
+            indexes.push_back(frame.index);
+        }
+
+        return indexes;
+    }
+
+    vector<Frame> emitted_;
+    vector<uint32_t> emitted_payloads_;
+
+    // Outlives the queue holding its buffers
+    FrameBufferPool buffer_pool_;
+    FrameReorderQueue reorder_queue_;
+};
+
+TEST_F(FrameReorderQueueTest, key_frame_waits_for_audio_to_catch_up)
+{
+    push(TEST_VIDEO_TRACK, 0, 0, 0, true);
+    EXPECT_TRUE(emitted_.empty());
+
+    push(TEST_AUDIO_TRACK, 1, 0, 0);
+    push(TEST_AUDIO_TRACK, 2, 20, 20);
+    push(TEST_VIDEO_TRACK, 3, 40, 40, true);
+    push(TEST_AUDIO_TRACK, 4, 40, 40);
+
+    // The audio frame at 40 must not end up ahead of the key frame starting the next cluster
+    EXPECT_EQ(vector<uint32_t>({0, 1, 2, 3}), emittedIndexes());
+
+    reorder_queue_.flush();
+    EXPECT_EQ(vector<uint32_t>({0, 1, 2, 3, 4}), emittedIndexes());
+    EXPECT_EQ(0, reorder_queue_.size());
+    EXPECT_EQ(5, reorder_queue_.getStats().frame_count);
+}
+
+TEST_F(FrameReorderQueueTest, video_keeps_decoding_order)
+{
+    // I P B B in decoding order
+    push(TEST_VIDEO_TRACK, 0, 0, 0, true);
+    push(TEST_VIDEO_TRACK, 1, 90, 30);
+    push(TEST_VIDEO_TRACK, 2, 30, 60);
+    push(TEST_VIDEO_TRACK, 3, 60, 90);
+    reorder_queue_.flush();
+
+    EXPECT_EQ(vector<uint32_t>({0, 1, 2, 3}), emittedIndexes());
+}
+
+TEST_F(FrameReorderQueueTest, silent_track_released_after_max_skew)
+{
+    push(TEST_VIDEO_TRACK, 0, 0, 0, true);
+    push(TEST_VIDEO_TRACK, 1, 50, 50);
+    push(TEST_VIDEO_TRACK, 2, 100, 100);
+    EXPECT_TRUE(emitted_.empty());
+
+    // More than the max skew buffered without a single audio frame
+    push(TEST_VIDEO_TRACK, 3, 150, 150);
+    EXPECT_EQ(vector<uint32_t>({0}), emittedIndexes());
+
+    push(TEST_VIDEO_TRACK, 4, 200, 200);
+    EXPECT_EQ(vector<uint32_t>({0, 1}), emittedIndexes());
+}
+
+TEST_F(FrameReorderQueueTest, track_queue_is_bounded)
+{
+    // Same timestamps so that the skew never kicks in
+    for (uint32_t i = 0; i < TEST_REORDER_QUEUE_SIZE * 2; i++) {
+        push(TEST_AUDIO_TRACK, i, 0, 0);
+        EXPECT_GE(TEST_REORDER_QUEUE_SIZE, reorder_queue_.size());
+    }
+
+    EXPECT_EQ(TEST_REORDER_QUEUE_SIZE, emitted_.size());
+    for (uint32_t i = 0; i < emitted_.size(); i++) {
+        EXPECT_EQ(i, emitted_[i].index);
+        EXPECT_EQ(i, emitted_payloads_[i]);
+    }
+}
+
+TEST_F(FrameReorderQueueTest, interleaves_by_presentation_time)
+{
+    // 30 fps video and 20ms audio frames over 2 seconds with the audio arriving 50ms late
+    vector<pair<uint64_t, uint32_t>> arrivals;
+    for (uint32_t i = 0; i < 60; i++) {
+        arrivals.push_back(make_pair(i * 33, TEST_VIDEO_TRACK));
+    }
+    for (uint32_t i = 0; i < 100; i++) {
+        arrivals.push_back(make_pair(i * 20 + 50, TEST_AUDIO_TRACK));
+    }
+    stable_sort(arrivals.begin(), arrivals.end(), [](const pair<uint64_t, uint32_t>& first, const pair<uint64_t, uint32_t>& second) {
+        return first.first < second.first;
+    });
+
+    uint32_t video_index = 0, audio_index = 0;
+    for (uint32_t i = 0; i < arrivals.size(); i++) {
+        if (arrivals[i].second == TEST_VIDEO_TRACK) {
+            push(TEST_VIDEO_TRACK, i, video_index * 33, video_index * 33, video_index % 30 == 0);
+            video_index++;
+        } else {
+            push(TEST_AUDIO_TRACK, i, audio_index * 20, audio_index * 20);
+            audio_index++;
+        }
+    }
+
+    reorder_queue_.flush();
+    ASSERT_EQ(160, emitted_.size());
+    for (uint32_t i = 1; i < emitted_.size(); i++) {
+        EXPECT_LE(emitted_[i - 1].presentationTs, emitted_[i].presentationTs);
+    }
+
+    EXPECT_EQ(160, reorder_queue_.getStats().frame_count);
+    EXPECT_LE(reorder_queue_.getStats().max_latency, reorder_queue_.getStats().total_latency);
+}
+
+TEST_F(FrameReorderQueueTest, destruction_emits_pending_frames)
+{
+    vector<uint64_t> emitted;
+    {
+        FrameReorderQueue reorder_queue({TEST_REORDER_QUEUE_SIZE, TEST_REORDER_QUEUE_SIZE},
+                                        milliseconds(TEST_REORDER_MAX_SKEW_MS),
+                                        [&](Frame& frame) {
+                                            emitted.push_back(frame.presentationTs);
+                                        });
+
+        Frame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.flags = FRAME_FLAG_KEY_FRAME;
+        reorder_queue.push(TEST_VIDEO_TRACK, frame, FrameBufferPool::Buffer());
+        EXPECT_TRUE(emitted.empty());
+    }
+
+    EXPECT_EQ(1, emitted.size());
+}
+
+TEST_F(FrameReorderQueueTest, single_track_does_not_wait)
+{
+    vector<uint64_t> emitted;
+    FrameReorderQueue reorder_queue({TEST_REORDER_QUEUE_SIZE}, milliseconds(TEST_REORDER_MAX_SKEW_MS), [&](Frame& frame) {
+        emitted.push_back(frame.decodingTs);
+    });
+
+    Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    for (uint32_t i = 0; i < 3; i++) {
+        frame.flags = i == 0 ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+        frame.presentationTs = frame.decodingTs = i * 33 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+        reorder_queue.push(TEST_VIDEO_TRACK, frame, FrameBufferPool::Buffer());
+        EXPECT_EQ(i + 1, emitted.size());
+    }
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,466 @@
+#include "ProducerTestFixture.h"
+#include "IotTokenBroker.h"
+#include "IotCertCredentialProvider.h"
+
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <set>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define CLOSE_SOCKET closesocket
+#define SHUT_RD SD_RECEIVE
+typedef SOCKET socket_t;
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define CLOSE_SOCKET close
+#define INVALID_SOCKET -1
+typedef int socket_t;
+#endif
+
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+#define TEST_IOT_ROLE_ALIAS                                 "test-role-alias"
+#define TEST_IOT_KEY_BITS                                   2048
+
+/**
+ * Local HTTPS stand-in for the IoT credentials endpoint. Requires a client certificate signed by its own
+ * certificate and hands out credentials named after the thing and the request count.
+ */
+class IotEndpointStandIn {
+public:
+    IotEndpointStandIn() : ssl_ctx_(nullptr), listen_fd_(INVALID_SOCKET), port_(0), stopping_(false), status_(200),
+                           lifetime_(seconds(3600)), delay_(milliseconds(0)), connection_count_(0), request_count_(0) {}
+
+    ~IotEndpointStandIn() {
+        stop();
+    }
+
+    bool start(const string& cert_path, const string& key_path) {
+        ssl_ctx_ = SSL_CTX_new(TLS_server_method());
+        if (nullptr == ssl_ctx_
+            || 1 != SSL_CTX_use_certificate_file(ssl_ctx_, cert_path.c_str(), SSL_FILETYPE_PEM)
+            || 1 != SSL_CTX_use_PrivateKey_file(ssl_ctx_, key_path.c_str(), SSL_FILETYPE_PEM)
+            || 1 != SSL_CTX_load_verify_locations(ssl_ctx_, cert_path.c_str(), nullptr)) {
+            return false;
+        }
+
+        SSL_CTX_set_verify(ssl_ctx_, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, nullptr);
+
+#if defined(_WIN32)
+        WSADATA wsa_data;
+        WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address;
+        MEMSET(&address, 0, SIZEOF(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t address_len = sizeof(address);
+        if (0 != ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address))
+            || 0 != listen(listen_fd_, 64)
+            || 0 != getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &address_len)) {
+            return false;
+        }
+
+        port_ = ntohs(address.sin_port);
+        accept_thread_ = thread(&IotEndpointStandIn::acceptRoutine, this);
+        return true;
+    }
+
+    void stop() {
+        if (!accept_thread_.joinable()) {
+            return;
+        }
+
+        stopping_ = true;
+#if defined(_WIN32)
+        // Winsock only unblocks the accept once the socket is closed
+        CLOSE_SOCKET(listen_fd_);
+        accept_thread_.join();
+#else
+        shutdown(listen_fd_, SHUT_RDWR);
+        accept_thread_.join();
+        CLOSE_SOCKET(listen_fd_);
+#endif
+
+        // Connections cached by the shared broker stay open, unblock their reads while keeping them writable
+        {
+            lock_guard<mutex> lock(mutex_);
+            for (auto fd : connection_fds_) {
+                shutdown(fd, SHUT_RD);
+            }
+        }
+
+        for (auto& connection_thread : connection_threads_) {
+            connection_thread.join();
+        }
+
+        SSL_CTX_free(ssl_ctx_);
+    }
+
+    string getEndpoint() const {
+        return "localhost:" + to_string(port_);
+    }
+
+    void setStatus(int status) {
+        status_ = status;
+    }
+
+    void setLifetime(seconds lifetime) {
+        lifetime_ = lifetime;
+    }
+
+    void setDelay(milliseconds delay) {
+        delay_ = delay;
+    }
+
+    uint32_t getConnectionCount() const {
+        return connection_count_.load();
+    }
+
+    uint32_t getRequestCount() const {
+        return request_count_.load();
+    }
+
+    vector<string> getRequests() {
+        lock_guard<mutex> lock(mutex_);
+        return requests_;
+    }
+
+private:
+    void acceptRoutine() {
+        while (!stopping_) {
+            socket_t fd = accept(listen_fd_, nullptr, nullptr);
+            if (INVALID_SOCKET == fd) {
+                break;
+            }
+
+            connection_count_++;
+            lock_guard<mutex> lock(mutex_);
+            connection_fds_.insert(fd);
+            connection_threads_.emplace_back(&IotEndpointStandIn::connectionRoutine, this, fd);
+        }
+    }
+
+    void connectionRoutine(socket_t fd) {
+        SSL* ssl = SSL_new(ssl_ctx_);
+        SSL_set_fd(ssl, (int) fd);
+        if (1 == SSL_accept(ssl)) {
+            string received;
+            char buffer[4096];
+            int read_size;
+            while ((read_size = SSL_read(ssl, buffer, sizeof(buffer))) > 0) {
+                received.append(buffer, read_size);
+                size_t end;
+                while (string::npos != (end = received.find("\r\n\r\n"))) {
+                    string response = respond(received.substr(0, end));
+                    received.erase(0, end + 4);
+                    SSL_write(ssl, response.data(), (int) response.size());
+                }
+            }
+        }
+
+        SSL_free(ssl);
+        {
+            lock_guard<mutex> lock(mutex_);
+            connection_fds_.erase(fd);
+        }
+
+        CLOSE_SOCKET(fd);
+    }
+
+    string respond(const string& request) {
+        auto count = ++request_count_;
+        this_thread::sleep_for(delay_.load());
+
+        // "GET <path> HTTP/1.1" followed by the headers
+        string path = request.substr(4, request.find(' ', 4) - 4);
+        string thing_name;
+        const string header = "x-amzn-iot-thingname: ";
+        auto position = request.find(header);
+        if (string::npos != position) {
+            thing_name = request.substr(position + header.size(), request.find("\r\n", position) - position - header.size());
+        }
+
+        {
+            lock_guard<mutex> lock(mutex_);
+            requests_.push_back(path + " " + thing_name);
+        }
+
+        time_t expiration = time(nullptr) + lifetime_.load().count();
+        tm expiration_tm;
+#if defined(_WIN32)
+        gmtime_s(&expiration_tm, &expiration);
+#else
+        gmtime_r(&expiration, &expiration_tm);
+#endif
+        char expiration_string[32];
+        strftime(expiration_string, sizeof(expiration_string), "%Y-%m-%dT%H:%M:%SZ", &expiration_tm);
+
+        int status = status_.load();
+        string body = 200 == status
+                ? string("{\"credentials\":{\"accessKeyId\":\"") + thing_name + "-" + to_string(count)
+                  + "\",\"secretAccessKey\":\"secret\",\"sessionToken\":\"token\",\"expiration\":\""
+                  + expiration_string + "\"}}"
+                : string("{\"message\":\"Access Denied\"}");
+
+        return "HTTP/1.1 " + to_string(status) + (200 == status ? " OK" : " Forbidden") + "\r\n"
+               + "Content-Type: application/json\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    SSL_CTX* ssl_ctx_;
+    socket_t listen_fd_;
+    uint16_t port_;
+    atomic<bool> stopping_;
+    atomic<int> status_;
+    atomic<seconds> lifetime_;
+    atomic<milliseconds> delay_;
+    atomic<uint32_t> connection_count_;
+    atomic<uint32_t> request_count_;
+    thread accept_thread_;
+    mutex mutex_;
+    set<socket_t> connection_fds_;
+    vector<thread> connection_threads_;
+    vector<string> requests_;
+};
+
+class IotTokenBrokerTest : public ::testing::Test {
+protected:
+    void SetUp() {
+        directory_ = createTestTempDirectory("kvs_iot_broker_test_");
+        ASSERT_FALSE(directory_.empty());
+        cert_path_ = directory_ + "/cert.pem";
+        key_path_ = directory_ + "/key.pem";
+        ASSERT_TRUE(createCertificate());
+        ASSERT_TRUE(endpoint_.start(cert_path_, key_path_));
+    }
+
+    void TearDown() {
+        endpoint_.stop();
+        remove(cert_path_.c_str());
+        remove(key_path_.c_str());
+        removeTestDirectory(directory_);
+    }
+
+    IotTokenRequest request(const string& thing_name) {
+        IotTokenRequest request;
+        request.endpoint = endpoint_.getEndpoint();
+        request.cert_path = cert_path_;
+        request.private_key_path = key_path_;
+        request.ca_cert_path = cert_path_;
+        request.role_alias = TEST_IOT_ROLE_ALIAS;
+        request.thing_name = thing_name;
+        return request;
+    }
+
+    // Self-signed certificate for localhost, used as the CA, the server and the client certificate
+    bool createCertificate() {
+        EVP_PKEY* key = nullptr;
+        EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+        bool created = nullptr != key_ctx
+                       && 1 == EVP_PKEY_keygen_init(key_ctx)
+                       && 1 == EVP_PKEY_CTX_set_rsa_keygen_bits(key_ctx, TEST_IOT_KEY_BITS)
+                       && 1 == EVP_PKEY_keygen(key_ctx, &key);
+        EVP_PKEY_CTX_free(key_ctx);
+
+        X509* cert = X509_new();
+        if (created) {
+            X509_set_version(cert, 2);
+            ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+            X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+            X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+            X509_set_pubkey(cert, key);
+            X509_NAME* name = X509_get_subject_name(cert);
+            X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*) "localhost", -1, -1, 0);
+            X509_set_issuer_name(cert, name);
+
+            X509V3_CTX v3_ctx;
+            X509V3_set_ctx_nodb(&v3_ctx);
+            X509V3_set_ctx(&v3_ctx, cert, cert, nullptr, nullptr, 0);
+            const pair<int, const char*> extensions[] = {
+                    {NID_basic_constraints, "critical,CA:TRUE"},
+                    {NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1"}};
+            for (auto& extension : extensions) {
+                X509_EXTENSION* x509_extension = X509V3_EXT_conf_nid(nullptr, &v3_ctx, extension.first,
+                                                                     const_cast<char*>(extension.second));
+                created = created && nullptr != x509_extension && 1 == X509_add_ext(cert, x509_extension, -1);
+                X509_EXTENSION_free(x509_extension);
+            }
+
+            created = created && 0 != X509_sign(cert, key, EVP_sha256());
+        }
+
+        FILE* cert_file = fopen(cert_path_.c_str(), "w");
+        FILE* key_file = fopen(key_path_.c_str(), "w");
+        created = created && nullptr != cert_file && nullptr != key_file
+                  && 1 == PEM_write_X509(cert_file, cert)
+                  && 1 == PEM_write_PrivateKey(key_file, key, nullptr, nullptr, 0, nullptr, nullptr);
+        if (nullptr != cert_file) {
+            fclose(cert_file);
+        }
+
+        if (nullptr != key_file) {
+            fclose(key_file);
+        }
+
+        X509_free(cert);
+        EVP_PKEY_free(key);
+        return created;
+    }
+
+    IotEndpointStandIn endpoint_;
+    string directory_;
+    string cert_path_;
+    string key_path_;
+};
+
+TEST(IotTokenBrokerParseTest, parses_the_credentials_object)
+{
+    Credentials credentials;
+    ASSERT_TRUE(IotTokenBroker::parseCredentials(
+            "{\"credentials\": {\"expiration\": \"2018-01-18T09:18:06Z\", \"accessKeyId\": \"AKID\",\n"
+            "\"secretAccessKey\": \"se\\\"cr\\\\et\\/\\u00e9\\ud83d\\ude00\", \"sessionToken\": \"TOKEN\", \"ttl\": 3600}}",
+            credentials));
+    EXPECT_EQ("AKID", credentials.getAccessKey());
+    EXPECT_EQ("se\"cr\\et/\xc3\xa9\xf0\x9f\x98\x80", credentials.getSecretKey());
+    EXPECT_EQ("TOKEN", credentials.getSessionToken());
+    EXPECT_EQ(1516267086, credentials.getExpiration().count());
+
+    // The field names are only looked up in the credentials object
+    ASSERT_TRUE(IotTokenBroker::parseCredentials(
+            "{\"message\": {\"accessKeyId\": \"WRONG\"}, \"note\": \"\\\"accessKeyId\\\": \\\"WRONG\\\"\", "
+            "\"credentials\": {\"accessKeyId\": \"AKID\", \"secretAccessKey\": \"SECRET\", \"sessionToken\": \"TOKEN\", "
+            "\"expiration\": \"2018-01-18T09:18:06Z\", \"nested\": {\"accessKeyId\": \"WRONG\"}}}",
+            credentials));
+    EXPECT_EQ("AKID", credentials.getAccessKey());
+}
+
+TEST(IotTokenBrokerParseTest, rejects_malformed_responses)
+{
+    Credentials credentials;
+    EXPECT_FALSE(IotTokenBroker::parseCredentials("", credentials));
+    EXPECT_FALSE(IotTokenBroker::parseCredentials("{\"message\": \"Access Denied\"}", credentials));
+    EXPECT_FALSE(IotTokenBroker::parseCredentials("{\"accessKeyId\": \"AKID\", \"secretAccessKey\": \"SECRET\", "
+                                                  "\"sessionToken\": \"TOKEN\", \"expiration\": \"2018-01-18T09:18:06Z\"}", credentials));
+    EXPECT_FALSE(IotTokenBroker::parseCredentials("{\"credentials\": {\"accessKeyId\": \"AKID\", \"secretAccessKey\": \"SECRET\", "
+                                                  "\"sessionToken\": \"TOKEN\", \"expiration\": \"2018-01-18T09:18:06Z\"}", credentials));
+    EXPECT_FALSE(IotTokenBroker::parseCredentials("{\"credentials\": {\"accessKeyId\": \"AK\\xID\", \"secretAccessKey\": \"SECRET\", "
+                                                  "\"sessionToken\": \"TOKEN\", \"expiration\": \"2018-01-18T09:18:06Z\"}}", credentials));
+    EXPECT_FALSE(IotTokenBroker::parseCredentials("{\"credentials\": {\"accessKeyId\": \"AKID\", \"secretAccessKey\": \"\\ud83d\", "
+                                                  "\"sessionToken\": \"TOKEN\", \"expiration\": \"2018-01-18T09:18:06Z\"}}", credentials));
+    EXPECT_FALSE(IotTokenBroker::parseCredentials("{\"credentials\": {\"accessKeyId\": \"AKID\", \"secretAccessKey\": \"SECRET\", "
+                                                  "\"sessionToken\": \"TOKEN\", \"expiration\": \"tomorrow\"}}", credentials));
+}
+
+TEST_F(IotTokenBrokerTest, concurrent_requests_share_a_call)
+{
+    IotTokenBroker broker;
+    endpoint_.setDelay(milliseconds(300));
+
+    vector<thread> threads;
+    vector<string> access_keys(16);
+    for (size_t i = 0; i < access_keys.size(); i++) {
+        threads.emplace_back([&, i]() {
+            access_keys[i] = broker.getCredentials(request("camera")).getAccessKey();
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(1, endpoint_.getRequestCount());
+    EXPECT_EQ(1, broker.getFetchCount());
+    for (auto& access_key : access_keys) {
+        EXPECT_EQ("camera-1", access_key);
+    }
+
+    // Served from the cache from then on
+    auto credentials = broker.getCredentials(request("camera"));
+    EXPECT_EQ("camera-1", credentials.getAccessKey());
+    EXPECT_EQ("secret", credentials.getSecretKey());
+    EXPECT_EQ("token", credentials.getSessionToken());
+    auto now_time = std::chrono::duration_cast<seconds>(systemCurrentTime().time_since_epoch());
+    EXPECT_NEAR((double) (now_time.count() + 3600), (double) credentials.getExpiration().count(), 5.0);
+    EXPECT_EQ(1, endpoint_.getRequestCount());
+}
+
+TEST_F(IotTokenBrokerTest, tokens_near_expiry_are_fetched_again)
+{
+    endpoint_.setLifetime(seconds(10 * 60));
+    IotTokenBroker broker(seconds(5 * 60));
+    broker.getCredentials(request("camera"));
+    broker.getCredentials(request("camera"));
+    EXPECT_EQ(1, endpoint_.getRequestCount());
+
+    IotTokenBroker impatient_broker(seconds(15 * 60));
+    EXPECT_EQ("camera-2", impatient_broker.getCredentials(request("camera")).getAccessKey());
+    EXPECT_EQ("camera-3", impatient_broker.getCredentials(request("camera")).getAccessKey());
+    EXPECT_EQ(3, endpoint_.getRequestCount());
+}
+
+TEST_F(IotTokenBrokerTest, things_are_cached_separately_over_one_connection)
+{
+    IotTokenBroker broker;
+    EXPECT_EQ("camera1-1", broker.getCredentials(request("camera1")).getAccessKey());
+    EXPECT_EQ("camera2-2", broker.getCredentials(request("camera2")).getAccessKey());
+    EXPECT_EQ("camera1-1", broker.getCredentials(request("camera1")).getAccessKey());
+
+    auto requests = endpoint_.getRequests();
+    ASSERT_EQ(2, requests.size());
+    EXPECT_EQ("/role-aliases/" TEST_IOT_ROLE_ALIAS "/credentials camera1", requests[0]);
+    EXPECT_EQ("/role-aliases/" TEST_IOT_ROLE_ALIAS "/credentials camera2", requests[1]);
+    EXPECT_EQ(1, endpoint_.getConnectionCount());
+}
+
+TEST_F(IotTokenBrokerTest, failed_calls_are_not_cached)
+{
+    IotTokenBroker broker;
+    endpoint_.setStatus(403);
+    EXPECT_THROW(broker.getCredentials(request("camera")), std::runtime_error);
+
+    endpoint_.setStatus(200);
+    EXPECT_EQ("camera-2", broker.getCredentials(request("camera")).getAccessKey());
+    EXPECT_EQ(2, endpoint_.getRequestCount());
+}
+
+TEST_F(IotTokenBrokerTest, providers_of_many_streams_share_the_token)
+{
+    // The process-wide broker outlives the test, the thing name keeps its cache entry to this test
+    string thing_name = "gateway-" + to_string(time(nullptr));
+    vector<unique_ptr<IotCertCredentialProvider>> providers;
+    for (int i = 0; i < 8; i++) {
+        providers.emplace_back(new IotCertCredentialProvider(endpoint_.getEndpoint(), cert_path_, key_path_,
+                                                             TEST_IOT_ROLE_ALIAS, cert_path_, thing_name));
+    }
+
+    for (auto& provider : providers) {
+        auto snapshot = provider->getCredentialsSnapshot();
+        EXPECT_EQ(thing_name + "-1", snapshot->getCredentials().getAccessKey());
+    }
+
+    EXPECT_EQ(1, endpoint_.getRequestCount());
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,255 @@
+#include "ProducerTestFixture.h"
+#include "NalAdapter.h"
+
+#include <random>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+
+class NalAdapterTest : public ::testing::Test {
+protected:
+    static vector<uint8_t> avcc(const vector<vector<uint8_t>>& nals) {
+        vector<uint8_t> data;
+        for (auto& nal : nals) {
+            data.push_back((uint8_t) (nal.size() >> 24));
+            data.push_back((uint8_t) (nal.size() >> 16));
+            data.push_back((uint8_t) (nal.size() >> 8));
+            data.push_back((uint8_t) nal.size());
+            data.insert(data.end(), nal.begin(), nal.end());
+        }
+
+        return data;
+    }
+
+    static vector<uint8_t> adapt(const vector<uint8_t>& annexb) {
+        vector<uint8_t> data(NalAdapter::maxAvccSize(annexb.size()));
+        data.resize(NalAdapter::annexBToAvcc(annexb.data(), annexb.size(), data.data(), data.size()));
+        return data;
+    }
+
+    /**
+     * Writes the bits of a synthetic parameter set, MSB first.
+     */
+    class BitWriter {
+    public:
+        void writeBits(uint32_t value, uint32_t count) {
+            for (int32_t i = count - 1; i >= 0; i--) {
+                if (bit_count_ % 8 == 0) {
+                    bytes_.push_back(0);
+                }
+
+                bytes_.back() |= ((value >> i) & 1) << (7 - bit_count_ % 8);
+                bit_count_++;
+            }
+        }
+
+        void writeUnsignedExpGolomb(uint32_t value) {
+            uint32_t bits = 0;
+            while (((uint64_t) value + 1) >> (bits + 1) != 0) {
+                bits++;
+            }
+
+            writeBits(0, bits);
+            writeBits(value + 1, bits + 1);
+        }
+
+        vector<uint8_t> rbspWithTrailingBits() {
+            writeBits(1, 1);
+            while (bit_count_ % 8 != 0) {
+                writeBits(0, 1);
+            }
+
+            return bytes_;
+        }
+
+    private:
+        vector<uint8_t> bytes_;
+        uint32_t bit_count_ = 0;
+    };
+
+    static vector<uint8_t> addEmulationPrevention(const vector<uint8_t>& rbsp) {
+        vector<uint8_t> nal;
+        uint32_t zero_count = 0;
+        for (auto byte : rbsp) {
+            if (zero_count >= 2 && byte <= 3) {
+                nal.push_back(3);
+                zero_count = 0;
+            }
+
+            nal.push_back(byte);
+            zero_count = byte == 0 ? zero_count + 1 : 0;
+        }
+
+        return nal;
+    }
+};
+
+TEST_F(NalAdapterTest, start_code_scan_matches_byte_by_byte_scan)
+{
+    mt19937 generator(42);
+    uniform_int_distribution<int> distribution(0, 3);
+
+    // Sparse alphabet so that the start codes land on every offset of the vector blocks and the tail
+    vector<uint8_t> data(4099);
+    for (auto& byte : data) {
+        byte = (uint8_t) distribution(generator);
+    }
+
+    for (size_t begin = 0; begin < 40; begin++) {
+        const uint8_t* end = data.data() + data.size();
+        const uint8_t* current = data.data() + begin;
+        while (current != end) {
+            const uint8_t* expected = current;
+            while (end - expected >= 3 && !(expected[0] == 0 && expected[1] == 0 && expected[2] == 1)) {
+                expected++;
+            }
+            if (end - expected < 3) {
+                expected = end;
+            }
+
+            const uint8_t* found = NalAdapter::findStartCode(current, end);
+            ASSERT_EQ(expected - data.data(), found - data.data());
+            current = found == end ? end : found + 1;
+        }
+    }
+
+    // No start code at all, with a 00 00 at the very end
+    vector<uint8_t> no_start_code(100, 0xff);
+    no_start_code[98] = no_start_code[99] = 0;
+    EXPECT_EQ(no_start_code.data() + no_start_code.size(),
+              NalAdapter::findStartCode(no_start_code.data(), no_start_code.data() + no_start_code.size()));
+}
+
+TEST_F(NalAdapterTest, annexb_is_adapted_to_avcc)
+{
+    vector<uint8_t> annexb = {
+            0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x00, 0x1e,
+            0x00, 0x00, 0x01, 0x68, 0xce,
+            // Empty NAL and trailing zeros
+            0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x00, 0x00, 0x03, 0x01, 0x00, 0x00
+    };
+
+    EXPECT_EQ(avcc({{0x67, 0x42, 0x00, 0x1e}, {0x68, 0xce}, {0x65, 0x88, 0x00, 0x00, 0x03, 0x01}}), adapt(annexb));
+
+    // Single large NAL spanning many vector blocks
+    vector<uint8_t> slice(100000, 0xab);
+    slice[0] = 0x65;
+    vector<uint8_t> large = {0x00, 0x00, 0x01};
+    large.insert(large.end(), slice.begin(), slice.end());
+    EXPECT_EQ(avcc({slice}), adapt(large));
+}
+
+TEST_F(NalAdapterTest, non_annexb_and_short_output_fail)
+{
+    vector<uint8_t> not_annexb = {0x00, 0x00, 0x00, 0x04, 0x67, 0x42, 0x00, 0x1e};
+    EXPECT_FALSE(NalAdapter::isAnnexB(not_annexb.data(), not_annexb.size()));
+    EXPECT_TRUE(adapt(not_annexb).empty());
+
+    vector<uint8_t> annexb = {0x00, 0x00, 0x01, 0x67, 0x42, 0x00, 0x1e};
+    vector<uint8_t> output(annexb.size() + 1);
+    EXPECT_EQ(0, NalAdapter::annexBToAvcc(annexb.data(), annexb.size(), output.data(), 7));
+    EXPECT_EQ(8, NalAdapter::annexBToAvcc(annexb.data(), annexb.size(), output.data(), 8));
+
+    // Worst case growth fits the max size
+    vector<uint8_t> single_byte_nals;
+    for (uint32_t i = 0; i < 100; i++) {
+        single_byte_nals.insert(single_byte_nals.end(), {0x00, 0x00, 0x01, 0x09});
+    }
+    EXPECT_EQ(500, adapt(single_byte_nals).size());
+}
+
+TEST_F(NalAdapterTest, h264_cpd_from_parameter_sets)
+{
+    vector<uint8_t> sps = {0x67, 0x42, 0x00, 0x1e, 0x95, 0xa8, 0x28, 0x0f, 0x64};
+    vector<uint8_t> pps = {0x68, 0xce, 0x3c, 0x80};
+    vector<uint8_t> idr = {0x65, 0x88, 0x84};
+    vector<uint8_t> cpd;
+
+    ASSERT_TRUE(NalAdapter::buildH264Cpd(avcc({sps, pps, idr}).data(), avcc({sps, pps, idr}).size(), cpd));
+
+    vector<uint8_t> expected = {0x01, 0x42, 0x00, 0x1e, 0xff, 0xe1, 0x00, 0x09};
+    expected.insert(expected.end(), sps.begin(), sps.end());
+    expected.insert(expected.end(), {0x01, 0x00, 0x04});
+    expected.insert(expected.end(), pps.begin(), pps.end());
+    EXPECT_EQ(expected, cpd);
+
+    // Delta frames carry no parameter sets
+    EXPECT_FALSE(NalAdapter::buildH264Cpd(avcc({{0x41, 0x9a}}).data(), avcc({{0x41, 0x9a}}).size(), cpd));
+}
+
+TEST_F(NalAdapterTest, h264_cpd_ignores_parameter_set_order_and_repeats)
+{
+    vector<uint8_t> sps = {0x67, 0x42, 0x00, 0x1e, 0x95, 0xa8, 0x28, 0x0f, 0x64};
+    vector<uint8_t> first_pps = {0x68, 0xce, 0x3c, 0x80};
+    vector<uint8_t> second_pps = {0x68, 0xce, 0x06, 0xe2};
+    vector<uint8_t> idr = {0x65, 0x88, 0x84};
+    vector<uint8_t> cpd, resent_cpd;
+
+    vector<uint8_t> access_unit = avcc({sps, first_pps, second_pps, idr});
+    ASSERT_TRUE(NalAdapter::buildH264Cpd(access_unit.data(), access_unit.size(), cpd));
+    access_unit = avcc({second_pps, sps, first_pps, sps, second_pps, idr});
+    ASSERT_TRUE(NalAdapter::buildH264Cpd(access_unit.data(), access_unit.size(), resent_cpd));
+    EXPECT_EQ(cpd, resent_cpd);
+
+    // One SPS and two PPS
+    EXPECT_EQ(0xe1, cpd[5]);
+    EXPECT_EQ(2, cpd[6 + 2 + sps.size()]);
+}
+
+TEST_F(NalAdapterTest, h265_cpd_from_parameter_sets)
+{
+    // Main profile level 4.1 with the constraint flags making the emulation prevention kick in
+    vector<uint8_t> profile_tier_level = {0x01, 0x60, 0x00, 0x00, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7b};
+
+    BitWriter writer;
+    // NAL header, VPS id 0, single sub-layer, temporal id nesting
+    writer.writeBits(0x4201, 16);
+    writer.writeBits(0x01, 8);
+    for (auto byte : profile_tier_level) {
+        writer.writeBits(byte, 8);
+    }
+    writer.writeUnsignedExpGolomb(0);
+    // 4:2:0, 1920x1080 with a conformance window, 10 bit luma and 8 bit chroma
+    writer.writeUnsignedExpGolomb(1);
+    writer.writeUnsignedExpGolomb(1920);
+    writer.writeUnsignedExpGolomb(1088);
+    writer.writeBits(1, 1);
+    writer.writeUnsignedExpGolomb(0);
+    writer.writeUnsignedExpGolomb(0);
+    writer.writeUnsignedExpGolomb(0);
+    writer.writeUnsignedExpGolomb(4);
+    writer.writeUnsignedExpGolomb(2);
+    writer.writeUnsignedExpGolomb(0);
+    vector<uint8_t> rbsp = writer.rbspWithTrailingBits();
+    vector<uint8_t> sps = addEmulationPrevention(rbsp);
+    ASSERT_NE(rbsp.size(), sps.size());
+
+    vector<uint8_t> vps = {0x40, 0x01, 0x0c, 0x01, 0xff, 0xff};
+    vector<uint8_t> pps = {0x44, 0x01, 0xc1, 0x72, 0xb4, 0x62, 0x40};
+    vector<uint8_t> idr = {0x26, 0x01, 0xaf};
+    vector<uint8_t> access_unit = avcc({vps, sps, pps, idr});
+    vector<uint8_t> cpd;
+
+    ASSERT_TRUE(NalAdapter::buildH265Cpd(access_unit.data(), access_unit.size(), cpd));
+
+    vector<uint8_t> expected = {0x01};
+    expected.insert(expected.end(), profile_tier_level.begin(), profile_tier_level.end());
+    expected.insert(expected.end(), {0xf0, 0x00, 0xfc, 0xfd, 0xfa, 0xf8, 0x00, 0x00, 0x0f, 0x03});
+    for (auto nal : {vps, sps, pps}) {
+        expected.push_back((uint8_t) (0x80 | ((nal[0] >> 1) & 0x3f)));
+        expected.insert(expected.end(), {0x00, 0x01, 0x00, (uint8_t) nal.size()});
+        expected.insert(expected.end(), nal.begin(), nal.end());
+    }
+    EXPECT_EQ(expected, cpd);
+
+    // Missing VPS
+    access_unit = avcc({sps, pps, idr});
+    EXPECT_FALSE(NalAdapter::buildH265Cpd(access_unit.data(), access_unit.size(), cpd));
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
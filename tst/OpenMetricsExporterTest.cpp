@@ -0,0 +1,118 @@
+#include "ProducerTestFixture.h"
+#include "OpenMetricsExporter.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define CLOSE_SOCKET closesocket
+typedef SOCKET socket_t;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define CLOSE_SOCKET close
+typedef int socket_t;
+#endif
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using namespace std::chrono;
+
+class OpenMetricsExporterTest : public ::testing::Test {
+protected:
+    MetricsSample sample() {
+        MetricsSample metrics_sample;
+        auto raw_client_metrics = const_cast<PClientMetrics>(metrics_sample.client_metrics.getRawMetrics());
+        raw_client_metrics->contentStoreSize = 1024;
+        raw_client_metrics->contentStoreAvailableSize = 256;
+
+        KinesisVideoStreamMetrics stream_metrics;
+        auto raw_stream_metrics = const_cast<PStreamMetrics>(stream_metrics.getRawMetrics());
+        raw_stream_metrics->currentViewSize = 4096;
+        raw_stream_metrics->currentViewDuration = 2 * HUNDREDS_OF_NANOS_IN_A_SECOND;
+        StreamCountersSnapshot counters;
+        counters.frames_put = 100;
+        counters.dropped_frames = 3;
+        counters.frames_shed[FRAME_SHED_REASON_GOP_TAIL] = 7;
+        stream_metrics.setCounters(counters);
+
+        FragmentAckLatencies latencies;
+        latencies.persisted.count = 10;
+        latencies.persisted.sum = milliseconds(4000);
+        latencies.persisted.p50 = milliseconds(250);
+        latencies.persisted.max = milliseconds(1500);
+        stream_metrics.setFragmentAckLatencies(latencies);
+
+        metrics_sample.stream_metrics.emplace_back("front \"door\"", stream_metrics);
+        return metrics_sample;
+    }
+
+    // The exporter has already initialized Winsock when it started its endpoint
+    string scrape(uint16_t port, const string& path) {
+        socket_t client = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        EXPECT_EQ(0, connect(client, (struct sockaddr*) &address, sizeof(address)));
+
+        string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        EXPECT_EQ((int) request.size(), (int) send(client, request.data(), (int) request.size(), 0));
+
+        string response;
+        char buffer[1024];
+        int received;
+        while ((received = (int) recv(client, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, received);
+        }
+
+        CLOSE_SOCKET(client);
+        return response;
+    }
+};
+
+TEST_F(OpenMetricsExporterTest, renders_client_and_stream_metrics)
+{
+    EXPECT_EQ(0, OpenMetricsExporter().getPort());
+
+    ostringstream out;
+    OpenMetricsExporter::render(sample(), out);
+    string text = out.str();
+
+    EXPECT_NE(string::npos, text.find("# TYPE kvs_producer_content_store_size_bytes gauge\n"));
+    EXPECT_NE(string::npos, text.find("kvs_producer_content_store_size_bytes 1024\n"));
+    EXPECT_NE(string::npos, text.find("kvs_producer_content_store_available_bytes 256\n"));
+    EXPECT_NE(string::npos, text.find("kvs_stream_current_view_size_bytes{stream=\"front \\\"door\\\"\"} 4096\n"));
+    EXPECT_NE(string::npos, text.find("kvs_stream_current_view_duration_seconds{stream=\"front \\\"door\\\"\"} 2\n"));
+    EXPECT_NE(string::npos, text.find("kvs_stream_frames_put_total{stream=\"front \\\"door\\\"\"} 100\n"));
+    EXPECT_NE(string::npos, text.find("kvs_stream_dropped_frames_total{stream=\"front \\\"door\\\"\"} 3\n"));
+    EXPECT_NE(string::npos, text.find("kvs_stream_frames_shed_total{stream=\"front \\\"door\\\"\",reason=\"gop_tail\"} 7\n"));
+    EXPECT_NE(string::npos, text.find("kvs_stream_fragment_ack_latency_seconds{stream=\"front \\\"door\\\"\",ack=\"persisted\",quantile=\"0.5\"} 0.25\n"));
+    EXPECT_NE(string::npos, text.find("kvs_stream_fragment_ack_latency_seconds_sum{stream=\"front \\\"door\\\"\",ack=\"persisted\"} 4\n"));
+    EXPECT_NE(string::npos, text.find("kvs_stream_fragment_ack_latency_seconds_count{stream=\"front \\\"door\\\"\",ack=\"persisted\"} 10\n"));
+    EXPECT_NE(string::npos, text.find("kvs_stream_fragment_ack_latency_max_seconds{stream=\"front \\\"door\\\"\",ack=\"persisted\"} 1.5\n"));
+}
+
+TEST_F(OpenMetricsExporterTest, serves_latest_sample)
+{
+    OpenMetricsExporter exporter(0);
+    uint16_t port = exporter.getPort();
+    ASSERT_NE(0, port);
+    EXPECT_NE(string::npos, scrape(port, "/metrics").find("HTTP/1.1 200 OK\r\n"));
+
+    exporter.exportMetrics(sample());
+    string response = scrape(port, "/metrics");
+    EXPECT_NE(string::npos, response.find("Content-Type: text/plain; version=0.0.4"));
+    EXPECT_NE(string::npos, response.find("\r\n\r\n" + exporter.getMetricsText()));
+    EXPECT_NE(string::npos, response.find("kvs_producer_content_store_size_bytes 1024\n"));
+
+    EXPECT_NE(string::npos, scrape(port, "/other").find("HTTP/1.1 404 Not Found\r\n"));
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -212,6 +212,51 @@ TEST_F(ProducerApiTest, create_free_stream)
     // The destructor should clear the streams again.
 }
 
+TEST_F(ProducerApiTest, create_streams_concurrently)
+{
+    // Check if it's run with the env vars set if not bail out
+    if (!access_key_set_) {
+        LOG_WARN("Creds not set");
+        return;
+    }
+
+    CreateProducer();
+
+    // Serial bring-up as the baseline
+    auto start_time = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < TEST_STREAM_COUNT; i++) {
+        streams_[i] = CreateTestStream(i);
+    }
+    auto serial_duration = std::chrono::steady_clock::now() - start_time;
+
+    kinesis_video_producer_->freeStreams();
+
+    std::vector<std::unique_ptr<StreamDefinition>> stream_definitions;
+    for (uint32_t i = 0; i < TEST_STREAM_COUNT; i++) {
+        stream_definitions.push_back(CreateTestStreamDefinition(i));
+    }
+
+    start_time = std::chrono::steady_clock::now();
+    auto futures = kinesis_video_producer_->createStreams(std::move(stream_definitions));
+    EXPECT_EQ(TEST_STREAM_COUNT, futures.size());
+    for (uint32_t i = 0; i < futures.size(); i++) {
+        streams_[i] = futures[i].get();
+        EXPECT_NE(nullptr, streams_[i]);
+    }
+    auto concurrent_duration = std::chrono::steady_clock::now() - start_time;
+
+    LOG_INFO("Brought up " << TEST_STREAM_COUNT << " streams serially in "
+             << std::chrono::duration_cast<std::chrono::milliseconds>(serial_duration).count() << "ms, concurrently in "
+             << std::chrono::duration_cast<std::chrono::milliseconds>(concurrent_duration).count() << "ms");
+
+    kinesis_video_producer_->freeStreams();
+
+    // Single stream flavor
+    auto future = kinesis_video_producer_->createStreamAsync(CreateTestStreamDefinition(0));
+    streams_[0] = future.get();
+    EXPECT_NE(nullptr, streams_[0]);
+}
+
 TEST_F(ProducerApiTest, DISABLED_create_produce_offline_stream)
 {
     // Check if it's run with the env vars set if not bail out
@@ -11,6 +11,7 @@
 #include "StreamDefinition.h"
 #include "CachingEndpointOnlyCallbackProvider.h"
 #include "Logger.h"
+#include "TestTempDirectory.h"
 
 #include <atomic>
 #include <map>
@@ -368,10 +369,10 @@ protected:
         }
     };
 
-    std::shared_ptr<KinesisVideoStream> CreateTestStream(int index,
-                                                    STREAMING_TYPE streaming_type = STREAMING_TYPE_REALTIME,
-                                                    uint32_t max_stream_latency_ms = TEST_MAX_STREAM_LATENCY_IN_MILLIS,
-                                                    int buffer_duration_seconds = 120) {
+    std::unique_ptr<StreamDefinition> CreateTestStreamDefinition(int index,
+                                                                 STREAMING_TYPE streaming_type = STREAMING_TYPE_REALTIME,
+                                                                 uint32_t max_stream_latency_ms = TEST_MAX_STREAM_LATENCY_IN_MILLIS,
+                                                                 int buffer_duration_seconds = 120) {
         char stream_name[MAX_STREAM_NAME_LEN];
         snprintf(stream_name, MAX_STREAM_NAME_LEN, "ScaryTestStream_%d", index);
         std::map<std::string, std::string> tags;
@@ -406,7 +407,15 @@ protected:
             std::chrono::seconds(buffer_duration_seconds),
             std::chrono::seconds(buffer_duration_seconds),
             std::chrono::seconds(50)));
-        return kinesis_video_producer_->createStreamSync(std::move(stream_definition));
+        return stream_definition;
+    };
+
+    std::shared_ptr<KinesisVideoStream> CreateTestStream(int index,
+                                                    STREAMING_TYPE streaming_type = STREAMING_TYPE_REALTIME,
+                                                    uint32_t max_stream_latency_ms = TEST_MAX_STREAM_LATENCY_IN_MILLIS,
+                                                    int buffer_duration_seconds = 120) {
+        return kinesis_video_producer_->createStreamSync(
+                CreateTestStreamDefinition(index, streaming_type, max_stream_latency_ms, buffer_duration_seconds));
     };
 
     virtual void SetUp() {
@@ -0,0 +1,196 @@
+#include "ProducerTestFixture.h"
+#include "RotatingCredentialProvider.h"
+#include "CredentialFileWatcher.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+#define TEST_ROTATING_STREAM_COUNT                          256
+#define TEST_ROTATING_ROTATION_COUNT                        20
+#define TEST_ROTATING_WAIT_SECONDS                          10
+
+class RotatingCredentialProviderTest : public ::testing::Test {
+protected:
+    void SetUp() {
+        directory_ = createTestTempDirectory("kvs_rotating_test_");
+        ASSERT_FALSE(directory_.empty());
+        path_ = directory_ + "/credentials";
+        temp_path_ = path_ + ".tmp";
+    }
+
+    void TearDown() {
+        remove(path_.c_str());
+        remove(temp_path_.c_str());
+        remove((directory_ + "/late/credentials").c_str());
+        removeTestDirectory(directory_ + "/late");
+        removeTestDirectory(directory_);
+    }
+
+    // Replaces the file the way the authentication modules do, written aside and renamed over
+    void writeCredentials(uint32_t version) {
+        {
+            ofstream file(temp_path_);
+            file << "CREDENTIALS AccessKey" << version << " 2100-01-01T00:00:00Z SecretKey" << version
+                 << " SessionToken" << version << endl;
+        }
+
+        ASSERT_EQ(0, rename(temp_path_.c_str(), path_.c_str()));
+    }
+
+    static uint32_t versionOf(const Credentials& credentials) {
+        return (uint32_t) stoul(credentials.getAccessKey().substr(strlen("AccessKey")));
+    }
+
+    string directory_;
+    string path_;
+    string temp_path_;
+};
+
+TEST_F(RotatingCredentialProviderTest, parses_credential_files)
+{
+    Credentials credentials;
+    ASSERT_TRUE(CredentialFileWatcher::parse("CREDENTIALS AKID SECRET\n", credentials));
+    EXPECT_EQ("AKID", credentials.getAccessKey());
+    EXPECT_EQ("SECRET", credentials.getSecretKey());
+    EXPECT_EQ("", credentials.getSessionToken());
+    EXPECT_EQ(MAX_UINT64, credentials.getExpiration().count());
+
+    ASSERT_TRUE(CredentialFileWatcher::parse("CREDENTIALS AKID 2018-01-18T09:18:06Z SECRET TOKEN", credentials));
+    EXPECT_EQ("SECRET", credentials.getSecretKey());
+    EXPECT_EQ("TOKEN", credentials.getSessionToken());
+    EXPECT_EQ(1516267086, credentials.getExpiration().count());
+
+    EXPECT_FALSE(CredentialFileWatcher::parse("", credentials));
+    EXPECT_FALSE(CredentialFileWatcher::parse("CREDENTIALS AKID", credentials));
+    EXPECT_FALSE(CredentialFileWatcher::parse("KEYS AKID SECRET", credentials));
+    EXPECT_FALSE(CredentialFileWatcher::parse("CREDENTIALS AKID yesterday SECRET TOKEN", credentials));
+}
+
+TEST_F(RotatingCredentialProviderTest, keeps_last_credentials_when_file_goes_bad)
+{
+    writeCredentials(1);
+    RotatingCredentialProvider provider(path_);
+    EXPECT_EQ("AccessKey1", provider.getCredentialsSnapshot()->getCredentials().getAccessKey());
+
+    {
+        ofstream file(temp_path_);
+        file << "garbage" << endl;
+    }
+
+    ASSERT_EQ(0, rename(temp_path_.c_str(), path_.c_str()));
+    this_thread::sleep_for(milliseconds(200));
+    EXPECT_EQ("AccessKey1", provider.getCredentialsSnapshot()->getCredentials().getAccessKey());
+
+    writeCredentials(2);
+    auto deadline = chrono::steady_clock::now() + seconds(TEST_ROTATING_WAIT_SECONDS);
+    while ("AccessKey2" != provider.getCredentialsSnapshot()->getCredentials().getAccessKey()
+           && chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(milliseconds(10));
+    }
+
+    EXPECT_EQ("AccessKey2", provider.getCredentialsSnapshot()->getCredentials().getAccessKey());
+}
+
+TEST_F(RotatingCredentialProviderTest, unwatched_files_are_checked_on_reads)
+{
+    // The directory doesn't exist yet so it can't be watched
+    string late_directory = directory_ + "/late";
+    string late_path = late_directory + "/credentials";
+    auto& watcher = CredentialFileWatcher::getInstance();
+    auto subscription = watcher.subscribe(late_path, []() {});
+    EXPECT_FALSE(watcher.get(late_path).valid);
+
+    ASSERT_TRUE(createTestDirectory(late_directory));
+    {
+        ofstream file(late_path);
+        file << "CREDENTIALS AccessKey1 SecretKey1" << endl;
+    }
+
+    auto credential_file = watcher.get(late_path);
+    EXPECT_TRUE(credential_file.valid);
+    EXPECT_EQ("AccessKey1", credential_file.credentials.getAccessKey());
+    watcher.unsubscribe(subscription);
+}
+
+TEST_F(RotatingCredentialProviderTest, hundreds_of_streams_rotate_at_once)
+{
+    writeCredentials(0);
+    auto& watcher = CredentialFileWatcher::getInstance();
+    auto start_parse_count = watcher.getParseCount();
+
+    vector<unique_ptr<RotatingCredentialProvider>> providers;
+    for (uint32_t i = 0; i < TEST_ROTATING_STREAM_COUNT; i++) {
+        providers.emplace_back(new RotatingCredentialProvider(path_));
+    }
+
+    // A token fetching thread per stream checks that every snapshot is whole and never goes back
+    atomic<bool> stop(false);
+    atomic<uint32_t> torn_count(0);
+    atomic<uint32_t> regression_count(0);
+    atomic<uint64_t> fetch_count(0);
+    vector<thread> streams;
+    for (auto& provider : providers) {
+        streams.emplace_back([&, this](RotatingCredentialProvider* stream_provider) {
+            uint32_t last_version = 0;
+            while (!stop) {
+                auto snapshot = stream_provider->getCredentialsSnapshot();
+                auto& credentials = snapshot->getCredentials();
+                uint32_t version = versionOf(credentials);
+                if (credentials.getSecretKey() != "SecretKey" + to_string(version)
+                    || credentials.getSessionToken() != "SessionToken" + to_string(version)
+                    || STATUS_FAILED(snapshot->getStatus())) {
+                    torn_count++;
+                }
+
+                if (version < last_version) {
+                    regression_count++;
+                }
+
+                last_version = version;
+                fetch_count++;
+                this_thread::yield();
+            }
+        }, provider.get());
+    }
+
+    for (uint32_t version = 1; version <= TEST_ROTATING_ROTATION_COUNT; version++) {
+        writeCredentials(version);
+        this_thread::sleep_for(milliseconds(20));
+    }
+
+    auto deadline = chrono::steady_clock::now() + seconds(TEST_ROTATING_WAIT_SECONDS);
+    for (auto& provider : providers) {
+        while (TEST_ROTATING_ROTATION_COUNT != versionOf(provider->getCredentialsSnapshot()->getCredentials())
+               && chrono::steady_clock::now() < deadline) {
+            this_thread::sleep_for(milliseconds(10));
+        }
+
+        EXPECT_EQ(TEST_ROTATING_ROTATION_COUNT, versionOf(provider->getCredentialsSnapshot()->getCredentials()));
+    }
+
+    stop = true;
+    for (auto& stream : streams) {
+        stream.join();
+    }
+
+    EXPECT_EQ(0, torn_count.load());
+    EXPECT_EQ(0, regression_count.load());
+
+    // Parsed once per version of the file however many streams fetch their tokens
+    EXPECT_GT(fetch_count.load(), (uint64_t) TEST_ROTATING_STREAM_COUNT * TEST_ROTATING_ROTATION_COUNT);
+    EXPECT_LE(watcher.getParseCount() - start_parse_count, TEST_ROTATING_ROTATION_COUNT + 1);
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,110 @@
+#include "ProducerTestFixture.h"
+#include "SnapshotBuffer.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+
+#define TEST_SNAPSHOT_READER_COUNT                          4
+#define TEST_SNAPSHOT_PUBLISH_COUNT                         100000
+#define TEST_SNAPSHOT_VALUE_WORDS                           16
+
+/**
+ * Value spanning several words which would show a torn copy as mismatching words
+ */
+struct TestSnapshotValue {
+    uint64_t words[TEST_SNAPSHOT_VALUE_WORDS];
+
+    void fill(uint64_t value) {
+        for (auto& word : words) {
+            word = value;
+        }
+    }
+};
+
+TEST(SnapshotBufferTest, read_fails_until_published)
+{
+    SnapshotBuffer<uint64_t> buffer;
+    uint64_t value = 7;
+    EXPECT_FALSE(buffer.read(value));
+    EXPECT_EQ(7, value);
+
+    buffer.publish(1);
+    ASSERT_TRUE(buffer.read(value));
+    EXPECT_EQ(1, value);
+}
+
+TEST(SnapshotBufferTest, read_returns_the_latest_published_value)
+{
+    SnapshotBuffer<uint64_t> buffer;
+    uint64_t value = 0;
+    for (uint64_t i = 1; i <= 5; i++) {
+        buffer.publish(i);
+        ASSERT_TRUE(buffer.read(value));
+        EXPECT_EQ(i, value);
+
+        // Reading doesn't consume the value
+        ASSERT_TRUE(buffer.read(value));
+        EXPECT_EQ(i, value);
+    }
+}
+
+TEST(SnapshotBufferTest, concurrent_readers_never_see_torn_or_older_values)
+{
+    SnapshotBuffer<TestSnapshotValue> buffer;
+    atomic<bool> done(false);
+    atomic<uint64_t> torn_count(0);
+    atomic<uint64_t> backwards_count(0);
+
+    vector<thread> readers;
+    for (uint32_t i = 0; i < TEST_SNAPSHOT_READER_COUNT; i++) {
+        readers.emplace_back([&]() {
+            TestSnapshotValue value;
+            uint64_t last = 0;
+            while (!done.load()) {
+                if (!buffer.read(value)) {
+                    continue;
+                }
+
+                for (auto word : value.words) {
+                    if (word != value.words[0]) {
+                        torn_count++;
+                        break;
+                    }
+                }
+
+                if (value.words[0] < last) {
+                    backwards_count++;
+                }
+
+                last = value.words[0];
+            }
+        });
+    }
+
+    TestSnapshotValue value;
+    for (uint64_t i = 1; i <= TEST_SNAPSHOT_PUBLISH_COUNT; i++) {
+        value.fill(i);
+        buffer.publish(value);
+    }
+
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    EXPECT_EQ(0, torn_count.load());
+    EXPECT_EQ(0, backwards_count.load());
+
+    ASSERT_TRUE(buffer.read(value));
+    EXPECT_EQ(TEST_SNAPSHOT_PUBLISH_COUNT, value.words[0]);
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
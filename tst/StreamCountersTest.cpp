@@ -0,0 +1,108 @@
+#include "ProducerTestFixture.h"
+#include "StreamCounters.h"
+
+#include <thread>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+
+#define TEST_COUNTER_THREAD_COUNT                           8
+#define TEST_COUNTER_ITERATIONS                             10000
+
+class StreamCountersTest : public ::testing::Test {
+protected:
+    static Frame frame(uint32_t size, bool key_frame) {
+        Frame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.size = size;
+        frame.flags = key_frame ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+        return frame;
+    }
+
+    static uint64_t failureCount(const StreamCountersSnapshot& snapshot, STATUS status) {
+        for (auto& failure : snapshot.put_frame_failures_by_status) {
+            if (failure.status == status) {
+                return failure.count;
+            }
+        }
+
+        return 0;
+    }
+
+    StreamCounters counters_;
+};
+
+TEST_F(StreamCountersTest, counters_are_kept_apart_by_cache_lines)
+{
+    EXPECT_GE(sizeof(StreamCounters), 4 * STREAM_COUNTERS_CACHE_LINE_SIZE);
+}
+
+TEST_F(StreamCountersTest, frames_and_drops_counted)
+{
+    counters_.framePut(frame(1000, true));
+    counters_.framePut(frame(200, false));
+    counters_.framePut(frame(300, false));
+    counters_.frameDropped();
+    counters_.fragmentDropped();
+    counters_.fragmentDropped();
+    counters_.frameShed(frame(50, false), FRAME_SHED_REASON_DISPOSABLE);
+    counters_.frameShed(frame(70, false), FRAME_SHED_REASON_GOP_TAIL);
+    counters_.frameShed(frame(30, false), FRAME_SHED_REASON_DISPOSABLE);
+
+    auto snapshot = counters_.snapshot();
+    EXPECT_EQ(3, snapshot.frames_put);
+    EXPECT_EQ(1500, snapshot.bytes_put);
+    EXPECT_EQ(1, snapshot.key_frames_put);
+    EXPECT_EQ(0, snapshot.put_frame_failures);
+    EXPECT_EQ(1, snapshot.dropped_frames);
+    EXPECT_EQ(2, snapshot.dropped_fragments);
+    EXPECT_EQ(2, snapshot.frames_shed[FRAME_SHED_REASON_DISPOSABLE]);
+    EXPECT_EQ(1, snapshot.frames_shed[FRAME_SHED_REASON_GOP_TAIL]);
+    EXPECT_EQ(0, snapshot.frames_shed[FRAME_SHED_REASON_GOP]);
+    EXPECT_EQ(150, snapshot.bytes_shed);
+}
+
+TEST_F(StreamCountersTest, failures_counted_by_status_across_threads)
+{
+    vector<thread> threads;
+    for (uint32_t i = 0; i < TEST_COUNTER_THREAD_COUNT; i++) {
+        threads.push_back(thread([this, i]() {
+            for (uint32_t j = 0; j < TEST_COUNTER_ITERATIONS; j++) {
+                // More distinct statuses than slots
+                counters_.putFrameFailed(STATUS_INVALID_ARG + (j + i) % (STREAM_COUNTERS_MAX_FAILURE_STATUSES + 2));
+                counters_.framePut(frame(10, false));
+            }
+        }));
+    }
+
+    for (auto& worker : threads) {
+        worker.join();
+    }
+
+    auto snapshot = counters_.snapshot();
+    EXPECT_EQ(TEST_COUNTER_THREAD_COUNT * TEST_COUNTER_ITERATIONS, snapshot.frames_put);
+    EXPECT_EQ(TEST_COUNTER_THREAD_COUNT * TEST_COUNTER_ITERATIONS * 10, snapshot.bytes_put);
+    EXPECT_EQ(TEST_COUNTER_THREAD_COUNT * TEST_COUNTER_ITERATIONS, snapshot.put_frame_failures);
+
+    // Every slot holds a distinct status and no failure is counted twice
+    uint64_t counted = 0;
+    for (uint32_t i = 0; i < STREAM_COUNTERS_MAX_FAILURE_STATUSES; i++) {
+        auto status = snapshot.put_frame_failures_by_status[i].status;
+        EXPECT_NE(STATUS_SUCCESS, status);
+        for (uint32_t j = i + 1; j < STREAM_COUNTERS_MAX_FAILURE_STATUSES; j++) {
+            EXPECT_NE(status, snapshot.put_frame_failures_by_status[j].status);
+        }
+
+        EXPECT_EQ(failureCount(snapshot, status), snapshot.put_frame_failures_by_status[i].count);
+        counted += snapshot.put_frame_failures_by_status[i].count;
+    }
+
+    EXPECT_LT(counted, snapshot.put_frame_failures);
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "CallbackProvider.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+#define STUB_CALLBACK_PROVIDER_DUMMY_ARN                    "arn:aws:kinesisvideo:us-west-2:11111111111:stream/stub/1"
+#define STUB_CALLBACK_PROVIDER_DUMMY_ENDPOINT               "https://s-11111111.kinesisvideo.us-west-2.amazonaws.com"
+#define STUB_CALLBACK_PROVIDER_DUMMY_TOKEN                  "stub_token"
+
+/**
+ * Completes every service call in-process with a canned successful result so that the client can be driven
+ * to streaming without the network or credentials, for the tests and the benchmarks.
+ *
+ * The control plane calls (CreateStream, DescribeStream and GetDataEndpoint) are completed right away or,
+ * with a non-zero latency, after a simulated round trip on their own threads like the curl callbacks do.
+ */
+class StubCallbackProvider : public CallbackProvider {
+public:
+    explicit StubCallbackProvider(std::chrono::milliseconds control_plane_latency = std::chrono::milliseconds::zero())
+            : control_plane_latency_(control_plane_latency), control_plane_call_count_(0), put_stream_count_(0),
+              dropped_frame_count_(0), upload_handle_(INVALID_UPLOAD_HANDLE_VALUE), next_upload_handle_(1) {}
+
+    virtual ~StubCallbackProvider() {
+        joinCalls();
+    }
+
+    /**
+     * Waits for the delayed control plane calls in flight, must be called before the streams are freed.
+     */
+    void joinCalls() {
+        std::vector<std::thread> calls;
+        {
+            std::lock_guard<std::mutex> lock(calls_mutex_);
+            calls.swap(calls_);
+        }
+
+        for (auto& call : calls) {
+            call.join();
+        }
+    }
+
+    uint64_t getControlPlaneCallCount() const {
+        return control_plane_call_count_.load();
+    }
+
+    uint64_t getPutStreamCount() const {
+        return put_stream_count_.load();
+    }
+
+    uint64_t getDroppedFrameCount() const {
+        return dropped_frame_count_.load();
+    }
+
+    /**
+     * @return Upload handle of the latest PutMedia session of any stream.
+     */
+    UPLOAD_HANDLE getUploadHandle() const {
+        return upload_handle_.load();
+    }
+
+    GetSecurityTokenFunc getSecurityTokenCallback() override {
+        return getSecurityTokenHandler;
+    }
+
+    CreateDeviceFunc getCreateDeviceCallback() override {
+        return createDeviceHandler;
+    }
+
+    CreateStreamFunc getCreateStreamCallback() override {
+        return createStreamHandler;
+    }
+
+    DescribeStreamFunc getDescribeStreamCallback() override {
+        return describeStreamHandler;
+    }
+
+    GetStreamingEndpointFunc getStreamingEndpointCallback() override {
+        return getStreamingEndpointHandler;
+    }
+
+    GetStreamingTokenFunc getStreamingTokenCallback() override {
+        return getStreamingTokenHandler;
+    }
+
+    PutStreamFunc getPutStreamCallback() override {
+        return putStreamHandler;
+    }
+
+    TagResourceFunc getTagResourceCallback() override {
+        return tagResourceHandler;
+    }
+
+    DroppedFrameReportFunc getDroppedFrameReportCallback() override {
+        return droppedFrameReportHandler;
+    }
+
+protected:
+    /**
+     * Called once a PutMedia session of the stream has started, before its data can be read with the upload handle.
+     */
+    virtual void uploadStarted(STREAM_HANDLE stream_handle, UPLOAD_HANDLE upload_handle) {
+        UNUSED_PARAM(stream_handle);
+        UNUSED_PARAM(upload_handle);
+    }
+
+private:
+    void completeControlPlaneCall(std::function<void()> completion) {
+        control_plane_call_count_++;
+        if (0 == control_plane_latency_.count()) {
+            completion();
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(calls_mutex_);
+        auto latency = control_plane_latency_;
+        calls_.emplace_back([latency, completion]() {
+            std::this_thread::sleep_for(latency);
+            completion();
+        });
+    }
+
+    static STATUS getSecurityTokenHandler(UINT64 custom_data, PBYTE* pp_token, PUINT32 p_size, PUINT64 p_expiration) {
+        UNUSED_PARAM(custom_data);
+        *pp_token = (PBYTE) STUB_CALLBACK_PROVIDER_DUMMY_TOKEN;
+        *p_size = (UINT32) STRLEN(STUB_CALLBACK_PROVIDER_DUMMY_TOKEN);
+        *p_expiration = MAX_UINT64;
+        return STATUS_SUCCESS;
+    }
+
+    static STATUS createDeviceHandler(UINT64 custom_data, PCHAR device_name, PServiceCallContext service_call_ctx) {
+        UNUSED_PARAM(custom_data);
+        UNUSED_PARAM(device_name);
+        return createDeviceResultEvent(service_call_ctx->customData, SERVICE_CALL_RESULT_OK,
+                                       (PCHAR) STUB_CALLBACK_PROVIDER_DUMMY_ARN);
+    }
+
+    static STATUS createStreamHandler(UINT64 custom_data, PCHAR device_name, PCHAR stream_name, PCHAR content_type,
+                                      PCHAR kms_arn, UINT64 retention_period, PServiceCallContext service_call_ctx) {
+        UNUSED_PARAM(device_name);
+        UNUSED_PARAM(stream_name);
+        UNUSED_PARAM(content_type);
+        UNUSED_PARAM(kms_arn);
+        UNUSED_PARAM(retention_period);
+        UINT64 stream_custom_data = service_call_ctx->customData;
+        reinterpret_cast<StubCallbackProvider*>(custom_data)->completeControlPlaneCall([stream_custom_data]() {
+            createStreamResultEvent(stream_custom_data, SERVICE_CALL_RESULT_OK, (PCHAR) STUB_CALLBACK_PROVIDER_DUMMY_ARN);
+        });
+
+        return STATUS_SUCCESS;
+    }
+
+    static STATUS describeStreamHandler(UINT64 custom_data, PCHAR stream_name, PServiceCallContext service_call_ctx) {
+        UINT64 stream_custom_data = service_call_ctx->customData;
+        std::string name(stream_name);
+        reinterpret_cast<StubCallbackProvider*>(custom_data)->completeControlPlaneCall([stream_custom_data, name]() {
+            StreamDescription stream_description;
+            MEMSET(&stream_description, 0, SIZEOF(stream_description));
+            stream_description.version = STREAM_DESCRIPTION_CURRENT_VERSION;
+            STRNCPY(stream_description.streamName, name.c_str(), MAX_STREAM_NAME_LEN);
+            STRNCPY(stream_description.streamArn, STUB_CALLBACK_PROVIDER_DUMMY_ARN, MAX_ARN_LEN);
+            STRNCPY(stream_description.contentType, "video/h264", MAX_CONTENT_TYPE_LEN);
+            stream_description.streamStatus = STREAM_STATUS_ACTIVE;
+            stream_description.retention = 2 * HUNDREDS_OF_NANOS_IN_AN_HOUR;
+            describeStreamResultEvent(stream_custom_data, SERVICE_CALL_RESULT_OK, &stream_description);
+        });
+
+        return STATUS_SUCCESS;
+    }
+
+    static STATUS getStreamingEndpointHandler(UINT64 custom_data, PCHAR stream_name, PCHAR api_name,
+                                              PServiceCallContext service_call_ctx) {
+        UNUSED_PARAM(stream_name);
+        UNUSED_PARAM(api_name);
+        UINT64 stream_custom_data = service_call_ctx->customData;
+        reinterpret_cast<StubCallbackProvider*>(custom_data)->completeControlPlaneCall([stream_custom_data]() {
+            getStreamingEndpointResultEvent(stream_custom_data, SERVICE_CALL_RESULT_OK,
+                                            (PCHAR) STUB_CALLBACK_PROVIDER_DUMMY_ENDPOINT);
+        });
+
+        return STATUS_SUCCESS;
+    }
+
+    static STATUS getStreamingTokenHandler(UINT64 custom_data, PCHAR stream_name, STREAM_ACCESS_MODE access_mode,
+                                           PServiceCallContext service_call_ctx) {
+        UNUSED_PARAM(custom_data);
+        UNUSED_PARAM(stream_name);
+        UNUSED_PARAM(access_mode);
+        return getStreamingTokenResultEvent(service_call_ctx->customData, SERVICE_CALL_RESULT_OK,
+                                            (PBYTE) STUB_CALLBACK_PROVIDER_DUMMY_TOKEN,
+                                            (UINT32) STRLEN(STUB_CALLBACK_PROVIDER_DUMMY_TOKEN), MAX_UINT64);
+    }
+
+    static STATUS putStreamHandler(UINT64 custom_data, PCHAR stream_name, PCHAR container_type, UINT64 start_timestamp,
+                                   BOOL absolute_fragment_timestamp, BOOL do_ack, PCHAR streaming_endpoint,
+                                   PServiceCallContext service_call_ctx) {
+        UNUSED_PARAM(stream_name);
+        UNUSED_PARAM(container_type);
+        UNUSED_PARAM(start_timestamp);
+        UNUSED_PARAM(absolute_fragment_timestamp);
+        UNUSED_PARAM(do_ack);
+        UNUSED_PARAM(streaming_endpoint);
+        auto this_obj = reinterpret_cast<StubCallbackProvider*>(custom_data);
+        STREAM_HANDLE stream_handle = (STREAM_HANDLE) service_call_ctx->customData;
+        UPLOAD_HANDLE upload_handle = this_obj->next_upload_handle_++;
+        this_obj->put_stream_count_++;
+
+        STATUS status = putStreamResultEvent(stream_handle, SERVICE_CALL_RESULT_OK, upload_handle);
+        if (STATUS_SUCCEEDED(status)) {
+            this_obj->upload_handle_ = upload_handle;
+            this_obj->uploadStarted(stream_handle, upload_handle);
+        }
+
+        return status;
+    }
+
+    static STATUS tagResourceHandler(UINT64 custom_data, PCHAR stream_arn, UINT32 num_tags, PTag tags,
+                                     PServiceCallContext service_call_ctx) {
+        UNUSED_PARAM(custom_data);
+        UNUSED_PARAM(stream_arn);
+        UNUSED_PARAM(num_tags);
+        UNUSED_PARAM(tags);
+        return tagResourceResultEvent(service_call_ctx->customData, SERVICE_CALL_RESULT_OK);
+    }
+
+    static STATUS droppedFrameReportHandler(UINT64 custom_data, STREAM_HANDLE stream_handle, UINT64 dropped_frame_timecode) {
+        auto this_obj = reinterpret_cast<StubCallbackProvider*>(custom_data);
+        this_obj->dropped_frame_count_++;
+        this_obj->notifyDroppedFrame(stream_handle, dropped_frame_timecode);
+        return STATUS_SUCCESS;
+    }
+
+    const std::chrono::milliseconds control_plane_latency_;
+    std::atomic<uint64_t> control_plane_call_count_;
+    std::atomic<uint64_t> put_stream_count_;
+    std::atomic<uint64_t> dropped_frame_count_;
+    std::atomic<UPLOAD_HANDLE> upload_handle_;
+    std::atomic<UPLOAD_HANDLE> next_upload_handle_;
+    std::mutex calls_mutex_;
+    std::vector<std::thread> calls_;
+};
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
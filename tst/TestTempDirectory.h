@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <errno.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+#define TEST_TEMP_DIRECTORY_MAX_ATTEMPTS                    100
+
+/**
+ * Creates a directory for a test.
+ *
+ * @return Whether the directory has been created
+ */
+inline bool createTestDirectory(const std::string& directory) {
+#if defined(_WIN32)
+    return 0 == _mkdir(directory.c_str());
+#else
+    return 0 == mkdir(directory.c_str(), 0700);
+#endif
+}
+
+/**
+ * Creates a new empty directory under the system temporary directory for the files of a test or benchmark.
+ *
+ * @param prefix Name prefix of the directory
+ * @return Path of the directory, empty if it couldn't be created
+ */
+inline std::string createTestTempDirectory(const std::string& prefix) {
+#if defined(_WIN32)
+    static std::atomic<uint32_t> directory_index(0);
+    const char* root = getenv("TEMP");
+    if (nullptr == root) {
+        root = getenv("TMP");
+    }
+
+    std::string base = std::string(nullptr != root ? root : ".") + "\\" + prefix + std::to_string(_getpid()) + "_";
+    for (uint32_t i = 0; i < TEST_TEMP_DIRECTORY_MAX_ATTEMPTS; i++) {
+        std::string directory = base + std::to_string(directory_index++);
+        if (createTestDirectory(directory)) {
+            return directory;
+        }
+
+        if (EEXIST != errno) {
+            break;
+        }
+    }
+
+    return "";
+#else
+    const char* root = getenv("TMPDIR");
+    std::string directory_template = std::string(nullptr != root ? root : "/tmp") + "/" + prefix + "XXXXXX";
+    return nullptr != mkdtemp(&directory_template[0]) ? directory_template : "";
+#endif
+}
+
+/**
+ * Removes an empty directory created by a test.
+ */
+inline void removeTestDirectory(const std::string& directory) {
+#if defined(_WIN32)
+    _rmdir(directory.c_str());
+#else
+    rmdir(directory.c_str());
+#endif
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
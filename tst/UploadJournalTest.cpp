@@ -0,0 +1,243 @@
+#include "ProducerTestFixture.h"
+#include "UploadJournal.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+using namespace std;
+
+#define TEST_JOURNAL_STREAM_NAME "journal_test_stream"
+
+class UploadJournalTest : public ::testing::Test {
+protected:
+    UploadJournalTest() : timestamp_(0) {
+        config_.sync_interval = std::chrono::milliseconds(0);
+    }
+
+    void SetUp() {
+        directory_ = createTestTempDirectory("kvs_journal_test_");
+        ASSERT_FALSE(directory_.empty());
+    }
+
+    void TearDown() {
+        UploadJournal::discard(directory_, TEST_JOURNAL_STREAM_NAME);
+        removeTestDirectory(directory_);
+    }
+
+    string journalDirectory() {
+        return directory_ + "/" + TEST_JOURNAL_STREAM_NAME;
+    }
+
+    // Puts a GOP of a key frame and two delta frames, returns the key frame timestamp
+    uint64_t appendGop(UploadJournal& journal) {
+        uint64_t key_timestamp = timestamp_;
+        for (uint32_t i = 0; i < 3; i++) {
+            vector<uint8_t> payload(100 + i, (uint8_t) i);
+            Frame frame;
+            memset(&frame, 0, sizeof(frame));
+            frame.flags = 0 == i ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+            frame.decodingTs = frame.presentationTs = timestamp_;
+            frame.duration = 40 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+            frame.trackId = DEFAULT_TRACK_ID;
+            frame.frameData = payload.data();
+            frame.size = (UINT32) payload.size();
+            journal.appendFrame(frame);
+            timestamp_ += frame.duration;
+        }
+
+        return key_timestamp;
+    }
+
+    static void persisted(UploadJournal& journal, uint64_t timestamp) {
+        FragmentAck ack;
+        memset(&ack, 0, sizeof(ack));
+        ack.ackType = FRAGMENT_ACK_TYPE_PERSISTED;
+        ack.timestamp = timestamp;
+        journal.fragmentAckReceived(ack);
+    }
+
+    UploadJournalRecovery recover(vector<UploadJournalRecord>& records, vector<vector<uint8_t>>& data) {
+        return UploadJournal::recover(directory_, TEST_JOURNAL_STREAM_NAME, [&](const UploadJournalRecord& record) {
+            records.push_back(record);
+            data.emplace_back(record.data, record.data + record.size);
+            return true;
+        });
+    }
+
+    UploadJournalConfig config_;
+    string directory_;
+    uint64_t timestamp_;
+};
+
+TEST_F(UploadJournalTest, recovers_unacked_fragments_with_codec_private_data)
+{
+    const uint8_t cpd1[] = {0x01, 0x64, 0x00, 0x1f};
+    const uint8_t cpd2[] = {0x01, 0x4d, 0x00, 0x28};
+    {
+        UploadJournal journal(directory_, TEST_JOURNAL_STREAM_NAME, config_);
+        journal.appendCodecPrivateData(DEFAULT_TRACK_ID, cpd1, sizeof(cpd1));
+        uint64_t first_key_timestamp = appendGop(journal);
+        appendGop(journal);
+        journal.appendCodecPrivateData(DEFAULT_TRACK_ID, cpd2, sizeof(cpd2));
+        appendGop(journal);
+
+        persisted(journal, first_key_timestamp);
+        EXPECT_EQ(2, journal.getPendingFragmentCount());
+    }
+
+    vector<UploadJournalRecord> records;
+    vector<vector<uint8_t>> data;
+    auto recovery = recover(records, data);
+
+    EXPECT_TRUE(recovery.complete);
+    EXPECT_EQ(1, recovery.segment_count);
+    EXPECT_EQ(6, recovery.frame_count);
+    EXPECT_EQ(3, recovery.skipped_frame_count);
+    EXPECT_EQ(2 * (100 + 101 + 102), recovery.byte_count);
+
+    // The initial codec private data, the second GOP, the changed codec private data and the third GOP
+    ASSERT_EQ(8, records.size());
+    EXPECT_EQ(UPLOAD_JOURNAL_RECORD_CODEC_PRIVATE_DATA, records[0].type);
+    EXPECT_EQ(vector<uint8_t>(cpd1, cpd1 + sizeof(cpd1)), data[0]);
+    EXPECT_EQ(UPLOAD_JOURNAL_RECORD_FRAME, records[1].type);
+    EXPECT_TRUE(CHECK_FRAME_FLAG_KEY_FRAME(records[1].frame.flags));
+    EXPECT_EQ(3 * 40 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND, records[1].frame.presentationTs);
+    EXPECT_EQ(100, records[1].frame.size);
+    EXPECT_EQ(vector<uint8_t>(101, 1), data[2]);
+    EXPECT_EQ(UPLOAD_JOURNAL_RECORD_CODEC_PRIVATE_DATA, records[4].type);
+    EXPECT_EQ(vector<uint8_t>(cpd2, cpd2 + sizeof(cpd2)), data[4]);
+    EXPECT_EQ(UPLOAD_JOURNAL_RECORD_FRAME, records[7].type);
+    EXPECT_EQ(8 * 40 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND, records[7].frame.decodingTs);
+}
+
+TEST_F(UploadJournalTest, deletes_persisted_segments_and_clean_journal)
+{
+    struct stat directory_stat;
+
+    // Every key frame rolls over to a new segment
+    config_.segment_size = 1;
+    config_.sync_interval = std::chrono::milliseconds(5);
+    {
+        UploadJournal journal(directory_, TEST_JOURNAL_STREAM_NAME, config_);
+        vector<uint64_t> key_timestamps;
+        for (uint32_t i = 0; i < 4; i++) {
+            key_timestamps.push_back(appendGop(journal));
+        }
+
+        persisted(journal, key_timestamps[1]);
+        journal.sync();
+
+        vector<UploadJournalRecord> records;
+        vector<vector<uint8_t>> data;
+        auto recovery = recover(records, data);
+        EXPECT_EQ(2, recovery.segment_count);
+        EXPECT_EQ(6, recovery.frame_count);
+
+        for (auto key_timestamp : key_timestamps) {
+            persisted(journal, key_timestamp);
+        }
+
+        EXPECT_EQ(0, journal.getPendingFragmentCount());
+        EXPECT_EQ(0, stat(journalDirectory().c_str(), &directory_stat));
+    }
+
+    EXPECT_NE(0, stat(journalDirectory().c_str(), &directory_stat));
+}
+
+TEST_F(UploadJournalTest, torn_record_ends_segment)
+{
+    {
+        UploadJournal journal(directory_, TEST_JOURNAL_STREAM_NAME, config_);
+        appendGop(journal);
+        appendGop(journal);
+    }
+
+    // Cut the last frame in half as if the process went down mid-write
+    string segment_path = journalDirectory() + "/0000000000000000.kvsj";
+    vector<char> segment;
+    {
+        ifstream segment_file(segment_path, ios::binary);
+        segment.assign(istreambuf_iterator<char>(segment_file), istreambuf_iterator<char>());
+    }
+
+    ASSERT_GT(segment.size(), 50);
+    ofstream(segment_path, ios::binary | ios::trunc).write(segment.data(), segment.size() - 50);
+
+    vector<UploadJournalRecord> records;
+    vector<vector<uint8_t>> data;
+    auto recovery = recover(records, data);
+    EXPECT_EQ(5, recovery.frame_count);
+    ASSERT_EQ(5, records.size());
+    EXPECT_EQ(vector<uint8_t>(101, 1), data.back());
+}
+
+TEST_F(UploadJournalTest, acks_only_cover_their_generation)
+{
+    {
+        UploadJournal journal(directory_, TEST_JOURNAL_STREAM_NAME, config_);
+        appendGop(journal);
+    }
+
+    // The previous generation hasn't been recovered and stays in place
+    {
+        UploadJournal journal(directory_, TEST_JOURNAL_STREAM_NAME, config_);
+        persisted(journal, appendGop(journal));
+        appendGop(journal);
+    }
+
+    vector<UploadJournalRecord> records;
+    vector<vector<uint8_t>> data;
+    auto recovery = recover(records, data);
+    EXPECT_EQ(2, recovery.segment_count);
+    EXPECT_EQ(6, recovery.frame_count);
+    EXPECT_EQ(3, recovery.skipped_frame_count);
+    ASSERT_EQ(6, records.size());
+    EXPECT_EQ(0, records[0].frame.presentationTs);
+    EXPECT_EQ(6 * 40 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND, records[3].frame.presentationTs);
+
+    // Stopped by the visitor
+    recovery = UploadJournal::recover(directory_, TEST_JOURNAL_STREAM_NAME, [](const UploadJournalRecord&) { return false; });
+    EXPECT_FALSE(recovery.complete);
+    EXPECT_EQ(0, recovery.frame_count);
+}
+
+TEST_F(UploadJournalTest, recovery_leaves_the_live_generation_alone)
+{
+    {
+        UploadJournal journal(directory_, TEST_JOURNAL_STREAM_NAME, config_);
+        appendGop(journal);
+    }
+
+    // Journaled into by the live stream while the previous generation is recovered
+    UploadJournal live_journal(directory_, TEST_JOURNAL_STREAM_NAME, config_);
+    EXPECT_NE(0, live_journal.getGeneration());
+    appendGop(live_journal);
+
+    vector<UploadJournalRecord> records;
+    auto recovery = UploadJournal::recover(directory_, TEST_JOURNAL_STREAM_NAME, [&](const UploadJournalRecord& record) {
+        records.push_back(record);
+        return true;
+    }, live_journal.getGeneration());
+    EXPECT_EQ(1, recovery.segment_count);
+    EXPECT_EQ(3, recovery.frame_count);
+
+    UploadJournal::discard(directory_, TEST_JOURNAL_STREAM_NAME, live_journal.getGeneration());
+    live_journal.sync();
+    records.clear();
+    vector<vector<uint8_t>> data;
+    recovery = recover(records, data);
+    EXPECT_EQ(1, recovery.segment_count);
+    ASSERT_EQ(3, recovery.frame_count);
+    EXPECT_EQ(3 * 40 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND, records[0].frame.presentationTs);
+}
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
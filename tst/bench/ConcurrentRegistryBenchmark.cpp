@@ -0,0 +1,100 @@
+/**
+ * Stream lookup throughput of the producer's stream registry against the mutex-guarded map it
+ * replaced, with a writer continuously tearing down and re-creating one of the streams.
+ */
+#include "benchmark/benchmark.h"
+#include "ConcurrentRegistry.h"
+#include "com/amazonaws/kinesis/video/client/Include.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+#define BENCH_REGISTRY_STREAM_COUNT                         512
+
+namespace {
+    /**
+     * Fake stream handles - the real ones are pointers so keep the low bits clear.
+     */
+    STREAM_HANDLE benchHandle(uint32_t index) {
+        return static_cast<STREAM_HANDLE>(0x10000 + index * 0x100);
+    }
+
+    /**
+     * The structure the registry replaced, used as the contention baseline.
+     */
+    class MutexMap {
+    public:
+        void put(STREAM_HANDLE k, std::shared_ptr<uint32_t> v) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            map_[k] = v;
+        }
+
+        std::shared_ptr<uint32_t> get(STREAM_HANDLE k) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = map_.find(k);
+            return it != map_.end() ? it->second : nullptr;
+        }
+
+        void remove(STREAM_HANDLE k) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            map_.erase(k);
+        }
+
+    private:
+        std::map<STREAM_HANDLE, std::shared_ptr<uint32_t>> map_;
+        std::mutex mutex_;
+    };
+
+    using Registry = ConcurrentRegistry<STREAM_HANDLE, std::shared_ptr<uint32_t>>;
+}
+
+template <typename M> static void BM_StreamLookup(benchmark::State& state) {
+    static M* registry;
+    static std::atomic<bool> stop;
+    static std::thread* writer;
+
+    if (0 == state.thread_index()) {
+        registry = new M();
+        for (uint32_t i = 0; i < BENCH_REGISTRY_STREAM_COUNT; i++) {
+            registry->put(benchHandle(i), std::make_shared<uint32_t>(i));
+        }
+
+        // Stream teardown/creation churn on the last stream
+        stop = false;
+        writer = new std::thread([]() {
+            while (!stop) {
+                registry->remove(benchHandle(BENCH_REGISTRY_STREAM_COUNT - 1));
+                registry->put(benchHandle(BENCH_REGISTRY_STREAM_COUNT - 1),
+                              std::make_shared<uint32_t>(BENCH_REGISTRY_STREAM_COUNT - 1));
+            }
+        });
+    }
+
+    uint32_t i = (uint32_t) state.thread_index();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(registry->get(benchHandle((i * 7) % BENCH_REGISTRY_STREAM_COUNT)));
+        i++;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+
+    if (0 == state.thread_index()) {
+        stop = true;
+        writer->join();
+        delete writer;
+        delete registry;
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_StreamLookup, Registry)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_StreamLookup, MutexMap)->ThreadRange(1, 8)->UseRealTime();
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,131 @@
+/**
+ * Annex-B to AVCC adaptation throughput.
+ *
+ * Synthetic access units sized like 1080p and 4K H.264 output are used by default. Point
+ * KVS_BENCH_ANNEXB_FILE at a raw byte-stream file (e.g. from ffmpeg -c:v copy -bsf:v h264_mp4toannexb -f h264)
+ * to also measure a real bitstream.
+ */
+#include "benchmark/benchmark.h"
+#include "NalAdapter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+#define BENCH_ANNEXB_FILE_ENV_VAR                           "KVS_BENCH_ANNEXB_FILE"
+
+namespace {
+    /**
+     * Random slice payload with the emulation prevention applied so that it holds no start codes.
+     */
+    void appendNal(std::vector<uint8_t>& access_unit, uint8_t header, size_t size, std::mt19937& generator) {
+        static const uint8_t START_CODE[] = {0x00, 0x00, 0x00, 0x01};
+        access_unit.insert(access_unit.end(), START_CODE, START_CODE + sizeof(START_CODE));
+        access_unit.push_back(header);
+
+        // Skewed towards zero bytes like entropy coded data with long runs
+        std::uniform_int_distribution<int> distribution(0, 511);
+        uint32_t zero_count = 0;
+        for (size_t i = 1; i < size; i++) {
+            int value = distribution(generator);
+            uint8_t byte = (uint8_t) (value > 255 ? 0 : value);
+            if (zero_count >= 2 && byte <= 3) {
+                access_unit.push_back(3);
+                zero_count = 0;
+            }
+
+            access_unit.push_back(byte);
+            zero_count = byte == 0 ? zero_count + 1 : 0;
+        }
+
+        // A NAL doesn't end with a zero byte
+        if (access_unit.back() == 0) {
+            access_unit.push_back(0x80);
+        }
+    }
+
+    /**
+     * A GOP worth of access units: an IDR with its parameter sets followed by P frames, each in several slices.
+     */
+    std::vector<std::vector<uint8_t>> syntheticGop(size_t idr_size, size_t p_size, uint32_t slice_count) {
+        std::mt19937 generator(42);
+        std::vector<std::vector<uint8_t>> gop(30);
+        for (size_t i = 0; i < gop.size(); i++) {
+            if (i == 0) {
+                appendNal(gop[i], 0x67, 16, generator);
+                appendNal(gop[i], 0x68, 4, generator);
+            }
+
+            size_t frame_size = i == 0 ? idr_size : p_size;
+            for (uint32_t slice = 0; slice < slice_count; slice++) {
+                appendNal(gop[i], i == 0 ? 0x65 : 0x41, frame_size / slice_count, generator);
+            }
+        }
+
+        return gop;
+    }
+
+    void adaptAccessUnits(benchmark::State& state, const std::vector<std::vector<uint8_t>>& access_units) {
+        size_t max_size = 0, total_size = 0;
+        for (auto& access_unit : access_units) {
+            max_size = std::max(max_size, access_unit.size());
+            total_size += access_unit.size();
+        }
+
+        std::vector<uint8_t> avcc(NalAdapter::maxAvccSize(max_size));
+        for (auto _ : state) {
+            for (auto& access_unit : access_units) {
+                size_t size = NalAdapter::annexBToAvcc(access_unit.data(), access_unit.size(), avcc.data(), avcc.size());
+                if (size == 0) {
+                    state.SkipWithError("Adaptation failed");
+                    return;
+                }
+
+                benchmark::DoNotOptimize(avcc.data());
+            }
+        }
+
+        state.SetItemsProcessed((int64_t) (state.iterations() * access_units.size()));
+        state.SetBytesProcessed((int64_t) (state.iterations() * total_size));
+    }
+}
+
+static void BM_AnnexBToAvcc1080p(benchmark::State& state) {
+    static const auto gop = syntheticGop(250 * 1024, 40 * 1024, 4);
+    adaptAccessUnits(state, gop);
+}
+
+static void BM_AnnexBToAvcc4K(benchmark::State& state) {
+    static const auto gop = syntheticGop(1024 * 1024, 160 * 1024, 8);
+    adaptAccessUnits(state, gop);
+}
+
+/**
+ * Adapts the whole file as a single buffer which exercises the scan over every NAL in the bitstream.
+ */
+static void BM_AnnexBToAvccFile(benchmark::State& state) {
+    const char* path = getenv(BENCH_ANNEXB_FILE_ENV_VAR);
+    if (nullptr == path) {
+        state.SkipWithError(BENCH_ANNEXB_FILE_ENV_VAR " is not set");
+        return;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<std::vector<uint8_t>> bitstream(1);
+    bitstream[0].assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    adaptAccessUnits(state, bitstream);
+}
+
+BENCHMARK(BM_AnnexBToAvcc1080p);
+BENCHMARK(BM_AnnexBToAvcc4K);
+BENCHMARK(BM_AnnexBToAvccFile);
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,369 @@
+/**
+ * Offline benchmark of the producer putFrame hot path.
+ *
+ * The service calls are completed in-process by a stub callback provider and a drain thread consumes
+ * the packaged stream data the way the curl upload would, so the benchmark needs neither the network
+ * nor credentials.
+ *
+ * Run with --benchmark_format=json (or --benchmark_out=<file> --benchmark_out_format=json) to track
+ * the results across builds.
+ */
+#include "benchmark/benchmark.h"
+#include "KinesisVideoProducer.h"
+#include "DefaultDeviceInfoProvider.h"
+#include "StreamDefinition.h"
+#include "Logger.h"
+#include "StubCallbackProvider.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+#define BENCH_STORAGE_SIZE_IN_BYTES                         (512 * 1024 * 1024ull)
+#define BENCH_FRAME_RATE                                    25
+#define BENCH_KEY_FRAME_INTERVAL                            BENCH_FRAME_RATE
+#define BENCH_FRAME_DURATION                                (HUNDREDS_OF_NANOS_IN_A_SECOND / BENCH_FRAME_RATE)
+#define BENCH_DRAIN_BUFFER_SIZE                             (256 * 1024)
+#define BENCH_MAX_LATENCY_SAMPLES                           (1024 * 1024)
+
+namespace {
+    /**
+     * Allocations made through operator new and the client memory routines.
+     */
+    std::atomic<uint64_t> gAllocationCount(0);
+
+    memAlloc gClientMemAlloc = nullptr;
+    memAlignAlloc gClientMemAlignAlloc = nullptr;
+    memCalloc gClientMemCalloc = nullptr;
+    memRealloc gClientMemRealloc = nullptr;
+
+    PVOID countingMemAlloc(SIZE_T size) {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+        return gClientMemAlloc(size);
+    }
+
+    PVOID countingMemAlignAlloc(SIZE_T size, SIZE_T alignment) {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+        return gClientMemAlignAlloc(size, alignment);
+    }
+
+    PVOID countingMemCalloc(SIZE_T num, SIZE_T size) {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+        return gClientMemCalloc(num, size);
+    }
+
+    PVOID countingMemRealloc(PVOID ptr, SIZE_T size) {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+        return gClientMemRealloc(ptr, size);
+    }
+
+    void hookClientMemory() {
+        if (nullptr == gClientMemAlloc) {
+            gClientMemAlloc = globalMemAlloc;
+            gClientMemAlignAlloc = globalMemAlignAlloc;
+            gClientMemCalloc = globalMemCalloc;
+            gClientMemRealloc = globalMemRealloc;
+
+            globalMemAlloc = countingMemAlloc;
+            globalMemAlignAlloc = countingMemAlignAlloc;
+            globalMemCalloc = countingMemCalloc;
+            globalMemRealloc = countingMemRealloc;
+        }
+    }
+}
+
+/**
+ * Per-stream state shared between the benchmark loop, the callbacks and the drain thread.
+ */
+struct BenchStream {
+    std::shared_ptr<KinesisVideoStream> stream;
+    STREAM_HANDLE stream_handle = INVALID_STREAM_HANDLE_VALUE;
+    std::atomic<UPLOAD_HANDLE> upload_handle;
+    uint64_t timestamp = 0;
+    uint64_t frame_index = 0;
+
+    BenchStream() : upload_handle(INVALID_UPLOAD_HANDLE_VALUE) {}
+};
+
+class BenchDeviceInfoProvider : public DefaultDeviceInfoProvider {
+    uint32_t stream_count_;
+public:
+    BenchDeviceInfoProvider(uint32_t stream_count) : stream_count_(stream_count) {}
+
+    device_info_t getDeviceInfo() override {
+        auto device_info = DefaultDeviceInfoProvider::getDeviceInfo();
+        device_info.storageInfo.storageSize = BENCH_STORAGE_SIZE_IN_BYTES;
+        device_info.streamCount = stream_count_;
+        return device_info;
+    }
+};
+
+/**
+ * Hands the uploads started by the stub over to the drain thread.
+ */
+class BenchCallbackProvider : public StubCallbackProvider {
+public:
+    /**
+     * Registers the stream before any frame is put so that the lookups from the callbacks don't race.
+     */
+    void addStream(BenchStream* bench_stream) {
+        std::lock_guard<std::mutex> lock(streams_mutex_);
+        streams_[bench_stream->stream_handle] = bench_stream;
+    }
+
+protected:
+    void uploadStarted(STREAM_HANDLE stream_handle, UPLOAD_HANDLE upload_handle) override {
+        std::lock_guard<std::mutex> lock(streams_mutex_);
+        auto it = streams_.find(stream_handle);
+        if (it != streams_.end()) {
+            it->second->upload_handle = upload_handle;
+        }
+    }
+
+private:
+    std::mutex streams_mutex_;
+    std::map<STREAM_HANDLE, BenchStream*> streams_;
+};
+
+/**
+ * Producer with the requested number of streams and a thread draining their stream data.
+ */
+class BenchProducer {
+public:
+    BenchProducer(uint32_t stream_count) : bench_streams_(stream_count), stop_drain_(false) {
+        std::unique_ptr<BenchCallbackProvider> callback_provider(new BenchCallbackProvider());
+        callback_provider_ = callback_provider.get();
+        std::unique_ptr<DeviceInfoProvider> device_info_provider(new BenchDeviceInfoProvider(stream_count));
+        kinesis_video_producer_ = KinesisVideoProducer::createSync(std::move(device_info_provider),
+                                                                   std::move(callback_provider));
+
+        uint64_t start_timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count() / DEFAULT_TIME_UNIT_IN_NANOS;
+        for (uint32_t i = 0; i < stream_count; i++) {
+            std::string stream_name = "producer_bench_" + std::to_string(i);
+            // No acks so that the drained data is trimmed right away, no latency or staleness checks
+            std::unique_ptr<StreamDefinition> stream_definition(new StreamDefinition(stream_name,
+                    std::chrono::hours(2),
+                    nullptr,
+                    "",
+                    STREAMING_TYPE_REALTIME,
+                    "video/h264",
+                    std::chrono::milliseconds::zero(),
+                    std::chrono::seconds(2),
+                    std::chrono::milliseconds(1),
+                    true,
+                    true,
+                    true,
+                    false,
+                    true,
+                    true,
+                    true,
+                    NAL_ADAPTATION_FLAG_NONE,
+                    BENCH_FRAME_RATE,
+                    4 * 1024 * 1024,
+                    std::chrono::seconds(120),
+                    std::chrono::seconds(40),
+                    std::chrono::seconds(0)));
+
+            BenchStream& bench_stream = bench_streams_[i];
+            bench_stream.stream = kinesis_video_producer_->createStreamSync(std::move(stream_definition));
+            bench_stream.stream_handle = *bench_stream.stream->getStreamHandle();
+            bench_stream.timestamp = start_timestamp;
+            callback_provider_->addStream(&bench_stream);
+        }
+
+        drain_thread_ = std::thread(&BenchProducer::drain, this);
+    }
+
+    ~BenchProducer() {
+        stop_drain_ = true;
+        drain_thread_.join();
+
+        for (auto& bench_stream : bench_streams_) {
+            kinesis_video_producer_->freeStream(std::move(bench_stream.stream));
+        }
+
+        kinesis_video_producer_.reset();
+    }
+
+    BenchStream& getStream(uint32_t index) {
+        return bench_streams_[index];
+    }
+
+    KinesisVideoProducer& getProducer() {
+        return *kinesis_video_producer_;
+    }
+
+    uint64_t getDroppedFrameCount() const {
+        return callback_provider_->getDroppedFrameCount();
+    }
+
+private:
+    /**
+     * Plays the part of the network thread, pulling the packaged data of every active upload.
+     */
+    void drain() {
+        std::vector<BYTE> buffer(BENCH_DRAIN_BUFFER_SIZE);
+        while (!stop_drain_) {
+            bool drained = false;
+            for (auto& bench_stream : bench_streams_) {
+                UPLOAD_HANDLE upload_handle = bench_stream.upload_handle.load();
+                if (INVALID_UPLOAD_HANDLE_VALUE == upload_handle) {
+                    continue;
+                }
+
+                UINT32 filled = 0;
+                STATUS status;
+                do {
+                    status = getKinesisVideoStreamData(bench_stream.stream_handle, upload_handle, buffer.data(),
+                                                       (UINT32) buffer.size(), &filled);
+                    drained = drained || filled != 0;
+                } while (STATUS_SUCCESS == status && filled != 0);
+            }
+
+            if (!drained) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    std::vector<BenchStream> bench_streams_;
+    std::unique_ptr<KinesisVideoProducer> kinesis_video_producer_;
+    BenchCallbackProvider* callback_provider_;
+    std::thread drain_thread_;
+    std::atomic<bool> stop_drain_;
+};
+
+static uint64_t percentile(std::vector<uint64_t>& sorted_samples, double fraction) {
+    if (sorted_samples.empty()) {
+        return 0;
+    }
+
+    size_t index = std::min(sorted_samples.size() - 1, (size_t) (fraction * sorted_samples.size()));
+    return sorted_samples[index];
+}
+
+/**
+ * Puts frames round robin over the streams, one frame per stream per iteration.
+ *
+ * Arguments are the stream count, the frame size in bytes and whether the frames go straight to the
+ * client's putKinesisVideoFrame instead of through KinesisVideoStream::putFrame. The latency difference
+ * between the two is the per-frame overhead the SDK adds on top of the client call.
+ */
+static void BM_PutFrame(benchmark::State& state) {
+    uint32_t stream_count = (uint32_t) state.range(0);
+    uint32_t frame_size = (uint32_t) state.range(1);
+    bool direct = 0 != state.range(2);
+
+    hookClientMemory();
+    BenchProducer bench_producer(stream_count);
+    std::vector<BYTE> frame_data(frame_size, 0xab);
+    std::vector<uint64_t> latencies;
+    latencies.reserve(BENCH_MAX_LATENCY_SAMPLES);
+    uint64_t frame_count = 0, failed_count = 0;
+    uint64_t allocation_count = gAllocationCount.load();
+
+    for (auto _ : state) {
+        for (uint32_t i = 0; i < stream_count; i++) {
+            BenchStream& bench_stream = bench_producer.getStream(i);
+            KinesisVideoFrame frame;
+            frame.version = FRAME_CURRENT_VERSION;
+            frame.index = (UINT32) bench_stream.frame_index;
+            frame.flags = bench_stream.frame_index % BENCH_KEY_FRAME_INTERVAL == 0 ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+            frame.decodingTs = bench_stream.timestamp;
+            frame.presentationTs = bench_stream.timestamp;
+            frame.duration = BENCH_FRAME_DURATION;
+            frame.size = frame_size;
+            frame.frameData = frame_data.data();
+            frame.trackId = DEFAULT_TRACK_ID;
+
+            auto start = std::chrono::steady_clock::now();
+            bool put = direct ? STATUS_SUCCEEDED(putKinesisVideoFrame(bench_stream.stream_handle, &frame))
+                              : bench_stream.stream->putFrame(frame);
+            auto end = std::chrono::steady_clock::now();
+
+            if (latencies.size() < latencies.capacity()) {
+                latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            }
+
+            failed_count += put ? 0 : 1;
+            bench_stream.frame_index++;
+            bench_stream.timestamp += BENCH_FRAME_DURATION;
+            frame_count++;
+        }
+    }
+
+    allocation_count = gAllocationCount.load() - allocation_count;
+
+    // Sampled before the teardown while the streams are still live
+    auto client_metrics = bench_producer.getProducer().getMetrics();
+    uint64_t content_store_size = client_metrics.getContentStoreSizeSize();
+    uint64_t content_store_used = content_store_size - client_metrics.getContentStoreAvailableSize();
+
+    std::sort(latencies.begin(), latencies.end());
+    state.SetItemsProcessed((int64_t) frame_count);
+    state.SetBytesProcessed((int64_t) (frame_count * frame_size));
+    state.counters["latency_p50_ns"] = (double) percentile(latencies, 0.50);
+    state.counters["latency_p90_ns"] = (double) percentile(latencies, 0.90);
+    state.counters["latency_p99_ns"] = (double) percentile(latencies, 0.99);
+    state.counters["latency_max_ns"] = latencies.empty() ? 0 : (double) latencies.back();
+    state.counters["allocs_per_frame"] = frame_count == 0 ? 0 : (double) allocation_count / frame_count;
+    state.counters["content_store_used_bytes"] = (double) content_store_used;
+    state.counters["content_store_occupancy"] = content_store_size == 0 ? 0 : (double) content_store_used / content_store_size;
+    state.counters["failed_frames"] = (double) failed_count;
+    state.counters["dropped_frames"] = (double) bench_producer.getDroppedFrameCount();
+}
+
+static void PutFrameArguments(benchmark::internal::Benchmark* benchmark) {
+    for (int64_t stream_count : {1, 8, 64}) {
+        for (int64_t frame_size : {1024, 16 * 1024, 256 * 1024}) {
+            benchmark->Args({stream_count, frame_size, 0});
+        }
+    }
+
+    // Audio sized frames with and without the SDK on top of the client call
+    for (int64_t stream_count : {1, 64}) {
+        for (int64_t direct : {0, 1}) {
+            benchmark->Args({stream_count, 256, direct});
+        }
+    }
+}
+
+BENCHMARK(BM_PutFrame)->ArgNames({"streams", "frame_size", "direct"})->Apply(PutFrameArguments)->UseRealTime();
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
+
+// Counts the allocations made by the SDK code itself on top of the client memory routines
+void* operator new(size_t size) {
+    com::amazonaws::kinesis::video::gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (nullptr == ptr) {
+        throw std::bad_alloc();
+    }
+
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+int main(int argc, char** argv) {
+    LOG_CONFIGURE_STDOUT("WARN");
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
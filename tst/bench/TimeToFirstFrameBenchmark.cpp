@@ -0,0 +1,206 @@
+/**
+ * Time to first frame of the streams of a starting producer, with and without the persistent API call cache.
+ *
+ * The control plane calls are completed in-process after a simulated round trip so that the benchmark needs
+ * neither the network nor credentials. A cold start makes the DescribeStream and GetDataEndpoint calls of every
+ * stream, a warm start serves them from a cache file written by a previous run. The control plane call counters
+ * are independent of the simulated latency, the times scale with it.
+ *
+ * The cache file is written under a new directory in the system temporary directory.
+ */
+#include "benchmark/benchmark.h"
+#include "KinesisVideoProducer.h"
+#include "DefaultDeviceInfoProvider.h"
+#include "StreamDefinition.h"
+#include "ApiCallCache.h"
+#include "StubCallbackProvider.h"
+#include "TestTempDirectory.h"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+#define TTFF_BENCH_STORAGE_SIZE_IN_BYTES                    (512 * 1024 * 1024ull)
+#define TTFF_BENCH_REGION                                   "us-west-2"
+#define TTFF_BENCH_FRAME_RATE                               25
+#define TTFF_BENCH_FRAME_SIZE                               1024
+
+namespace {
+    class TtffDeviceInfoProvider : public DefaultDeviceInfoProvider {
+        uint32_t stream_count_;
+    public:
+        TtffDeviceInfoProvider(uint32_t stream_count) : stream_count_(stream_count) {}
+
+        device_info_t getDeviceInfo() override {
+            auto device_info = DefaultDeviceInfoProvider::getDeviceInfo();
+            device_info.storageInfo.storageSize = TTFF_BENCH_STORAGE_SIZE_IN_BYTES;
+            device_info.streamCount = stream_count_;
+            return device_info;
+        }
+    };
+
+    /**
+     * Stub provider with its control plane calls going through the API call cache, if any.
+     */
+    class ControlPlaneCallbackProvider : public StubCallbackProvider {
+    public:
+        ControlPlaneCallbackProvider(std::chrono::milliseconds latency, std::shared_ptr<ApiCallCache> api_call_cache)
+                : StubCallbackProvider(latency), api_call_cache_(std::move(api_call_cache)) {}
+
+        ~ControlPlaneCallbackProvider() {
+            joinCalls();
+            if (nullptr != api_call_cache_) {
+                ApiCallCache::detach(reinterpret_cast<UINT64>(this));
+            }
+        }
+
+        callback_t getCallbacks() override {
+            auto callbacks = CallbackProvider::getCallbacks();
+            if (nullptr != api_call_cache_) {
+                return ApiCallCache::attach(api_call_cache_, callbacks, TTFF_BENCH_REGION);
+            }
+
+            return callbacks;
+        }
+
+    private:
+        const std::shared_ptr<ApiCallCache> api_call_cache_;
+    };
+
+    struct TtffResult {
+        std::chrono::microseconds time_to_first_frame;
+        uint64_t control_plane_call_count;
+    };
+
+    std::unique_ptr<StreamDefinition> streamDefinition(const std::string& stream_name) {
+        return std::unique_ptr<StreamDefinition>(new StreamDefinition(stream_name,
+                std::chrono::hours(2),
+                nullptr,
+                "",
+                STREAMING_TYPE_REALTIME,
+                "video/h264",
+                std::chrono::milliseconds::zero(),
+                std::chrono::seconds(2),
+                std::chrono::milliseconds(1),
+                true,
+                true,
+                true,
+                false,
+                true,
+                true,
+                true,
+                NAL_ADAPTATION_FLAG_NONE,
+                TTFF_BENCH_FRAME_RATE,
+                4 * 1024 * 1024,
+                std::chrono::seconds(120),
+                std::chrono::seconds(40),
+                std::chrono::seconds(0)));
+    }
+
+    /**
+     * Starts a producer, brings its streams up concurrently and puts a key frame into each of them.
+     *
+     * @return Time until every stream has accepted its first frame.
+     */
+    TtffResult startProducer(uint32_t stream_count, std::chrono::milliseconds latency,
+                             std::shared_ptr<ApiCallCache> api_call_cache) {
+        std::unique_ptr<ControlPlaneCallbackProvider> callback_provider(
+                new ControlPlaneCallbackProvider(latency, std::move(api_call_cache)));
+        ControlPlaneCallbackProvider* control_plane = callback_provider.get();
+        std::unique_ptr<DeviceInfoProvider> device_info_provider(new TtffDeviceInfoProvider(stream_count));
+        auto kinesis_video_producer = KinesisVideoProducer::createSync(std::move(device_info_provider),
+                                                                       std::move(callback_provider));
+
+        std::vector<std::unique_ptr<StreamDefinition>> stream_definitions;
+        for (uint32_t i = 0; i < stream_count; i++) {
+            stream_definitions.push_back(streamDefinition("ttff_bench_" + std::to_string(i)));
+        }
+
+        std::vector<BYTE> frame_data(TTFF_BENCH_FRAME_SIZE, 0xab);
+        uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count() / DEFAULT_TIME_UNIT_IN_NANOS;
+        std::vector<std::shared_ptr<KinesisVideoStream>> streams;
+
+        auto start = std::chrono::steady_clock::now();
+        auto stream_futures = kinesis_video_producer->createStreams(std::move(stream_definitions), stream_count);
+        for (auto& stream_future : stream_futures) {
+            auto stream = stream_future.get();
+            KinesisVideoFrame frame;
+            frame.version = FRAME_CURRENT_VERSION;
+            frame.index = 0;
+            frame.flags = FRAME_FLAG_KEY_FRAME;
+            frame.decodingTs = frame.presentationTs = timestamp;
+            frame.duration = HUNDREDS_OF_NANOS_IN_A_SECOND / TTFF_BENCH_FRAME_RATE;
+            frame.size = TTFF_BENCH_FRAME_SIZE;
+            frame.frameData = frame_data.data();
+            frame.trackId = DEFAULT_TRACK_ID;
+            stream->putFrame(frame);
+            streams.push_back(stream);
+        }
+
+        TtffResult result;
+        result.time_to_first_frame = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+
+        // The frames are put to the streams so that the endpoints get recorded for the warm starts
+        while (control_plane->getPutStreamCount() < stream_count) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        result.control_plane_call_count = control_plane->getControlPlaneCallCount();
+        control_plane->joinCalls();
+        for (auto& stream : streams) {
+            kinesis_video_producer->freeStream(std::move(stream));
+        }
+
+        return result;
+    }
+}
+
+/**
+ * Arguments are the stream count, the simulated control plane round trip in milliseconds and whether the start
+ * is warm, served from the cache written by a previous start.
+ */
+static void BM_TimeToFirstFrame(benchmark::State& state) {
+    uint32_t stream_count = (uint32_t) state.range(0);
+    std::chrono::milliseconds latency(state.range(1));
+    bool warm = 0 != state.range(2);
+
+    std::string directory = createTestTempDirectory("kvs_ttff_bench_");
+    if (directory.empty()) {
+        state.SkipWithError("Unable to create the cache directory");
+        return;
+    }
+
+    std::string cache_path = directory + "/api_call_cache";
+    if (warm) {
+        startProducer(stream_count, latency, std::make_shared<ApiCallCache>(cache_path));
+    }
+
+    uint64_t control_plane_call_count = 0;
+    for (auto _ : state) {
+        auto result = startProducer(stream_count, latency,
+                                    warm ? std::make_shared<ApiCallCache>(cache_path) : nullptr);
+        state.SetIterationTime(std::chrono::duration<double>(result.time_to_first_frame).count());
+        control_plane_call_count += result.control_plane_call_count;
+    }
+
+    remove(cache_path.c_str());
+    removeTestDirectory(directory);
+    state.counters["control_plane_calls_per_stream"] =
+            (double) control_plane_call_count / ((double) state.iterations() * stream_count);
+}
+
+BENCHMARK(BM_TimeToFirstFrame)->ArgNames({"streams", "rtt_ms", "warm"})
+        ->Args({10, 50, 0})->Args({10, 50, 1})->Args({100, 50, 0})->Args({100, 50, 1})
+        ->Iterations(5)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
@@ -0,0 +1,202 @@
+/**
+ * Upload journal write bandwidth and recovery time.
+ *
+ * The journal is written under the system temporary directory by default which is often RAM-backed. Point
+ * KVS_BENCH_JOURNAL_DIR at a directory on the target storage for representative fsync costs.
+ *
+ * The append benchmark reports the time each appendFrame holds up the thread putting the frames, which is
+ * what the journal adds to every putFrame.
+ *
+ * The recovery benchmark measures reading the journal back and handing the un-acked frames out, the
+ * re-upload itself runs at the network rate on top of it.
+ */
+#include "benchmark/benchmark.h"
+#include "UploadJournal.h"
+#include "StreamDefinition.h"
+#include "TestTempDirectory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace com { namespace amazonaws { namespace kinesis { namespace video {
+
+#define BENCH_JOURNAL_DIR_ENV_VAR                           "KVS_BENCH_JOURNAL_DIR"
+#define BENCH_JOURNAL_STREAM_NAME                           "journal_bench"
+#define BENCH_JOURNAL_FRAME_RATE                            25
+#define BENCH_JOURNAL_KEY_FRAME_INTERVAL                    BENCH_JOURNAL_FRAME_RATE
+#define BENCH_JOURNAL_FRAME_DURATION                        (HUNDREDS_OF_NANOS_IN_A_SECOND / BENCH_JOURNAL_FRAME_RATE)
+#define BENCH_JOURNAL_FRAME_SIZE                            (16 * 1024)
+
+// Fragments left un-acked behind the one being written, like a few seconds of upload latency
+#define BENCH_JOURNAL_ACK_LAG_FRAGMENTS                     2
+
+namespace {
+    std::string benchDirectory() {
+        const char* directory = getenv(BENCH_JOURNAL_DIR_ENV_VAR);
+        if (nullptr != directory) {
+            return directory;
+        }
+
+        std::string temp_directory = createTestTempDirectory("kvs_journal_bench_");
+        return !temp_directory.empty() ? temp_directory : ".";
+    }
+
+    void removeBenchDirectory(const std::string& directory) {
+        UploadJournal::discard(directory, BENCH_JOURNAL_STREAM_NAME);
+        if (nullptr == getenv(BENCH_JOURNAL_DIR_ENV_VAR)) {
+            removeTestDirectory(directory);
+        }
+    }
+
+    /**
+     * Writes the frames of a stream at the bench frame rate
+     */
+    class JournalWriter {
+    public:
+        JournalWriter(UploadJournal& journal, uint32_t frame_size)
+                : journal_(journal), frame_data_(frame_size, 0xab), frame_index_(0) {}
+
+        /**
+         * @return Key frame timestamp of the fragment started by the frame, zero for a delta frame
+         */
+        uint64_t appendFrame() {
+            Frame frame;
+            frame.version = FRAME_CURRENT_VERSION;
+            frame.index = (UINT32) frame_index_;
+            frame.flags = frame_index_ % BENCH_JOURNAL_KEY_FRAME_INTERVAL == 0 ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+            frame.decodingTs = frame.presentationTs = (frame_index_ + 1) * BENCH_JOURNAL_FRAME_DURATION;
+            frame.duration = BENCH_JOURNAL_FRAME_DURATION;
+            frame.size = (UINT32) frame_data_.size();
+            frame.frameData = frame_data_.data();
+            frame.trackId = DEFAULT_TRACK_ID;
+            journal_.appendFrame(frame);
+            frame_index_++;
+
+            return CHECK_FRAME_FLAG_KEY_FRAME(frame.flags) ? frame.presentationTs : 0;
+        }
+
+    private:
+        UploadJournal& journal_;
+        std::vector<uint8_t> frame_data_;
+        uint64_t frame_index_;
+    };
+
+    void persisted(UploadJournal& journal, uint64_t timestamp) {
+        FragmentAck ack;
+        memset(&ack, 0, sizeof(ack));
+        ack.version = FRAGMENT_ACK_CURRENT_VERSION;
+        ack.ackType = FRAGMENT_ACK_TYPE_PERSISTED;
+        ack.timestamp = timestamp;
+        journal.fragmentAckReceived(ack);
+    }
+}
+
+/**
+ * Appends frames with the persisted acks trailing a few fragments behind so the segments get deleted as they
+ * would while streaming.
+ *
+ * Arguments are the frame size in bytes and the sync interval in milliseconds, zero leaving it to the OS.
+ * The append_us counters are the 50th, 99th percentile and max time of a single appendFrame call, the
+ * higher percentiles include the waits for the background sync flushing the stdio buffer.
+ */
+static void BM_JournalAppend(benchmark::State& state) {
+    std::string directory = benchDirectory();
+    UploadJournalConfig config;
+    config.sync_interval = std::chrono::milliseconds(state.range(1));
+
+    uint64_t frame_count = 0;
+    {
+        UploadJournal journal(directory, BENCH_JOURNAL_STREAM_NAME, config);
+        JournalWriter writer(journal, (uint32_t) state.range(0));
+        std::vector<uint64_t> key_timestamps;
+        std::vector<double> append_us;
+
+        for (auto _ : state) {
+            auto append_start = std::chrono::steady_clock::now();
+            uint64_t key_timestamp = writer.appendFrame();
+            append_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - append_start).count());
+            if (0 != key_timestamp) {
+                key_timestamps.push_back(key_timestamp);
+                if (key_timestamps.size() > BENCH_JOURNAL_ACK_LAG_FRAGMENTS) {
+                    persisted(journal, key_timestamps[key_timestamps.size() - 1 - BENCH_JOURNAL_ACK_LAG_FRAGMENTS]);
+                }
+            }
+
+            frame_count++;
+        }
+
+        // The final fsync is part of getting the frames to the disk
+        journal.sync();
+        state.counters["pending_fragments"] = (double) journal.getPendingFragmentCount();
+
+        if (!append_us.empty()) {
+            std::sort(append_us.begin(), append_us.end());
+            state.counters["append_us_p50"] = append_us[append_us.size() / 2];
+            state.counters["append_us_p99"] = append_us[append_us.size() * 99 / 100];
+            state.counters["append_us_max"] = append_us.back();
+        }
+    }
+
+    removeBenchDirectory(directory);
+    state.SetItemsProcessed((int64_t) frame_count);
+    state.SetBytesProcessed((int64_t) (frame_count * state.range(0)));
+}
+
+BENCHMARK(BM_JournalAppend)->ArgNames({"frame_size", "sync_ms"})
+        ->Args({1024, 1000})->Args({16 * 1024, 1000})->Args({256 * 1024, 1000})
+        ->Args({16 * 1024, 0})->Args({16 * 1024, 100})->UseRealTime();
+
+/**
+ * Recovers a journal of un-acked frames written beforehand, a quarter of its fragments acked.
+ *
+ * Argument is the journal size in MiB.
+ */
+static void BM_JournalRecover(benchmark::State& state) {
+    std::string directory = benchDirectory();
+    uint64_t frame_total = (uint64_t) state.range(0) * 1024 * 1024 / BENCH_JOURNAL_FRAME_SIZE;
+    {
+        UploadJournalConfig config;
+        config.sync_interval = std::chrono::milliseconds(0);
+        UploadJournal journal(directory, BENCH_JOURNAL_STREAM_NAME, config);
+        JournalWriter writer(journal, BENCH_JOURNAL_FRAME_SIZE);
+        uint64_t last_acked_timestamp = 0;
+
+        for (uint64_t i = 0; i < frame_total; i++) {
+            uint64_t key_timestamp = writer.appendFrame();
+            if (0 != key_timestamp && i < frame_total / 4) {
+                last_acked_timestamp = key_timestamp;
+            }
+        }
+
+        persisted(journal, last_acked_timestamp);
+        journal.sync();
+    }
+
+    UploadJournalRecovery recovery;
+    for (auto _ : state) {
+        uint64_t checksum = 0;
+        recovery = UploadJournal::recover(directory, BENCH_JOURNAL_STREAM_NAME, [&checksum](const UploadJournalRecord& record) {
+            checksum += record.size;
+            return true;
+        });
+
+        benchmark::DoNotOptimize(checksum);
+    }
+
+    removeBenchDirectory(directory);
+    state.SetItemsProcessed((int64_t) (state.iterations() * recovery.frame_count));
+    state.SetBytesProcessed((int64_t) (state.iterations() * recovery.byte_count));
+    state.counters["segments"] = (double) recovery.segment_count;
+    state.counters["recovered_frames"] = (double) recovery.frame_count;
+    state.counters["skipped_frames"] = (double) recovery.skipped_frame_count;
+}
+
+BENCHMARK(BM_JournalRecover)->ArgName("journal_mib")->Arg(16)->Arg(256)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}  // namespace video
+}  // namespace kinesis
+}  // namespace amazonaws
+}  // namespace com
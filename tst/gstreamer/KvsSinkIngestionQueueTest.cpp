@@ -0,0 +1,204 @@
+#include "KvsSinkIngestionQueue.h"
+#include <gst/check/gstcheck.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace com::amazonaws::kinesis::video;
+
+/**
+ * Holds the worker in the processing function until opened and records the offsets of the buffers processed.
+ */
+class IngestionQueueProbe {
+public:
+    IngestionQueueProbe(bool open) : open_(open), failing_offset_(-1) {}
+
+    KvsSinkIngestionQueue::ProcessFunc processFunc() {
+        return [this](gpointer track, GstBuffer *buffer) {
+            GstFlowReturn ret = GST_FLOW_OK;
+            unique_lock<mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return open_; });
+            processed_.push_back((gint64) GST_BUFFER_OFFSET(buffer));
+            if ((gint64) GST_BUFFER_OFFSET(buffer) == failing_offset_) {
+                ret = GST_FLOW_ERROR;
+            }
+
+            gst_buffer_unref(buffer);
+            return ret;
+        };
+    }
+
+    void open() {
+        lock_guard<mutex> lock(mutex_);
+        open_ = true;
+        cv_.notify_all();
+    }
+
+    void failOn(gint64 offset) {
+        lock_guard<mutex> lock(mutex_);
+        failing_offset_ = offset;
+    }
+
+    vector<gint64> processed() {
+        lock_guard<mutex> lock(mutex_);
+        return processed_;
+    }
+
+    // Waits for the worker to pick up the first buffer
+    void waitForWorker(KvsSinkIngestionQueue &queue) {
+        while (0 != queue.getLevel()) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+private:
+    mutex mutex_;
+    condition_variable cv_;
+    bool open_;
+    gint64 failing_offset_;
+    vector<gint64> processed_;
+};
+
+static GstBuffer *
+create_test_buffer(guint64 offset, bool key_frame)
+{
+    GstBuffer *buffer = gst_buffer_new();
+    GST_BUFFER_OFFSET(buffer) = offset;
+    if (!key_frame) {
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+
+    return buffer;
+}
+
+static int gTrack;
+
+GST_START_TEST(ingestion_queue_blocks_when_full)
+{
+    IngestionQueueProbe probe(false);
+    KvsSinkIngestionQueue queue({&gTrack}, 2, false, probe.processFunc());
+
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(0, true)));
+    probe.waitForWorker(queue);
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(1, false)));
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(2, false)));
+
+    // The ring is full so the streaming thread is held until the worker catches up
+    atomic<bool> pushed(false);
+    thread streaming_thread([&]() {
+        fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(3, false)));
+        pushed = true;
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+    fail_unless(!pushed);
+
+    probe.open();
+    streaming_thread.join();
+    queue.drain();
+
+    vector<gint64> expected = {0, 1, 2, 3};
+    fail_unless(expected == probe.processed());
+    fail_unless_equals_int(0, queue.getDroppedCount());
+}
+GST_END_TEST;
+
+GST_START_TEST(ingestion_queue_leaks_up_to_next_key_frame)
+{
+    IngestionQueueProbe probe(false);
+    KvsSinkIngestionQueue queue({&gTrack}, 1, true, probe.processFunc());
+
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(0, true)));
+    probe.waitForWorker(queue);
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(1, false)));
+
+    // Full, the streaming thread is never held in leaky mode
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(2, false)));
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(3, false)));
+
+    probe.open();
+    queue.drain();
+
+    // There is room again but the delta unit depends on the dropped ones
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(4, false)));
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(5, true)));
+    queue.drain();
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(6, false)));
+    queue.drain();
+
+    vector<gint64> expected = {0, 1, 5, 6};
+    fail_unless(expected == probe.processed());
+    fail_unless_equals_int(3, queue.getDroppedCount());
+}
+GST_END_TEST;
+
+GST_START_TEST(ingestion_queue_propagates_errors_until_flush)
+{
+    IngestionQueueProbe probe(true);
+    KvsSinkIngestionQueue queue({&gTrack}, 4, false, probe.processFunc());
+    probe.failOn(1);
+
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(0, true)));
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(1, false)));
+    queue.drain();
+
+    // The worker error is surfaced on the next push and the buffer is released
+    fail_unless_equals_int(GST_FLOW_ERROR, queue.push(&gTrack, create_test_buffer(2, false)));
+    fail_unless_equals_int(GST_FLOW_ERROR, queue.push(&gTrack, create_test_buffer(3, false)));
+
+    queue.flush();
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(4, true)));
+    queue.drain();
+
+    vector<gint64> expected = {0, 1, 4};
+    fail_unless(expected == probe.processed());
+
+    // Unknown pads are rejected and a stopped queue is flushing
+    fail_unless_equals_int(GST_FLOW_ERROR, queue.push(&probe, create_test_buffer(5, true)));
+    queue.stop();
+    fail_unless_equals_int(GST_FLOW_FLUSHING, queue.push(&gTrack, create_test_buffer(6, true)));
+}
+GST_END_TEST;
+
+GST_START_TEST(ingestion_queue_flush_discards_queued_buffers)
+{
+    IngestionQueueProbe probe(false);
+    KvsSinkIngestionQueue queue({&gTrack}, 4, false, probe.processFunc());
+
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(0, true)));
+    probe.waitForWorker(queue);
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(1, false)));
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(2, false)));
+
+    // The buffer being processed completes, the queued ones are released
+    thread flushing_thread([&]() {
+        queue.flush();
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(50));
+    probe.open();
+    flushing_thread.join();
+
+    fail_unless_equals_int(0, queue.getLevel());
+    fail_unless_equals_int(GST_FLOW_OK, queue.push(&gTrack, create_test_buffer(3, true)));
+    queue.drain();
+
+    vector<gint64> expected = {0, 3};
+    fail_unless(expected == probe.processed());
+}
+GST_END_TEST;
+
+TCase *kvs_sink_ingestion_queue_tcase(void) {
+    TCase *tc = tcase_create("IngestionQueueTests");
+    tcase_set_timeout(tc, 15);
+    tcase_add_test(tc, ingestion_queue_blocks_when_full);
+    tcase_add_test(tc, ingestion_queue_leaks_up_to_next_key_frame);
+    tcase_add_test(tc, ingestion_queue_propagates_errors_until_flush);
+    tcase_add_test(tc, ingestion_queue_flush_discards_queued_buffers);
+    return tc;
+}
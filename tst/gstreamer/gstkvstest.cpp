@@ -10,6 +10,9 @@ static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
                                                                    GST_STATIC_CAPS(
                                                                            "video/x-h264,stream-format=avc,alignment=au"
                                                                    ));
+
+TCase *kvs_sink_ingestion_queue_tcase(void);
+
 static char const *accessKey;
 static char const *secretKey;
 static char const *sessionToken;
@@ -300,6 +303,46 @@ GST_START_TEST(check_playing_to_paused_and_back_to_playing)
     }
 GST_END_TEST;
 
+static GstBuffer *
+create_key_frame(GstClockTime timestamp)
+{
+    GstBuffer *buffer = gst_buffer_new_allocate(NULL, 1024, NULL);
+    gst_buffer_memset(buffer, 0, 0x55, 1024);
+    GST_BUFFER_PTS(buffer) = timestamp;
+    GST_BUFFER_DTS(buffer) = timestamp;
+    GST_BUFFER_DURATION(buffer) = 40 * GST_MSECOND;
+    return buffer;
+}
+
+GST_START_TEST(check_codec_data_change_while_streaming)
+    {
+        GstElement *pElement = setup_kinesisvideoproducersink();
+        GstPad *srcpad;
+
+        // The changed codec data restarts the stream, don't wait long for the dummy frames to be uploaded
+        g_object_set(G_OBJECT (pElement), "stop-stream-timeout", 2, NULL);
+
+        srcpad = gst_check_setup_src_pad_by_name (pElement, &srctemplate, "video_0");
+        gst_pad_set_active (srcpad, TRUE);
+
+        fail_unless_equals_int(GST_STATE_CHANGE_SUCCESS, gst_element_set_state(pElement, GST_STATE_PLAYING));
+        GstCaps *caps = gst_caps_from_string("video/x-h264,stream-format=avc,alignment=au,codec_data=(buffer)01640028ffe1");
+        gst_check_setup_events(srcpad, pElement, caps, GST_FORMAT_TIME);
+        gst_caps_unref(caps);
+        fail_unless_equals_int(GST_FLOW_OK, gst_pad_push(srcpad, create_key_frame(0)));
+
+        // Same as a resolution change of the encoder
+        fail_unless(gst_pad_push_event(srcpad, gst_event_new_caps(gst_caps_from_string(
+                "video/x-h264,stream-format=avc,alignment=au,codec_data=(buffer)0164001fffe1"))));
+        fail_unless_equals_int(GST_FLOW_OK, gst_pad_push(srcpad, create_key_frame(40 * GST_MSECOND)));
+
+        fail_unless_equals_int(GST_STATE_CHANGE_SUCCESS, gst_element_set_state(pElement, GST_STATE_NULL));
+        gst_pad_set_active (srcpad, FALSE);
+
+        cleanup_kinesisvideoproducersink(pElement);
+    }
+GST_END_TEST;
+
 GST_START_TEST(test_check_credentials)
     {
         CHAR missingVars[128] = {0};
@@ -333,6 +376,9 @@ Suite *gst_kinesisvideoproducer_suite(void) {
     TCase *tc = tcase_create("AllStateChangeTests");
     tcase_set_timeout(tc, 15);  // 15 second timeout per test
 
+    // The ingestion queue is exercised on its own and doesn't need the credentials
+    suite_add_tcase(s, kvs_sink_ingestion_queue_tcase());
+
     accessKey = GETENV(ACCESS_KEY_ENV_VAR);
     secretKey = GETENV(SECRET_KEY_ENV_VAR);
     sessionToken = GETENV(SESSION_TOKEN_ENV_VAR);
@@ -359,6 +405,7 @@ Suite *gst_kinesisvideoproducer_suite(void) {
     tcase_add_test(tc, kvsproducersinkteststop);
     tcase_add_test(tc, check_properties_are_passed_correctly);
     tcase_add_test(tc, check_playing_to_paused_and_back_to_playing);
+    tcase_add_test(tc, check_codec_data_change_while_streaming);
     suite_add_tcase(s, tc);
     return s;
 }